@@ -7,6 +7,8 @@
 #define AST_ROOT_NODES_MAX  8192
 #define AST_BLOCK_NODES_MAX 4096
 #define AST_PROCEDURE_PARAMS_MAX 128
+#define AST_PROCEDURE_TYPE_PARAMS_MAX 8
+#define AST_STRUCT_FIELDS_MAX 64
 
 #define _AST_KIND_ALL\
     AST_KIND(AST_Root)\
@@ -19,7 +21,16 @@
     AST_KIND(AST_Literal)\
     AST_KIND(AST_Binary)\
     AST_KIND(AST_Variable_Ref)\
-    AST_KIND(AST_Procedure_Call)
+    AST_KIND(AST_Procedure_Call)\
+    AST_KIND(AST_Conversion)\
+    AST_KIND(AST_Index)\
+    AST_KIND(AST_Reduction)\
+    AST_KIND(AST_Assignment)\
+    AST_KIND(AST_Comparison)\
+    AST_KIND(AST_While)\
+    AST_KIND(AST_For)\
+    AST_KIND(AST_Struct)\
+    AST_KIND(AST_Field)
 
 #define AST_KIND(T) AST_KIND__##T,
 typedef enum : uint8_t { _AST_KIND_ALL AST_KIND__COUNT, AST_KIND__INVALID } AST_Kind;
@@ -33,7 +44,13 @@ static const wchar_t *ast_kind_strings[AST_KIND__COUNT] = { _AST_KIND_ALL };
 #define ast_kind(T) AST_KIND__##T
 
 typedef enum : uint16_t {
-    TEMP
+    AST_FLAG_NONE     = 0x0,
+    AST_FLAG_EXPORTED = 0x1, // AST_Procedure visible outside of the module
+    AST_FLAG_BODY_PENDING = 0x2, // AST_Procedure whose block was skipped, see parser_parse_body
+    AST_FLAG_REACHED      = 0x4, // AST_Procedure, only set during remove_unreachable_procedures
+    AST_FLAG_ASSIGNED     = 0x8, // AST_Declaration or AST_Parameter assigned to after it, lives in a stack slot
+    AST_FLAG_LAYOUT_C     = 0x10, // AST_Struct keeping its fields in the declared order, laid out like C does
+    AST_FLAG_SOA          = 0x20, // AST_Struct whose arrays hold an array per field instead of whole structs
 } AST_Flags;
 
 typedef struct {
@@ -52,10 +69,55 @@ typedef enum : uint8_t {
     TYPE_INT64,
     TYPE_UINT64,
     TYPE_FLOAT64,
-    TYPE_CUSTOM
+    TYPE_INT32,
+    TYPE_UINT32,
+    TYPE_INT16,
+    TYPE_INT8,
+    TYPE_FLOAT32,
+    TYPE_CUSTOM,    // Struct, see AST_Struct; Never a value, only its fields are
+    TYPE_PARAMETER, // Of a generic procedure, stands for the type argument of each instance
+    TYPE_ARRAY      // Fixed size, see AST_Type_Def; Never a value, only its elements are
 } Type_Kind;
 
+// Vector types are their element kind with log2 of the lane count in the bits above it, see make_vector_type
+#define TYPE_VECTOR_LANES_SHIFT 4
+#define TYPE_VECTOR_LANES_MAX   16
+#define TYPE_KINDS_MAX          (5 << TYPE_VECTOR_LANES_SHIFT) // Every simple and vector kind is below
+
+inline bool is_vector_type(Type_Kind kind) {
+    return (kind >> TYPE_VECTOR_LANES_SHIFT) != 0;
+}
+
+// 1 for everything but vectors
+inline uint32_t get_vector_lanes(Type_Kind kind) {
+    return 1u << (kind >> TYPE_VECTOR_LANES_SHIFT);
+}
+
+inline Type_Kind get_element_type(Type_Kind kind) {
+    return (Type_Kind)(kind & ((1 << TYPE_VECTOR_LANES_SHIFT) - 1));
+}
+
+// Lanes are a power of two up to TYPE_VECTOR_LANES_MAX
+inline Type_Kind make_vector_type(Type_Kind element, uint32_t lanes) {
+    assert(lanes >= 2 && lanes <= TYPE_VECTOR_LANES_MAX && (lanes & (lanes - 1)) == 0 && "Invalid vector lane count");
+    uint32_t lanes_log2 = 0;
+    while((1u << lanes_log2) < lanes) {
+        lanes_log2 += 1;
+    }
+    return (Type_Kind)(element | (lanes_log2 << TYPE_VECTOR_LANES_SHIFT));
+}
+
+// Arrays and structs only live in memory, they are passed by pointer and only their elements or fields are values
+inline bool is_memory_type(Type_Kind kind) {
+    return kind == TYPE_ARRAY || kind == TYPE_CUSTOM;
+}
+
+// Not for TYPE_ARRAY, the length is in its AST_Type_Def; Not for TYPE_CUSTOM either, struct sizes come from the target's data layout
 inline const int32_t get_size_of_type(Type_Kind kind) {
+    if(is_vector_type(kind)) {
+        return get_size_of_type(get_element_type(kind)) * (int32_t)get_vector_lanes(kind);
+    }
+
     switch(kind) {
         default: {
             assert(0 && "Undefined Type_Kind");
@@ -72,19 +134,79 @@ inline const int32_t get_size_of_type(Type_Kind kind) {
             return 8;
         }
 
+        case TYPE_INT32:
+        case TYPE_UINT32:
+        case TYPE_FLOAT32: {
+            return 4;
+        }
+
+        case TYPE_INT16: {
+            return 2;
+        }
+
+        case TYPE_INT8: {
+            return 1;
+        }
+
         case TYPE_CUSTOM: {
-            assert(0 && "Not implemented @TODO");
+            assert(0 && "Size of a struct depends on the target");
         }
     }
 
     return -1;
 }
 
-typedef struct {
+// Of the elements for vectors
+inline bool is_floating_type(Type_Kind kind) {
+    kind = get_element_type(kind);
+    return kind == TYPE_FLOAT64 || kind == TYPE_FLOAT32;
+}
+
+inline bool is_unsigned_type(Type_Kind kind) {
+    kind = get_element_type(kind);
+    return kind == TYPE_UINT64 || kind == TYPE_UINT32;
+}
+
+// Names of the simple types in dumps, messages and interface files
+static const wchar_t *simple_type_signatures[TYPE_CUSTOM] = {
+    [TYPE_VOID]    = L"void",
+    [TYPE_INT64]   = L"int64",
+    [TYPE_UINT64]  = L"uint64",
+    [TYPE_FLOAT64] = L"float64",
+    [TYPE_INT32]   = L"int32",
+    [TYPE_UINT32]  = L"uint32",
+    [TYPE_INT16]   = L"int16",
+    [TYPE_INT8]    = L"int8",
+    [TYPE_FLOAT32] = L"float32",
+};
+
+#define TYPE_SIGNATURE_MAX 32
+
+// Simple type names, "vec4_float64" for vectors; Returns buffer
+inline const wchar_t *format_type_signature(wchar_t buffer[TYPE_SIGNATURE_MAX], Type_Kind kind) {
+    const Type_Kind element = get_element_type(kind);
+    assert(element < TYPE_CUSTOM && "Only simple types and vectors of them have signatures");
+
+    if(is_vector_type(kind)) {
+        swprintf(buffer, TYPE_SIGNATURE_MAX, L"vec%u_%ls", get_vector_lanes(kind), simple_type_signatures[element]);
+    } else {
+        swprintf(buffer, TYPE_SIGNATURE_MAX, L"%ls", simple_type_signatures[element]);
+    }
+    return buffer;
+}
+
+typedef struct AST_Type_Def {
     AST_Node node;
     Type_Kind kind;
     Str_View signature;
-} AST_Type_Def;
+    uint32_t type_param_index; // TYPE_PARAMETER only, position in the procedure's type parameters
+
+    // TYPE_ARRAY only, "[length]element"; The element is a simple type, a vector, a type parameter or a struct
+    struct AST_Type_Def *element_type;
+    uint32_t array_length;
+
+    struct AST_Struct *struct_def; // TYPE_CUSTOM only
+} AST_Type_Def; // Vector and array ones have the element's signature, vector ones its type_param_index
 
 typedef struct {
     AST_Node node;
@@ -105,13 +227,28 @@ typedef struct {
     size_t nodes_count;
 } AST_Block;
 
+// "Name :: struktura { field : typ; ... }", the fields are simple types or vectors
+// They are stored largest first, so each one starts aligned and only the end gets padded; "struktura(c)" keeps the declared order
+// "struktura(soa)" turns arrays of it into an array per field, loops over one field then read only that field's memory
+typedef struct AST_Struct {
+    AST_Node node;
+    Str_View identifier;
+    AST_Type_Def *data_type; // TYPE_CUSTOM, pointing back here
+    AST_Declaration *fields[AST_STRUCT_FIELDS_MAX]; // In declared order, without expressions
+    size_t fields_count;
+    uint8_t field_slots[AST_STRUCT_FIELDS_MAX]; // Position of each field in the stored order
+} AST_Struct;
+
 typedef struct {
     AST_Node node;
     Str_View signature;
     AST_Type_Def *return_type;
     AST_Parameter *params[AST_PROCEDURE_PARAMS_MAX];
     size_t params_count;
-    AST_Block *block;
+    AST_Block *block;   // NULL while AST_FLAG_BODY_PENDING
+    size_t body_token;  // Token index of the block's opening brace
+    AST_Type_Def *type_params[AST_PROCEDURE_TYPE_PARAMS_MAX]; // Generic procedures only, see generics.h
+    size_t type_params_count;
 } AST_Procedure;
 
 typedef struct {
@@ -171,7 +308,108 @@ typedef struct {
     Str_View procedure_signature;
     AST_Node *params[AST_PROCEDURE_PARAMS_MAX];
     size_t params_count;
+    AST_Type_Def *type_args[AST_PROCEDURE_TYPE_PARAMS_MAX]; // Explicit ones of a generic call, inferred from the arguments without them
+    size_t type_args_count;
 } AST_Procedure_Call;
 
+// "typ(expression)", values never change type otherwise; Literals take the type they are used as
+typedef struct {
+    AST_Node node;
+    AST_Type_Def *data_type;
+    AST_Node *expression;
+} AST_Conversion;
+
+// "vector[index]", a single lane
+typedef struct {
+    AST_Node node;
+    AST_Node *expression;
+    AST_Node *index;
+} AST_Index;
+
+typedef enum : uint8_t {
+    REDUCTION_SUM = 0,
+    REDUCTION_PRODUCT,
+    REDUCTION_MIN,
+    REDUCTION_MAX,
+    REDUCTION__COUNT
+} Reduction_Operation;
+
+inline const wchar_t *reduction_operation_string(Reduction_Operation op) {
+    switch(op) {
+        default: assert(0 && "Unhandled Reduction_Operation in reduction_operation_string");
+        case REDUCTION_SUM:     return L"suma";
+        case REDUCTION_PRODUCT: return L"iloczyn";
+        case REDUCTION_MIN:     return L"minimum";
+        case REDUCTION_MAX:     return L"maksimum";
+    }
+}
+
+// "suma(vector)" and the like, all lanes combined into one value
+typedef struct {
+    AST_Node node;
+    AST_Node *expression;
+    Reduction_Operation operation;
+} AST_Reduction;
+
+// "name.field", also "name[index].field" for arrays of structs
+typedef struct {
+    AST_Node node;
+    AST_Node *expression; // AST_Variable_Ref or AST_Index of one when valid, the converter checks
+    Str_View identifier;
+} AST_Field;
+
+// "name = expression;", "name[index] = expression;" or a field of either
+typedef struct {
+    AST_Node node;
+    AST_Node *target; // AST_Variable_Ref, AST_Index of one or AST_Field of either
+    AST_Node *expression;
+} AST_Assignment;
+
+typedef enum : uint8_t {
+    COMPARISON_LESS = 0,
+    COMPARISON_LESS_EQUAL,
+    COMPARISON_GREATER,
+    COMPARISON_GREATER_EQUAL,
+    COMPARISON_EQUAL,
+    COMPARISON_NOT_EQUAL,
+    COMPARISON__COUNT
+} Comparison_Operation;
+
+inline const wchar_t *comparison_operation_string(Comparison_Operation op) {
+    switch(op) {
+        default: assert(0 && "Unhandled Comparison_Operation in comparison_operation_string");
+        case COMPARISON_LESS:          return L"<";
+        case COMPARISON_LESS_EQUAL:    return L"<=";
+        case COMPARISON_GREATER:       return L">";
+        case COMPARISON_GREATER_EQUAL: return L">=";
+        case COMPARISON_EQUAL:         return L"==";
+        case COMPARISON_NOT_EQUAL:     return L"!=";
+    }
+}
+
+// Condition of a loop, there is no boolean type
+typedef struct {
+    AST_Node node;
+    AST_Node *expr_l;
+    AST_Node *expr_r;
+    Comparison_Operation operation;
+} AST_Comparison;
+
+// "dopóki condition { ... }"
+typedef struct {
+    AST_Node node;
+    AST_Comparison *condition;
+    AST_Block *block;
+} AST_While;
+
+// "dla name = start do end { ... }", name goes from start up to but without end, one at a time; It can't be assigned to
+typedef struct {
+    AST_Node node;
+    Str_View identifier;
+    AST_Node *start;
+    AST_Node *end; // Evaluated once, before the first iteration
+    AST_Block *block;
+} AST_For;
+
 
 #endif /* _AST_DEFS_H */
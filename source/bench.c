@@ -0,0 +1,367 @@
+#include "bench.h"
+#include "timing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <llvm-c/LLJIT.h>
+#include <llvm-c/Orc.h>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#ifdef _WIN32
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define BENCH_HAS_TSC 1
+#endif
+
+#define BENCH_THUNK_NAME "__polang_bench"
+
+// Thunk signature: calls the procedure count times with the arguments stored as 8 byte slots
+typedef void Bench_Thunk(const uint64_t *args, uint64_t count);
+
+typedef struct {
+    double   ns_per_call;
+    double   cycles_per_call;
+} Bench_Sample;
+
+static uint64_t read_cycle_counter(void) {
+#ifdef BENCH_HAS_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Generic procedures are skipped, only their instances get emitted; out_generic tells if the name was one of those
+static AST_Procedure *find_procedure(Parser *parser, const char *procedure_name, bool *out_generic) {
+    *out_generic = false;
+
+    wchar_t *wide_name = convert_to_wcs_alloc(procedure_name, strlen(procedure_name), NULL);
+    if(wide_name == NULL) {
+        return NULL;
+    }
+
+    AST_Procedure *found = NULL;
+    for(size_t index = 0; index < parser->ast_root->nodes_count && found == NULL; ++index) {
+        AST_Node *node = parser->ast_root->nodes[index];
+        if(node->kind != ast_kind(AST_Procedure) || !str_view_compare_to_string(((AST_Procedure *)node)->signature, wide_name)) {
+            continue;
+        }
+
+        if(((AST_Procedure *)node)->type_params_count > 0) {
+            *out_generic = true;
+        } else {
+            found = (AST_Procedure *)node;
+        }
+    }
+
+    free(wide_name);
+    return found;
+}
+
+// Fills one slot per parameter; Floats keep their bit pattern, the thunk loads every slot as i64 and narrower types take its low bits
+static bool parse_arguments(AST_Procedure *ast_proc, const char *args, uint64_t *out_slots) {
+    const char *at = args != NULL ? args : "";
+    size_t count = 0;
+
+    while(*at != '\0') {
+        if(count == ast_proc->params_count) {
+            fwprintf(stderr, L"Too many benchmark arguments, %.*ls takes %llu\n", ast_proc->signature.length, ast_proc->signature.data, ast_proc->params_count);
+            return false;
+        }
+
+        AST_Parameter *ast_param = ast_proc->params[count];
+        char *end = NULL;
+        errno = 0;
+
+        switch(ast_param->data_type->kind) {
+            default: {
+                fwprintf(stderr, L"Can't pass benchmark argument to parameter %.*ls\n", ast_param->identifier.length, ast_param->identifier.data);
+                return false;
+            };
+            case TYPE_INT64:
+            case TYPE_INT32:
+            case TYPE_INT16:
+            case TYPE_INT8: {
+                out_slots[count] = (uint64_t)strtoll(at, &end, 10);
+            } break;
+            case TYPE_UINT64:
+            case TYPE_UINT32: {
+                out_slots[count] = strtoull(at, &end, 10);
+            } break;
+            case TYPE_FLOAT64: {
+                const double value = strtod(at, &end);
+                memcpy(&out_slots[count], &value, sizeof(value));
+            } break;
+            case TYPE_FLOAT32: {
+                const float value = strtof(at, &end);
+                uint32_t bits = 0;
+                memcpy(&bits, &value, sizeof(value));
+                out_slots[count] = bits;
+            } break;
+        }
+
+        if(end == at || errno == ERANGE || (*end != ',' && *end != '\0')) {
+            fwprintf(stderr, L"Invalid benchmark argument for parameter %.*ls: %hs\n", ast_param->identifier.length, ast_param->identifier.data, at);
+            return false;
+        }
+
+        count += 1;
+        at = *end == ',' ? end + 1 : end;
+    }
+
+    if(count != ast_proc->params_count) {
+        fwprintf(stderr, L"%.*ls takes %llu arguments, %llu given\n", ast_proc->signature.length, ast_proc->signature.data, ast_proc->params_count, count);
+        return false;
+    }
+
+    return true;
+}
+
+// for(i = 0; i < count; ++i) sink = proc(args[0], args[1], ...); With count always at least 1
+static void build_thunk(LLVM_Context *ctx, LLVMValueRef proc, AST_Procedure *ast_proc) {
+    LLVMTypeRef int64_type = LLVMInt64TypeInContext(ctx->context);
+    LLVMTypeRef slots_type = LLVMPointerType(int64_type, 0);
+    LLVMTypeRef param_types[] = { slots_type, int64_type };
+    LLVMTypeRef thunk_type = LLVMFunctionType(LLVMVoidTypeInContext(ctx->context), param_types, ARRAY_SIZE(param_types), 0);
+    LLVMValueRef thunk = LLVMAddFunction(ctx->module, BENCH_THUNK_NAME, thunk_type);
+
+    LLVMTypeRef proc_type = LLVMGlobalGetValueType(proc);
+    LLVMTypeRef return_type = LLVMGetReturnType(proc_type);
+    LLVMValueRef sink = NULL;
+    if(ast_proc->return_type->kind != TYPE_VOID) {
+        sink = LLVMAddGlobal(ctx->module, return_type, BENCH_THUNK_NAME "_sink");
+        LLVMSetInitializer(sink, LLVMConstNull(return_type));
+        LLVMSetLinkage(sink, LLVMInternalLinkage);
+    }
+
+    // Measuring the call itself, inlining it into the loop would let the optimizer overlap iterations
+    const uint32_t noinline_kind = LLVMGetEnumAttributeKindForName("noinline", 8);
+    LLVMAddAttributeAtIndex(proc, LLVMAttributeFunctionIndex, LLVMCreateEnumAttribute(ctx->context, noinline_kind, 0));
+
+    LLVMBasicBlockRef entry_block = LLVMAppendBasicBlockInContext(ctx->context, thunk, "entry");
+    LLVMBasicBlockRef loop_block  = LLVMAppendBasicBlockInContext(ctx->context, thunk, "loop");
+    LLVMBasicBlockRef exit_block  = LLVMAppendBasicBlockInContext(ctx->context, thunk, "exit");
+
+    LLVMPositionBuilderAtEnd(ctx->builder, entry_block);
+    LLVMBuildBr(ctx->builder, loop_block);
+
+    LLVMPositionBuilderAtEnd(ctx->builder, loop_block);
+    LLVMValueRef counter = LLVMBuildPhi(ctx->builder, int64_type, "counter");
+
+    LLVMValueRef args[AST_PROCEDURE_PARAMS_MAX];
+    for(size_t index = 0; index < ast_proc->params_count; ++index) {
+        LLVMValueRef slot_index = LLVMConstInt(int64_type, index, 0);
+        LLVMValueRef slot = LLVMBuildGEP2(ctx->builder, int64_type, LLVMGetParam(thunk, 0), &slot_index, 1, "slot");
+        LLVMValueRef value = LLVMBuildLoad2(ctx->builder, int64_type, slot, "arg");
+        LLVMSetVolatile(value, 1);
+
+        const Type_Kind param_type = ast_proc->params[index]->data_type->kind;
+        if(get_size_of_type(param_type) < 8) {
+            value = LLVMBuildTrunc(ctx->builder, value, LLVMIntTypeInContext(ctx->context, get_size_of_type(param_type) * 8), "arg_bits");
+        }
+        if(is_floating_type(param_type)) {
+            value = LLVMBuildBitCast(ctx->builder, value, LLVMTypeOf(LLVMGetParam(proc, index)), "arg_float");
+        }
+        args[index] = value;
+    }
+
+    LLVMValueRef call = LLVMBuildCall2(ctx->builder, proc_type, proc, args, ast_proc->params_count, "");
+    LLVMSetInstructionCallConv(call, LLVMGetFunctionCallConv(proc));
+    if(sink != NULL) {
+        LLVMValueRef store = LLVMBuildStore(ctx->builder, call, sink);
+        LLVMSetVolatile(store, 1);
+    }
+
+    LLVMValueRef next = LLVMBuildAdd(ctx->builder, counter, LLVMConstInt(int64_type, 1, 0), "next");
+    LLVMValueRef done = LLVMBuildICmp(ctx->builder, LLVMIntUGE, next, LLVMGetParam(thunk, 1), "done");
+    LLVMBuildCondBr(ctx->builder, done, exit_block, loop_block);
+
+    LLVMValueRef incoming_values[] = { LLVMConstInt(int64_type, 0, 0), next };
+    LLVMBasicBlockRef incoming_blocks[] = { entry_block, loop_block };
+    LLVMAddIncoming(counter, incoming_values, incoming_blocks, ARRAY_SIZE(incoming_values));
+
+    LLVMPositionBuilderAtEnd(ctx->builder, exit_block);
+    LLVMBuildRetVoid(ctx->builder);
+}
+
+static bool report_jit_error(LLVMErrorRef error) {
+    if(error == NULL) {
+        return false;
+    }
+
+    char *message = LLVMGetErrorMessage(error);
+    fprintf(stderr, "LLVM JIT ERROR: %s\n", message);
+    LLVMDisposeErrorMessage(message);
+    return true;
+}
+
+// Compiles the module for the host, position independent so the JIT can place sections anywhere
+static LLVMMemoryBufferRef emit_jit_object(LLVM_Context *ctx) {
+    char *cpu_name = LLVMGetHostCPUName();
+    char *cpu_features = LLVMGetHostCPUFeatures();
+    LLVMTargetMachineRef target_machine = LLVMCreateTargetMachine(ctx->target, ctx->target_triple, cpu_name, cpu_features, ctx->opt_level, LLVMRelocPIC, LLVMCodeModelJITDefault);
+    LLVMDisposeMessage(cpu_name);
+    LLVMDisposeMessage(cpu_features);
+
+    char *error_message = NULL;
+    LLVMMemoryBufferRef buffer = NULL;
+    if(LLVMTargetMachineEmitToMemoryBuffer(target_machine, ctx->module, LLVMObjectFile, &error_message, &buffer) != 0) {
+        fprintf(stderr, "LLVM EMIT ERROR: %s\n", error_message);
+        LLVMDisposeMessage(error_message);
+        buffer = NULL;
+    }
+
+    LLVMDisposeTargetMachine(target_machine);
+    return buffer;
+}
+
+static Bench_Thunk *load_thunk(LLVMOrcLLJITRef jit, LLVMMemoryBufferRef object) {
+    LLVMOrcJITDylibRef dylib = LLVMOrcLLJITGetMainJITDylib(jit);
+
+    // Code generation can call into the C runtime, memcpy or __chkstk
+    LLVMOrcDefinitionGeneratorRef process_symbols = NULL;
+    if(report_jit_error(LLVMOrcCreateDynamicLibrarySearchGeneratorForProcess(&process_symbols, LLVMOrcLLJITGetGlobalPrefix(jit), NULL, NULL))) {
+        LLVMDisposeMemoryBuffer(object);
+        return NULL;
+    }
+    LLVMOrcJITDylibAddGenerator(dylib, process_symbols);
+
+    // Takes ownership of the object
+    if(report_jit_error(LLVMOrcLLJITAddObjectFile(jit, dylib, object))) {
+        return NULL;
+    }
+
+    LLVMOrcExecutorAddress address = 0;
+    if(report_jit_error(LLVMOrcLLJITLookup(jit, &address, BENCH_THUNK_NAME))) {
+        return NULL;
+    }
+
+    return (Bench_Thunk *)(uintptr_t)address;
+}
+
+static Bench_Sample run_sample(Bench_Thunk *thunk, const uint64_t *args, uint64_t batch) {
+    const uint64_t cycles_start = read_cycle_counter();
+    const uint64_t wall_start = timing_wall_ns();
+
+    thunk(args, batch);
+
+    const uint64_t wall_end = timing_wall_ns();
+    const uint64_t cycles_end = read_cycle_counter();
+
+    return (Bench_Sample) {
+        .ns_per_call = (double)(wall_end - wall_start) / (double)batch,
+        .cycles_per_call = (double)(cycles_end - cycles_start) / (double)batch,
+    };
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    const double value_a = *(const double *)a;
+    const double value_b = *(const double *)b;
+    return (value_a > value_b) - (value_a < value_b);
+}
+
+static bool measure(Bench_Thunk *thunk, const uint64_t *args, size_t sample_count, AST_Procedure *ast_proc, LLVMCodeGenOptLevel opt_level, Output_Sink *out) {
+    double *ns_samples = (double *)malloc(sizeof(double) * sample_count);
+    double *cycle_samples = (double *)malloc(sizeof(double) * sample_count);
+    if(ns_samples == NULL || cycle_samples == NULL) {
+        fwprintf(stderr, L"Failed to allocate memory in bench_run.\n");
+        free(ns_samples);
+        free(cycle_samples);
+        return false;
+    }
+
+    // Double the batch until one sample is long enough to time
+    uint64_t batch = 1;
+    while(run_sample(thunk, args, batch).ns_per_call * (double)batch < (double)BENCH_SAMPLE_NS_MIN) {
+        batch *= 2;
+    }
+
+    const uint64_t warmup_end = timing_wall_ns() + BENCH_WARMUP_NS;
+    while(timing_wall_ns() < warmup_end) {
+        run_sample(thunk, args, batch);
+    }
+
+    for(size_t index = 0; index < sample_count; ++index) {
+        const Bench_Sample sample = run_sample(thunk, args, batch);
+        ns_samples[index] = sample.ns_per_call;
+        cycle_samples[index] = sample.cycles_per_call;
+    }
+
+    qsort(ns_samples, sample_count, sizeof(double), compare_doubles);
+    qsort(cycle_samples, sample_count, sizeof(double), compare_doubles);
+
+    const size_t p99_index = (sample_count * 99 + 99) / 100 - 1;
+
+    output_format(out, "Benchmark ");
+    output_wide(out, ast_proc->signature.data, ast_proc->signature.length);
+    output_format(out, " at -O%d: %llu samples of %llu calls\n", (int32_t)opt_level, (unsigned long long)sample_count, (unsigned long long)batch);
+    output_format(out, "  min     %10.3f ns/call\n", ns_samples[0]);
+    output_format(out, "  median  %10.3f ns/call\n", ns_samples[sample_count / 2]);
+    output_format(out, "  p99     %10.3f ns/call\n", ns_samples[p99_index]);
+#ifdef BENCH_HAS_TSC
+    output_format(out, "  cycles  %10.3f per call (median, TSC reference cycles)\n", cycle_samples[sample_count / 2]);
+#else
+    output_format(out, "  cycles         n/a (no cycle counter on this target)\n");
+#endif
+
+    free(ns_samples);
+    free(cycle_samples);
+    return true;
+}
+
+bool bench_run(LLVM_Context *ctx, const char *procedure_name, const char *args, size_t sample_count, Output_Sink *out) {
+    bool is_generic = false;
+    AST_Procedure *ast_proc = find_procedure(ctx->parser, procedure_name, &is_generic);
+    if(ast_proc == NULL && is_generic) {
+        fwprintf(stderr, L"Can't benchmark generic procedure %hs, benchmark a procedure calling it with concrete types\n", procedure_name);
+        return false;
+    }
+    if(ast_proc == NULL) {
+        fwprintf(stderr, L"No procedure to benchmark named: %hs\n", procedure_name);
+        return false;
+    }
+
+    uint64_t arg_slots[AST_PROCEDURE_PARAMS_MAX];
+    if(!parse_arguments(ast_proc, args, arg_slots)) {
+        return false;
+    }
+
+    char *proc_signature = convert_to_mbs_alloc(ast_proc->signature.data, ast_proc->signature.length, NULL);
+    LLVMValueRef proc = LLVMGetNamedFunction(ctx->module, proc_signature);
+    free(proc_signature);
+    if(proc == NULL) {
+        fwprintf(stderr, L"Procedure to benchmark wasn't converted: %hs\n", procedure_name);
+        return false;
+    }
+
+    build_thunk(ctx, proc, ast_proc);
+    llvm_verify(ctx);
+
+    if(!llvm_optimize(ctx)) {
+        return false;
+    }
+
+    LLVMMemoryBufferRef object = emit_jit_object(ctx);
+    LLVMDisposeModule(ctx->module);
+    ctx->module = NULL;
+
+    if(object == NULL) {
+        return false;
+    }
+
+    LLVMOrcLLJITRef jit = NULL;
+    if(report_jit_error(LLVMOrcCreateLLJIT(&jit, NULL))) {
+        LLVMDisposeMemoryBuffer(object);
+        return false;
+    }
+
+    Bench_Thunk *thunk = load_thunk(jit, object);
+    const bool success = thunk != NULL && measure(thunk, arg_slots, MAX(sample_count, 1), ast_proc, ctx->opt_level, out);
+
+    report_jit_error(LLVMOrcDisposeLLJIT(jit));
+    return success;
+}
@@ -0,0 +1,24 @@
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include "common.h"
+#include "llvm_converter.h"
+#include "output.h"
+
+/*
+ * Procedure benchmarking, for --bench
+ * A loop that calls the procedure with the given arguments is added to the converted module,
+ * which then goes through the usual -O pipeline and gets compiled for the host and loaded with the ORC JIT.
+ * The arguments are loaded and the result stored with volatile accesses, so no call can be folded or hoisted away.
+ * Each sample times a batch of calls, the batch is grown until a sample outlasts the timer resolution.
+ */
+
+#define BENCH_DEFAULT_SAMPLES 1000
+#define BENCH_SAMPLE_NS_MIN   20000 // Per sample, calibrated batch size makes it at least this long
+#define BENCH_WARMUP_NS       100000000
+
+// Use after llvm_convert instead of llvm_optimize; args are comma separated, parsed by each parameter's type
+// The module gets disposed by the JIT, ctx->module is NULL afterwards; Results go to out
+bool bench_run(LLVM_Context *ctx, const char *procedure_name, const char *args, size_t sample_count, Output_Sink *out);
+
+#endif /* _BENCH_H */
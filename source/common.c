@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -14,7 +15,7 @@ wchar_t *convert_to_wcs_alloc(const char *src, size_t src_length, size_t *out_co
         return NULL;
     }
 
-    wchar_t *wide_buffer = (wchar_t *)malloc(wide_length * sizeof(wchar_t) + 1);
+    wchar_t *wide_buffer = (wchar_t *)malloc((wide_length + 1) * sizeof(wchar_t));
     if(wide_buffer == NULL) {
         fprintf(stderr, "Failed to allocate memory in convert_to_wcs_alloc.\n");
         return NULL;
@@ -85,3 +86,53 @@ char *convert_to_mbs_alloc(const wchar_t *src, size_t src_length, size_t *out_co
     NOT_IMPLEMENTED;
 #endif
 }
+
+static THREAD_LOCAL jmp_buf *error_recovery_point = NULL;
+
+jmp_buf *error_recovery_set(jmp_buf *recovery) {
+    jmp_buf *previous = error_recovery_point;
+    error_recovery_point = recovery;
+    return previous;
+}
+
+void fatal_error(void) {
+    fflush(stdout);
+    fflush(stderr);
+
+    if(error_recovery_point == NULL) {
+        exit(-1);
+    }
+    longjmp(*error_recovery_point, 1);
+}
+
+static THREAD_LOCAL Diagnostic_Handler diagnostic_handler = { };
+
+Diagnostic_Handler diagnostic_handler_set(Diagnostic_Handler handler) {
+    Diagnostic_Handler previous = diagnostic_handler;
+    diagnostic_handler = handler;
+    return previous;
+}
+
+Diagnostic_Handler diagnostic_handler_get(void) {
+    return diagnostic_handler;
+}
+
+void report_error(const wchar_t *format, ...) {
+    wchar_t message[DIAGNOSTIC_MESSAGE_MAX];
+
+    va_list args;
+    va_start(args, format);
+    const int32_t length = vswprintf(message, ARRAY_SIZE(message), format, args);
+    va_end(args);
+
+    // Negative when truncated, the buffer still holds what fit
+    if(length < 0) {
+        message[ARRAY_SIZE(message) - 1] = L'\0';
+    }
+
+    if(diagnostic_handler.proc == NULL) {
+        fwprintf(stderr, L"%ls\n", message);
+    } else {
+        diagnostic_handler.proc(diagnostic_handler.user_data, message);
+    }
+}
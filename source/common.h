@@ -7,6 +7,10 @@
 #include <assert.h>
 #include <string.h>
 #include <malloc.h>
+#include <setjmp.h>
+
+// Part of the object cache key, bump whenever generated code can change
+#define POLANG_VERSION "0.1.0"
 
 #define KB(B) ((B) * 1024)
 #define MB(B) (KB(B) * 1024)
@@ -19,6 +23,12 @@
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
 #define MAX(a, b) (((a) > (b)) ? (a) : (b))
 
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
 #define INVALID_CODE_PATH assert(0 && "Invalid code path!")
 #define NOT_IMPLEMENTED assert(0 && "Not implemented path!")
 
@@ -30,4 +40,26 @@ size_t convert_to_wcs(const char *src, size_t src_length, wchar_t *dest, size_t
 
 char *convert_to_mbs_alloc(const wchar_t *src, size_t src_length, size_t *out_converted);
 
+// @NOTE : Errors compilation can't continue from end in fatal_error; It jumps to the innermost recovery point of the calling thread,
+//         the process exits if the thread has none. Set a point with setjmp(recovery) after error_recovery_set(&recovery),
+//         then put the previous point back with error_recovery_set(previous) on both paths.
+void fatal_error(void);
+jmp_buf *error_recovery_set(jmp_buf *recovery);
+
+#define DIAGNOSTIC_MESSAGE_MAX 2048
+
+// Receives one whole message, without a trailing newline
+typedef void Diagnostic_Proc(void *user_data, const wchar_t *message);
+
+typedef struct {
+    Diagnostic_Proc *proc; // NULL prints to stderr
+    void *user_data;
+} Diagnostic_Handler;
+
+// @NOTE : Compile errors go through report_error to the handler of the calling thread; Works like error_recovery_set,
+//         returns the previous handler to put back afterwards. Messages longer than DIAGNOSTIC_MESSAGE_MAX get truncated.
+Diagnostic_Handler diagnostic_handler_set(Diagnostic_Handler handler);
+Diagnostic_Handler diagnostic_handler_get(void);
+void report_error(const wchar_t *format, ...);
+
 #endif /* _COMMON_H */
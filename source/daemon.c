@@ -0,0 +1,579 @@
+// struct ucred
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "daemon.h"
+#include "file_io.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <afunix.h>
+#include <io.h>
+#include <direct.h>
+
+typedef SOCKET Socket;
+#define SOCKET_INVALID INVALID_SOCKET
+#else
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+typedef int32_t Socket;
+#define SOCKET_INVALID (-1)
+#endif
+
+enum {
+    DAEMON_COMMAND_COMPILE = 1,
+    DAEMON_COMMAND_STOP    = 2,
+};
+
+enum {
+    DAEMON_FRAME_STDOUT = 1,
+    DAEMON_FRAME_STDERR = 2,
+    DAEMON_FRAME_EXIT   = 3, // Payload is the exit code, last frame of a compile
+};
+
+#define DAEMON_FRAME_BYTES_MAX KB(64)
+#define DAEMON_STRING_BYTES_MAX KB(32)
+#define DAEMON_ARGS_MAX 4096
+
+// A client that went away must not kill the daemon with SIGPIPE
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+static bool sockets_startup(void) {
+#ifdef _WIN32
+    WSADATA wsa_data;
+    return WSAStartup(MAKEWORD(2, 2), &wsa_data) == 0;
+#else
+    return true;
+#endif
+}
+
+static void sockets_cleanup(void) {
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+static void socket_close(Socket socket_handle) {
+#ifdef _WIN32
+    closesocket(socket_handle);
+#else
+    close(socket_handle);
+#endif
+}
+
+static bool socket_send_all(Socket socket_handle, const void *data, size_t bytes) {
+    const char *at = (const char *)data;
+    while(bytes > 0) {
+        const int32_t sent = send(socket_handle, at, (int32_t)MIN(bytes, DAEMON_FRAME_BYTES_MAX), SEND_FLAGS);
+        if(sent <= 0) {
+            return false;
+        }
+        at += sent;
+        bytes -= sent;
+    }
+    return true;
+}
+
+static bool socket_recv_all(Socket socket_handle, void *data, size_t bytes) {
+    char *at = (char *)data;
+    while(bytes > 0) {
+        const int32_t received = recv(socket_handle, at, (int32_t)MIN(bytes, DAEMON_FRAME_BYTES_MAX), 0);
+        if(received <= 0) {
+            return false;
+        }
+        at += received;
+        bytes -= received;
+    }
+    return true;
+}
+
+// Both ends run on the same machine, integers go in native byte order
+static bool send_u32(Socket socket_handle, uint32_t value) {
+    return socket_send_all(socket_handle, &value, sizeof(value));
+}
+
+static bool recv_u32(Socket socket_handle, uint32_t *out_value) {
+    return socket_recv_all(socket_handle, out_value, sizeof(*out_value));
+}
+
+static bool send_string(Socket socket_handle, const char *string) {
+    const size_t length = strlen(string);
+    return length <= DAEMON_STRING_BYTES_MAX && send_u32(socket_handle, (uint32_t)length) && socket_send_all(socket_handle, string, length);
+}
+
+// NULL on failure or if the string is too long
+static char *recv_string_alloc(Socket socket_handle) {
+    uint32_t length = 0;
+    if(!recv_u32(socket_handle, &length) || length > DAEMON_STRING_BYTES_MAX) {
+        return NULL;
+    }
+
+    char *string = (char *)malloc(length + 1);
+    if(string == NULL) {
+        fprintf(stderr, "Failed to allocate memory in recv_string_alloc.\n");
+        return NULL;
+    }
+
+    if(!socket_recv_all(socket_handle, string, length)) {
+        free(string);
+        return NULL;
+    }
+
+    string[length] = '\0';
+    return string;
+}
+
+static bool send_frame(Socket socket_handle, uint32_t kind, const void *data, size_t bytes) {
+    return send_u32(socket_handle, kind) && send_u32(socket_handle, (uint32_t)bytes) && socket_send_all(socket_handle, data, bytes);
+}
+
+static bool make_address(struct sockaddr_un *address, const char *socket_path) {
+    ZERO_STRUCT(*address);
+    address->sun_family = AF_UNIX;
+
+    // Empty when the default socket directory couldn't be set up, already reported
+    if(socket_path[0] == '\0') {
+        return false;
+    }
+
+    if(strlen(socket_path) >= sizeof(address->sun_path)) {
+        fprintf(stderr, "Daemon socket path is too long: %s\n", socket_path);
+        return false;
+    }
+
+    strcpy(address->sun_path, socket_path);
+    return true;
+}
+
+#ifndef _WIN32
+// Other users must not be able to replace the socket or reach it, the daemon compiles with its owner's rights
+static bool make_private_directory(const char *path) {
+    if(mkdir(path, 0700) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Failed to create daemon socket directory: %s\n", path);
+        return false;
+    }
+
+    struct stat info;
+    if(lstat(path, &info) != 0 || !S_ISDIR(info.st_mode) || info.st_uid != geteuid() || (info.st_mode & 077) != 0) {
+        fprintf(stderr, "Daemon socket directory isn't private to this user: %s\n", path);
+        return false;
+    }
+    return true;
+}
+#endif
+
+bool daemon_default_socket_path(char *buffer, size_t buffer_size) {
+#ifdef _WIN32
+    // The temporary directory is already per user
+    get_temp_file_path(buffer, buffer_size, DAEMON_SOCKET_NAME);
+    return true;
+#else
+    const char *runtime_directory = getenv("XDG_RUNTIME_DIR");
+    if(runtime_directory != NULL && runtime_directory[0] != '\0') {
+        snprintf(buffer, buffer_size, "%s/%s", runtime_directory, DAEMON_SOCKET_NAME);
+        return true;
+    }
+
+    char directory_name[64];
+    snprintf(directory_name, sizeof(directory_name), "polang-%u", (uint32_t)geteuid());
+
+    char directory[512];
+    get_temp_file_path(directory, sizeof(directory), directory_name);
+    if(!make_private_directory(directory)) {
+        buffer[0] = '\0';
+        return false;
+    }
+
+    snprintf(buffer, buffer_size, "%s/%s", directory, DAEMON_SOCKET_NAME);
+    return true;
+#endif
+}
+
+static bool set_working_directory(const char *path) {
+#ifdef _WIN32
+    wchar_t *wide_path = convert_to_wcs_alloc(path, strlen(path), NULL);
+    const bool success = wide_path != NULL && _wchdir(wide_path) == 0;
+    free(wide_path);
+    return success;
+#else
+    return chdir(path) == 0;
+#endif
+}
+
+// @allocated; UTF-8
+static char *get_working_directory(void) {
+#ifdef _WIN32
+    wchar_t *wide_path = _wgetcwd(NULL, 0);
+    char *path = wide_path != NULL ? convert_to_mbs_alloc(wide_path, wcslen(wide_path), NULL) : NULL;
+    free(wide_path);
+    return path;
+#else
+    return getcwd(NULL, 0);
+#endif
+}
+
+static FILE *open_temp_file(void) {
+#ifdef _WIN32
+    // tmpfile() wants to write to the root of the drive
+    wchar_t temp_directory[MAX_PATH + 1];
+    wchar_t temp_path[MAX_PATH + 1];
+    if(GetTempPathW(ARRAY_SIZE(temp_directory), temp_directory) == 0 || GetTempFileNameW(temp_directory, L"plg", 0, temp_path) == 0) {
+        return NULL;
+    }
+
+    // D deletes it on close
+    FILE *file = NULL;
+    return _wfopen_s(&file, temp_path, L"w+bD") == 0 ? file : NULL;
+#else
+    return tmpfile();
+#endif
+}
+
+// Points a standard stream's file descriptor at a temporary file for the duration of a compile
+typedef struct {
+    FILE   *stream;
+    FILE   *file;
+    int32_t saved_fd;
+} Output_Capture;
+
+static bool capture_begin(Output_Capture *capture, FILE *stream) {
+    fflush(stream);
+
+    capture->stream = stream;
+    capture->file = open_temp_file();
+    if(capture->file == NULL) {
+        return false;
+    }
+
+#ifdef _WIN32
+    capture->saved_fd = _dup(_fileno(stream));
+    _dup2(_fileno(capture->file), _fileno(stream));
+#else
+    capture->saved_fd = dup(fileno(stream));
+    dup2(fileno(capture->file), fileno(stream));
+#endif
+    return true;
+}
+
+static void capture_end(Output_Capture *capture) {
+    fflush(capture->stream);
+
+#ifdef _WIN32
+    _dup2(capture->saved_fd, _fileno(capture->stream));
+    _close(capture->saved_fd);
+#else
+    dup2(capture->saved_fd, fileno(capture->stream));
+    close(capture->saved_fd);
+#endif
+}
+
+static bool send_captured(Socket socket_handle, Output_Capture *capture, uint32_t frame_kind) {
+    char *chunk = (char *)malloc(DAEMON_FRAME_BYTES_MAX);
+    if(chunk == NULL) {
+        fprintf(stderr, "Failed to allocate memory in send_captured.\n");
+        fclose(capture->file);
+        return false;
+    }
+
+    rewind(capture->file);
+
+    bool success = true;
+    size_t bytes = 0;
+    while(success && (bytes = fread(chunk, 1, DAEMON_FRAME_BYTES_MAX, capture->file)) > 0) {
+        success = send_frame(socket_handle, frame_kind, chunk, bytes);
+    }
+
+    free(chunk);
+    fclose(capture->file);
+    return success;
+}
+
+static int32_t run_captured_compile(Socket client, Daemon_Compile_Proc *compile_proc, void *user_data, int32_t argc, char **argv) {
+    Output_Capture captured_stdout;
+    Output_Capture captured_stderr;
+
+    if(!capture_begin(&captured_stdout, stdout)) {
+        return -1;
+    }
+    if(!capture_begin(&captured_stderr, stderr)) {
+        capture_end(&captured_stdout);
+        fclose(captured_stdout.file);
+        return -1;
+    }
+
+    const int32_t exit_code = compile_proc(user_data, argc, argv);
+
+    capture_end(&captured_stdout);
+    capture_end(&captured_stderr);
+
+    // The two streams arrive one after the other, not interleaved
+    send_captured(client, &captured_stdout, DAEMON_FRAME_STDOUT);
+    send_captured(client, &captured_stderr, DAEMON_FRAME_STDERR);
+    return exit_code;
+}
+
+// Returns false when the client asked the daemon to stop
+static bool serve_client(Socket client, Daemon_Compile_Proc *compile_proc, void *user_data) {
+    uint32_t version = 0;
+    uint32_t command = 0;
+    if(!recv_u32(client, &version) || version != DAEMON_PROTOCOL_VERSION || !recv_u32(client, &command)) {
+        return true;
+    }
+
+    if(command == DAEMON_COMMAND_STOP) {
+        const int32_t exit_code = 0;
+        send_frame(client, DAEMON_FRAME_EXIT, &exit_code, sizeof(exit_code));
+        return false;
+    }
+
+    char *working_directory = recv_string_alloc(client);
+    uint32_t argc = 0;
+    if(working_directory == NULL || !recv_u32(client, &argc) || argc == 0 || argc > DAEMON_ARGS_MAX) {
+        free(working_directory);
+        return true;
+    }
+
+    char **argv = (char **)calloc(argc + 1, sizeof(char *));
+    bool received = argv != NULL;
+    for(uint32_t index = 0; index < argc && received; ++index) {
+        argv[index] = recv_string_alloc(client);
+        received = argv[index] != NULL;
+    }
+
+    if(received) {
+        int32_t exit_code = -1;
+
+        if(set_working_directory(working_directory)) {
+            exit_code = run_captured_compile(client, compile_proc, user_data, (int32_t)argc, argv);
+        } else {
+            const char *message = "Daemon can't enter the working directory\n";
+            send_frame(client, DAEMON_FRAME_STDERR, message, strlen(message));
+        }
+
+        send_frame(client, DAEMON_FRAME_EXIT, &exit_code, sizeof(exit_code));
+    }
+
+    for(uint32_t index = 0; argv != NULL && index < argc; ++index) {
+        free(argv[index]);
+    }
+    free(argv);
+    free(working_directory);
+    return true;
+}
+
+static void delete_socket_file(const char *socket_path) {
+    wchar_t *wide_path = convert_to_wcs_alloc(socket_path, strlen(socket_path), NULL);
+    if(wide_path != NULL) {
+        file_delete(wide_path);
+        free(wide_path);
+    }
+}
+
+// Left behind by a daemon that didn't exit cleanly; Anything else at the path stays
+static bool delete_stale_socket(const char *socket_path) {
+#ifndef _WIN32
+    struct stat info;
+    if(lstat(socket_path, &info) != 0) {
+        return errno == ENOENT;
+    }
+
+    if(!S_ISSOCK(info.st_mode) || info.st_uid != geteuid()) {
+        fprintf(stderr, "Not replacing %s, it isn't a daemon socket of this user\n", socket_path);
+        return false;
+    }
+#endif
+
+    delete_socket_file(socket_path);
+    return true;
+}
+
+static bool bind_private(Socket listener, struct sockaddr_un *address) {
+#ifdef _WIN32
+    return bind(listener, (struct sockaddr *)address, sizeof(*address)) == 0;
+#else
+    // Socket file is created without group and other permissions
+    const mode_t previous_umask = umask(077);
+    const bool bound = bind(listener, (struct sockaddr *)address, sizeof(*address)) == 0;
+    umask(previous_umask);
+    return bound;
+#endif
+}
+
+// Only the user running the daemon may compile through it
+static bool peer_is_owner(Socket client) {
+#if defined(_WIN32)
+    // Nothing to ask on Windows, the socket sits in the per-user temporary directory
+    return true;
+#elif defined(SO_PEERCRED)
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+    return getsockopt(client, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0 && credentials.uid == geteuid();
+#else
+    uid_t uid = 0;
+    gid_t gid = 0;
+    return getpeereid(client, &uid, &gid) == 0 && uid == geteuid();
+#endif
+}
+
+bool daemon_serve(const char *socket_path, Daemon_Compile_Proc *compile_proc, void *user_data) {
+    struct sockaddr_un address;
+    if(!make_address(&address, socket_path) || !sockets_startup()) {
+        return false;
+    }
+
+    Socket listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listener == SOCKET_INVALID) {
+        fprintf(stderr, "Failed to create daemon socket.\n");
+        sockets_cleanup();
+        return false;
+    }
+
+    if(!delete_stale_socket(socket_path)) {
+        socket_close(listener);
+        sockets_cleanup();
+        return false;
+    }
+
+    if(!bind_private(listener, &address) || listen(listener, 16) != 0) {
+        fprintf(stderr, "Failed to listen on %s\n", socket_path);
+        socket_close(listener);
+        sockets_cleanup();
+        return false;
+    }
+
+    fprintf(stderr, "Daemon listening on %s\n", socket_path);
+
+    bool running = true;
+    while(running) {
+        Socket client = accept(listener, NULL, NULL);
+        if(client == SOCKET_INVALID) {
+            continue;
+        }
+
+        if(!peer_is_owner(client)) {
+            fprintf(stderr, "Rejected a connection from another user\n");
+            socket_close(client);
+            continue;
+        }
+
+        running = serve_client(client, compile_proc, user_data);
+        socket_close(client);
+    }
+
+    socket_close(listener);
+    delete_socket_file(socket_path);
+    sockets_cleanup();
+    return true;
+}
+
+static Socket connect_to_daemon(const char *socket_path) {
+    struct sockaddr_un address;
+    if(!make_address(&address, socket_path) || !sockets_startup()) {
+        return SOCKET_INVALID;
+    }
+
+    Socket connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(connection == SOCKET_INVALID) {
+        sockets_cleanup();
+        return SOCKET_INVALID;
+    }
+
+    if(connect(connection, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        fprintf(stderr, "No daemon listening on %s\n", socket_path);
+        socket_close(connection);
+        sockets_cleanup();
+        return SOCKET_INVALID;
+    }
+
+    return connection;
+}
+
+// Writes output frames as they come until the exit frame
+static int32_t receive_compile_result(Socket connection) {
+    char *payload = (char *)malloc(DAEMON_FRAME_BYTES_MAX);
+    if(payload == NULL) {
+        fprintf(stderr, "Failed to allocate memory in receive_compile_result.\n");
+        return -1;
+    }
+
+    int32_t exit_code = -1;
+    while(true) {
+        uint32_t kind = 0;
+        uint32_t bytes = 0;
+        if(!recv_u32(connection, &kind) || !recv_u32(connection, &bytes) || bytes > DAEMON_FRAME_BYTES_MAX || !socket_recv_all(connection, payload, bytes)) {
+            fprintf(stderr, "Lost connection to the daemon\n");
+            break;
+        }
+
+        if(kind == DAEMON_FRAME_STDOUT) {
+            stdout_write(payload, bytes);
+        } else if(kind == DAEMON_FRAME_STDERR) {
+            fwrite(payload, 1, bytes, stderr);
+        } else if(kind == DAEMON_FRAME_EXIT && bytes == sizeof(exit_code)) {
+            memcpy(&exit_code, payload, sizeof(exit_code));
+            break;
+        }
+    }
+
+    free(payload);
+    return exit_code;
+}
+
+int32_t daemon_forward_compile(const char *socket_path, int32_t argc, char **argv) {
+    Socket connection = connect_to_daemon(socket_path);
+    if(connection == SOCKET_INVALID) {
+        return -1;
+    }
+
+    char *working_directory = get_working_directory();
+
+    bool sent = working_directory != NULL &&
+                send_u32(connection, DAEMON_PROTOCOL_VERSION) &&
+                send_u32(connection, DAEMON_COMMAND_COMPILE) &&
+                send_string(connection, working_directory) &&
+                send_u32(connection, (uint32_t)argc);
+
+    for(int32_t index = 0; index < argc && sent; ++index) {
+        sent = send_string(connection, argv[index]);
+    }
+
+    free(working_directory);
+
+    int32_t exit_code = -1;
+    if(sent) {
+        exit_code = receive_compile_result(connection);
+    } else {
+        fprintf(stderr, "Failed to send the compile to the daemon\n");
+    }
+
+    socket_close(connection);
+    sockets_cleanup();
+    return exit_code;
+}
+
+bool daemon_stop(const char *socket_path) {
+    Socket connection = connect_to_daemon(socket_path);
+    if(connection == SOCKET_INVALID) {
+        return false;
+    }
+
+    const bool success = send_u32(connection, DAEMON_PROTOCOL_VERSION) &&
+                         send_u32(connection, DAEMON_COMMAND_STOP) &&
+                         receive_compile_result(connection) == 0;
+
+    socket_close(connection);
+    sockets_cleanup();
+    return success;
+}
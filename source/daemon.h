@@ -0,0 +1,36 @@
+#ifndef _DAEMON_H
+#define _DAEMON_H
+
+#include "common.h"
+
+/*
+ * Resident compiler
+ *
+ * The daemon listens on a Unix domain socket and runs one compile per connection, one at a time, in its own process,
+ * so native target setup, target machines and parser arenas are paid for once.
+ * A client sends its working directory and arguments; the daemon runs the compile in that directory with stdout and stderr
+ * captured, then sends both back together with the exit code. The client writes them to its own stdout and stderr.
+ * Only the user running the daemon can connect: the socket is created without permissions for others, in a private
+ * directory by default, and connections from other users are rejected.
+ */
+
+#define DAEMON_PROTOCOL_VERSION 1
+#define DAEMON_SOCKET_NAME "polang_daemon.sock"
+
+/* Runs one compile with the forwarded arguments, argv[0] is the client's program name; Returns the exit code */
+typedef int32_t Daemon_Compile_Proc(void *user_data, int32_t argc, char **argv);
+
+/* Default socket in $XDG_RUNTIME_DIR, otherwise in a directory of the temporary directory only this user can access;
+   False if that directory can't be made private, buffer is then empty */
+bool daemon_default_socket_path(char *buffer, size_t buffer_size);
+
+/* Serves compiles until a client asks it to stop; Returns false if the socket couldn't be set up */
+bool daemon_serve(const char *socket_path, Daemon_Compile_Proc *compile_proc, void *user_data);
+
+/* Forwards a compile and returns its exit code, -1 if the daemon couldn't be reached */
+int32_t daemon_forward_compile(const char *socket_path, int32_t argc, char **argv);
+
+/* Asks the daemon to exit after the current compile */
+bool daemon_stop(const char *socket_path);
+
+#endif /* _DAEMON_H */
@@ -0,0 +1,503 @@
+#include "driver.h"
+#include "lexer.h"
+#include "parser.h"
+#include "llvm_lto.h"
+#include "procedure_table.h"
+#include "interface_file.h"
+#include "thread_pool.h"
+#include "file_io.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+    const char *source_path;
+    wchar_t *source_path_wide;
+    char *output_path;
+    char *interface_path; // NULL without --emit-interface
+
+    size_t token_count;
+    wchar_t *file_data; // Taken from the worker's lexer, AST nodes point into it
+    Parser parser;
+    bool   parsed;
+
+    LLVMMemoryBufferRef bitcode; // Pre-link module when using ThinLTO
+
+    Cache_Key cache_key;
+} Compile_Unit;
+
+typedef struct {
+    Compile_Options *options;
+
+    Compile_Unit *units;
+    size_t unit_count;
+
+    // Kept by each pool worker between jobs, indexed by worker_index
+    Lexer *worker_lexers;            // Token storage
+    LLVM_Context *worker_contexts;   // Context, builder and target machine, every job gets a fresh module in one
+    size_t worker_count;
+
+    // Exported procedures of all units, then of the interface files with owners counted on from unit_count
+    Procedure_Table exported;
+    Interface_Set interfaces;
+
+    size_t failed_count; // Atomic
+} Driver;
+
+// "<directory>/<source file name without extension>.<extension>"
+static char *make_output_path(const char *directory, const char *source_path, Emit_Kind kind) {
+    const char *name = source_path;
+    for(const char *at = source_path; *at; ++at) {
+        if(*at == '/' || *at == '\\') {
+            name = at + 1;
+        }
+    }
+
+    size_t name_length = strlen(name);
+    const char *extension = strrchr(name, '.');
+    if(extension != NULL && extension != name) {
+        name_length = extension - name;
+    }
+
+    const size_t bytes = strlen(directory) + name_length + strlen(emit_kind_extensions[kind]) + 3;
+    char *output_path = (char *)malloc(bytes);
+    if(output_path == NULL) {
+        fprintf(stderr, "Failed to allocate memory in make_output_path.\n");
+        return NULL;
+    }
+
+    snprintf(output_path, bytes, "%s/%.*s.%s", directory, (int32_t)name_length, name, emit_kind_extensions[kind]);
+    return output_path;
+}
+
+static void parse_unit_job(void *user_data, size_t job_index, size_t worker_index) {
+    Driver *driver = (Driver *)user_data;
+    Compile_Unit *unit = &driver->units[job_index];
+
+    Trace_Span trace_span;
+    trace_begin(&trace_span);
+
+    Lexer *lexer = &driver->worker_lexers[worker_index];
+    if(!lexer_load_file(lexer, unit->source_path_wide)) {
+        fwprintf(stderr, L"Failed to read source file: %ls\n", unit->source_path_wide);
+        ATOMIC_ADD(&driver->failed_count, 1);
+        return;
+    }
+
+    unit->token_count = lexer->token_count;
+
+    if(!parser_init(&unit->parser, lexer)) {
+        ATOMIC_ADD(&driver->failed_count, 1);
+        return;
+    }
+
+    // A syntax error fails this file only, the other workers keep going
+    jmp_buf recovery;
+    jmp_buf *previous_recovery = error_recovery_set(&recovery);
+
+    if(setjmp(recovery) == 0) {
+        lexer_rewind(lexer);
+        parser_parse(&unit->parser);
+        unit->parsed = true;
+    } else {
+        ATOMIC_ADD(&driver->failed_count, 1);
+    }
+
+    if(unit->parsed && unit->interface_path != NULL && !interface_file_write(unit->interface_path, unit->parser.ast_root)) {
+        ATOMIC_ADD(&driver->failed_count, 1);
+    }
+
+    error_recovery_set(previous_recovery);
+
+    // Taken only now, syntax errors print their source line from the lexer
+    unit->file_data = lexer_take_file_data(lexer);
+
+    // Tokens get overwritten by the worker's next file
+    unit->parser.lexer = NULL;
+
+    trace_end(&trace_span, "file", unit->source_path);
+}
+
+static const char *get_owner_path(Driver *driver, uint32_t owner) {
+    return owner < driver->unit_count ? driver->units[owner].source_path : driver->interfaces.files[owner - driver->unit_count].path;
+}
+
+// Fills the table of exported procedures, fails if two files export the same signature
+static bool register_exports(Driver *driver) {
+    size_t procedure_count = driver->interfaces.procedures.count;
+    for(size_t index = 0; index < driver->unit_count; ++index) {
+        procedure_count += driver->units[index].parser.ast_root->nodes_count;
+    }
+
+    if(!procedure_table_init(&driver->exported, procedure_count)) {
+        return false;
+    }
+
+    bool success = true;
+    for(size_t unit_index = 0; unit_index < driver->unit_count; ++unit_index) {
+        AST_Root *ast_root = driver->units[unit_index].parser.ast_root;
+
+        for(size_t index = 0; index < ast_root->nodes_count; ++index) {
+            AST_Node *node = ast_root->nodes[index];
+            if(node->kind != ast_kind(AST_Procedure) || !(node->flags & AST_FLAG_EXPORTED)) {
+                continue;
+            }
+
+            AST_Procedure *ast_proc = (AST_Procedure *)node;
+
+            Procedure_Table_Entry existing = { };
+            if(!procedure_table_add(&driver->exported, ast_proc, (uint32_t)unit_index, &existing)) {
+                if(existing.procedure == NULL) {
+                    return false;
+                }
+
+                fwprintf(stderr, L"Procedure %.*ls exported from both %hs and %hs\n",
+                         ast_proc->signature.length, ast_proc->signature.data,
+                         get_owner_path(driver, existing.owner), driver->units[unit_index].source_path);
+                success = false;
+            }
+        }
+    }
+
+    // Interface files already checked each other
+    for(size_t file_index = 0; file_index < driver->interfaces.file_count; ++file_index) {
+        Interface_File *file = &driver->interfaces.files[file_index];
+
+        for(size_t index = 0; index < file->procedure_count; ++index) {
+            AST_Procedure *ast_proc = &file->procedures[index];
+
+            Procedure_Table_Entry existing = { };
+            if(!procedure_table_add(&driver->exported, ast_proc, (uint32_t)(driver->unit_count + file_index), &existing)) {
+                if(existing.procedure == NULL) {
+                    return false;
+                }
+
+                fwprintf(stderr, L"Procedure %.*ls exported from both %hs and %hs\n",
+                         ast_proc->signature.length, ast_proc->signature.data, get_owner_path(driver, existing.owner), file->path);
+                success = false;
+            }
+        }
+    }
+
+    return success;
+}
+
+static void codegen_unit_job(void *user_data, size_t job_index, size_t worker_index) {
+    Driver *driver = (Driver *)user_data;
+    Compile_Unit *unit = &driver->units[job_index];
+    Compile_Options *options = driver->options;
+
+    Trace_Span trace_span;
+    trace_begin(&trace_span);
+
+    LLVM_Context ctx;
+    llvm_init_module_shared(&ctx, &driver->worker_contexts[worker_index], &unit->parser, unit->source_path);
+    ctx.external_procs = &driver->exported;
+    ctx.specialize_budget = options->specialize_budget;
+
+    jmp_buf recovery;
+    jmp_buf *previous_recovery = error_recovery_set(&recovery);
+
+    if(setjmp(recovery) == 0) {
+        llvm_convert(&ctx);
+
+        bool success = true;
+        if(options->thin_lto) {
+            unit->bitcode = llvm_lto_prepare_module(&ctx);
+            success = unit->bitcode != NULL;
+        } else {
+            success = llvm_optimize(&ctx) && llvm_emit(&ctx, options->emit_kind, unit->output_path);
+        }
+
+        if(!success) {
+            ATOMIC_ADD(&driver->failed_count, 1);
+        }
+    } else {
+        ATOMIC_ADD(&driver->failed_count, 1);
+    }
+
+    error_recovery_set(previous_recovery);
+
+    llvm_shutdown_module(&ctx);
+
+    trace_end(&trace_span, "file", unit->source_path);
+}
+
+static void free_units(Driver *driver) {
+    for(size_t index = 0; index < driver->unit_count; ++index) {
+        Compile_Unit *unit = &driver->units[index];
+
+        if(unit->bitcode != NULL) {
+            LLVMDisposeMemoryBuffer(unit->bitcode);
+        }
+
+        if(unit->parser.ast_mem_arena.pointer != NULL) {
+            parser_free(&unit->parser);
+        }
+
+        free(unit->file_data);
+        free(unit->source_path_wide);
+        free(unit->output_path);
+        free(unit->interface_path);
+    }
+
+    free(driver->units);
+}
+
+static bool init_workers(Driver *driver, size_t worker_count) {
+    driver->worker_lexers = (Lexer *)calloc(worker_count, sizeof(Lexer));
+    driver->worker_contexts = (LLVM_Context *)calloc(worker_count, sizeof(LLVM_Context));
+    if(driver->worker_lexers == NULL || driver->worker_contexts == NULL) {
+        fprintf(stderr, "Failed to allocate memory in init_workers.\n");
+        return false;
+    }
+
+    for(size_t index = 0; index < worker_count; ++index) {
+        if(!llvm_init(&driver->worker_contexts[index], NULL, driver->options->opt_level)) {
+            return false;
+        }
+        driver->worker_count += 1;
+    }
+
+    return true;
+}
+
+static void free_workers(Driver *driver) {
+    for(size_t index = 0; index < driver->worker_count; ++index) {
+        lexer_free(&driver->worker_lexers[index]);
+        llvm_shutdown(&driver->worker_contexts[index]);
+    }
+
+    free(driver->worker_lexers);
+    free(driver->worker_contexts);
+}
+
+// Starts the biggest jobs first so one large file doesn't end up alone on the critical path
+static bool run_largest_first(Driver *driver, Thread_Pool *pool, const size_t *weights, Thread_Pool_Job_Proc *job_proc) {
+    size_t *job_order = thread_pool_order_largest_first(weights, driver->unit_count);
+    const bool ran = thread_pool_run_ordered(pool, job_order, driver->unit_count, job_proc, driver);
+    free(job_order);
+    return ran;
+}
+
+bool driver_init_cache_key(Cache_Key *key, Compile_Options *options, wchar_t **source_paths, size_t source_count) {
+    cache_key_init(key);
+
+    // Thread count doesn't change outputs; Split objects are never cached
+    cache_key_add_u64(key, options->opt_level);
+    cache_key_add_u64(key, options->codegen_partitions);
+    cache_key_add_u64(key, options->emit_kind);
+    cache_key_add_u64(key, options->thin_lto);
+    cache_key_add_u64(key, options->keep_unreachable || options->pipeline); // Single files drop unreachable procedures otherwise
+    cache_key_add_u64(key, options->procedure_cache); // Nothing gets inlined across procedures then
+    cache_key_add_u64(key, options->specialize_budget);
+    cache_key_add_u64(key, source_count);
+
+    for(size_t index = 0; index < source_count; ++index) {
+        if(!cache_key_add_file(key, source_paths[index])) {
+            return false;
+        }
+    }
+
+    cache_key_add_u64(key, options->interface_count);
+
+    for(size_t index = 0; index < options->interface_count; ++index) {
+        wchar_t *interface_path = convert_to_wcs_alloc(options->interface_paths[index], strlen(options->interface_paths[index]), NULL);
+        const bool added = interface_path != NULL && cache_key_add_file(key, interface_path);
+        free(interface_path);
+
+        if(!added) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void driver_interface_cache_key(Cache_Key *out_key, const Cache_Key *output_key) {
+    *out_key = *output_key;
+    cache_key_add_string(out_key, "interface");
+}
+
+// True if every output came from the cache; Cache keys of the units are set either way
+static bool fetch_cached_outputs(Driver *driver, Object_Cache *cache) {
+    wchar_t **source_paths = (wchar_t **)malloc(driver->unit_count * sizeof(wchar_t *));
+    if(source_paths == NULL) {
+        fprintf(stderr, "Failed to allocate memory in fetch_cached_outputs.\n");
+        return false;
+    }
+
+    for(size_t index = 0; index < driver->unit_count; ++index) {
+        source_paths[index] = driver->units[index].source_path_wide;
+    }
+
+    Cache_Key base_key;
+    const bool has_key = driver_init_cache_key(&base_key, driver->options, source_paths, driver->unit_count);
+    free(source_paths);
+
+    // Unreadable sources get reported by parsing
+    if(!has_key) {
+        return false;
+    }
+
+    // All or nothing: any miss means every file has to be parsed for its exports anyway
+    bool all_hits = true;
+    for(size_t index = 0; index < driver->unit_count; ++index) {
+        Compile_Unit *unit = &driver->units[index];
+
+        // Module names end up in the outputs
+        unit->cache_key = base_key;
+        cache_key_add_u64(&unit->cache_key, index);
+        cache_key_add_string(&unit->cache_key, unit->source_path);
+
+        if(all_hits) {
+            all_hits = object_cache_fetch(cache, &unit->cache_key, unit->output_path);
+        } else {
+            cache->misses += 1;
+        }
+
+        if(all_hits && unit->interface_path != NULL) {
+            Cache_Key interface_key;
+            driver_interface_cache_key(&interface_key, &unit->cache_key);
+            all_hits = object_cache_fetch(cache, &interface_key, unit->interface_path);
+        }
+    }
+
+    return all_hits;
+}
+
+bool driver_compile_files(Compile_Options *options, Object_Cache *cache) {
+    if(options->output_path != NULL && strcmp(options->output_path, "-") == 0) {
+        fwprintf(stderr, L"Can't write outputs of many files to stdout\n");
+        return false;
+    }
+
+    Driver driver = { };
+    driver.options = options;
+    driver.unit_count = options->source_count;
+
+    driver.units = (Compile_Unit *)calloc(driver.unit_count, sizeof(Compile_Unit));
+    if(driver.units == NULL) {
+        fprintf(stderr, "Failed to allocate memory in driver_compile_files.\n");
+        return false;
+    }
+
+    const char *output_directory = options->output_path != NULL ? options->output_path : ".";
+
+    for(size_t index = 0; index < driver.unit_count; ++index) {
+        Compile_Unit *unit = &driver.units[index];
+        unit->source_path = options->source_paths[index];
+        unit->output_path = make_output_path(output_directory, unit->source_path, options->emit_kind);
+
+        if(unit->output_path == NULL) {
+            free_units(&driver);
+            return false;
+        }
+
+        if(options->emit_interface) {
+            unit->interface_path = interface_path_for_output(unit->output_path);
+            if(unit->interface_path == NULL) {
+                free_units(&driver);
+                return false;
+            }
+        }
+
+        unit->source_path_wide = convert_to_wcs_alloc(unit->source_path, strlen(unit->source_path), NULL);
+        if(unit->source_path_wide == NULL) {
+            fprintf(stderr, "Invalid source file path: %s\n", unit->source_path);
+            free_units(&driver);
+            return false;
+        }
+
+        for(size_t other_index = 0; other_index < index; ++other_index) {
+            if(strcmp(driver.units[other_index].output_path, unit->output_path) == 0) {
+                fprintf(stderr, "Sources %s and %s would both be written to %s\n", driver.units[other_index].source_path, unit->source_path, unit->output_path);
+                free_units(&driver);
+                return false;
+            }
+        }
+    }
+
+    if(cache != NULL && fetch_cached_outputs(&driver, cache)) {
+        free_units(&driver);
+        return true;
+    }
+
+    if(!interface_set_load(&driver.interfaces, options->interface_paths, options->interface_count)) {
+        free_units(&driver);
+        return false;
+    }
+
+    Thread_Pool pool;
+    if(!thread_pool_init(&pool, options->thread_count)) {
+        interface_set_free(&driver.interfaces);
+        free_units(&driver);
+        return false;
+    }
+
+    size_t *weights = (size_t *)calloc(driver.unit_count, sizeof(size_t));
+    if(weights == NULL) {
+        fprintf(stderr, "Failed to allocate memory in driver_compile_files.\n");
+    }
+
+    bool success = weights != NULL && init_workers(&driver, pool.worker_count);
+
+    if(success) {
+        // File size is all that is known before lexing
+        for(size_t index = 0; index < driver.unit_count; ++index) {
+            // Unreadable files weigh nothing, parsing reports them
+            file_get_size(driver.units[index].source_path_wide, &weights[index]);
+        }
+
+        // All files have to be parsed before any code generation, calls resolve against procedures exported from every file
+        success = run_largest_first(&driver, &pool, weights, parse_unit_job) && driver.failed_count == 0 && register_exports(&driver);
+    }
+
+    if(success) {
+        for(size_t index = 0; index < driver.unit_count; ++index) {
+            weights[index] = driver.units[index].token_count;
+        }
+
+        success = run_largest_first(&driver, &pool, weights, codegen_unit_job) && driver.failed_count == 0;
+    }
+
+    if(success && options->thin_lto) {
+        LTO_Module *modules = (LTO_Module *)calloc(driver.unit_count, sizeof(LTO_Module));
+        if(modules == NULL) {
+            fprintf(stderr, "Failed to allocate memory in driver_compile_files.\n");
+            success = false;
+        } else {
+            for(size_t index = 0; index < driver.unit_count; ++index) {
+                modules[index].bitcode = driver.units[index].bitcode;
+                modules[index].output_path = driver.units[index].output_path;
+                modules[index].module_name = driver.units[index].source_path;
+            }
+
+            success = llvm_lto_run_backends(modules, driver.unit_count, &driver.exported, &pool, driver.worker_contexts, options->emit_kind);
+            free(modules);
+        }
+    }
+
+    if(success && cache != NULL) {
+        for(size_t index = 0; index < driver.unit_count; ++index) {
+            Compile_Unit *unit = &driver.units[index];
+            object_cache_store(cache, &unit->cache_key, unit->output_path);
+
+            if(unit->interface_path != NULL) {
+                Cache_Key interface_key;
+                driver_interface_cache_key(&interface_key, &unit->cache_key);
+                object_cache_store(cache, &interface_key, unit->interface_path);
+            }
+        }
+    }
+
+    thread_pool_free(&pool);
+    free(weights);
+    free_workers(&driver);
+    procedure_table_free(&driver.exported);
+    interface_set_free(&driver.interfaces);
+    free_units(&driver);
+
+    return success;
+}
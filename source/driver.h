@@ -0,0 +1,73 @@
+#ifndef _DRIVER_H
+#define _DRIVER_H
+
+#include "common.h"
+#include "llvm_converter.h"
+#include "object_cache.h"
+#include "timing.h"
+#include "output.h"
+
+typedef struct {
+    const char **source_paths; // Empty uses the test source file
+    size_t source_count;
+
+    const char **interface_paths; // Interface files of sources compiled earlier, see interface_file.h
+    size_t interface_count;
+    bool emit_interface; // Also write <output without extension>.polangi for every source
+    char *interface_output_path; // Single file only, set with emit_interface
+
+    LLVMCodeGenOptLevel opt_level;
+
+    // Partitioned code generation, partition count alone decides the output
+    size_t codegen_partitions;
+    bool   split_objects;   // One output per partition instead of linking them back
+
+    size_t thread_count; // Workers for partitions and files, 0 uses the processor count
+    bool   pipeline;     // Lex, parse and convert a single file on overlapping threads, see pipeline.h
+    bool   lazy_bodies;  // Single file only, see Parser.lazy_bodies
+    bool   keep_unreachable; // Single file only, see reachability.h; Not done when pipelined
+    bool   procedure_cache;  // Single file only, reuse optimized procedures from the cache directory, see procedure_cache.h
+    size_t specialize_budget; // Clone procedures called with literal arguments, 0 disables; Not when pipelined, see specialization.h
+
+    Emit_Kind   emit_kind;
+    const char *output_path; // NULL uses a default; "-" is stdout; Output directory when compiling many files
+
+    bool thin_lto; // Import across files before optimizing, see llvm_lto.h
+
+    const char *cache_directory; // NULL disables the object cache
+    size_t cache_size_mb;
+
+    bool time_report;
+    Timing_Report_Format time_report_format;
+    const char *time_report_path; // NULL is stderr
+
+    const char *trace_path; // Chrome trace-event file, NULL disables tracing
+
+    // JIT and time this procedure instead of writing output, see bench.h
+    const char *bench_procedure;
+    const char *bench_args; // Comma separated, NULL for none
+    size_t bench_samples;
+
+    Output_Verbosity verbosity; // -q is OUTPUT_QUIET
+    bool dump_tokens;
+    bool dump_ast;
+} Compile_Options;
+
+/*
+ * Compiles many files at once on a work-stealing thread pool, the largest files are started first
+ * Each file gets its own parser arena and LLVM module; exported procedures are callable from the other files.
+ * Workers keep their lexer token storage and LLVM context between files.
+ * Outputs are written to "<output directory>/<source name>.<extension>".
+ */
+bool driver_compile_files(Compile_Options *options, Object_Cache *cache);
+
+/*
+ * Object cache key of everything that decides the outputs besides which unit it is: options and the bytes of every source
+ * Every source and interface file goes into the key of every unit, calls and imports across files make outputs depend on the other files.
+ */
+bool driver_init_cache_key(Cache_Key *key, Compile_Options *options, wchar_t **source_paths, size_t source_count);
+
+/* Interface files are cached next to the output they were written with */
+void driver_interface_cache_key(Cache_Key *out_key, const Cache_Key *output_key);
+
+#endif /* _DRIVER_H */
@@ -1,7 +1,30 @@
 #include "file_io.h"
+#include "timing.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#include <direct.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+// Wide paths only exist on Windows, elsewhere the file system takes UTF-8
+static char *narrow_path(const wchar_t *path) {
+    return convert_to_mbs_alloc(path, wcslen(path), NULL);
+}
+#endif
 
 bool file_read(const wchar_t *filepath, wchar_t **out_chars, size_t *out_length) {
     FILE *file = NULL;
@@ -14,6 +37,9 @@ bool file_read(const wchar_t *filepath, wchar_t **out_chars, size_t *out_length)
     long bytes = ftell(file);
     rewind(file);
 
+    Timing_Section read_timing;
+    timing_begin(&read_timing, TIMING_FILE_READ);
+
     // Allocate memory and read entire file into the buffer
     char *buffer = malloc(bytes + 1);
     if(buffer == NULL) {
@@ -26,10 +52,17 @@ bool file_read(const wchar_t *filepath, wchar_t **out_chars, size_t *out_length)
     buffer[bytes] = '\0';
     fclose(file);
 
+    timing_end(&read_timing);
+
+    Timing_Section conversion_timing;
+    timing_begin(&conversion_timing, TIMING_UTF_CONVERSION);
+
     // Convert read file contents into wcs string
     size_t wide_length = 0;
     wchar_t *wide_buffer = convert_to_wcs_alloc(buffer, bytes, &wide_length);
 
+    timing_end(&conversion_timing);
+
     free(buffer);
     
     if(wide_buffer == NULL) {
@@ -42,3 +75,360 @@ bool file_read(const wchar_t *filepath, wchar_t **out_chars, size_t *out_length)
 
     return true;
 }
+
+bool file_get_size(const wchar_t *filepath, size_t *out_bytes) {
+    FILE *file = NULL;
+    if(_wfopen_s(&file, filepath, L"rb") != 0) {
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long bytes = ftell(file);
+    fclose(file);
+
+    if(bytes < 0) {
+        return false;
+    }
+
+    *out_bytes = (size_t)bytes;
+    return true;
+}
+
+bool file_read_bytes(const wchar_t *filepath, void **out_data, size_t *out_bytes) {
+    FILE *file = NULL;
+    if(_wfopen_s(&file, filepath, L"rb") != 0) {
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long bytes = ftell(file);
+    rewind(file);
+
+    if(bytes < 0) {
+        fclose(file);
+        return false;
+    }
+
+    // At least one byte so an empty file doesn't look like a failed allocation
+    void *data = malloc(bytes + 1);
+    if(data == NULL) {
+        fprintf(stderr, "Failed to allocate memory in file_read_bytes.\n");
+        fclose(file);
+        return false;
+    }
+
+    const size_t read = fread(data, 1, bytes, file);
+    fclose(file);
+
+    if(read != (size_t)bytes) {
+        free(data);
+        return false;
+    }
+
+    *out_data = data;
+    *out_bytes = (size_t)bytes;
+    return true;
+}
+
+bool file_map(const wchar_t *filepath, File_Mapping *out_mapping) {
+    ZERO_STRUCT(*out_mapping);
+
+#ifdef _WIN32
+    HANDLE file = CreateFileW(filepath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return false;
+    }
+
+    // Mapping an empty file fails, there is nothing to map anyway
+    if(size.QuadPart == 0) {
+        CloseHandle(file);
+        return true;
+    }
+
+    // The mapping keeps the file open
+    HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if(mapping == NULL) {
+        return false;
+    }
+
+    const void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if(data == NULL) {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    out_mapping->data = data;
+    out_mapping->bytes = (size_t)size.QuadPart;
+    out_mapping->handle = mapping;
+#else
+    char *narrow = narrow_path(filepath);
+    const int32_t file = narrow != NULL ? open(narrow, O_RDONLY) : -1;
+    free(narrow);
+    if(file < 0) {
+        return false;
+    }
+
+    struct stat status;
+    if(fstat(file, &status) != 0) {
+        close(file);
+        return false;
+    }
+
+    if(status.st_size == 0) {
+        close(file);
+        return true;
+    }
+
+    void *data = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if(data == MAP_FAILED) {
+        return false;
+    }
+
+    out_mapping->data = data;
+    out_mapping->bytes = (size_t)status.st_size;
+#endif
+
+    return true;
+}
+
+void file_unmap(File_Mapping *mapping) {
+    if(mapping->data != NULL) {
+#ifdef _WIN32
+        UnmapViewOfFile(mapping->data);
+        CloseHandle(mapping->handle);
+#else
+        munmap((void *)mapping->data, mapping->bytes);
+#endif
+    }
+
+    ZERO_STRUCT(*mapping);
+}
+
+bool file_write(const wchar_t *filepath, const void *data, size_t bytes) {
+    file_delete(filepath);
+
+    FILE *file = NULL;
+    if(_wfopen_s(&file, filepath, L"wb") != 0) {
+        return false;
+    }
+
+    const size_t written = fwrite(data, 1, bytes, file);
+    const bool closed = fclose(file) == 0;
+    return written == bytes && closed;
+}
+
+bool stream_write(FILE *stream, const void *data, size_t bytes) {
+    fflush(stream);
+
+    // Straight to the file descriptor, fwrite would fix the stream to byte orientation and later wprintf calls would fail
+    const char *at = (const char *)data;
+    bool success = true;
+
+#ifdef _WIN32
+    // Don't let the CRT translate newlines in binary output
+    const int32_t previous_mode = _setmode(_fileno(stream), _O_BINARY);
+
+    while(success && bytes > 0) {
+        const int32_t written = _write(_fileno(stream), at, (uint32_t)MIN(bytes, MB(64)));
+        success = written > 0;
+        at += written;
+        bytes -= written;
+    }
+
+    _setmode(_fileno(stream), previous_mode);
+#else
+    while(success && bytes > 0) {
+        const ssize_t written = write(fileno(stream), at, bytes);
+        success = written > 0;
+        at += written;
+        bytes -= written;
+    }
+#endif
+
+    return success;
+}
+
+bool stdout_write(const void *data, size_t bytes) {
+    return stream_write(stdout, data, bytes);
+}
+
+bool file_link_or_copy(const wchar_t *existing_path, const wchar_t *link_path) {
+    file_delete(link_path);
+
+#ifdef _WIN32
+    if(CreateHardLinkW(link_path, existing_path, NULL)) {
+        return true;
+    }
+#else
+    char *existing_narrow = narrow_path(existing_path);
+    char *link_narrow = narrow_path(link_path);
+    const bool linked = existing_narrow != NULL && link_narrow != NULL && link(existing_narrow, link_narrow) == 0;
+    free(existing_narrow);
+    free(link_narrow);
+
+    if(linked) {
+        return true;
+    }
+#endif
+
+    void *data = NULL;
+    size_t bytes = 0;
+    if(!file_read_bytes(existing_path, &data, &bytes)) {
+        return false;
+    }
+
+    const bool success = file_write(link_path, data, bytes);
+    free(data);
+    return success;
+}
+
+bool file_rename(const wchar_t *from_path, const wchar_t *to_path) {
+#ifdef _WIN32
+    return MoveFileExW(from_path, to_path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    char *from_narrow = narrow_path(from_path);
+    char *to_narrow = narrow_path(to_path);
+    const bool success = from_narrow != NULL && to_narrow != NULL && rename(from_narrow, to_narrow) == 0;
+    free(from_narrow);
+    free(to_narrow);
+    return success;
+#endif
+}
+
+bool file_delete(const wchar_t *filepath) {
+#ifdef _WIN32
+    return _wremove(filepath) == 0;
+#else
+    char *narrow = narrow_path(filepath);
+    const bool success = narrow != NULL && remove(narrow) == 0;
+    free(narrow);
+    return success;
+#endif
+}
+
+bool file_touch(const wchar_t *filepath) {
+#ifdef _WIN32
+    return _wutime(filepath, NULL) == 0;
+#else
+    char *narrow = narrow_path(filepath);
+    const bool success = narrow != NULL && utime(narrow, NULL) == 0;
+    free(narrow);
+    return success;
+#endif
+}
+
+bool directory_create(const wchar_t *path) {
+#ifdef _WIN32
+    return _wmkdir(path) == 0 || errno == EEXIST;
+#else
+    char *narrow = narrow_path(path);
+    const bool success = narrow != NULL && (mkdir(narrow, 0777) == 0 || errno == EEXIST);
+    free(narrow);
+    return success;
+#endif
+}
+
+bool directory_list(const wchar_t *path, Directory_Entry_Proc *entry_proc, void *user_data) {
+#ifdef _WIN32
+    const size_t pattern_length = wcslen(path) + 3;
+    wchar_t *pattern = (wchar_t *)malloc(pattern_length * sizeof(wchar_t));
+    if(pattern == NULL) {
+        fprintf(stderr, "Failed to allocate memory in directory_list.\n");
+        return false;
+    }
+    swprintf(pattern, pattern_length, L"%ls\\*", path);
+
+    WIN32_FIND_DATAW find_data;
+    HANDLE find = FindFirstFileW(pattern, &find_data);
+    free(pattern);
+
+    if(find == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    do {
+        if(find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            continue;
+        }
+
+        Directory_Entry entry = {
+            .name = find_data.cFileName,
+            .bytes = ((uint64_t)find_data.nFileSizeHigh << 32) | find_data.nFileSizeLow,
+            .modified_time = ((uint64_t)find_data.ftLastWriteTime.dwHighDateTime << 32) | find_data.ftLastWriteTime.dwLowDateTime
+        };
+        entry_proc(user_data, &entry);
+    } while(FindNextFileW(find, &find_data));
+
+    FindClose(find);
+    return true;
+#else
+    char *narrow = narrow_path(path);
+    DIR *dir = narrow != NULL ? opendir(narrow) : NULL;
+    if(dir == NULL) {
+        free(narrow);
+        return false;
+    }
+
+    for(struct dirent *dir_entry = readdir(dir); dir_entry != NULL; dir_entry = readdir(dir)) {
+        const size_t full_path_bytes = strlen(narrow) + strlen(dir_entry->d_name) + 2;
+        char *full_path = (char *)malloc(full_path_bytes);
+        if(full_path == NULL) {
+            continue;
+        }
+        snprintf(full_path, full_path_bytes, "%s/%s", narrow, dir_entry->d_name);
+
+        struct stat file_stat;
+        const bool is_file = stat(full_path, &file_stat) == 0 && S_ISREG(file_stat.st_mode);
+        free(full_path);
+
+        wchar_t *name = is_file ? convert_to_wcs_alloc(dir_entry->d_name, strlen(dir_entry->d_name), NULL) : NULL;
+        if(name == NULL) {
+            continue;
+        }
+
+        Directory_Entry entry = {
+            .name = name,
+            .bytes = (uint64_t)file_stat.st_size,
+            .modified_time = (uint64_t)file_stat.st_mtime
+        };
+        entry_proc(user_data, &entry);
+        free(name);
+    }
+
+    closedir(dir);
+    free(narrow);
+    return true;
+#endif
+}
+
+uint32_t get_process_id(void) {
+#ifdef _WIN32
+    return (uint32_t)GetCurrentProcessId();
+#else
+    return (uint32_t)getpid();
+#endif
+}
+
+void get_temp_file_path(char *buffer, size_t buffer_size, const char *file_name) {
+#ifdef _WIN32
+    wchar_t temp_directory[MAX_PATH + 1];
+    char *narrow_directory = NULL;
+    if(GetTempPathW(ARRAY_SIZE(temp_directory), temp_directory) != 0) {
+        narrow_directory = convert_to_mbs_alloc(temp_directory, wcslen(temp_directory), NULL);
+    }
+
+    // GetTempPathW ends with a separator
+    snprintf(buffer, buffer_size, "%s%s", narrow_directory != NULL ? narrow_directory : "", file_name);
+    free(narrow_directory);
+#else
+    snprintf(buffer, buffer_size, "/tmp/%s", file_name);
+#endif
+}
@@ -3,8 +3,65 @@
 
 #include "common.h"
 
+#include <stdio.h>
+
 /* out_chars -> @allocated; Includes null-terminator */
 /* out_length -> Number of characters not including null-terminator */
 bool file_read(const wchar_t *filepath, wchar_t **out_chars, size_t *out_length);
 
+/* Size of the file in bytes */
+bool file_get_size(const wchar_t *filepath, size_t *out_bytes);
+
+/* out_data -> @allocated; Raw bytes without any conversion */
+bool file_read_bytes(const wchar_t *filepath, void **out_data, size_t *out_bytes);
+
+typedef struct {
+    const void *data; // NULL for an empty file
+    size_t bytes;
+    void *handle;     // Mapping object on Windows
+} File_Mapping;
+
+/* Maps the whole file read-only, pages are loaded as they are touched */
+bool file_map(const wchar_t *filepath, File_Mapping *out_mapping);
+void file_unmap(File_Mapping *mapping);
+
+/* Writes whole buffer with a single write call; Replaces an existing file instead of truncating it, so its other hardlinks keep their contents */
+bool file_write(const wchar_t *filepath, const void *data, size_t bytes);
+
+/* Makes link_path a hardlink of existing_path, copies when the file system can't link; Replaces link_path */
+bool file_link_or_copy(const wchar_t *existing_path, const wchar_t *link_path);
+
+/* Atomic when both paths are on the same volume; Replaces to_path */
+bool file_rename(const wchar_t *from_path, const wchar_t *to_path);
+
+bool file_delete(const wchar_t *filepath);
+
+/* Sets modification time to now */
+bool file_touch(const wchar_t *filepath);
+
+/* Succeeds if the directory already exists */
+bool directory_create(const wchar_t *path);
+
+typedef struct {
+    const wchar_t *name; // Without the directory
+    uint64_t bytes;
+    uint64_t modified_time; // Only comparable with other modified_time values
+} Directory_Entry;
+
+typedef void Directory_Entry_Proc(void *user_data, const Directory_Entry *entry);
+
+/* Calls entry_proc for every regular file directly in the directory */
+bool directory_list(const wchar_t *path, Directory_Entry_Proc *entry_proc, void *user_data);
+
+uint32_t get_process_id(void);
+
+/* "<temporary directory>/<file_name>" in UTF-8 */
+void get_temp_file_path(char *buffer, size_t buffer_size, const char *file_name);
+
+/* Writes whole buffer to the stream's file descriptor in binary mode, flushing the stream first */
+bool stream_write(FILE *stream, const void *data, size_t bytes);
+
+/* Writes whole buffer to stdout in binary mode with a single write call */
+bool stdout_write(const void *data, size_t bytes);
+
 #endif /* _FILE_IO_H */
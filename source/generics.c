@@ -0,0 +1,115 @@
+#include "generics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+bool generic_instances_init(Generic_Instances *instances, AST_Root *ast_root) {
+    ZERO_STRUCT(*instances);
+
+    if(!procedure_table_init(&instances->procedures, 16)) {
+        return false;
+    }
+
+    // Redefinitions get reported by declare_procedure, the first one is as good as any here
+    for(size_t index = 0; index < ast_root->nodes_count; ++index) {
+        AST_Node *node = ast_root->nodes[index];
+        if(node->kind == ast_kind(AST_Procedure) && ((AST_Procedure *)node)->type_params_count > 0) {
+            procedure_table_add(&instances->procedures, (AST_Procedure *)node, 0, NULL);
+        }
+    }
+
+    instances->capacity = 64;
+    instances->entries = (Generic_Instance *)calloc(instances->capacity, sizeof(Generic_Instance));
+    if(instances->entries == NULL) {
+        fprintf(stderr, "Failed to allocate memory in generic_instances_init.\n");
+        procedure_table_free(&instances->procedures);
+        return false;
+    }
+
+    return true;
+}
+
+void generic_instances_free(Generic_Instances *instances) {
+    procedure_table_free(&instances->procedures);
+    free(instances->entries);
+
+    ZERO_STRUCT(*instances);
+}
+
+static uint64_t hash_key(AST_Procedure *procedure, const Type_Kind *type_args) {
+    uint64_t hash = 0xcbf29ce484222325ull ^ (uint64_t)(uintptr_t)procedure;
+    hash *= 0x100000001b3ull;
+
+    for(size_t index = 0; index < procedure->type_params_count; ++index) {
+        hash ^= type_args[index];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+static bool keys_equal(Generic_Instance *entry, AST_Procedure *procedure, const Type_Kind *type_args) {
+    return entry->procedure == procedure && memcmp(entry->type_args, type_args, sizeof(Type_Kind) * procedure->type_params_count) == 0;
+}
+
+static Generic_Instance *find_slot(Generic_Instance *entries, size_t capacity, AST_Procedure *procedure, const Type_Kind *type_args) {
+    size_t index = (size_t)hash_key(procedure, type_args) & (capacity - 1);
+    while(true) {
+        Generic_Instance *entry = &entries[index];
+        if(entry->procedure == NULL || keys_equal(entry, procedure, type_args)) {
+            return entry;
+        }
+        index = (index + 1) & (capacity - 1);
+    }
+}
+
+static bool grow(Generic_Instances *instances) {
+    const size_t new_capacity = instances->capacity * 2;
+    Generic_Instance *new_entries = (Generic_Instance *)calloc(new_capacity, sizeof(Generic_Instance));
+    if(new_entries == NULL) {
+        fprintf(stderr, "Failed to allocate memory in generic_instances_get.\n");
+        return false;
+    }
+
+    for(size_t index = 0; index < instances->capacity; ++index) {
+        Generic_Instance *entry = &instances->entries[index];
+        if(entry->procedure != NULL) {
+            *find_slot(new_entries, new_capacity, entry->procedure, entry->type_args) = *entry;
+        }
+    }
+
+    free(instances->entries);
+    instances->entries = new_entries;
+    instances->capacity = new_capacity;
+    return true;
+}
+
+Generic_Instance *generic_instances_get(Generic_Instances *instances, AST_Procedure *procedure, const Type_Kind *type_args) {
+    Generic_Instance *entry = find_slot(instances->entries, instances->capacity, procedure, type_args);
+    if(entry->procedure != NULL) {
+        return entry;
+    }
+
+    if((instances->count + 1) * 2 > instances->capacity) {
+        if(!grow(instances)) {
+            return NULL;
+        }
+        entry = find_slot(instances->entries, instances->capacity, procedure, type_args);
+    }
+
+    entry->procedure = procedure;
+    memcpy(entry->type_args, type_args, sizeof(Type_Kind) * procedure->type_params_count);
+    instances->count += 1;
+    return entry;
+}
+
+void generic_instance_name(char *buffer, size_t bytes, AST_Procedure *procedure, const Type_Kind *type_args) {
+    char *signature = convert_to_mbs_alloc(procedure->signature.data, procedure->signature.length, NULL);
+    int32_t length = snprintf(buffer, bytes, "%s", signature);
+    free(signature);
+
+    for(size_t index = 0; index < procedure->type_params_count && length > 0 && (size_t)length < bytes; ++index) {
+        wchar_t signature[TYPE_SIGNATURE_MAX];
+        length += snprintf(buffer + length, bytes - length, ".%ls", format_type_signature(signature, type_args[index]));
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef _GENERICS_H
+#define _GENERICS_H
+
+#include "common.h"
+#include "ast_defs.h"
+#include "procedure_table.h"
+
+#include <llvm-c/Core.h>
+
+/*
+ * Generic procedures, "name :: [T, U](a : T, b : U) -> T"
+ * A generic procedure has no code of its own, every call goes to an instance emitted for its type arguments,
+ * given explicitly as "name[rzeczywista64](...)" or inferred from the arguments.
+ * Instances are kept per (procedure, type arguments) so each one is emitted once per module.
+ */
+
+typedef struct {
+    AST_Procedure *procedure; // NULL if the slot is empty
+    Type_Kind type_args[AST_PROCEDURE_TYPE_PARAMS_MAX];
+    LLVMValueRef instance;    // NULL until emitted
+} Generic_Instance;
+
+typedef struct {
+    Procedure_Table procedures; // Generic procedures defined in the module
+
+    Generic_Instance *entries;
+    size_t capacity; // Power of two
+    size_t count;
+} Generic_Instances;
+
+bool generic_instances_init(Generic_Instances *instances, AST_Root *ast_root);
+void generic_instances_free(Generic_Instances *instances);
+
+/* Entry for the procedure and type arguments, added with a NULL instance the first time; NULL if out of memory */
+Generic_Instance *generic_instances_get(Generic_Instances *instances, AST_Procedure *procedure, const Type_Kind *type_args);
+
+/* "<signature>.<type>.<type>", the symbol name of an instance */
+void generic_instance_name(char *buffer, size_t bytes, AST_Procedure *procedure, const Type_Kind *type_args);
+
+#endif /* _GENERICS_H */
@@ -0,0 +1,296 @@
+#include "interface_file.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+bool is_interface_path(const char *path) {
+    const char *extension = strrchr(path, '.');
+    return extension != NULL && strcmp(extension + 1, INTERFACE_FILE_EXTENSION) == 0;
+}
+
+char *interface_path_for_output(const char *output_path) {
+    const char *name = output_path;
+    for(const char *at = output_path; *at; ++at) {
+        if(*at == '/' || *at == '\\') {
+            name = at + 1;
+        }
+    }
+
+    size_t stem_length = strlen(output_path);
+    const char *extension = strrchr(name, '.');
+    if(extension != NULL && extension != name) {
+        stem_length = extension - output_path;
+    }
+
+    const size_t bytes = stem_length + strlen(INTERFACE_FILE_EXTENSION) + 2;
+    char *path = (char *)malloc(bytes);
+    if(path == NULL) {
+        report_error(L"Failed to allocate memory in interface_path_for_output.");
+        return NULL;
+    }
+
+    snprintf(path, bytes, "%.*s.%s", (int32_t)stem_length, output_path, INTERFACE_FILE_EXTENSION);
+    return path;
+}
+
+// Simple types and vectors of them, the ones interface files hold
+static bool is_interface_type(uint32_t kind) {
+    const Type_Kind element = get_element_type((Type_Kind)kind);
+    return kind < TYPE_KINDS_MAX && element < TYPE_CUSTOM && (element != TYPE_VOID || kind == TYPE_VOID);
+}
+
+// Generic procedures need their body for every instance, there is nothing to call through a signature
+static bool is_exported_procedure(AST_Node *node) {
+    return node->kind == ast_kind(AST_Procedure) && (node->flags & AST_FLAG_EXPORTED) && ((AST_Procedure *)node)->type_params_count == 0;
+}
+
+bool interface_file_write(const char *path, AST_Root *ast_root) {
+    Interface_Header header = {
+        .magic = INTERFACE_FILE_MAGIC,
+        .version = INTERFACE_FILE_VERSION,
+        .char_bytes = sizeof(wchar_t),
+    };
+
+    size_t char_count = 0;
+    for(size_t index = 0; index < ast_root->nodes_count; ++index) {
+        if(!is_exported_procedure(ast_root->nodes[index])) {
+            continue;
+        }
+
+        AST_Procedure *ast_proc = (AST_Procedure *)ast_root->nodes[index];
+        if(!is_interface_type(ast_proc->return_type->kind)) {
+            report_error(L"Interface files can't hold the return type of %.*ls", ast_proc->signature.length, ast_proc->signature.data);
+            return false;
+        }
+
+        header.procedure_count += 1;
+        header.param_count += (uint32_t)ast_proc->params_count;
+        char_count += ast_proc->signature.length;
+        for(size_t param_index = 0; param_index < ast_proc->params_count; ++param_index) {
+            AST_Parameter *ast_param = ast_proc->params[param_index];
+            if(!is_interface_type(ast_param->data_type->kind)) {
+                report_error(L"Interface files can't hold the type of parameter %.*ls of %.*ls", ast_param->identifier.length, ast_param->identifier.data, ast_proc->signature.length, ast_proc->signature.data);
+                return false;
+            }
+            char_count += ast_param->identifier.length;
+        }
+    }
+    header.char_count = (uint32_t)char_count;
+
+    const size_t bytes = sizeof(Interface_Header) + header.procedure_count * sizeof(Interface_Procedure) +
+                         header.param_count * sizeof(Interface_Param) + char_count * sizeof(wchar_t);
+    uint8_t *data = (uint8_t *)calloc(1, bytes);
+    if(data == NULL) {
+        report_error(L"Failed to allocate memory in interface_file_write.");
+        return false;
+    }
+
+    Interface_Procedure *procedures = (Interface_Procedure *)(data + sizeof(Interface_Header));
+    Interface_Param *params = (Interface_Param *)(procedures + header.procedure_count);
+    wchar_t *chars = (wchar_t *)(params + header.param_count);
+    memcpy(data, &header, sizeof(header));
+
+    uint32_t procedure_at = 0;
+    uint32_t param_at = 0;
+    uint32_t char_at = 0;
+    for(size_t index = 0; index < ast_root->nodes_count; ++index) {
+        if(!is_exported_procedure(ast_root->nodes[index])) {
+            continue;
+        }
+
+        AST_Procedure *ast_proc = (AST_Procedure *)ast_root->nodes[index];
+        procedures[procedure_at++] = (Interface_Procedure) {
+            .name_offset = char_at,
+            .name_length = (uint32_t)ast_proc->signature.length,
+            .first_param = param_at,
+            .param_count = (uint8_t)ast_proc->params_count,
+            .return_kind = ast_proc->return_type->kind,
+        };
+        memcpy(chars + char_at, ast_proc->signature.data, ast_proc->signature.length * sizeof(wchar_t));
+        char_at += (uint32_t)ast_proc->signature.length;
+
+        for(size_t param_index = 0; param_index < ast_proc->params_count; ++param_index) {
+            AST_Parameter *ast_param = ast_proc->params[param_index];
+            params[param_at++] = (Interface_Param) {
+                .name_offset = char_at,
+                .name_length = (uint32_t)ast_param->identifier.length,
+                .kind = ast_param->data_type->kind,
+            };
+            memcpy(chars + char_at, ast_param->identifier.data, ast_param->identifier.length * sizeof(wchar_t));
+            char_at += (uint32_t)ast_param->identifier.length;
+        }
+    }
+
+    wchar_t *wide_path = convert_to_wcs_alloc(path, strlen(path), NULL);
+    const bool success = wide_path != NULL && file_write(wide_path, data, bytes);
+    free(wide_path);
+    free(data);
+
+    if(!success) {
+        report_error(L"Failed to write interface file: %hs", path);
+    }
+    return success;
+}
+
+static bool view_in_range(uint32_t offset, uint32_t length, uint32_t count) {
+    return offset <= count && length <= count - offset;
+}
+
+// Checks every offset and kind before anything points into the mapping
+static bool load_file(Interface_File *file, const char *path) {
+    ZERO_STRUCT(*file);
+    file->path = path;
+
+    wchar_t *wide_path = convert_to_wcs_alloc(path, strlen(path), NULL);
+    const bool mapped = wide_path != NULL && file_map(wide_path, &file->mapping);
+    free(wide_path);
+
+    if(!mapped) {
+        report_error(L"Failed to read interface file: %hs", path);
+        return false;
+    }
+
+    const uint8_t *data = (const uint8_t *)file->mapping.data;
+    const Interface_Header *header = (const Interface_Header *)data;
+
+    if(file->mapping.bytes < sizeof(Interface_Header) || header->magic != INTERFACE_FILE_MAGIC) {
+        report_error(L"Not an interface file: %hs", path);
+        return false;
+    }
+
+    if(header->version != INTERFACE_FILE_VERSION || header->char_bytes != sizeof(wchar_t)) {
+        report_error(L"Interface file written by an incompatible compiler: %hs", path);
+        return false;
+    }
+
+    const uint64_t expected_bytes = sizeof(Interface_Header) + (uint64_t)header->procedure_count * sizeof(Interface_Procedure) +
+                                    (uint64_t)header->param_count * sizeof(Interface_Param) + (uint64_t)header->char_count * sizeof(wchar_t);
+    if(expected_bytes != file->mapping.bytes) {
+        report_error(L"Interface file is damaged: %hs", path);
+        return false;
+    }
+
+    const Interface_Procedure *procedures = (const Interface_Procedure *)(data + sizeof(Interface_Header));
+    const Interface_Param *params = (const Interface_Param *)(procedures + header->procedure_count);
+    const wchar_t *chars = (const wchar_t *)(params + header->param_count);
+
+    file->procedures = (AST_Procedure *)calloc(MAX(header->procedure_count, 1), sizeof(AST_Procedure));
+    file->params = (AST_Parameter *)calloc(MAX(header->param_count, 1), sizeof(AST_Parameter));
+    if(file->procedures == NULL || file->params == NULL) {
+        report_error(L"Failed to allocate memory in load_file.");
+        return false;
+    }
+
+    for(size_t kind = 0; kind < ARRAY_SIZE(file->types); ++kind) {
+        if(is_interface_type(kind)) {
+            file->types[kind].node.kind = ast_kind(AST_Type_Def);
+            file->types[kind].kind = (Type_Kind)kind;
+            file->types[kind].signature = str_view_wcstr(simple_type_signatures[get_element_type((Type_Kind)kind)]);
+        }
+    }
+
+    for(uint32_t index = 0; index < header->param_count; ++index) {
+        const Interface_Param *param = &params[index];
+        if(!view_in_range(param->name_offset, param->name_length, header->char_count) || param->kind == TYPE_VOID || !is_interface_type(param->kind)) {
+            report_error(L"Interface file is damaged: %hs", path);
+            return false;
+        }
+
+        AST_Parameter *ast_param = &file->params[index];
+        ast_param->node.kind = ast_kind(AST_Parameter);
+        ast_param->identifier = str_view(chars + param->name_offset, param->name_length);
+        ast_param->data_type = &file->types[param->kind];
+    }
+
+    for(uint32_t index = 0; index < header->procedure_count; ++index) {
+        const Interface_Procedure *procedure = &procedures[index];
+        if(!view_in_range(procedure->name_offset, procedure->name_length, header->char_count) || procedure->name_length == 0 ||
+           !view_in_range(procedure->first_param, procedure->param_count, header->param_count) ||
+           procedure->param_count > AST_PROCEDURE_PARAMS_MAX || !is_interface_type(procedure->return_kind)) {
+            report_error(L"Interface file is damaged: %hs", path);
+            return false;
+        }
+
+        // Never converted, only declared by the files calling it
+        AST_Procedure *ast_proc = &file->procedures[index];
+        ast_proc->node.kind = ast_kind(AST_Procedure);
+        ast_proc->node.flags = AST_FLAG_EXPORTED;
+        ast_proc->signature = str_view(chars + procedure->name_offset, procedure->name_length);
+        ast_proc->return_type = &file->types[procedure->return_kind];
+        ast_proc->params_count = procedure->param_count;
+        for(size_t param_index = 0; param_index < procedure->param_count; ++param_index) {
+            ast_proc->params[param_index] = &file->params[procedure->first_param + param_index];
+        }
+    }
+
+    file->procedure_count = header->procedure_count;
+    return true;
+}
+
+static void free_file(Interface_File *file) {
+    free(file->procedures);
+    free(file->params);
+    file_unmap(&file->mapping);
+}
+
+bool interface_set_load(Interface_Set *set, const char **paths, size_t path_count) {
+    ZERO_STRUCT(*set);
+
+    set->files = (Interface_File *)calloc(MAX(path_count, 1), sizeof(Interface_File));
+    if(set->files == NULL) {
+        report_error(L"Failed to allocate memory in interface_set_load.");
+        return false;
+    }
+
+    size_t procedure_count = 0;
+    for(size_t index = 0; index < path_count; ++index) {
+        set->file_count += 1;
+        if(!load_file(&set->files[index], paths[index])) {
+            interface_set_free(set);
+            return false;
+        }
+        procedure_count += set->files[index].procedure_count;
+    }
+
+    if(!procedure_table_init(&set->procedures, procedure_count)) {
+        interface_set_free(set);
+        return false;
+    }
+
+    bool success = true;
+    for(size_t file_index = 0; file_index < set->file_count; ++file_index) {
+        Interface_File *file = &set->files[file_index];
+
+        for(size_t index = 0; index < file->procedure_count; ++index) {
+            AST_Procedure *ast_proc = &file->procedures[index];
+
+            Procedure_Table_Entry existing = { };
+            if(!procedure_table_add(&set->procedures, ast_proc, (uint32_t)file_index, &existing)) {
+                if(existing.procedure == NULL) {
+                    interface_set_free(set);
+                    return false;
+                }
+
+                report_error(L"Procedure %.*ls exported from both %hs and %hs",
+                             ast_proc->signature.length, ast_proc->signature.data, set->files[existing.owner].path, file->path);
+                success = false;
+            }
+        }
+    }
+
+    if(!success) {
+        interface_set_free(set);
+    }
+    return success;
+}
+
+void interface_set_free(Interface_Set *set) {
+    for(size_t index = 0; index < set->file_count; ++index) {
+        free_file(&set->files[index]);
+    }
+
+    procedure_table_free(&set->procedures);
+    free(set->files);
+
+    ZERO_STRUCT(*set);
+}
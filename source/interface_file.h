@@ -0,0 +1,79 @@
+#ifndef _INTERFACE_FILE_H
+#define _INTERFACE_FILE_H
+
+#include "common.h"
+#include "ast_defs.h"
+#include "file_io.h"
+#include "procedure_table.h"
+
+/*
+ * Interface files, .polangi
+ * Exported procedure signatures of a source file, so other files can call into it without lexing and parsing it.
+ * The file is mapped and read in place: a header, fixed-size procedure and parameter records and the identifiers
+ * as wchar_t, every part aligned for its type. Loading checks the header, then every record's offsets, lengths
+ * and type kinds against the file, and fills in AST nodes whose identifiers point into the mapping.
+ * Written with --emit-interface next to the output, given on the command line like a source file.
+ */
+
+#define INTERFACE_FILE_EXTENSION "polangi"
+#define INTERFACE_FILE_MAGIC     0x49474c50 // "PLGI"
+#define INTERFACE_FILE_VERSION   1
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t char_bytes; // sizeof(wchar_t) of the writer, identifiers are stored as they are in memory
+    uint32_t procedure_count;
+    uint32_t param_count;
+    uint32_t char_count;
+    uint32_t reserved;
+} Interface_Header;
+
+typedef struct {
+    uint32_t name_offset; // In characters
+    uint32_t name_length;
+    uint32_t first_param;
+    uint8_t  param_count;
+    uint8_t  return_kind; // Type_Kind
+    uint16_t reserved;
+} Interface_Procedure;
+
+typedef struct {
+    uint32_t name_offset;
+    uint32_t name_length;
+    uint8_t  kind; // Type_Kind
+    uint8_t  reserved[3];
+} Interface_Param;
+
+typedef struct {
+    const char *path;
+    File_Mapping mapping;
+
+    // Nodes of the exported procedures, identifiers point into the mapping
+    AST_Procedure *procedures;
+    AST_Parameter *params;
+    size_t procedure_count;
+    AST_Type_Def types[TYPE_KINDS_MAX]; // Simple and vector ones
+} Interface_File;
+
+typedef struct {
+    Interface_File *files;
+    size_t file_count;
+
+    Procedure_Table procedures; // Owner is the index in files
+} Interface_Set;
+
+/* Writes exported procedures of the AST; Fails on types interfaces can't hold yet */
+bool interface_file_write(const char *path, AST_Root *ast_root);
+
+/* Loads every file and fails if two of them export the same procedure */
+bool interface_set_load(Interface_Set *set, const char **paths, size_t path_count);
+void interface_set_free(Interface_Set *set);
+
+/* Output path with the extension changed to INTERFACE_FILE_EXTENSION; @allocated */
+char *interface_path_for_output(const char *output_path);
+
+/* True for paths ending in .polangi */
+bool is_interface_path(const char *path);
+
+#endif /* _INTERFACE_FILE_H */
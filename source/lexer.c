@@ -1,4 +1,6 @@
 #include "lexer.h"
+#include "timing.h"
+#include "threads.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -34,8 +36,51 @@ static inline bool continues_identifier(wchar_t _char) {
     return starts_identifier(_char) || iswdigit(_char);
 }
 
+static void lexer_grow_tokens(Lexer *lexer) {
+    const size_t new_capacity = MAX(lexer->token_capacity * 2, 4096);
+    Token *new_tokens = (Token *)realloc(lexer->tokens, new_capacity * sizeof(Token));
+    if(new_tokens == NULL) {
+        report_error(L"Failed to allocate memory for tokens.");
+        fatal_error();
+    }
+    lexer->tokens = new_tokens;
+    lexer->token_capacity = new_capacity;
+}
+
+static Token_Chunk *lexer_new_chunk(void) {
+    Token_Chunk *chunk = (Token_Chunk *)malloc(sizeof(Token_Chunk));
+    if(chunk == NULL) {
+        report_error(L"Failed to allocate memory for tokens.");
+        fatal_error();
+    }
+    chunk->count = 0;
+    chunk->last = false;
+    chunk->aborted = false;
+    return chunk;
+}
+
+static void lexer_push_token_to_queue(Lexer *lexer, Token *token) {
+    if(lexer->chunk == NULL) {
+        lexer->chunk = lexer_new_chunk();
+    } else if(lexer->chunk->count == TOKEN_CHUNK_SIZE) {
+        spsc_queue_push(lexer->token_queue, lexer->chunk);
+        lexer->chunk = NULL; // Belongs to the consumer now, even if allocating the next one fails
+        lexer->chunk = lexer_new_chunk();
+    }
+    lexer->chunk->tokens[lexer->chunk->count++] = *token;
+}
+
 static inline void lexer_push_token(Lexer *lexer, Token *token) {
     token->line = lexer->current_line; // @TODO:
+
+    if(lexer->token_queue != NULL) {
+        lexer_push_token_to_queue(lexer, token);
+        return;
+    }
+
+    if(lexer->token_count == lexer->token_capacity) {
+        lexer_grow_tokens(lexer);
+    }
     lexer->tokens[lexer->token_count++] = *token;
 }
 
@@ -74,12 +119,48 @@ static void lexer_read_identifier(Lexer *lexer) {
             lexer_push_token_no_data(lexer, TOKEN_KEYWORD_RETURN);
         } else if(str_view_compare_to_string(ident_view, L"nic")) {
             lexer_push_token_no_data(lexer, TOKEN_KEYWORD_VOID);
+        } else if(str_view_compare_to_string(ident_view, L"eksport")) {
+            lexer_push_token_no_data(lexer, TOKEN_KEYWORD_EXPORT);
         } else if(str_view_compare_to_string(ident_view, L"całkowita64")) {
             lexer_push_token_no_data(lexer, TOKEN_KEYWORD_INT64);
         } else if(str_view_compare_to_string(ident_view, L"nieujemna64")) {
             lexer_push_token_no_data(lexer, TOKEN_KEYWORD_UINT64);
         } else if(str_view_compare_to_string(ident_view, L"rzeczywista64")) {
             lexer_push_token_no_data(lexer, TOKEN_KEYWORD_FLOAT64);
+        } else if(str_view_compare_to_string(ident_view, L"całkowita32")) {
+            lexer_push_token_no_data(lexer, TOKEN_KEYWORD_INT32);
+        } else if(str_view_compare_to_string(ident_view, L"nieujemna32")) {
+            lexer_push_token_no_data(lexer, TOKEN_KEYWORD_UINT32);
+        } else if(str_view_compare_to_string(ident_view, L"całkowita16")) {
+            lexer_push_token_no_data(lexer, TOKEN_KEYWORD_INT16);
+        } else if(str_view_compare_to_string(ident_view, L"całkowita8")) {
+            lexer_push_token_no_data(lexer, TOKEN_KEYWORD_INT8);
+        } else if(str_view_compare_to_string(ident_view, L"rzeczywista32")) {
+            lexer_push_token_no_data(lexer, TOKEN_KEYWORD_FLOAT32);
+        } else if(str_view_compare_to_string(ident_view, L"wektor2")) {
+            lexer_push_token_no_data(lexer, TOKEN_KEYWORD_VECTOR2);
+        } else if(str_view_compare_to_string(ident_view, L"wektor4")) {
+            lexer_push_token_no_data(lexer, TOKEN_KEYWORD_VECTOR4);
+        } else if(str_view_compare_to_string(ident_view, L"wektor8")) {
+            lexer_push_token_no_data(lexer, TOKEN_KEYWORD_VECTOR8);
+        } else if(str_view_compare_to_string(ident_view, L"wektor16")) {
+            lexer_push_token_no_data(lexer, TOKEN_KEYWORD_VECTOR16);
+        } else if(str_view_compare_to_string(ident_view, L"suma")) {
+            lexer_push_token_no_data(lexer, TOKEN_KEYWORD_SUM);
+        } else if(str_view_compare_to_string(ident_view, L"iloczyn")) {
+            lexer_push_token_no_data(lexer, TOKEN_KEYWORD_PRODUCT);
+        } else if(str_view_compare_to_string(ident_view, L"minimum")) {
+            lexer_push_token_no_data(lexer, TOKEN_KEYWORD_MIN);
+        } else if(str_view_compare_to_string(ident_view, L"maksimum")) {
+            lexer_push_token_no_data(lexer, TOKEN_KEYWORD_MAX);
+        } else if(str_view_compare_to_string(ident_view, L"dopóki")) {
+            lexer_push_token_no_data(lexer, TOKEN_KEYWORD_WHILE);
+        } else if(str_view_compare_to_string(ident_view, L"dla")) {
+            lexer_push_token_no_data(lexer, TOKEN_KEYWORD_FOR);
+        } else if(str_view_compare_to_string(ident_view, L"do")) {
+            lexer_push_token_no_data(lexer, TOKEN_KEYWORD_TO);
+        } else if(str_view_compare_to_string(ident_view, L"struktura")) {
+            lexer_push_token_no_data(lexer, TOKEN_KEYWORD_STRUCT);
         } else {
             // Identifier
             Token token = { };
@@ -130,8 +211,8 @@ static void lexer_read_number(Lexer *lexer) {
 
         if(_char == L'.') {
             if(dot_encountered) {
-                // @TODO , @ERROR
-                assert(0 && "Encountered second '.' while reading number...");
+                report_error(L"On line: %llu\nSecond '.' in a number", lexer->current_line);
+                fatal_error();
             } else {
                 dot_encountered = true;
             }
@@ -140,8 +221,8 @@ static void lexer_read_number(Lexer *lexer) {
         number_buffer[number_length++] = _char;
 
         if(number_length >= (ARRAY_SIZE(number_buffer) - 1)) {
-            // @TODO , @ERROR
-            assert(0 && "Too long number; Number should never get that big!");
+            report_error(L"On line: %llu\nNumber too long", lexer->current_line);
+            fatal_error();
         }
     }
 
@@ -187,12 +268,8 @@ static void lexer_consume_until_next_line(Lexer *lexer) {
     }
 }
 
-static void lexer_tokenize(Lexer *lexer) {
-    lexer->current_line = 1;
-    // lexer->current_char = 1;
-    lexer->token_count  = 0;
-    lexer->token_cursor = 0;
- 
+// Tokens of the rest of file_view, without the final EOF
+static void lexer_scan(Lexer *lexer) {
     lexer_consume_whitespaces(lexer);
 
     while(lexer->file_view.length) {
@@ -250,9 +327,30 @@ static void lexer_tokenize(Lexer *lexer) {
         } else if(_char == L'}') {
             lexer_push_token_no_data(lexer, TOKEN_BRACE_CLOSE);
             lexer_consume_char(lexer);
+        } else if(_char == L'[') {
+            lexer_push_token_no_data(lexer, TOKEN_BRACKET_OPEN);
+            lexer_consume_char(lexer);
+        } else if(_char == L']') {
+            lexer_push_token_no_data(lexer, TOKEN_BRACKET_CLOSE);
+            lexer_consume_char(lexer);
         } else if(_char == L',') {
             lexer_push_token_no_data(lexer, TOKEN_COMMA);
             lexer_consume_char(lexer);
+        } else if(_char == L'<' || _char == L'>') {
+            const bool or_equal = lexer_peek_char_next(lexer, 1) == L'=';
+            if(_char == L'<') {
+                lexer_push_token_no_data(lexer, or_equal ? TOKEN_LESS_EQUAL : TOKEN_LESS);
+            } else {
+                lexer_push_token_no_data(lexer, or_equal ? TOKEN_GREATER_EQUAL : TOKEN_GREATER);
+            }
+            if(or_equal) {
+                lexer_consume_char(lexer);
+            }
+            lexer_consume_char(lexer);
+        } else if(_char == L'!' && lexer_peek_char_next(lexer, 1) == L'=') {
+            lexer_push_token_no_data(lexer, TOKEN_NOT_EQUAL);
+            lexer_consume_char(lexer);
+            lexer_consume_char(lexer);
         } else if(_char == L'+') {
             lexer_push_token_no_data(lexer, TOKEN_PLUS);
             lexer_consume_char(lexer);
@@ -260,7 +358,12 @@ static void lexer_tokenize(Lexer *lexer) {
             lexer_push_token_no_data(lexer, TOKEN_STAR);
             lexer_consume_char(lexer);
         } else if(_char == L'=') {
-            lexer_push_token_no_data(lexer, TOKEN_EQUAL);
+            if(lexer_peek_char_next(lexer, 1) == L'=') {
+                lexer_push_token_no_data(lexer, TOKEN_EQUAL_DOUBLE);
+                lexer_consume_char(lexer);
+            } else {
+                lexer_push_token_no_data(lexer, TOKEN_EQUAL);
+            }
             lexer_consume_char(lexer);
         } else if(_char == L'/') {
             if(lexer_peek_char_next(lexer, 1) == L'/') {
@@ -274,16 +377,133 @@ static void lexer_tokenize(Lexer *lexer) {
             lexer_push_token_no_data(lexer, TOKEN_SLASH_BACKWARD);
             lexer_consume_char(lexer);
         } else {
-            // No token recognized, skip the char?
-            assert(0 && "Unrecognized character encountered in lexer_tokenize");
-            lexer_consume_char(lexer);
+            report_error(L"On line: %llu\nUnrecognized character '%lc'", lexer->current_line, (wint_t)_char);
+            fatal_error();
         }
     }
+}
+
+static void lexer_tokenize(Lexer *lexer) {
+    lexer->current_line = 1;
+    // lexer->current_char = 1;
+    lexer->token_count  = 0;
+    lexer->token_cursor = 0;
+
+    lexer_scan(lexer);
 
     // Push EOF token at the end
     lexer_push_token_no_data(lexer, TOKEN_EOF);
 }
 
+typedef struct {
+    Lexer lexer; // Own token storage, file_view covers the range only
+    Thread thread;
+    bool started;
+    bool failed;
+} Lexer_Range;
+
+// Errors are reported again by the sequential fallback, with the right line numbers
+static void discard_diagnostic(void *user_data, const wchar_t *message) {
+    (void)user_data;
+    (void)message;
+}
+
+static void lexer_range_thread(void *user_data) {
+    Lexer_Range *range = (Lexer_Range *)user_data;
+    diagnostic_handler_set((Diagnostic_Handler) { .proc = discard_diagnostic });
+
+    jmp_buf recovery;
+    error_recovery_set(&recovery);
+
+    if(setjmp(recovery) == 0) {
+        range->lexer.current_line = 1;
+        lexer_scan(&range->lexer);
+    } else {
+        range->failed = true;
+    }
+
+    error_recovery_set(NULL);
+}
+
+// False if the file is too small to split or any range failed to lex; lexer_tokenize then does it all again
+static bool lexer_tokenize_parallel(Lexer *lexer) {
+    const size_t range_count = MIN(MIN(get_processor_count(), LEXER_PARALLEL_RANGES_MAX), lexer->file_length / LEXER_PARALLEL_RANGE_MIN_CHARS);
+    if(range_count < 2) {
+        return false;
+    }
+
+    Lexer_Range *ranges = (Lexer_Range *)calloc(range_count, sizeof(Lexer_Range));
+    if(ranges == NULL) {
+        return false;
+    }
+
+    // Ranges start right after a newline; Nothing spans lines, '//' comments end at the newline, so no token or comment gets cut
+    const wchar_t *file_data = lexer->file_data;
+    size_t range_start = 0;
+    for(size_t index = 0; index < range_count; ++index) {
+        size_t range_end = lexer->file_length;
+        if(index + 1 < range_count) {
+            range_end = MAX(range_start, lexer->file_length / range_count * (index + 1));
+            while(range_end < lexer->file_length && file_data[range_end] != L'\n') {
+                range_end += 1;
+            }
+            range_end = MIN(range_end + 1, lexer->file_length);
+        }
+
+        ranges[index].lexer.file_view = str_view((wchar_t *)file_data + range_start, range_end - range_start);
+        range_start = range_end;
+    }
+
+    bool success = true;
+    for(size_t index = 0; index < range_count; ++index) {
+        ranges[index].started = thread_create(&ranges[index].thread, lexer_range_thread, &ranges[index]);
+        success = success && ranges[index].started;
+    }
+
+    size_t token_count = 0;
+    for(size_t index = 0; index < range_count; ++index) {
+        if(ranges[index].started) {
+            thread_join(&ranges[index].thread);
+        }
+        success = success && !ranges[index].failed;
+        token_count += ranges[index].lexer.token_count;
+    }
+
+    if(success) {
+        lexer->token_count = 0;
+        lexer->token_cursor = 0;
+        while(lexer->token_capacity < token_count + 1) {
+            lexer_grow_tokens(lexer);
+        }
+
+        // Each range counted lines from 1
+        size_t line_offset = 0;
+        for(size_t index = 0; index < range_count; ++index) {
+            Lexer *range = &ranges[index].lexer;
+            Token *tokens = lexer->tokens + lexer->token_count;
+            memcpy(tokens, range->tokens, range->token_count * sizeof(Token));
+
+            for(size_t token_index = 0; token_index < range->token_count; ++token_index) {
+                tokens[token_index].line += line_offset;
+            }
+
+            lexer->token_count += range->token_count;
+            line_offset += range->current_line - 1;
+        }
+
+        lexer->current_line = line_offset + 1;
+        lexer->file_view = str_view(lexer->file_data + lexer->file_length, 0);
+        lexer_push_token_no_data(lexer, TOKEN_EOF);
+    }
+
+    for(size_t index = 0; index < range_count; ++index) {
+        free(ranges[index].lexer.tokens);
+    }
+    free(ranges);
+
+    return success;
+}
+
 static inline void lexer_set_file_data(Lexer *lexer, wchar_t *file_data, size_t file_length) {
     lexer->file_data = file_data;
     lexer->file_length = file_length;
@@ -292,22 +512,180 @@ static inline void lexer_set_file_data(Lexer *lexer, wchar_t *file_data, size_t
 
 bool lexer_init_from_file(Lexer *lexer, wchar_t *filepath) {
     ZERO_STRUCT(*lexer);
+    return lexer_load_file(lexer, filepath);
+}
+
+// Takes ownership of file_data
+static void lexer_load_data(Lexer *lexer, wchar_t *file_data, size_t file_length) {
+    lexer_set_file_data(lexer, file_data, file_length);
+
+    Timing_Section timing;
+    timing_begin(&timing, TIMING_TOKENIZE);
+    if(lexer->file_length < LEXER_PARALLEL_MIN_CHARS || !lexer_tokenize_parallel(lexer)) {
+        lexer_set_file_data(lexer, file_data, file_length);
+        lexer_tokenize(lexer);
+    }
+    timing_end(&timing);
+}
+
+static void lexer_clear(Lexer *lexer) {
+    free(lexer->file_data);
+    lexer_set_file_data(lexer, NULL, 0);
+    lexer->token_count = 0;
+    lexer->token_cursor = 0;
+}
+
+bool lexer_read_file(Lexer *lexer, wchar_t *filepath) {
+    lexer_clear(lexer);
 
     wchar_t *file_data = NULL;
     size_t   file_length = 0;
     if(!file_read(filepath, &file_data, &file_length)) {
-        fwprintf(stderr, L"Failed to read file while initializing lexer.\n");
+        report_error(L"Failed to read file while initializing lexer.");
         return false;
     }
 
     lexer_set_file_data(lexer, file_data, file_length);
+    return true;
+}
+
+bool lexer_load_file(Lexer *lexer, wchar_t *filepath) {
+    if(!lexer_read_file(lexer, filepath)) {
+        return false;
+    }
+
+    lexer_load_data(lexer, lexer->file_data, lexer->file_length);
+    return true;
+}
+
+// Hands the chunk being filled to the consumer as the last one
+static void lexer_push_last_chunk(Lexer *lexer, bool aborted) {
+    if(lexer->chunk == NULL) {
+        lexer->chunk = lexer_new_chunk();
+    }
+
+    lexer->chunk->last = true;
+    lexer->chunk->aborted = aborted;
+    spsc_queue_push(lexer->token_queue, lexer->chunk);
+
+    lexer->chunk = NULL;
+    lexer->token_queue = NULL;
+}
+
+void lexer_tokenize_to_queue(Lexer *lexer, SPSC_Queue *queue) {
+    lexer->token_queue = queue;
+    lexer->chunk = NULL;
+
+    Timing_Section timing;
+    timing_begin(&timing, TIMING_TOKENIZE);
     lexer_tokenize(lexer);
+    timing_end(&timing);
+
+    lexer_push_last_chunk(lexer, false);
+}
 
+void lexer_abort_stream(Lexer *lexer) {
+    if(lexer->token_queue != NULL) {
+        lexer_push_last_chunk(lexer, true);
+    }
+}
+
+void lexer_init_from_queue(Lexer *lexer, const Lexer *producer, SPSC_Queue *queue) {
+    ZERO_STRUCT(*lexer);
+
+    // For error messages, the tokens come from the queue
+    lexer_set_file_data(lexer, producer->file_data, producer->file_length);
+    lexer->token_queue = queue;
+}
+
+void lexer_drain_stream(Lexer *lexer) {
+    bool ended = (lexer->chunk != NULL && lexer->chunk->last) || (lexer->next_chunk != NULL && lexer->next_chunk->last);
+    free(lexer->chunk);
+    free(lexer->next_chunk);
+
+    // The producer blocks on a full queue until everything is popped
+    while(!ended) {
+        Token_Chunk *chunk = (Token_Chunk *)spsc_queue_pop(lexer->token_queue);
+        ended = chunk->last;
+        free(chunk);
+    }
+
+    ZERO_STRUCT(*lexer);
+}
+
+// Token at the cursor plus offset of a consuming lexer, waits for the producer when it isn't there yet
+static Token lexer_stream_token(Lexer *lexer, size_t offset) {
+    if(lexer->chunk == NULL) {
+        lexer->chunk = (Token_Chunk *)spsc_queue_pop(lexer->token_queue);
+    }
+
+    Token_Chunk *chunk = lexer->chunk;
+    size_t index = lexer->token_cursor + offset;
+
+    if(index >= chunk->count && !chunk->last) {
+        if(lexer->next_chunk == NULL) {
+            lexer->next_chunk = (Token_Chunk *)spsc_queue_pop(lexer->token_queue);
+        }
+
+        index -= chunk->count;
+        chunk = lexer->next_chunk;
+        assert((index < chunk->count || chunk->last) && "Peeking further than a token chunk");
+    }
+
+    if(index >= chunk->count) {
+        // The producer already reported why it stopped, parsing the cut off stream would only add bogus errors
+        if(chunk->aborted) {
+            fatal_error();
+        }
+        return chunk->tokens[chunk->count - 1];
+    }
+
+    return chunk->tokens[index];
+}
+
+// The final EOF token is never consumed, same as with the tokens array
+static Token lexer_stream_next_token(Lexer *lexer) {
+    Token token = lexer_stream_token(lexer, 0);
+    if(token.kind == TOKEN_EOF) {
+        return token;
+    }
+
+    lexer->token_cursor += 1;
+
+    if(lexer->token_cursor == lexer->chunk->count) {
+        free(lexer->chunk);
+        lexer->chunk = lexer->next_chunk != NULL ? lexer->next_chunk : (Token_Chunk *)spsc_queue_pop(lexer->token_queue);
+        lexer->next_chunk = NULL;
+        lexer->token_cursor = 0;
+    }
+
+    return token;
+}
+
+bool lexer_load_buffer(Lexer *lexer, const char *source, size_t bytes) {
+    lexer_clear(lexer);
+
+    size_t wide_length = 0;
+    wchar_t *file_data = bytes > 0 ? convert_to_wcs_alloc(source, bytes, &wide_length) : (wchar_t *)calloc(1, sizeof(wchar_t));
+    if(file_data == NULL) {
+        report_error(L"Source is not valid UTF-8.");
+        return false;
+    }
+
+    // Converted length counts the null-term char
+    lexer_load_data(lexer, file_data, bytes > 0 ? wide_length - 1 : 0);
     return true;
 }
 
+wchar_t *lexer_take_file_data(Lexer *lexer) {
+    wchar_t *file_data = lexer->file_data;
+    lexer_set_file_data(lexer, NULL, 0);
+    return file_data;
+}
+
 void lexer_free(Lexer *lexer) {
     free(lexer->file_data);
+    free(lexer->tokens);
 
     ZERO_STRUCT(*lexer);
 }
@@ -316,7 +694,22 @@ void lexer_rewind(Lexer *lexer) {
     lexer->token_cursor = 0;
 }
 
+size_t lexer_tell(Lexer *lexer) {
+    assert(lexer->token_queue == NULL && "Streaming lexers can't go back");
+    return lexer->token_cursor;
+}
+
+void lexer_seek(Lexer *lexer, size_t token_index) {
+    assert(lexer->token_queue == NULL && "Streaming lexers can't go back");
+    assert(token_index < lexer->token_count);
+    lexer->token_cursor = token_index;
+}
+
 Token lexer_peek_token(Lexer *lexer, size_t offset) {
+    if(lexer->token_queue != NULL) {
+        return lexer_stream_token(lexer, offset);
+    }
+
     const size_t cursor = lexer->token_cursor + offset;
 
     if(cursor >= lexer->token_count) {
@@ -328,6 +721,10 @@ Token lexer_peek_token(Lexer *lexer, size_t offset) {
 }
 
 Token lexer_next_token(Lexer *lexer) {
+    if(lexer->token_queue != NULL) {
+        return lexer_stream_next_token(lexer);
+    }
+
     if((lexer->token_cursor + 1) >= lexer->token_count) {
         Token token_eof = { .kind = TOKEN_EOF };
         return token_eof;
@@ -4,6 +4,7 @@
 #include "common.h"
 #include "file_io.h"
 #include "string_view.h"
+#include "spsc_queue.h"
 
 typedef enum : uint8_t {
     TOKEN_EOF = 0,
@@ -27,12 +28,36 @@ typedef enum : uint8_t {
     TOKEN_BRACKET_OPEN,
     TOKEN_BRACKET_CLOSE,
     TOKEN_DOT,
+    TOKEN_LESS,
+    TOKEN_GREATER,
+    TOKEN_LESS_EQUAL,
+    TOKEN_GREATER_EQUAL,
+    TOKEN_EQUAL_DOUBLE,
+    TOKEN_NOT_EQUAL,
 
     TOKEN_KEYWORD_RETURN,
     TOKEN_KEYWORD_INT64,
     TOKEN_KEYWORD_UINT64,
     TOKEN_KEYWORD_FLOAT64,
+    TOKEN_KEYWORD_INT32,
+    TOKEN_KEYWORD_UINT32,
+    TOKEN_KEYWORD_INT16,
+    TOKEN_KEYWORD_INT8,
+    TOKEN_KEYWORD_FLOAT32,
+    TOKEN_KEYWORD_VECTOR2,
+    TOKEN_KEYWORD_VECTOR4,
+    TOKEN_KEYWORD_VECTOR8,
+    TOKEN_KEYWORD_VECTOR16,
+    TOKEN_KEYWORD_SUM,
+    TOKEN_KEYWORD_PRODUCT,
+    TOKEN_KEYWORD_MIN,
+    TOKEN_KEYWORD_MAX,
+    TOKEN_KEYWORD_WHILE,
+    TOKEN_KEYWORD_FOR,
+    TOKEN_KEYWORD_TO,
+    TOKEN_KEYWORD_STRUCT,
     TOKEN_KEYWORD_VOID,
+    TOKEN_KEYWORD_EXPORT,
 
     TOKEN__COUNT,
     TOKEN__INVALID
@@ -60,12 +85,36 @@ static const wchar_t *token_kind_strings[TOKEN__COUNT] = {
     L"Open bracket",
     L"Close bracket",
     L"Dot",
+    L"Less",
+    L"Greater",
+    L"Less or equal",
+    L"Greater or equal",
+    L"Double equal",
+    L"Not equal",
 
     L"Keyword return",
     L"Keyword int64",
     L"Keyword uint64",
     L"Keyword float64",
+    L"Keyword int32",
+    L"Keyword uint32",
+    L"Keyword int16",
+    L"Keyword int8",
+    L"Keyword float32",
+    L"Keyword vector2",
+    L"Keyword vector4",
+    L"Keyword vector8",
+    L"Keyword vector16",
+    L"Keyword sum",
+    L"Keyword product",
+    L"Keyword min",
+    L"Keyword max",
+    L"Keyword while",
+    L"Keyword for",
+    L"Keyword to",
+    L"Keyword struct",
     L"Keyword void",
+    L"Keyword export",
 };
 
 typedef enum : uint16_t {
@@ -92,6 +141,25 @@ typedef struct {
     };
 } Token;
 
+#define TOKEN_CHUNK_SIZE 4096
+
+// Unit of tokens passed from the lexing thread to the parsing one when streaming
+typedef struct {
+    Token  tokens[TOKEN_CHUNK_SIZE];
+    size_t count; // TOKEN_CHUNK_SIZE unless last
+    bool   last;  // Ends with TOKEN_EOF unless aborted
+    bool   aborted; // Tokenizing stopped on an error
+} Token_Chunk;
+
+/*
+ * Files of at least LEXER_PARALLEL_MIN_CHARS characters get split on newlines into a range per processor,
+ * lexed on their own threads into separate token buffers, then joined with the line numbers shifted.
+ * When any range fails, the whole file is lexed again on the calling thread, which reports the error.
+ */
+#define LEXER_PARALLEL_MIN_CHARS       MB(4)
+#define LEXER_PARALLEL_RANGE_MIN_CHARS MB(1)
+#define LEXER_PARALLEL_RANGES_MAX      64
+
 typedef struct {
     // Lexer input
     wchar_t *file_data;
@@ -102,15 +170,49 @@ typedef struct {
     size_t current_line;
     // size_t current_char;
 
-    // Generated tokens
-    Token  tokens[4096]; // @TODO: Fixed size
+    // Generated tokens, storage grows as needed and is kept between files by lexer_load_file
+    Token *tokens;
+    size_t token_capacity;
     size_t token_count;
-    size_t token_cursor;
+    size_t token_cursor; // Into chunk when streaming
+
+    // Streaming, tokens go through the queue in chunks instead of the tokens array
+    SPSC_Queue  *token_queue;
+    Token_Chunk *chunk;      // Being filled by the producer, being read by the consumer
+    Token_Chunk *next_chunk; // Consumer only, popped early when peeking past the end of chunk
 } Lexer;
 
 bool  lexer_init_from_file(Lexer *lexer, wchar_t *filepath);
 void  lexer_free(Lexer *lexer);
+
+/* Reads and tokenizes another file, reusing the token storage; Frees the previous file data unless it was taken */
+bool  lexer_load_file(Lexer *lexer, wchar_t *filepath);
+
+/* Reads the file without tokenizing it, for lexer_tokenize_to_queue */
+bool  lexer_read_file(Lexer *lexer, wchar_t *filepath);
+
+/*
+ * Streaming, for the pipelined mode
+ * The producer tokenizes into chunks pushed on the queue, the consumer is then read like any lexer from another thread.
+ * When tokenizing stops on a fatal error, lexer_abort_stream ends the stream; The consumer then fails without a message once it reaches the end.
+ * The consumer shares the producer's file data; Finish it with lexer_drain_stream, which frees chunks nobody read, not lexer_free.
+ */
+void  lexer_tokenize_to_queue(Lexer *lexer, SPSC_Queue *queue);
+void  lexer_abort_stream(Lexer *lexer);
+void  lexer_init_from_queue(Lexer *lexer, const Lexer *producer, SPSC_Queue *queue);
+void  lexer_drain_stream(Lexer *lexer);
+
+/* Same as lexer_load_file for UTF-8 source in memory, the source gets copied */
+bool  lexer_load_buffer(Lexer *lexer, const char *source, size_t bytes);
+
+/* Hands the file data over to the caller who has to free it; Str_Views in tokens and AST nodes point into it */
+wchar_t *lexer_take_file_data(Lexer *lexer);
+
 void  lexer_rewind(Lexer *lexer);
+
+/* Cursor into the tokens array, for coming back to skipped tokens; Not for streaming lexers */
+size_t lexer_tell(Lexer *lexer);
+void   lexer_seek(Lexer *lexer, size_t token_index);
 Token lexer_peek_token(Lexer *lexer, size_t offset);
 Token lexer_next_token(Lexer *lexer);
 
@@ -1,50 +1,148 @@
 #include "llvm_converter.h"
+#include "file_io.h"
+#include "timing.h"
+#include "trace.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+
+#include <llvm-c/BitReader.h>
+#include <llvm-c/BitWriter.h>
+#include <llvm-c/DebugInfo.h>
+#include <llvm-c/Linker.h>
+#include <llvm-c/Transforms/PassBuilder.h>
 
 // For now allocating all over the place and converting wide strings to multibyte string and stuff which is bad
 
 #define DEFAULT_INVALID default: { assert(0 && "Invalid default case in a switch statement"); }
 
-bool llvm_init(LLVM_Context *ctx, Parser *parser) {
+// Target registration is global, has to happen once before any worker thread creates its own context
+static void llvm_init_native_target(void) {
+    static bool initialized = false;
+    if(!initialized) {
+        LLVMInitializeNativeTarget();
+        LLVMInitializeNativeAsmPrinter();
+        LLVMInitializeNativeAsmParser();
+        initialized = true;
+    }
+}
+
+// Triple and data layout of the target machine, struct layouts and sizes in the IR are then the ones C uses on it
+static void set_module_target(LLVM_Context *ctx) {
+    LLVMSetTarget(ctx->module, ctx->target_triple);
+
+    LLVMTargetDataRef data_layout = LLVMCreateTargetDataLayout(ctx->target_machine);
+    char *data_layout_string = LLVMCopyStringRepOfTargetData(data_layout);
+    LLVMSetDataLayout(ctx->module, data_layout_string);
+    LLVMDisposeMessage(data_layout_string);
+    LLVMDisposeTargetData(data_layout);
+}
+
+bool llvm_init_module(LLVM_Context *ctx, Parser *parser, LLVMCodeGenOptLevel opt_level, const char *module_name) {
     ZERO_STRUCT(*ctx);
 
     ctx->parser = parser;
+    ctx->opt_level = opt_level;
 
     ctx->context = LLVMContextCreate();
-    ctx->module  = LLVMModuleCreateWithNameInContext("module", ctx->context);
+    ctx->module  = LLVMModuleCreateWithNameInContext(module_name, ctx->context);
     ctx->builder = LLVMCreateBuilderInContext(ctx->context);
 
-    LLVMInitializeNativeTarget();
-    LLVMInitializeNativeAsmPrinter();
-    LLVMInitializeNativeAsmParser();
+    llvm_init_native_target();
 
     ctx->target_triple = LLVMGetDefaultTargetTriple();
 
     char *error_message = NULL;
     if(LLVMGetTargetFromTriple(ctx->target_triple, &ctx->target, &error_message) != 0) {
-        fprintf(stderr, "LLVM ERROR: %s\n", error_message);
+        report_error(L"LLVM ERROR: %hs", error_message);
         LLVMDisposeMessage(error_message);
 
         return false; // @TODO Free resources
     }
 
-    ctx->target_machine = LLVMCreateTargetMachine(ctx->target, ctx->target_triple, LLVMGetHostCPUName(), LLVMGetHostCPUFeatures(), LLVMCodeGenLevelNone, LLVMRelocDefault, LLVMCodeModelDefault);
+    char *cpu_name = LLVMGetHostCPUName();
+    char *cpu_features = LLVMGetHostCPUFeatures();
+
+    ctx->target_machine = LLVMCreateTargetMachine(ctx->target, ctx->target_triple, cpu_name, cpu_features, opt_level, LLVMRelocDefault, LLVMCodeModelDefault);
+
+    LLVMDisposeMessage(cpu_name);
+    LLVMDisposeMessage(cpu_features);
+
+    set_module_target(ctx);
 
     return true;
 }
 
+bool llvm_init(LLVM_Context *ctx, Parser *parser, LLVMCodeGenOptLevel opt_level) {
+    return llvm_init_module(ctx, parser, opt_level, "module");
+}
+
+void llvm_init_module_shared(LLVM_Context *ctx, LLVM_Context *base, Parser *parser, const char *module_name) {
+    *ctx = *base;
+    ctx->parser = parser;
+    ctx->is_partition = false;
+    ctx->external_procs = NULL;
+    ctx->declared = NULL;
+    ctx->specializations = NULL;
+    ctx->generics = NULL;
+    ctx->type_args = NULL;
+
+    ctx->module = LLVMModuleCreateWithNameInContext(module_name, ctx->context);
+    set_module_target(ctx);
+}
+
+static void free_conversion_state(LLVM_Context *ctx) {
+    if(ctx->declared != NULL) {
+        procedure_table_free(ctx->declared);
+        free(ctx->declared);
+        ctx->declared = NULL;
+    }
+
+    if(ctx->specializations != NULL) {
+        specialization_cache_free(ctx->specializations);
+        free(ctx->specializations);
+        ctx->specializations = NULL;
+    }
+
+    if(ctx->generics != NULL) {
+        generic_instances_free(ctx->generics);
+        free(ctx->generics);
+        ctx->generics = NULL;
+    }
+}
+
+void llvm_shutdown_module(LLVM_Context *ctx) {
+    free_conversion_state(ctx);
+
+    if(ctx->module != NULL) {
+        LLVMDisposeModule(ctx->module);
+    }
+
+    ZERO_STRUCT(*ctx);
+}
+
 void llvm_shutdown(LLVM_Context *ctx) {
+    free_conversion_state(ctx);
+
+    if(ctx->target_machine != NULL) {
+        LLVMDisposeTargetMachine(ctx->target_machine);
+    }
     LLVMDisposeBuilder(ctx->builder);
-    LLVMDisposeModule(ctx->module);
+    if(ctx->module != NULL) {
+        LLVMDisposeModule(ctx->module);
+    }
     LLVMContextDispose(ctx->context);
     LLVMDisposeMessage(ctx->target_triple);
 
     ZERO_STRUCT(*ctx);
 }
 
-// Only used for simple types @TODO Change when structs
+// Only used for simple types and vectors of them, structs have get_llvm_struct_type
 LLVMTypeRef get_llvm_simple_type(LLVM_Context *ctx, Type_Kind kind) {
+    if(is_vector_type(kind)) {
+        return LLVMVectorType(get_llvm_simple_type(ctx, get_element_type(kind)), get_vector_lanes(kind));
+    }
+
     switch(kind) { DEFAULT_INVALID;
         case TYPE_VOID: {
             return LLVMVoidTypeInContext(ctx->context);
@@ -58,7 +156,101 @@ LLVMTypeRef get_llvm_simple_type(LLVM_Context *ctx, Type_Kind kind) {
         case TYPE_FLOAT64: {
             return LLVMDoubleTypeInContext(ctx->context);
         };
+        case TYPE_INT32:
+        case TYPE_UINT32: {
+            return LLVMInt32TypeInContext(ctx->context);
+        };
+        case TYPE_INT16: {
+            return LLVMInt16TypeInContext(ctx->context);
+        };
+        case TYPE_INT8: {
+            return LLVMInt8TypeInContext(ctx->context);
+        };
+        case TYPE_FLOAT32: {
+            return LLVMFloatTypeInContext(ctx->context);
+        };
+    }
+}
+
+static bool struct_body_matches(LLVMTypeRef struct_type, LLVMTypeRef *field_types, size_t fields_count) {
+    if(LLVMIsOpaqueStruct(struct_type) || LLVMIsPackedStruct(struct_type) || LLVMCountStructElementTypes(struct_type) != fields_count) {
+        return false;
+    }
+
+    for(size_t index = 0; index < fields_count; ++index) {
+        if(LLVMStructGetTypeAtIndex(struct_type, (unsigned)index) != field_types[index]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Named after the struct, with the fields in their stored order; Contexts outlive modules, so one with the same name and fields is reused
+// and a different struct of the same name, say from another file, gets the first free "name.N"
+static LLVMTypeRef get_llvm_struct_type(LLVM_Context *ctx, AST_Struct *ast_struct) {
+    LLVMTypeRef field_types[AST_STRUCT_FIELDS_MAX];
+    for(size_t index = 0; index < ast_struct->fields_count; ++index) {
+        field_types[ast_struct->field_slots[index]] = get_llvm_simple_type(ctx, ast_struct->fields[index]->data_type->kind);
+    }
+
+    char *struct_name = convert_to_mbs_alloc(ast_struct->identifier.data, ast_struct->identifier.length, NULL);
+    char name[512];
+    snprintf(name, sizeof(name), "%s", struct_name);
+
+    LLVMTypeRef struct_type = NULL;
+    for(size_t suffix = 1; struct_type == NULL; ++suffix) {
+        LLVMTypeRef existing = LLVMGetTypeByName2(ctx->context, name);
+        if(existing == NULL) {
+            struct_type = LLVMStructCreateNamed(ctx->context, name);
+            LLVMStructSetBody(struct_type, field_types, (unsigned)ast_struct->fields_count, 0);
+        } else if(struct_body_matches(existing, field_types, ast_struct->fields_count)) {
+            struct_type = existing;
+        } else {
+            snprintf(name, sizeof(name), "%s.%llu", struct_name, (unsigned long long)suffix);
+        }
+    }
+
+    free(struct_name);
+    return struct_type;
+}
+
+// Arrays are only ever in memory, as stack slots or behind parameter pointers; element_struct is for TYPE_CUSTOM elements
+// Arrays of soa structs are a struct of one array per field instead, in the stored field order
+static LLVMTypeRef get_llvm_array_type(LLVM_Context *ctx, Type_Kind element, AST_Struct *element_struct, uint32_t length) {
+    if(element != TYPE_CUSTOM) {
+        return LLVMArrayType(get_llvm_simple_type(ctx, element), length);
+    }
+    if(!(element_struct->node.flags & AST_FLAG_SOA)) {
+        return LLVMArrayType(get_llvm_struct_type(ctx, element_struct), length);
+    }
+
+    LLVMTypeRef field_arrays[AST_STRUCT_FIELDS_MAX];
+    for(size_t index = 0; index < element_struct->fields_count; ++index) {
+        field_arrays[element_struct->field_slots[index]] = LLVMArrayType(get_llvm_simple_type(ctx, element_struct->fields[index]->data_type->kind), length);
+    }
+    return LLVMStructTypeInContext(ctx->context, field_arrays, (unsigned)element_struct->fields_count, 0);
+}
+
+// Same struct, or one declared the same way in another file
+static bool structs_match(AST_Struct *struct_a, AST_Struct *struct_b) {
+    if(struct_a == struct_b) {
+        return true;
+    }
+
+    const AST_Flags layout_flags = AST_FLAG_LAYOUT_C | AST_FLAG_SOA;
+    if(!str_view_compare(struct_a->identifier, struct_b->identifier) || (struct_a->node.flags & layout_flags) != (struct_b->node.flags & layout_flags) ||
+       struct_a->fields_count != struct_b->fields_count) {
+        return false;
+    }
+
+    for(size_t index = 0; index < struct_a->fields_count; ++index) {
+        AST_Declaration *field_a = struct_a->fields[index];
+        AST_Declaration *field_b = struct_b->fields[index];
+        if(!str_view_compare(field_a->identifier, field_b->identifier) || field_a->data_type->kind != field_b->data_type->kind) {
+            return false;
+        }
     }
+    return true;
 }
 
 LLVMTypeRef get_llvm_literal_simple_type(LLVM_Context *ctx, Literal_Kind kind) {
@@ -75,16 +267,44 @@ LLVMTypeRef get_llvm_literal_simple_type(LLVM_Context *ctx, Literal_Kind kind) {
     }
 }
 
+// Type parameters stand for the type arguments of the instance being emitted
+static Type_Kind get_type_kind(LLVM_Context *ctx, AST_Type_Def *type) {
+    if(get_element_type(type->kind) != TYPE_PARAMETER) {
+        return type->kind;
+    }
+
+    assert(ctx->type_args != NULL && "Type parameter outside of a generic instance");
+    const Type_Kind type_arg = ctx->type_args[type->type_param_index];
+    if(!is_vector_type(type->kind)) {
+        return type_arg;
+    }
+
+    if(is_vector_type(type_arg)) {
+        report_error(L"Vector type argument %.*ls used as the element of a vector", type->signature.length, type->signature.data);
+        fatal_error();
+    }
+    return make_vector_type(type_arg, get_vector_lanes(type->kind));
+}
+
 typedef struct {
     const char *ident_string; // Allocated for now @TODO
-    LLVMValueRef value_ref;
+    LLVMValueRef value_ref;   // The value itself, or its alloca if is_stack_slot; Pointer to the elements for arrays
     Type_Kind type;
+    bool is_stack_slot;
+
+    // TYPE_ARRAY only
+    Type_Kind element_type;
+    uint32_t array_length;
+
+    AST_Struct *struct_def; // TYPE_CUSTOM, or the element's for arrays of structs
 } Scope_Symbol;
 
 #define SCOPE_SYMBOLS_MAX 1024
 
 typedef struct {
     LLVMBasicBlockRef basic_block;
+    LLVMBasicBlockRef entry_block; // Stack slots all go here, where mem2reg and SROA look for them
+    Type_Kind return_type;
 
     // For variable lookup
     Scope_Symbol symbols[SCOPE_SYMBOLS_MAX];
@@ -95,27 +315,348 @@ void llvm_scope_init(LLVM_Scope *scope) {
     scope->symbols_count = 0;
 }
 
-void llvm_scope_add_symbol(LLVM_Scope *scope, LLVMValueRef ref, const char *ident, Type_Kind type) {
+void llvm_scope_add_symbol(LLVM_Scope *scope, LLVMValueRef ref, const char *ident, Type_Kind type, bool is_stack_slot) {
     assert(scope->symbols_count < SCOPE_SYMBOLS_MAX && "Exceeded LLVM_Scope symbols limit @TODO");
-    Scope_Symbol symbol = (Scope_Symbol) { .ident_string = ident, .value_ref = ref, .type = type };
+    Scope_Symbol symbol = (Scope_Symbol) { .ident_string = ident, .value_ref = ref, .type = type, .is_stack_slot = is_stack_slot };
     scope->symbols[scope->symbols_count++] = symbol;
 }
 
-// @TODO: Hash(?)
+void llvm_scope_add_array(LLVM_Scope *scope, LLVMValueRef ref, const char *ident, Type_Kind element_type, AST_Struct *element_struct, uint32_t array_length) {
+    llvm_scope_add_symbol(scope, ref, ident, TYPE_ARRAY, false);
+    scope->symbols[scope->symbols_count - 1].element_type = element_type;
+    scope->symbols[scope->symbols_count - 1].array_length = array_length;
+    scope->symbols[scope->symbols_count - 1].struct_def = element_struct;
+}
+
+void llvm_scope_add_struct(LLVM_Scope *scope, LLVMValueRef ref, const char *ident, AST_Struct *struct_def) {
+    llvm_scope_add_symbol(scope, ref, ident, TYPE_CUSTOM, false);
+    scope->symbols[scope->symbols_count - 1].struct_def = struct_def;
+}
+
+// Latest first, variables of nested blocks shadow the outer ones @TODO: Hash(?)
 Scope_Symbol llvm_scope_lookup_symbol(LLVM_Scope *scope, const char *ident) {
-    for(size_t index = 0; index < scope->symbols_count; ++index) {
-        if(strcmp(ident, scope->symbols[index].ident_string) == 0) {
-            return scope->symbols[index];
+    for(size_t index = scope->symbols_count; index > 0; --index) {
+        if(strcmp(ident, scope->symbols[index - 1].ident_string) == 0) {
+            return scope->symbols[index - 1];
         }
     }
     return (Scope_Symbol) { };
 }
 
-LLVMValueRef make_llvm_expression(LLVM_Context *ctx, AST_Node *expr, LLVM_Scope *scope) {
+static Scope_Symbol lookup_variable(LLVM_Scope *scope, Str_View identifier) {
+    char *var_ident = convert_to_mbs_alloc(identifier.data, identifier.length, NULL);
+    assert(var_ident);
+    Scope_Symbol symbol = llvm_scope_lookup_symbol(scope, var_ident);
+    free(var_ident);
+
+    if(symbol.value_ref == NULL) {
+        report_error(L"Unknown variable: %.*ls", identifier.length, identifier.data);
+        fatal_error();
+    }
+    return symbol;
+}
+
+void declare_procedure(LLVM_Context *ctx, AST_Procedure *ast_proc);
+static LLVMValueRef specialize_call(LLVM_Context *ctx, AST_Procedure_Call *ast_proc_call);
+static AST_Procedure *find_generic_procedure(LLVM_Context *ctx, Str_View signature);
+static LLVMValueRef emit_generic_call(LLVM_Context *ctx, AST_Procedure_Call *ast_proc_call, AST_Procedure *ast_proc, LLVM_Scope *scope, Type_Kind *out_type);
+
+static void report_procedure_call_error(AST_Procedure_Call *ast_proc_call, const wchar_t *message) {
+    report_error(L"%ls: %.*ls", message, ast_proc_call->procedure_signature.length, ast_proc_call->procedure_signature.data);
+    fatal_error();
+}
+
+// Literals, and arithmetic on nothing but literals, have no type of their own until they are used
+static bool is_untyped_constant(AST_Node *expr) {
+    if(expr->kind == ast_kind(AST_Binary)) {
+        AST_Binary *ast_binary = (AST_Binary *)expr;
+        return is_untyped_constant(ast_binary->expr_l) && is_untyped_constant(ast_binary->expr_r);
+    }
+    return expr->kind == ast_kind(AST_Literal);
+}
+
+// value is a folded integer constant of type from, type a scalar integer one
+static bool constant_fits_type(LLVMValueRef constant, Type_Kind from, Type_Kind type) {
+    const int32_t bits = get_size_of_type(type) * 8;
+    if(bits == 64) {
+        return true;
+    }
+    if(is_unsigned_type(from) && LLVMConstIntGetZExtValue(constant) > INT64_MAX) {
+        return false;
+    }
+
+    const int64_t value = LLVMConstIntGetSExtValue(constant);
+    if(is_unsigned_type(type)) {
+        return value >= 0 && value < (1ll << bits);
+    }
+    return value >= -(1ll << (bits - 1)) && value < (1ll << (bits - 1));
+}
+
+// Integers of the same width mix regardless of sign, like the 64-bit ones always did
+static bool types_match(Type_Kind type_a, Type_Kind type_b) {
+    if(type_a == type_b) {
+        return true;
+    }
+    return !is_floating_type(type_a) && !is_floating_type(type_b) && type_a != TYPE_VOID && type_b != TYPE_VOID &&
+           get_vector_lanes(type_a) == get_vector_lanes(type_b) && get_size_of_type(type_a) == get_size_of_type(type_b);
+}
+
+// Every lane set to the scalar value, constants fold into a constant vector
+static LLVMValueRef build_broadcast(LLVM_Context *ctx, LLVMValueRef value, Type_Kind type) {
+    LLVMTypeRef vector_type = get_llvm_simple_type(ctx, type);
+    LLVMTypeRef int32_type = LLVMInt32TypeInContext(ctx->context);
+
+    LLVMValueRef vector = LLVMBuildInsertElement(ctx->builder, LLVMGetUndef(vector_type), value, LLVMConstInt(int32_type, 0, 0), "");
+    LLVMValueRef mask = LLVMConstNull(LLVMVectorType(int32_type, get_vector_lanes(type)));
+    return LLVMBuildShuffleVector(ctx->builder, vector, LLVMGetUndef(vector_type), mask, "splat");
+}
+
+// Sign of integers comes from the type converted from; Vectors convert lane by lane, from ones with as many lanes
+static LLVMValueRef build_conversion(LLVM_Context *ctx, LLVMValueRef value, Type_Kind from, Type_Kind to) {
+    LLVMTypeRef type = get_llvm_simple_type(ctx, to);
+    if(LLVMTypeOf(value) == type) {
+        return value;
+    }
+
+    if(is_floating_type(from) && is_floating_type(to)) {
+        return LLVMBuildFPCast(ctx->builder, value, type, "conv");
+    }
+    if(is_floating_type(from)) {
+        return is_unsigned_type(to) ? LLVMBuildFPToUI(ctx->builder, value, type, "conv") : LLVMBuildFPToSI(ctx->builder, value, type, "conv");
+    }
+    if(is_floating_type(to)) {
+        return is_unsigned_type(from) ? LLVMBuildUIToFP(ctx->builder, value, type, "conv") : LLVMBuildSIToFP(ctx->builder, value, type, "conv");
+    }
+    return LLVMBuildIntCast2(ctx->builder, value, type, !is_unsigned_type(from), "conv");
+}
+
+// Untyped constants take the type they are used as, anything else has to have it already
+static LLVMValueRef match_type(LLVM_Context *ctx, AST_Node *expr, LLVMValueRef value, Type_Kind from, Type_Kind to) {
+    if(types_match(from, to)) {
+        return value;
+    }
+
+    wchar_t from_signature[TYPE_SIGNATURE_MAX];
+    wchar_t to_signature[TYPE_SIGNATURE_MAX];
+    format_type_signature(to_signature, to);
+
+    if(!is_untyped_constant(expr) || to == TYPE_VOID) {
+        report_error(L"Value of type %ls used as %ls, convert it explicitly", format_type_signature(from_signature, from), to_signature);
+        fatal_error();
+    }
+
+    if(is_floating_type(from) && !is_floating_type(to)) {
+        report_error(L"Floating point constant used as %ls, convert it explicitly", to_signature);
+        fatal_error();
+    }
+
+    // Constants are scalars, used as a vector they go into every lane; Checked after folding, so 200 + 100 is caught like 300
+    const Type_Kind element = get_element_type(to);
+    if(!is_floating_type(from) && !is_floating_type(element) && LLVMIsAConstantInt(value) && !constant_fits_type(value, from, element)) {
+        if(is_unsigned_type(from)) {
+            report_error(L"Constant %llu out of range of %ls", (unsigned long long)LLVMConstIntGetZExtValue(value), to_signature);
+        } else {
+            report_error(L"Constant %lld out of range of %ls", (long long)LLVMConstIntGetSExtValue(value), to_signature);
+        }
+        fatal_error();
+    }
+
+    // The builder folds it, constants stay constants
+    value = build_conversion(ctx, value, from, element);
+    return is_vector_type(to) ? build_broadcast(ctx, value, to) : value;
+}
+
+// Like match_type, a typed scalar operand of a vector operation also goes into every lane if it has the element type
+static LLVMValueRef match_operand(LLVM_Context *ctx, AST_Node *expr, LLVMValueRef value, Type_Kind from, Type_Kind to) {
+    if(is_vector_type(to) && !is_vector_type(from) && !is_untyped_constant(expr)) {
+        return build_broadcast(ctx, match_type(ctx, expr, value, from, get_element_type(to)), to);
+    }
+    return match_type(ctx, expr, value, from, to);
+}
+
+// One step of a reduction, lane by lane
+static LLVMValueRef build_reduction_step(LLVM_Context *ctx, LLVMValueRef value_a, LLVMValueRef value_b, Type_Kind type, Reduction_Operation operation) {
+    const bool is_float = is_floating_type(type);
+    const bool is_unsigned = is_unsigned_type(type);
+
+    switch(operation) { DEFAULT_INVALID;
+        case REDUCTION_SUM: {
+            return is_float ? LLVMBuildFAdd(ctx->builder, value_a, value_b, "a") : LLVMBuildAdd(ctx->builder, value_a, value_b, "a");
+        };
+        case REDUCTION_PRODUCT: {
+            return is_float ? LLVMBuildFMul(ctx->builder, value_a, value_b, "m") : LLVMBuildMul(ctx->builder, value_a, value_b, "m");
+        };
+        case REDUCTION_MIN:
+        case REDUCTION_MAX: {
+            const bool is_min = operation == REDUCTION_MIN;
+            LLVMValueRef compare = is_float ? LLVMBuildFCmp(ctx->builder, is_min ? LLVMRealOLT : LLVMRealOGT, value_a, value_b, "cmp") :
+                                   LLVMBuildICmp(ctx->builder, is_min ? (is_unsigned ? LLVMIntULT : LLVMIntSLT) : (is_unsigned ? LLVMIntUGT : LLVMIntSGT), value_a, value_b, "cmp");
+            return LLVMBuildSelect(ctx->builder, compare, value_a, value_b, is_min ? "min" : "max");
+        };
+    }
+}
+
+// Lanes pair up with the ones half the vector away until one is left; Floating point sums come out in that order on every target
+static LLVMValueRef build_reduction(LLVM_Context *ctx, LLVMValueRef value, Type_Kind type, Reduction_Operation operation) {
+    LLVMTypeRef int32_type = LLVMInt32TypeInContext(ctx->context);
+
+    for(uint32_t lanes = get_vector_lanes(type) / 2; lanes > 0; lanes /= 2) {
+        LLVMValueRef low_mask[TYPE_VECTOR_LANES_MAX / 2];
+        LLVMValueRef high_mask[TYPE_VECTOR_LANES_MAX / 2];
+        for(uint32_t lane = 0; lane < lanes; ++lane) {
+            low_mask[lane] = LLVMConstInt(int32_type, lane, 0);
+            high_mask[lane] = LLVMConstInt(int32_type, lanes + lane, 0);
+        }
+
+        LLVMValueRef undef = LLVMGetUndef(LLVMTypeOf(value));
+        LLVMValueRef low = LLVMBuildShuffleVector(ctx->builder, value, undef, LLVMConstVector(low_mask, lanes), "low");
+        LLVMValueRef high = LLVMBuildShuffleVector(ctx->builder, value, undef, LLVMConstVector(high_mask, lanes), "high");
+        value = build_reduction_step(ctx, low, high, type, operation);
+    }
+
+    return LLVMBuildExtractElement(ctx->builder, value, LLVMConstInt(int32_type, 0, 0), "r");
+}
+
+LLVMValueRef make_llvm_expression(LLVM_Context *ctx, AST_Node *expr, LLVM_Scope *scope, Type_Kind *out_type);
+
+static LLVMValueRef make_llvm_expression_as(LLVM_Context *ctx, AST_Node *expr, LLVM_Scope *scope, Type_Kind type) {
+    Type_Kind expr_type = TYPE_VOID;
+    LLVMValueRef value = make_llvm_expression(ctx, expr, scope, &expr_type);
+    return match_type(ctx, expr, value, expr_type, type);
+}
+
+// Index of a lane or of an array element, what names it in errors
+static LLVMValueRef make_llvm_index(LLVM_Context *ctx, AST_Node *expr, LLVM_Scope *scope, const wchar_t *what, Type_Kind *out_type) {
+    LLVMValueRef index = make_llvm_expression(ctx, expr, scope, out_type);
+    if(*out_type == TYPE_VOID || is_floating_type(*out_type) || is_vector_type(*out_type)) {
+        report_error(L"%ls index has to be an integer", what);
+        fatal_error();
+    }
+    return index;
+}
+
+// Index of an array element as i64; Past the end is only caught for constant indices, like for lanes
+static LLVMValueRef make_element_index(LLVM_Context *ctx, Scope_Symbol *symbol, AST_Node *index_expr, LLVM_Scope *scope) {
+    Type_Kind index_type = TYPE_VOID;
+    LLVMValueRef index = make_llvm_index(ctx, index_expr, scope, L"Element", &index_type);
+
+    if(LLVMIsAConstantInt(index) && LLVMConstIntGetZExtValue(index) >= symbol->array_length) {
+        report_error(L"Element index %lld out of range of an array of %u", LLVMConstIntGetSExtValue(index), symbol->array_length);
+        fatal_error();
+    }
+
+    return build_conversion(ctx, index, index_type, TYPE_INT64);
+}
+
+// Not for arrays of structs, only their fields are ever loaded or stored
+static LLVMValueRef build_element_pointer(LLVM_Context *ctx, Scope_Symbol *symbol, AST_Node *index_expr, LLVM_Scope *scope) {
+    LLVMValueRef indices[2] = {
+        LLVMConstInt(LLVMInt64TypeInContext(ctx->context), 0, 0),
+        make_element_index(ctx, symbol, index_expr, scope),
+    };
+    LLVMTypeRef array_type = get_llvm_array_type(ctx, symbol->element_type, NULL, symbol->array_length);
+    return LLVMBuildInBoundsGEP2(ctx->builder, array_type, symbol->value_ref, indices, 2, "element");
+}
+
+// Field of a struct variable or of an element of an array of structs; Elements of soa arrays are spread over the field arrays
+static LLVMValueRef build_field_pointer(LLVM_Context *ctx, AST_Field *ast_field, LLVM_Scope *scope, Type_Kind *out_type) {
+    AST_Node *base = ast_field->expression;
+    const bool is_element = base->kind == ast_kind(AST_Index);
+    AST_Node *ast_var = is_element ? ((AST_Index *)base)->expression : base;
+    if(ast_var->kind != ast_kind(AST_Variable_Ref)) {
+        report_error(L"Field %.*ls taken of an expression, only struct variables and elements of arrays of them have fields", ast_field->identifier.length, ast_field->identifier.data);
+        fatal_error();
+    }
+
+    Str_View var_ident = ((AST_Variable_Ref *)ast_var)->var_ident;
+    Scope_Symbol symbol = lookup_variable(scope, var_ident);
+    const bool has_fields = is_element ? symbol.type == TYPE_ARRAY && symbol.element_type == TYPE_CUSTOM : symbol.type == TYPE_CUSTOM;
+    if(!has_fields) {
+        report_error(L"Field %.*ls of %.*ls, only struct variables and elements of arrays of them have fields", ast_field->identifier.length, ast_field->identifier.data, var_ident.length, var_ident.data);
+        fatal_error();
+    }
+
+    AST_Struct *ast_struct = symbol.struct_def;
+    size_t field_index = 0;
+    while(field_index < ast_struct->fields_count && !str_view_compare(ast_struct->fields[field_index]->identifier, ast_field->identifier)) {
+        field_index += 1;
+    }
+    if(field_index == ast_struct->fields_count) {
+        report_error(L"Struct %.*ls has no field %.*ls", ast_struct->identifier.length, ast_struct->identifier.data, ast_field->identifier.length, ast_field->identifier.data);
+        fatal_error();
+    }
+
+    *out_type = ast_struct->fields[field_index]->data_type->kind;
+    const unsigned slot = ast_struct->field_slots[field_index];
+
+    if(!is_element) {
+        return LLVMBuildStructGEP2(ctx->builder, get_llvm_struct_type(ctx, ast_struct), symbol.value_ref, slot, "field");
+    }
+
+    LLVMValueRef zero = LLVMConstInt(LLVMInt64TypeInContext(ctx->context), 0, 0);
+    LLVMValueRef slot_index = LLVMConstInt(LLVMInt32TypeInContext(ctx->context), slot, 0);
+    LLVMValueRef element_index = make_element_index(ctx, &symbol, ((AST_Index *)base)->index, scope);
+
+    LLVMValueRef indices[3] = { zero, element_index, slot_index };
+    if(ast_struct->node.flags & AST_FLAG_SOA) {
+        indices[1] = slot_index;
+        indices[2] = element_index;
+    }
+
+    LLVMTypeRef array_type = get_llvm_array_type(ctx, TYPE_CUSTOM, ast_struct, symbol.array_length);
+    return LLVMBuildInBoundsGEP2(ctx->builder, array_type, symbol.value_ref, indices, 3, "field");
+}
+
+// Array or struct variable passed for a parameter of that type, by pointer; Simple element types are left for the caller to check
+// Such parameters are noalias, previous_args are the arguments before it so the same variable can't go in twice
+static LLVMValueRef make_memory_argument(LLVM_Context *ctx, AST_Procedure_Call *ast_proc_call, size_t index, AST_Type_Def *param_type, LLVMValueRef *previous_args, LLVM_Scope *scope, Type_Kind *out_element_type) {
+    AST_Node *ast_arg = ast_proc_call->params[index];
+    Scope_Symbol symbol = { };
+    if(ast_arg->kind == ast_kind(AST_Variable_Ref)) {
+        symbol = lookup_variable(scope, ((AST_Variable_Ref *)ast_arg)->var_ident);
+    }
+
+    if(param_type->kind == TYPE_CUSTOM) {
+        if(symbol.type != TYPE_CUSTOM) {
+            report_procedure_call_error(ast_proc_call, L"Argument for a struct parameter isn't a struct variable in call to procedure");
+        }
+        if(!structs_match(symbol.struct_def, param_type->struct_def)) {
+            report_procedure_call_error(ast_proc_call, L"Argument for a struct parameter is a different struct in call to procedure");
+        }
+    } else {
+        if(symbol.type != TYPE_ARRAY) {
+            report_procedure_call_error(ast_proc_call, L"Argument for an array parameter isn't an array variable in call to procedure");
+        }
+        if(symbol.array_length != param_type->array_length) {
+            report_procedure_call_error(ast_proc_call, L"Argument for an array parameter isn't an array of the same length in call to procedure");
+        }
+
+        AST_Type_Def *param_element = param_type->element_type;
+        if(symbol.element_type == TYPE_CUSTOM && param_element->kind == TYPE_PARAMETER) {
+            report_procedure_call_error(ast_proc_call, L"Arrays of structs can't give a type parameter its type in call to procedure");
+        }
+        if((symbol.element_type == TYPE_CUSTOM || param_element->kind == TYPE_CUSTOM) &&
+           (symbol.element_type != param_element->kind || !structs_match(symbol.struct_def, param_element->struct_def))) {
+            report_procedure_call_error(ast_proc_call, L"Argument for an array parameter has a different element type in call to procedure");
+        }
+    }
+
+    for(size_t previous = 0; previous < index; ++previous) {
+        if(previous_args[previous] == symbol.value_ref) {
+            report_procedure_call_error(ast_proc_call, L"Same variable passed for two parameters in call to procedure");
+        }
+    }
+
+    *out_element_type = param_type->kind == TYPE_CUSTOM ? TYPE_CUSTOM : symbol.element_type;
+    return symbol.value_ref;
+}
+
+LLVMValueRef make_llvm_expression(LLVM_Context *ctx, AST_Node *expr, LLVM_Scope *scope, Type_Kind *out_type) {
      switch(expr->kind) { DEFAULT_INVALID;
 
         case ast_kind(AST_Literal): {
             AST_Literal *ast_literal = (AST_Literal *)expr;
+            *out_type = ast_literal->kind == LITERAL_FLOAT64 ? TYPE_FLOAT64 : ast_literal->kind == LITERAL_UINT64 ? TYPE_UINT64 : TYPE_INT64;
             switch(ast_literal->kind) { DEFAULT_INVALID;
                 case LITERAL_INT64: {
                     return LLVMConstInt(get_llvm_literal_simple_type(ctx, ast_literal->kind), (uint64_t)ast_literal->value_int64, 1);
@@ -132,8 +673,33 @@ LLVMValueRef make_llvm_expression(LLVM_Context *ctx, AST_Node *expr, LLVM_Scope
         case ast_kind(AST_Binary): {
             AST_Binary *ast_binary = (AST_Binary *)expr;
 
-            LLVMValueRef expr_l = make_llvm_expression(ctx, ast_binary->expr_l, scope);
-            LLVMValueRef expr_r = make_llvm_expression(ctx, ast_binary->expr_r, scope);
+            Type_Kind type_l = TYPE_VOID;
+            Type_Kind type_r = TYPE_VOID;
+            LLVMValueRef expr_l = make_llvm_expression(ctx, ast_binary->expr_l, scope, &type_l);
+            LLVMValueRef expr_r = make_llvm_expression(ctx, ast_binary->expr_r, scope, &type_r);
+
+            // An untyped constant takes the type of the other operand, two of them become floating point if either is
+            Type_Kind type = type_l;
+            if(is_untyped_constant(ast_binary->expr_l) && (!is_untyped_constant(ast_binary->expr_r) || is_floating_type(type_r))) {
+                type = type_r;
+            }
+            // Vectors operate lane by lane, a scalar operand goes into every lane
+            if(!is_vector_type(type) && is_vector_type(type_r)) {
+                type = type_r;
+            }
+
+            expr_l = match_operand(ctx, ast_binary->expr_l, expr_l, type_l, type);
+            expr_r = match_operand(ctx, ast_binary->expr_r, expr_r, type_r, type);
+            *out_type = type;
+
+            if(is_floating_type(type)) {
+                switch(ast_binary->operation) { DEFAULT_INVALID;
+                    case BINARY_OP_ADD: return LLVMBuildFAdd(ctx->builder, expr_l, expr_r, "a");
+                    case BINARY_OP_SUB: return LLVMBuildFSub(ctx->builder, expr_l, expr_r, "s");
+                    case BINARY_OP_MUL: return LLVMBuildFMul(ctx->builder, expr_l, expr_r, "m");
+                    case BINARY_OP_DIV: return LLVMBuildFDiv(ctx->builder, expr_l, expr_r, "d");
+                }
+            }
 
             switch(ast_binary->operation) { DEFAULT_INVALID;
                 case BINARY_OP_ADD: {
@@ -146,6 +712,9 @@ LLVMValueRef make_llvm_expression(LLVM_Context *ctx, AST_Node *expr, LLVM_Scope
                     return LLVMBuildMul(ctx->builder, expr_l, expr_r, "m");
                 };
                 case BINARY_OP_DIV: {
+                    if(is_unsigned_type(type)) {
+                        return LLVMBuildUDiv(ctx->builder, expr_l, expr_r, "d");
+                    }
                     return LLVMBuildSDiv(ctx->builder, expr_l, expr_r, "d");
                 };
             }
@@ -153,114 +722,1361 @@ LLVMValueRef make_llvm_expression(LLVM_Context *ctx, AST_Node *expr, LLVM_Scope
 
         case ast_kind(AST_Variable_Ref): {
             AST_Variable_Ref *ast_var_ref = (AST_Variable_Ref *)expr;
-            
-            char *var_ident = convert_to_mbs_alloc(ast_var_ref->var_ident.data, ast_var_ref->var_ident.length, NULL);
-            assert(var_ident);
-            Scope_Symbol symbol = llvm_scope_lookup_symbol(scope, var_ident);
-            free(var_ident);
+            Scope_Symbol symbol = lookup_variable(scope, ast_var_ref->var_ident);
+
+            if(symbol.type == TYPE_ARRAY) {
+                report_error(L"Array %.*ls used as a value, only its elements are values", ast_var_ref->var_ident.length, ast_var_ref->var_ident.data);
+                fatal_error();
+            }
+            if(symbol.type == TYPE_CUSTOM) {
+                report_error(L"Struct %.*ls used as a value, only its fields are values", ast_var_ref->var_ident.length, ast_var_ref->var_ident.data);
+                fatal_error();
+            }
+
+            *out_type = symbol.type;
+
+            if(!symbol.is_stack_slot) {
+                return symbol.value_ref;
+            }
 
             LLVMValueRef loaded = LLVMBuildLoad2(ctx->builder, get_llvm_simple_type(ctx, symbol.type), symbol.value_ref, "");
             return loaded;
         } break;
-    }
-}
 
-void emit_return(LLVM_Context *ctx, AST_Return *ast_ret, LLVM_Scope *scope) {
-    if(ast_ret->expression == NULL) {
-        LLVMBuildRetVoid(ctx->builder);
-        return;
-    }
-    
-    LLVMValueRef expr = make_llvm_expression(ctx, ast_ret->expression, scope);
-    LLVMBuildRet(ctx->builder, expr);
-}
+        case ast_kind(AST_Procedure_Call): {
+            AST_Procedure_Call *ast_proc_call = (AST_Procedure_Call *)expr;
 
-void emit_procedure(LLVM_Context *ctx, AST_Procedure *ast_proc) {
+            // Every procedure of the module is declared up front, so calls to ones defined later resolve too
+            char *proc_signature = convert_to_mbs_alloc(ast_proc_call->procedure_signature.data, ast_proc_call->procedure_signature.length, NULL);
+            LLVMValueRef proc = LLVMGetNamedFunction(ctx->module, proc_signature);
 
-    LLVMTypeRef return_type = get_llvm_simple_type(ctx, ast_proc->return_type->kind);
-    
-    LLVMTypeRef param_types[AST_PROCEDURE_PARAMS_MAX];
-    
-    for(size_t index = 0; index < ast_proc->params_count; ++index) {
-        AST_Parameter *ast_param = ast_proc->params[index];
-        param_types[index] = get_llvm_simple_type(ctx, ast_param->data_type->kind);
-    }
+            // Generic ones are never declared, the call goes to an instance
+            if(proc == NULL) {
+                AST_Procedure *generic = find_generic_procedure(ctx, ast_proc_call->procedure_signature);
+                if(generic != NULL) {
+                    free(proc_signature);
+                    return emit_generic_call(ctx, ast_proc_call, generic, scope, out_type);
+                }
+            }
 
-    LLVMTypeRef proc_type = LLVMFunctionType(return_type, param_types, ast_proc->params_count, 0);
+            // Otherwise it can be exported from another file
+            if(proc == NULL && ctx->external_procs != NULL) {
+                Procedure_Table_Entry *entry = procedure_table_find(ctx->external_procs, ast_proc_call->procedure_signature);
+                if(entry != NULL) {
+                    declare_procedure(ctx, entry->procedure);
+                    proc = LLVMGetNamedFunction(ctx->module, proc_signature);
+                }
+            }
 
-    // @TODO: Use temporary buffer 
-    char *proc_signature = convert_to_mbs_alloc(ast_proc->signature.data, ast_proc->signature.length, NULL);
+            free(proc_signature);
 
-    LLVMValueRef proc = LLVMAddFunction(ctx->module, proc_signature, proc_type);
+            if(proc == NULL) {
+                report_procedure_call_error(ast_proc_call, L"Call to undefined procedure");
+            }
 
-    free(proc_signature);
+            if(ast_proc_call->type_args_count > 0) {
+                report_procedure_call_error(ast_proc_call, L"Type arguments in call to procedure that isn't generic");
+            }
+
+            if(LLVMCountParams(proc) != ast_proc_call->params_count) {
+                report_procedure_call_error(ast_proc_call, L"Wrong number of arguments in call to procedure");
+            }
 
-    LLVMBasicBlockRef block = LLVMAppendBasicBlock(proc, "block");
+            AST_Procedure *callee = procedure_table_find(ctx->declared, ast_proc_call->procedure_signature)->procedure;
+            *out_type = callee->return_type->kind;
 
-    LLVMPositionBuilderAtEnd(ctx->builder, block);
+            // Checked before specializing, a literal for an array or struct parameter would otherwise get bound into a clone
+            LLVMValueRef memory_args[AST_PROCEDURE_PARAMS_MAX] = { };
+            for(size_t index = 0; index < ast_proc_call->params_count; ++index) {
+                AST_Type_Def *param_type = callee->params[index]->data_type;
+                if(!is_memory_type(param_type->kind)) {
+                    continue;
+                }
 
-    LLVM_Scope scope;
-    llvm_scope_init(&scope);
+                Type_Kind element_type = TYPE_VOID;
+                memory_args[index] = make_memory_argument(ctx, ast_proc_call, index, param_type, memory_args, scope, &element_type);
+                if(param_type->kind == TYPE_ARRAY && !types_match(element_type, param_type->element_type->kind)) {
+                    report_procedure_call_error(ast_proc_call, L"Argument for an array parameter has a different element type in call to procedure");
+                }
+            }
 
-    AST_Block *ast_block = ast_proc->block;
+            // Literal arguments are already bound inside a clone
+            LLVMValueRef clone = specialize_call(ctx, ast_proc_call);
+            if(clone != NULL) {
+                proc = clone;
+            }
 
-    for(size_t index = 0; index < ast_block->nodes_count; ++index) {
-        AST_Node *node = ast_block->nodes[index];
- 
-        if(node->kind == ast_kind(AST_Return)) {
-            emit_return(ctx, (AST_Return *)node, &scope);
-        }
+            LLVMValueRef args[AST_PROCEDURE_PARAMS_MAX];
+            size_t args_count = 0;
+            for(size_t index = 0; index < ast_proc_call->params_count; ++index) {
+                AST_Node *ast_arg = ast_proc_call->params[index];
+                if(memory_args[index] != NULL) {
+                    args[args_count++] = memory_args[index];
+                } else if(clone == NULL || ast_arg->kind != ast_kind(AST_Literal)) {
+                    args[args_count++] = make_llvm_expression_as(ctx, ast_arg, scope, callee->params[index]->data_type->kind);
+                }
+            }
 
-        if(node->kind == ast_kind(AST_Declaration)) {
-            AST_Declaration *ast_decl = (AST_Declaration *)node;
-            
-            // @TODO Do not allocate
-            char *var_ident = convert_to_mbs_alloc(ast_decl->identifier.data, ast_decl->identifier.length, NULL);
+            LLVMTypeRef proc_type = LLVMGlobalGetValueType(proc);
+            const bool returns_value = LLVMGetTypeKind(LLVMGetReturnType(proc_type)) != LLVMVoidTypeKind;
+
+            LLVMValueRef call = LLVMBuildCall2(ctx->builder, proc_type, proc, args, args_count, returns_value ? "c" : "");
+            LLVMSetInstructionCallConv(call, LLVMGetFunctionCallConv(proc));
+            return call;
+        } break;
 
-            LLVMValueRef var_decl = LLVMBuildAlloca(ctx->builder, get_llvm_simple_type(ctx, ast_decl->data_type->kind), var_ident);
+        case ast_kind(AST_Conversion): {
+            AST_Conversion *ast_conversion = (AST_Conversion *)expr;
 
-            if(ast_decl->expression != NULL) {
-                LLVMValueRef expr = make_llvm_expression(ctx, ast_decl->expression, &scope);
-                LLVMBuildStore(ctx->builder, expr, var_decl);
+            Type_Kind from = TYPE_VOID;
+            LLVMValueRef value = make_llvm_expression(ctx, ast_conversion->expression, scope, &from);
+            if(from == TYPE_VOID) {
+                report_error(L"Converting the result of a procedure returning nothing");
+                fatal_error();
             }
 
-            llvm_scope_add_symbol(&scope, var_decl, var_ident, ast_decl->data_type->kind);
-            // free(var_ident);
-        }
-    }
-}
+            *out_type = get_type_kind(ctx, ast_conversion->data_type);
 
-void llvm_convert(LLVM_Context *ctx) {
-    AST_Root *ast_root = ctx->parser->ast_root;
+            // Scalars go into every lane of a vector, vectors only convert to ones with as many lanes
+            if(is_vector_type(from) && get_vector_lanes(from) != get_vector_lanes(*out_type)) {
+                wchar_t from_signature[TYPE_SIGNATURE_MAX];
+                wchar_t to_signature[TYPE_SIGNATURE_MAX];
+                report_error(L"Converting %ls to %ls, the number of lanes differs", format_type_signature(from_signature, from), format_type_signature(to_signature, *out_type));
+                fatal_error();
+            }
+            if(is_vector_type(*out_type) && !is_vector_type(from)) {
+                return build_broadcast(ctx, build_conversion(ctx, value, from, get_element_type(*out_type)), *out_type);
+            }
 
-    for(size_t index = 0; index < ast_root->nodes_count; ++index) {
-        AST_Node *node = ast_root->nodes[index];
-        if(node->kind == ast_kind(AST_Procedure)) {
-            emit_procedure(ctx, (AST_Procedure *)node);
-        }
-    }
+            return build_conversion(ctx, value, from, *out_type);
+        } break;
 
-    LLVMVerifyModule(ctx->module, LLVMAbortProcessAction, NULL);
-}
+        case ast_kind(AST_Index): {
+            AST_Index *ast_index = (AST_Index *)expr;
 
-bool llvm_write_ir_file(LLVM_Context *ctx, const char *filepath) {
-    char *error_message = NULL;
-    bool success = LLVMPrintModuleToFile(ctx->module, filepath, &error_message) == 0;
-    if(!success) {
-        fprintf(stderr, "LLVM PRINT TO FILE ERROR: %s\n", error_message);
-        LLVMDisposeMessage(error_message);
-        return false;
+            if(ast_index->expression->kind == ast_kind(AST_Variable_Ref)) {
+                Str_View var_ident = ((AST_Variable_Ref *)ast_index->expression)->var_ident;
+                Scope_Symbol symbol = lookup_variable(scope, var_ident);
+                if(symbol.type == TYPE_ARRAY && symbol.element_type == TYPE_CUSTOM) {
+                    report_error(L"Element of the array of structs %.*ls used as a value, only its fields are values", var_ident.length, var_ident.data);
+                    fatal_error();
+                }
+                if(symbol.type == TYPE_ARRAY) {
+                    LLVMValueRef element = build_element_pointer(ctx, &symbol, ast_index->index, scope);
+                    *out_type = symbol.element_type;
+                    return LLVMBuildLoad2(ctx->builder, get_llvm_simple_type(ctx, symbol.element_type), element, "");
+                }
+            }
+
+            Type_Kind type = TYPE_VOID;
+            LLVMValueRef vector = make_llvm_expression(ctx, ast_index->expression, scope, &type);
+            if(!is_vector_type(type)) {
+                wchar_t signature[TYPE_SIGNATURE_MAX];
+                report_error(L"Indexing a value of type %ls, only vectors and arrays can be indexed", format_type_signature(signature, type));
+                fatal_error();
+            }
+
+            Type_Kind index_type = TYPE_VOID;
+            LLVMValueRef index = make_llvm_index(ctx, ast_index->index, scope, L"Lane", &index_type);
+
+            // Past the last lane is only caught for constants, at runtime the result is undefined
+            if(LLVMIsAConstantInt(index) && LLVMConstIntGetZExtValue(index) >= get_vector_lanes(type)) {
+                wchar_t signature[TYPE_SIGNATURE_MAX];
+                report_error(L"Lane index %lld out of range of %ls", LLVMConstIntGetSExtValue(index), format_type_signature(signature, type));
+                fatal_error();
+            }
+
+            *out_type = get_element_type(type);
+            return LLVMBuildExtractElement(ctx->builder, vector, index, "lane");
+        } break;
+
+        case ast_kind(AST_Reduction): {
+            AST_Reduction *ast_reduction = (AST_Reduction *)expr;
+
+            Type_Kind type = TYPE_VOID;
+            LLVMValueRef vector = make_llvm_expression(ctx, ast_reduction->expression, scope, &type);
+            if(!is_vector_type(type)) {
+                wchar_t signature[TYPE_SIGNATURE_MAX];
+                report_error(L"%ls of a value of type %ls, only vectors can be reduced", reduction_operation_string(ast_reduction->operation), format_type_signature(signature, type));
+                fatal_error();
+            }
+
+            *out_type = get_element_type(type);
+            return build_reduction(ctx, vector, type, ast_reduction->operation);
+        } break;
+
+        case ast_kind(AST_Field): {
+            LLVMValueRef field = build_field_pointer(ctx, (AST_Field *)expr, scope, out_type);
+            return LLVMBuildLoad2(ctx->builder, get_llvm_simple_type(ctx, *out_type), field, "");
+        } break;
+    }
+}
+
+void emit_return(LLVM_Context *ctx, AST_Return *ast_ret, LLVM_Scope *scope) {
+    if(ast_ret->expression == NULL) {
+        LLVMBuildRetVoid(ctx->builder);
+        return;
+    }
+    
+    LLVMValueRef expr = make_llvm_expression_as(ctx, ast_ret->expression, scope, scope->return_type);
+    LLVMBuildRet(ctx->builder, expr);
+}
+
+// Builds the alloca at the top of the entry block, then puts the builder back where it was
+static LLVMValueRef build_entry_alloca(LLVM_Context *ctx, LLVM_Scope *scope, LLVMTypeRef type, const char *name) {
+    LLVMBasicBlockRef current_block = LLVMGetInsertBlock(ctx->builder);
+
+    LLVMValueRef first_instruction = LLVMGetFirstInstruction(scope->entry_block);
+    if(first_instruction != NULL) {
+        LLVMPositionBuilderBefore(ctx->builder, first_instruction);
+    } else {
+        LLVMPositionBuilderAtEnd(ctx->builder, scope->entry_block);
+    }
+
+    LLVMValueRef alloca = LLVMBuildAlloca(ctx->builder, type, name);
+
+    LLVMPositionBuilderAtEnd(ctx->builder, current_block);
+    return alloca;
+}
+
+void emit_declaration(LLVM_Context *ctx, AST_Declaration *ast_decl, LLVM_Scope *scope) {
+    // @TODO Do not allocate
+    char *var_ident = convert_to_mbs_alloc(ast_decl->identifier.data, ast_decl->identifier.length, NULL);
+
+    // Elements and fields read before being assigned are 0 rather than undefined
+    if(ast_decl->data_type->kind == TYPE_ARRAY) {
+        AST_Type_Def *element = ast_decl->data_type->element_type;
+        const Type_Kind element_type = get_type_kind(ctx, element);
+        LLVMTypeRef array_type = get_llvm_array_type(ctx, element_type, element->struct_def, ast_decl->data_type->array_length);
+        LLVMValueRef array = build_entry_alloca(ctx, scope, array_type, var_ident);
+        LLVMBuildMemSet(ctx->builder, array, LLVMConstInt(LLVMInt8TypeInContext(ctx->context), 0, 0), LLVMSizeOf(array_type), LLVMGetAlignment(array));
+
+        llvm_scope_add_array(scope, array, var_ident, element_type, element->struct_def, ast_decl->data_type->array_length);
+        return;
+    }
+
+    if(ast_decl->data_type->kind == TYPE_CUSTOM) {
+        LLVMTypeRef struct_type = get_llvm_struct_type(ctx, ast_decl->data_type->struct_def);
+        LLVMValueRef struct_slot = build_entry_alloca(ctx, scope, struct_type, var_ident);
+        LLVMBuildMemSet(ctx->builder, struct_slot, LLVMConstInt(LLVMInt8TypeInContext(ctx->context), 0, 0), LLVMSizeOf(struct_type), LLVMGetAlignment(struct_slot));
+
+        llvm_scope_add_struct(scope, struct_slot, var_ident, ast_decl->data_type->struct_def);
+        return;
+    }
+
+    // Variables never assigned to after their declaration are bound directly to the SSA value of the initializer
+    const Type_Kind type = get_type_kind(ctx, ast_decl->data_type);
+    if(ast_decl->expression != NULL && !(ast_decl->node.flags & AST_FLAG_ASSIGNED)) {
+        LLVMValueRef expr = make_llvm_expression_as(ctx, ast_decl->expression, scope, type);
+        // Name the result after the variable, unless it is just another variable's value
+        if(LLVMIsAInstruction(expr) && ast_decl->expression->kind != ast_kind(AST_Variable_Ref)) {
+            LLVMSetValueName2(expr, var_ident, strlen(var_ident));
+        }
+
+        llvm_scope_add_symbol(scope, expr, var_ident, type, false);
+        return;
+    }
+
+    LLVMValueRef var_decl = build_entry_alloca(ctx, scope, get_llvm_simple_type(ctx, type), var_ident);
+    if(ast_decl->expression != NULL) {
+        LLVMBuildStore(ctx->builder, make_llvm_expression_as(ctx, ast_decl->expression, scope, type), var_decl);
+    }
+
+    llvm_scope_add_symbol(scope, var_decl, var_ident, type, true);
+    // free(var_ident);
+}
+
+static void emit_assignment(LLVM_Context *ctx, AST_Assignment *ast_assignment, LLVM_Scope *scope) {
+    AST_Node *target = ast_assignment->target;
+    if(target->kind == ast_kind(AST_Field)) {
+        Type_Kind field_type = TYPE_VOID;
+        LLVMValueRef field = build_field_pointer(ctx, (AST_Field *)target, scope, &field_type);
+        LLVMBuildStore(ctx->builder, make_llvm_expression_as(ctx, ast_assignment->expression, scope, field_type), field);
+        return;
+    }
+
+    AST_Variable_Ref *ast_var_ref = (AST_Variable_Ref *)(target->kind == ast_kind(AST_Index) ? ((AST_Index *)target)->expression : target);
+    Scope_Symbol symbol = lookup_variable(scope, ast_var_ref->var_ident);
+
+    if(target->kind == ast_kind(AST_Variable_Ref)) {
+        if(symbol.type == TYPE_ARRAY) {
+            report_error(L"Assigning to the whole array %.*ls, assign its elements instead", ast_var_ref->var_ident.length, ast_var_ref->var_ident.data);
+            fatal_error();
+        }
+        if(symbol.type == TYPE_CUSTOM) {
+            report_error(L"Assigning to the whole struct %.*ls, assign its fields instead", ast_var_ref->var_ident.length, ast_var_ref->var_ident.data);
+            fatal_error();
+        }
+
+        assert(symbol.is_stack_slot && "Variables assigned to get a stack slot");
+        LLVMBuildStore(ctx->builder, make_llvm_expression_as(ctx, ast_assignment->expression, scope, symbol.type), symbol.value_ref);
+        return;
+    }
+
+    AST_Index *ast_index = (AST_Index *)target;
+    if(symbol.type == TYPE_ARRAY && symbol.element_type == TYPE_CUSTOM) {
+        report_error(L"Assigning to a whole element of the array of structs %.*ls, assign its fields instead", ast_var_ref->var_ident.length, ast_var_ref->var_ident.data);
+        fatal_error();
+    }
+    if(symbol.type == TYPE_ARRAY) {
+        LLVMValueRef element = build_element_pointer(ctx, &symbol, ast_index->index, scope);
+        LLVMBuildStore(ctx->builder, make_llvm_expression_as(ctx, ast_assignment->expression, scope, symbol.element_type), element);
+        return;
+    }
+
+    // A lane of a vector variable, the rest of it stays
+    if(symbol.type == TYPE_CUSTOM) {
+        report_error(L"Indexing the struct %.*ls, only vectors and arrays can be indexed", ast_var_ref->var_ident.length, ast_var_ref->var_ident.data);
+        fatal_error();
+    }
+    if(!is_vector_type(symbol.type)) {
+        wchar_t signature[TYPE_SIGNATURE_MAX];
+        report_error(L"Indexing a value of type %ls, only vectors and arrays can be indexed", format_type_signature(signature, symbol.type));
+        fatal_error();
+    }
+
+    Type_Kind index_type = TYPE_VOID;
+    LLVMValueRef index = make_llvm_index(ctx, ast_index->index, scope, L"Lane", &index_type);
+    if(LLVMIsAConstantInt(index) && LLVMConstIntGetZExtValue(index) >= get_vector_lanes(symbol.type)) {
+        wchar_t signature[TYPE_SIGNATURE_MAX];
+        report_error(L"Lane index %lld out of range of %ls", LLVMConstIntGetSExtValue(index), format_type_signature(signature, symbol.type));
+        fatal_error();
+    }
+
+    assert(symbol.is_stack_slot && "Variables assigned to get a stack slot");
+    LLVMValueRef lane = make_llvm_expression_as(ctx, ast_assignment->expression, scope, get_element_type(symbol.type));
+    LLVMValueRef vector = LLVMBuildLoad2(ctx->builder, get_llvm_simple_type(ctx, symbol.type), symbol.value_ref, "");
+    LLVMBuildStore(ctx->builder, LLVMBuildInsertElement(ctx->builder, vector, lane, index, "lane"), symbol.value_ref);
+}
+
+// Condition of a loop, the operands follow the rules of binary operations; There are no booleans, so only loops use the result
+static LLVMValueRef make_llvm_comparison(LLVM_Context *ctx, AST_Comparison *ast_comparison, LLVM_Scope *scope) {
+    Type_Kind type_l = TYPE_VOID;
+    Type_Kind type_r = TYPE_VOID;
+    LLVMValueRef expr_l = make_llvm_expression(ctx, ast_comparison->expr_l, scope, &type_l);
+    LLVMValueRef expr_r = make_llvm_expression(ctx, ast_comparison->expr_r, scope, &type_r);
+
+    Type_Kind type = type_l;
+    if(is_untyped_constant(ast_comparison->expr_l) && (!is_untyped_constant(ast_comparison->expr_r) || is_floating_type(type_r))) {
+        type = type_r;
+    }
+
+    if(type == TYPE_VOID || is_vector_type(type_l) || is_vector_type(type_r)) {
+        wchar_t signature[TYPE_SIGNATURE_MAX];
+        report_error(L"Comparing values of type %ls, only scalars can be compared", format_type_signature(signature, is_vector_type(type_r) ? type_r : type));
+        fatal_error();
+    }
+
+    expr_l = match_type(ctx, ast_comparison->expr_l, expr_l, type_l, type);
+    expr_r = match_type(ctx, ast_comparison->expr_r, expr_r, type_r, type);
+
+    if(is_floating_type(type)) {
+        // Ordered, so NaN fails every comparison but !=
+        switch(ast_comparison->operation) { DEFAULT_INVALID;
+            case COMPARISON_LESS:          return LLVMBuildFCmp(ctx->builder, LLVMRealOLT, expr_l, expr_r, "cmp");
+            case COMPARISON_LESS_EQUAL:    return LLVMBuildFCmp(ctx->builder, LLVMRealOLE, expr_l, expr_r, "cmp");
+            case COMPARISON_GREATER:       return LLVMBuildFCmp(ctx->builder, LLVMRealOGT, expr_l, expr_r, "cmp");
+            case COMPARISON_GREATER_EQUAL: return LLVMBuildFCmp(ctx->builder, LLVMRealOGE, expr_l, expr_r, "cmp");
+            case COMPARISON_EQUAL:         return LLVMBuildFCmp(ctx->builder, LLVMRealOEQ, expr_l, expr_r, "cmp");
+            case COMPARISON_NOT_EQUAL:     return LLVMBuildFCmp(ctx->builder, LLVMRealUNE, expr_l, expr_r, "cmp");
+        }
+    }
+
+    const bool is_unsigned = is_unsigned_type(type);
+    switch(ast_comparison->operation) { DEFAULT_INVALID;
+        case COMPARISON_LESS:          return LLVMBuildICmp(ctx->builder, is_unsigned ? LLVMIntULT : LLVMIntSLT, expr_l, expr_r, "cmp");
+        case COMPARISON_LESS_EQUAL:    return LLVMBuildICmp(ctx->builder, is_unsigned ? LLVMIntULE : LLVMIntSLE, expr_l, expr_r, "cmp");
+        case COMPARISON_GREATER:       return LLVMBuildICmp(ctx->builder, is_unsigned ? LLVMIntUGT : LLVMIntSGT, expr_l, expr_r, "cmp");
+        case COMPARISON_GREATER_EQUAL: return LLVMBuildICmp(ctx->builder, is_unsigned ? LLVMIntUGE : LLVMIntSGE, expr_l, expr_r, "cmp");
+        case COMPARISON_EQUAL:         return LLVMBuildICmp(ctx->builder, LLVMIntEQ, expr_l, expr_r, "cmp");
+        case COMPARISON_NOT_EQUAL:     return LLVMBuildICmp(ctx->builder, LLVMIntNE, expr_l, expr_r, "cmp");
+    }
+    return NULL;
+}
+
+static bool block_has_terminator(LLVM_Context *ctx) {
+    return LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(ctx->builder)) != NULL;
+}
+
+// Loop ID on the branch back to the header of a dla loop: a distinct node listing itself first, then the hints
+// Its bound is evaluated once, so it always ends and can be marked as making progress; dopóki loops get no hints,
+// one that never ends without side effects has to stay. Unrolling is left to the unroller's cost model
+static void set_loop_metadata(LLVM_Context *ctx, LLVMValueRef back_branch) {
+    LLVMMetadataRef progress_name = LLVMMDStringInContext2(ctx->context, "llvm.loop.mustprogress", strlen("llvm.loop.mustprogress"));
+    LLVMMetadataRef vectorize_operands[2] = {
+        LLVMMDStringInContext2(ctx->context, "llvm.loop.vectorize.enable", strlen("llvm.loop.vectorize.enable")),
+        LLVMValueAsMetadata(LLVMConstInt(LLVMInt1TypeInContext(ctx->context), 1, 0)),
+    };
+
+    LLVMMetadataRef self = LLVMTemporaryMDNode(ctx->context, NULL, 0);
+    LLVMMetadataRef operands[3] = {
+        self,
+        LLVMMDNodeInContext2(ctx->context, &progress_name, 1),
+        LLVMMDNodeInContext2(ctx->context, vectorize_operands, 2),
+    };
+
+    LLVMMetadataRef loop_id = LLVMMDNodeInContext2(ctx->context, operands, ARRAY_SIZE(operands));
+    LLVMMetadataReplaceAllUsesWith(self, loop_id);
+
+    const uint32_t kind = LLVMGetMDKindIDInContext(ctx->context, "llvm.loop", strlen("llvm.loop"));
+    LLVMSetMetadata(back_branch, kind, LLVMMetadataAsValue(ctx->context, loop_id));
+}
+
+static void emit_block(LLVM_Context *ctx, AST_Block *ast_block, LLVM_Scope *scope);
+
+// header: condition, to the body or out; body: back to the header, which is its only latch
+static void emit_while(LLVM_Context *ctx, AST_While *ast_while, LLVM_Scope *scope) {
+    LLVMValueRef proc = LLVMGetBasicBlockParent(LLVMGetInsertBlock(ctx->builder));
+    LLVMBasicBlockRef header_block = LLVMAppendBasicBlockInContext(ctx->context, proc, "while.header");
+    LLVMBasicBlockRef body_block = LLVMAppendBasicBlockInContext(ctx->context, proc, "while.body");
+    LLVMBasicBlockRef exit_block = LLVMAppendBasicBlockInContext(ctx->context, proc, "while.exit");
+
+    LLVMBuildBr(ctx->builder, header_block);
+
+    LLVMPositionBuilderAtEnd(ctx->builder, header_block);
+    LLVMBuildCondBr(ctx->builder, make_llvm_comparison(ctx, ast_while->condition, scope), body_block, exit_block);
+
+    LLVMPositionBuilderAtEnd(ctx->builder, body_block);
+    emit_block(ctx, ast_while->block, scope);
+    if(!block_has_terminator(ctx)) {
+        LLVMBuildBr(ctx->builder, header_block);
+    }
+
+    // After the blocks of nested loops
+    LLVMMoveBasicBlockAfter(exit_block, LLVMGetLastBasicBlock(proc));
+    LLVMPositionBuilderAtEnd(ctx->builder, exit_block);
+}
+
+// The shape the loop passes expect: the current block is the preheader, the header compares the induction variable against the end,
+// and a single latch steps it; Stepping can't overflow since it is below the end, so it is nsw or nuw
+static void emit_for(LLVM_Context *ctx, AST_For *ast_for, LLVM_Scope *scope) {
+    Type_Kind start_type = TYPE_VOID;
+    Type_Kind end_type = TYPE_VOID;
+    LLVMValueRef start = make_llvm_expression(ctx, ast_for->start, scope, &start_type);
+    LLVMValueRef end = make_llvm_expression(ctx, ast_for->end, scope, &end_type);
+
+    // An untyped bound takes the type of the other one, like operands
+    const Type_Kind type = is_untyped_constant(ast_for->start) ? end_type : start_type;
+    if(type == TYPE_VOID || is_floating_type(type) || is_vector_type(type)) {
+        report_error(L"Bounds of a dla loop have to be integers: %.*ls", ast_for->identifier.length, ast_for->identifier.data);
+        fatal_error();
+    }
+
+    start = match_type(ctx, ast_for->start, start, start_type, type);
+    end = match_type(ctx, ast_for->end, end, end_type, type);
+
+    char *var_ident = convert_to_mbs_alloc(ast_for->identifier.data, ast_for->identifier.length, NULL);
+    const bool is_unsigned = is_unsigned_type(type);
+
+    LLVMBasicBlockRef preheader_block = LLVMGetInsertBlock(ctx->builder);
+    LLVMValueRef proc = LLVMGetBasicBlockParent(preheader_block);
+    LLVMBasicBlockRef header_block = LLVMAppendBasicBlockInContext(ctx->context, proc, "for.header");
+    LLVMBasicBlockRef body_block = LLVMAppendBasicBlockInContext(ctx->context, proc, "for.body");
+
+    LLVMBuildBr(ctx->builder, header_block);
+
+    LLVMPositionBuilderAtEnd(ctx->builder, header_block);
+    LLVMValueRef induction = LLVMBuildPhi(ctx->builder, get_llvm_simple_type(ctx, type), var_ident);
+    LLVMValueRef condition = LLVMBuildICmp(ctx->builder, is_unsigned ? LLVMIntULT : LLVMIntSLT, induction, end, "cmp");
+
+    LLVMBasicBlockRef exit_block = LLVMAppendBasicBlockInContext(ctx->context, proc, "for.exit");
+    LLVMBuildCondBr(ctx->builder, condition, body_block, exit_block);
+
+    // Visible in the body only
+    LLVMPositionBuilderAtEnd(ctx->builder, body_block);
+    const size_t symbols_count = scope->symbols_count;
+    llvm_scope_add_symbol(scope, induction, var_ident, type, false);
+    emit_block(ctx, ast_for->block, scope);
+    scope->symbols_count = symbols_count;
+
+    LLVMBasicBlockRef latch_block = LLVMAppendBasicBlockInContext(ctx->context, proc, "for.latch");
+    if(!block_has_terminator(ctx)) {
+        LLVMBuildBr(ctx->builder, latch_block);
+    }
+
+    LLVMPositionBuilderAtEnd(ctx->builder, latch_block);
+    LLVMValueRef one = LLVMConstInt(get_llvm_simple_type(ctx, type), 1, 0);
+    LLVMValueRef next = is_unsigned ? LLVMBuildNUWAdd(ctx->builder, induction, one, "next") : LLVMBuildNSWAdd(ctx->builder, induction, one, "next");
+    set_loop_metadata(ctx, LLVMBuildBr(ctx->builder, header_block));
+
+    LLVMValueRef incoming_values[2] = { start, next };
+    LLVMBasicBlockRef incoming_blocks[2] = { preheader_block, latch_block };
+    LLVMAddIncoming(induction, incoming_values, incoming_blocks, 2);
+
+    LLVMMoveBasicBlockAfter(exit_block, latch_block);
+    LLVMPositionBuilderAtEnd(ctx->builder, exit_block);
+}
+
+// Statements after a return are never reached, nothing gets emitted for them
+static void emit_block(LLVM_Context *ctx, AST_Block *ast_block, LLVM_Scope *scope) {
+    // Declarations go out of scope with the block
+    const size_t symbols_count = scope->symbols_count;
+
+    for(size_t index = 0; index < ast_block->nodes_count && !block_has_terminator(ctx); ++index) {
+        AST_Node *node = ast_block->nodes[index];
+
+        switch(node->kind) { DEFAULT_INVALID;
+            case ast_kind(AST_Return): {
+                emit_return(ctx, (AST_Return *)node, scope);
+            } break;
+
+            case ast_kind(AST_Declaration): {
+                emit_declaration(ctx, (AST_Declaration *)node, scope);
+            } break;
+
+            case ast_kind(AST_Assignment): {
+                emit_assignment(ctx, (AST_Assignment *)node, scope);
+            } break;
+
+            // Any result is dropped
+            case ast_kind(AST_Procedure_Call): {
+                Type_Kind type = TYPE_VOID;
+                make_llvm_expression(ctx, node, scope, &type);
+            } break;
+
+            case ast_kind(AST_While): {
+                emit_while(ctx, (AST_While *)node, scope);
+            } break;
+
+            case ast_kind(AST_For): {
+                emit_for(ctx, (AST_For *)node, scope);
+            } break;
+        }
+    }
+
+    scope->symbols_count = symbols_count;
+}
+
+static void add_enum_attribute(LLVM_Context *ctx, LLVMValueRef proc, LLVMAttributeIndex index, const char *name) {
+    const uint32_t kind = LLVMGetEnumAttributeKindForName(name, strlen(name));
+    assert(kind != 0 && "Unknown LLVM attribute name");
+    LLVMAddAttributeAtIndex(proc, index, LLVMCreateEnumAttribute(ctx->context, kind, 0));
+}
+
+// What array and struct parameters point to
+static LLVMTypeRef get_llvm_pointee_type(LLVM_Context *ctx, AST_Type_Def *param_type) {
+    if(param_type->kind == TYPE_CUSTOM) {
+        return get_llvm_struct_type(ctx, param_type->struct_def);
+    }
+
+    AST_Type_Def *element = param_type->element_type;
+    return get_llvm_array_type(ctx, get_type_kind(ctx, element), element->struct_def, param_type->array_length);
+}
+
+// Arrays and structs are passed as a pointer to them
+static LLVMTypeRef get_llvm_param_type(LLVM_Context *ctx, AST_Type_Def *param_type) {
+    if(is_memory_type(param_type->kind)) {
+        return LLVMPointerType(get_llvm_pointee_type(ctx, param_type), 0);
+    }
+    return get_llvm_simple_type(ctx, get_type_kind(ctx, param_type));
+}
+
+// Parameters bound to a literal in constant_args are left out; constant_args can be NULL
+static LLVMTypeRef get_procedure_type(LLVM_Context *ctx, AST_Procedure *ast_proc, AST_Node **constant_args) {
+    LLVMTypeRef return_type = get_llvm_simple_type(ctx, get_type_kind(ctx, ast_proc->return_type));
+    
+    LLVMTypeRef param_types[AST_PROCEDURE_PARAMS_MAX];
+    size_t param_count = 0;
+    
+    for(size_t index = 0; index < ast_proc->params_count; ++index) {
+        if(constant_args != NULL && constant_args[index]->kind == ast_kind(AST_Literal)) {
+            continue;
+        }
+
+        AST_Parameter *ast_param = ast_proc->params[index];
+        param_types[param_count++] = get_llvm_param_type(ctx, ast_param->data_type);
     }
+
+    return LLVMFunctionType(return_type, param_types, param_count, 0);
+}
+
+// There are no exceptions and no uninitialized values can be passed around
+// Arrays and structs passed in never overlap and the pointers don't outlive the call, which lets loops over them vectorize without runtime checks
+static void add_procedure_attributes(LLVM_Context *ctx, LLVMValueRef proc, AST_Procedure *ast_proc, AST_Node **constant_args) {
+    add_enum_attribute(ctx, proc, LLVMAttributeFunctionIndex, "nounwind");
+    if(ast_proc->return_type->kind != TYPE_VOID) {
+        add_enum_attribute(ctx, proc, LLVMAttributeReturnIndex, "noundef");
+    }
+
+    LLVMAttributeIndex attribute_index = 1;
+    for(size_t index = 0; index < ast_proc->params_count; ++index) {
+        if(constant_args != NULL && constant_args[index]->kind == ast_kind(AST_Literal)) {
+            continue;
+        }
+
+        add_enum_attribute(ctx, proc, attribute_index, "noundef");
+
+        AST_Type_Def *param_type = ast_proc->params[index]->data_type;
+        if(is_memory_type(param_type->kind)) {
+            add_enum_attribute(ctx, proc, attribute_index, "noalias");
+            add_enum_attribute(ctx, proc, attribute_index, "nocapture");
+
+            // Padding included, from the module's data layout
+            const uint64_t bytes = LLVMABISizeOfType(LLVMGetModuleDataLayout(ctx->module), get_llvm_pointee_type(ctx, param_type));
+            const uint32_t kind = LLVMGetEnumAttributeKindForName("dereferenceable", strlen("dereferenceable"));
+            LLVMAddAttributeAtIndex(proc, attribute_index, LLVMCreateEnumAttribute(ctx->context, kind, bytes));
+        }
+
+        attribute_index += 1;
+    }
+}
+
+// Adds the procedure to the module without a body; Generic ones only exist as instances, added by their calls
+void declare_procedure(LLVM_Context *ctx, AST_Procedure *ast_proc) {
+    if(ast_proc->type_params_count > 0) {
+        return;
+    }
+
+    LLVMTypeRef proc_type = get_procedure_type(ctx, ast_proc, NULL);
+
+    // @TODO: Use temporary buffer 
+    char *proc_signature = convert_to_mbs_alloc(ast_proc->signature.data, ast_proc->signature.length, NULL);
+
+    if(LLVMGetNamedFunction(ctx->module, proc_signature) != NULL) {
+        report_error(L"Procedure defined more than once: %.*ls", ast_proc->signature.length, ast_proc->signature.data);
+        fatal_error();
+    }
+
+    LLVMValueRef proc = LLVMAddFunction(ctx->module, proc_signature, proc_type);
+
+    free(proc_signature);
+
+    // Freed with the module after a fatal error
+    if(ctx->declared == NULL) {
+        ctx->declared = (Procedure_Table *)malloc(sizeof(Procedure_Table));
+        if(ctx->declared == NULL || !procedure_table_init(ctx->declared, 256)) {
+            report_error(L"Failed to allocate memory in declare_procedure.");
+            free(ctx->declared);
+            ctx->declared = NULL;
+            fatal_error();
+        }
+    }
+
+    // Redefinitions are caught above
+    if(!procedure_table_add(ctx->declared, ast_proc, 0, NULL)) {
+        fatal_error();
+    }
+
+    // Procedures nobody outside can see are free to use the faster calling convention, LLVM can then also inline and drop them
+    if(!(ast_proc->node.flags & AST_FLAG_EXPORTED)) {
+        LLVMSetFunctionCallConv(proc, LLVMFastCallConv);
+        if(ctx->is_partition) {
+            LLVMSetVisibility(proc, LLVMHiddenVisibility);
+        } else {
+            LLVMSetLinkage(proc, LLVMInternalLinkage);
+        }
+    }
+
+    add_procedure_attributes(ctx, proc, ast_proc, NULL);
+}
+
+// Emits into proc, parameters bound to a literal in constant_args become that constant; constant_args can be NULL
+static void emit_procedure_body(LLVM_Context *ctx, AST_Procedure *ast_proc, LLVMValueRef proc, AST_Node **constant_args) {
+    LLVMBasicBlockRef block = LLVMAppendBasicBlockInContext(ctx->context, proc, "block");
+
+    LLVMPositionBuilderAtEnd(ctx->builder, block);
+
+    LLVM_Scope scope;
+    llvm_scope_init(&scope);
+    scope.basic_block = block;
+    scope.entry_block = block;
+    scope.return_type = get_type_kind(ctx, ast_proc->return_type);
+
+    // Parameters never written to use the incoming values directly
+    size_t llvm_param_index = 0;
+    for(size_t index = 0; index < ast_proc->params_count; ++index) {
+        AST_Parameter *ast_param = ast_proc->params[index];
+
+        char *param_ident = convert_to_mbs_alloc(ast_param->identifier.data, ast_param->identifier.length, NULL);
+
+        LLVMValueRef param = NULL;
+        if(constant_args != NULL && constant_args[index]->kind == ast_kind(AST_Literal)) {
+            param = make_llvm_expression_as(ctx, constant_args[index], &scope, get_type_kind(ctx, ast_param->data_type));
+        } else {
+            param = LLVMGetParam(proc, llvm_param_index++);
+            LLVMSetValueName2(param, param_ident, strlen(param_ident));
+        }
+
+        const Type_Kind param_type = get_type_kind(ctx, ast_param->data_type);
+        if(param_type == TYPE_ARRAY) {
+            AST_Type_Def *element = ast_param->data_type->element_type;
+            llvm_scope_add_array(&scope, param, param_ident, get_type_kind(ctx, element), element->struct_def, ast_param->data_type->array_length);
+        } else if(param_type == TYPE_CUSTOM) {
+            llvm_scope_add_struct(&scope, param, param_ident, ast_param->data_type->struct_def);
+        } else if(ast_param->node.flags & AST_FLAG_ASSIGNED) {
+            LLVMValueRef slot = build_entry_alloca(ctx, &scope, get_llvm_simple_type(ctx, param_type), param_ident);
+            LLVMBuildStore(ctx->builder, param, slot);
+            llvm_scope_add_symbol(&scope, slot, param_ident, param_type, true);
+        } else {
+            llvm_scope_add_symbol(&scope, param, param_ident, param_type, false);
+        }
+    }
+
+    // Skipped bodies get parsed here, the first time codegen needs them
+    emit_block(ctx, parser_parse_body(ctx->parser, ast_proc), &scope);
+
+    // Falling off the end returns from procedures returning nothing
+    if(!block_has_terminator(ctx)) {
+        if(scope.return_type != TYPE_VOID) {
+            report_error(L"Procedure can reach its end without returning a value: %.*ls", ast_proc->signature.length, ast_proc->signature.data);
+            fatal_error();
+        }
+        LLVMBuildRetVoid(ctx->builder);
+    }
+}
+
+void emit_procedure(LLVM_Context *ctx, AST_Procedure *ast_proc) {
+    if(ast_proc->type_params_count > 0) {
+        return;
+    }
+
+    Trace_Span trace_span;
+    trace_begin(&trace_span);
+
+    char *proc_signature = convert_to_mbs_alloc(ast_proc->signature.data, ast_proc->signature.length, NULL);
+    LLVMValueRef proc = LLVMGetNamedFunction(ctx->module, proc_signature);
+    free(proc_signature);
+
+    assert(proc != NULL && "Procedure has to be declared before emitting its body");
+
+    emit_procedure_body(ctx, ast_proc, proc, NULL);
+
+    trace_end_wide(&trace_span, "codegen", ast_proc->signature);
+}
+
+// Clone of the callee for the call's literal arguments, emitted the first time; NULL calls the procedure itself
+static LLVMValueRef specialize_call(LLVM_Context *ctx, AST_Procedure_Call *ast_proc_call) {
+    Specialization_Cache *cache = ctx->specializations;
+    if(cache == NULL || !specialization_has_constants(ast_proc_call->params, ast_proc_call->params_count)) {
+        return NULL;
+    }
+
+    // Procedures of other files have no body here
+    Procedure_Table_Entry *entry = procedure_table_find(&cache->procedures, ast_proc_call->procedure_signature);
+    if(entry == NULL) {
+        return NULL;
+    }
+
+    AST_Procedure *ast_proc = entry->procedure;
+    LLVMValueRef clone = specialization_find(cache, ast_proc, ast_proc_call->params);
+    if(clone != NULL) {
+        return clone;
+    }
+
+    parser_parse_body(ctx->parser, ast_proc);
+
+    Specialization *specialization = specialization_add(cache, ast_proc, ast_proc_call->params);
+    if(specialization == NULL) {
+        return NULL;
+    }
+
+    char *proc_signature = convert_to_mbs_alloc(ast_proc->signature.data, ast_proc->signature.length, NULL);
+    char clone_name[512];
+    snprintf(clone_name, sizeof(clone_name), "%s.spec%llu", proc_signature, (unsigned long long)cache->count);
+    free(proc_signature);
+
+    // Only calls from this module can reach a clone
+    clone = LLVMAddFunction(ctx->module, clone_name, get_procedure_type(ctx, ast_proc, ast_proc_call->params));
+    LLVMSetFunctionCallConv(clone, LLVMFastCallConv);
+    LLVMSetLinkage(clone, LLVMInternalLinkage);
+    add_procedure_attributes(ctx, clone, ast_proc, ast_proc_call->params);
+
+    // Set before emitting, recursive calls with the same literals call the clone itself
+    specialization->clone = clone;
+
+    // The procedure being emitted continues afterwards, the clone isn't part of its generic instance if it is one
+    LLVMBasicBlockRef current_block = LLVMGetInsertBlock(ctx->builder);
+    const Type_Kind *current_type_args = ctx->type_args;
+    ctx->type_args = NULL;
+
+    emit_procedure_body(ctx, ast_proc, clone, ast_proc_call->params);
+
+    ctx->type_args = current_type_args;
+    LLVMPositionBuilderAtEnd(ctx->builder, current_block);
+
+    return clone;
+}
+
+static Generic_Instances *get_generic_instances(LLVM_Context *ctx) {
+    if(ctx->generics != NULL) {
+        return ctx->generics;
+    }
+
+    // Freed with the module after a fatal error
+    ctx->generics = (Generic_Instances *)malloc(sizeof(Generic_Instances));
+    if(ctx->generics == NULL || !generic_instances_init(ctx->generics, ctx->parser->ast_root)) {
+        report_error(L"Failed to set up generic instances in get_generic_instances.");
+        free(ctx->generics);
+        ctx->generics = NULL;
+        fatal_error();
+    }
+
+    return ctx->generics;
+}
+
+// Generic procedure of the module or exported from another file; NULL if the signature names none
+static AST_Procedure *find_generic_procedure(LLVM_Context *ctx, Str_View signature) {
+    Procedure_Table_Entry *entry = procedure_table_find(&get_generic_instances(ctx)->procedures, signature);
+    if(entry == NULL && ctx->external_procs != NULL) {
+        entry = procedure_table_find(ctx->external_procs, signature);
+    }
+
+    return entry != NULL && entry->procedure->type_params_count > 0 ? entry->procedure : NULL;
+}
+
+// Calls the instance of the generic procedure for the call's type arguments, emitted the first time
+static LLVMValueRef emit_generic_call(LLVM_Context *ctx, AST_Procedure_Call *ast_proc_call, AST_Procedure *ast_proc, LLVM_Scope *scope, Type_Kind *out_type) {
+    if(ast_proc->params_count != ast_proc_call->params_count) {
+        report_procedure_call_error(ast_proc_call, L"Wrong number of arguments in call to procedure");
+    }
+
+    // Arrays give the type of their elements
+    LLVMValueRef args[AST_PROCEDURE_PARAMS_MAX];
+    Type_Kind arg_types[AST_PROCEDURE_PARAMS_MAX];
+    for(size_t index = 0; index < ast_proc_call->params_count; ++index) {
+        AST_Type_Def *param_type = ast_proc->params[index]->data_type;
+        if(is_memory_type(param_type->kind)) {
+            args[index] = make_memory_argument(ctx, ast_proc_call, index, param_type, args, scope, &arg_types[index]);
+        } else {
+            args[index] = make_llvm_expression(ctx, ast_proc_call->params[index], scope, &arg_types[index]);
+        }
+    }
+
+    // TYPE_VOID is never a type argument, it marks the ones not known yet
+    Type_Kind type_args[AST_PROCEDURE_TYPE_PARAMS_MAX] = { };
+
+    if(ast_proc_call->type_args_count > 0) {
+        if(ast_proc_call->type_args_count != ast_proc->type_params_count) {
+            report_procedure_call_error(ast_proc_call, L"Wrong number of type arguments in call to procedure");
+        }
+
+        for(size_t index = 0; index < ast_proc_call->type_args_count; ++index) {
+            type_args[index] = get_type_kind(ctx, ast_proc_call->type_args[index]);
+        }
+    } else {
+        // Typed arguments decide, untyped constants only fill in type parameters nothing else gives
+        for(size_t pass = 0; pass < 2; ++pass) {
+            for(size_t index = 0; index < ast_proc->params_count; ++index) {
+                AST_Type_Def *param_type = ast_proc->params[index]->data_type;
+                if(param_type->kind == TYPE_ARRAY) {
+                    param_type = param_type->element_type;
+                }
+                if(get_element_type(param_type->kind) != TYPE_PARAMETER || is_untyped_constant(ast_proc_call->params[index]) != (pass == 1)) {
+                    continue;
+                }
+
+                // Vector parameters of T give T the element type of the argument, constants give their own type
+                Type_Kind arg_type = arg_types[index];
+                if(pass == 0 && is_vector_type(param_type->kind)) {
+                    if(get_vector_lanes(arg_type) != get_vector_lanes(param_type->kind)) {
+                        report_procedure_call_error(ast_proc_call, L"Argument for a vector parameter isn't a vector with as many lanes in call to procedure");
+                    }
+                    arg_type = get_element_type(arg_type);
+                }
+
+                Type_Kind *type_arg = &type_args[param_type->type_param_index];
+                if(pass == 0 && *type_arg != TYPE_VOID && *type_arg != arg_type) {
+                    report_procedure_call_error(ast_proc_call, L"Conflicting types of arguments for the same type parameter in call to procedure");
+                }
+                if(*type_arg == TYPE_VOID) {
+                    *type_arg = arg_type;
+                }
+            }
+        }
+
+        for(size_t index = 0; index < ast_proc->type_params_count; ++index) {
+            if(type_args[index] == TYPE_VOID) {
+                report_procedure_call_error(ast_proc_call, L"Type arguments can't be inferred, give them in [] in call to procedure");
+            }
+        }
+    }
+
+    // Parameter and return types of the instance
+    const Type_Kind *current_type_args = ctx->type_args;
+    ctx->type_args = type_args;
+
+    for(size_t index = 0; index < ast_proc_call->params_count; ++index) {
+        AST_Type_Def *param_type = ast_proc->params[index]->data_type;
+        if(param_type->kind == TYPE_CUSTOM) {
+            continue;
+        }
+        if(param_type->kind != TYPE_ARRAY) {
+            args[index] = match_type(ctx, ast_proc_call->params[index], args[index], arg_types[index], get_type_kind(ctx, param_type));
+        } else if(!types_match(arg_types[index], get_type_kind(ctx, param_type->element_type))) {
+            report_procedure_call_error(ast_proc_call, L"Argument for an array parameter has a different element type in call to procedure");
+        }
+    }
+    *out_type = get_type_kind(ctx, ast_proc->return_type);
+
+    ctx->type_args = current_type_args;
+
+    Generic_Instance *instance = generic_instances_get(get_generic_instances(ctx), ast_proc, type_args);
+    if(instance == NULL) {
+        fatal_error();
+    }
+
+    LLVMValueRef proc = instance->instance;
+    if(proc == NULL) {
+        char instance_name[512];
+        generic_instance_name(instance_name, sizeof(instance_name), ast_proc, type_args);
+
+        // Resolves the type parameters while emitting, the builder goes back to the caller afterwards
+        LLVMBasicBlockRef current_block = LLVMGetInsertBlock(ctx->builder);
+        const Type_Kind *current_type_args = ctx->type_args;
+        ctx->type_args = type_args;
+
+        proc = LLVMAddFunction(ctx->module, instance_name, get_procedure_type(ctx, ast_proc, NULL));
+
+        // Every file calling an exported generic gets its own copy of each instance, the linker keeps one
+        if(ast_proc->node.flags & AST_FLAG_EXPORTED) {
+            LLVMSetLinkage(proc, LLVMLinkOnceODRLinkage);
+        } else {
+            LLVMSetFunctionCallConv(proc, LLVMFastCallConv);
+            LLVMSetLinkage(proc, LLVMInternalLinkage);
+        }
+        add_procedure_attributes(ctx, proc, ast_proc, NULL);
+
+        // Set before emitting, the entry can move while the body instantiates others; Recursive calls find the instance itself
+        instance->instance = proc;
+
+        emit_procedure_body(ctx, ast_proc, proc, NULL);
+
+        ctx->type_args = current_type_args;
+        LLVMPositionBuilderAtEnd(ctx->builder, current_block);
+    }
+
+    LLVMTypeRef proc_type = LLVMGlobalGetValueType(proc);
+    const bool returns_value = LLVMGetTypeKind(LLVMGetReturnType(proc_type)) != LLVMVoidTypeKind;
+
+    LLVMValueRef call = LLVMBuildCall2(ctx->builder, proc_type, proc, args, ast_proc_call->params_count, returns_value ? "c" : "");
+    LLVMSetInstructionCallConv(call, LLVMGetFunctionCallConv(proc));
+    return call;
+}
+
+static bool expression_calls_declared(LLVM_Context *ctx, AST_Node *expr) {
+    switch(expr->kind) {
+        default: {
+            return true;
+        };
+
+        case ast_kind(AST_Binary): {
+            AST_Binary *ast_binary = (AST_Binary *)expr;
+            return expression_calls_declared(ctx, ast_binary->expr_l) && expression_calls_declared(ctx, ast_binary->expr_r);
+        };
+
+        case ast_kind(AST_Comparison): {
+            AST_Comparison *ast_comparison = (AST_Comparison *)expr;
+            return expression_calls_declared(ctx, ast_comparison->expr_l) && expression_calls_declared(ctx, ast_comparison->expr_r);
+        };
+
+        case ast_kind(AST_Conversion): {
+            return expression_calls_declared(ctx, ((AST_Conversion *)expr)->expression);
+        };
+
+        case ast_kind(AST_Index): {
+            AST_Index *ast_index = (AST_Index *)expr;
+            return expression_calls_declared(ctx, ast_index->expression) && expression_calls_declared(ctx, ast_index->index);
+        };
+
+        case ast_kind(AST_Reduction): {
+            return expression_calls_declared(ctx, ((AST_Reduction *)expr)->expression);
+        };
+
+        case ast_kind(AST_Field): {
+            return expression_calls_declared(ctx, ((AST_Field *)expr)->expression);
+        };
+
+        case ast_kind(AST_Procedure_Call): {
+            AST_Procedure_Call *ast_proc_call = (AST_Procedure_Call *)expr;
+            for(size_t index = 0; index < ast_proc_call->params_count; ++index) {
+                if(!expression_calls_declared(ctx, ast_proc_call->params[index])) {
+                    return false;
+                }
+            }
+
+            char *proc_signature = convert_to_mbs_alloc(ast_proc_call->procedure_signature.data, ast_proc_call->procedure_signature.length, NULL);
+            const bool declared = LLVMGetNamedFunction(ctx->module, proc_signature) != NULL ||
+                                  (ctx->external_procs != NULL && procedure_table_find(ctx->external_procs, ast_proc_call->procedure_signature) != NULL);
+            free(proc_signature);
+            return declared;
+        };
+    }
+}
+
+static bool block_calls_declared(LLVM_Context *ctx, AST_Block *ast_block) {
+    for(size_t index = 0; index < ast_block->nodes_count; ++index) {
+        AST_Node *expressions[2];
+        AST_Block *nested_block;
+        const size_t expressions_count = get_statement_expressions(ast_block->nodes[index], expressions, &nested_block);
+
+        for(size_t expr_index = 0; expr_index < expressions_count; ++expr_index) {
+            if(!expression_calls_declared(ctx, expressions[expr_index])) {
+                return false;
+            }
+        }
+
+        if(nested_block != NULL && !block_calls_declared(ctx, nested_block)) {
+            return false;
+        }
+    }
+
     return true;
 }
 
-bool llvm_emit_object(LLVM_Context *ctx, const char *filepath) {
-    char *error_message = NULL;
-    bool success = LLVMTargetMachineEmitToFile(ctx->target_machine, ctx->module, filepath, LLVMObjectFile, &error_message) == 0;
-    if(!success) {
-        fprintf(stderr, "LLVM EMIT ERROR: %s\n", error_message);
-        LLVMDisposeMessage(error_message);
+bool llvm_procedure_calls_declared(LLVM_Context *ctx, AST_Procedure *ast_proc) {
+    return block_calls_declared(ctx, ast_proc->block);
+}
+
+void llvm_verify(LLVM_Context *ctx) {
+    Timing_Section timing;
+    timing_begin(&timing, TIMING_VERIFY);
+    LLVMVerifyModule(ctx->module, LLVMAbortProcessAction, NULL);
+    timing_end(&timing);
+}
+
+static void convert_nodes(LLVM_Context *ctx, AST_Node **nodes, size_t nodes_count) {
+    Timing_Section timing;
+    timing_begin(&timing, TIMING_IR_BUILD);
+
+    // Declare everything first, a partition also needs declarations of procedures it doesn't define
+    AST_Root *ast_root = ctx->parser->ast_root;
+    for(size_t index = 0; index < ast_root->nodes_count; ++index) {
+        AST_Node *node = ast_root->nodes[index];
+        if(node->kind == ast_kind(AST_Procedure)) {
+            declare_procedure(ctx, (AST_Procedure *)node);
+        }
+    }
+
+    // Freed with the module after a fatal error
+    if(ctx->specialize_budget > 0) {
+        ctx->specializations = (Specialization_Cache *)malloc(sizeof(Specialization_Cache));
+        if(ctx->specializations == NULL || !specialization_cache_init(ctx->specializations, ast_root, ctx->specialize_budget)) {
+            report_error(L"Failed to set up specialization in convert_nodes.");
+            free(ctx->specializations);
+            ctx->specializations = NULL;
+            fatal_error();
+        }
+    }
+
+    for(size_t index = 0; index < nodes_count; ++index) {
+        AST_Node *node = nodes[index];
+        if(node->kind == ast_kind(AST_Procedure)) {
+            emit_procedure(ctx, (AST_Procedure *)node);
+        }
+    }
+
+    free_conversion_state(ctx);
+
+    timing_end(&timing);
+
+    llvm_verify(ctx);
+}
+
+void llvm_convert(LLVM_Context *ctx) {
+    AST_Root *ast_root = ctx->parser->ast_root;
+    convert_nodes(ctx, ast_root->nodes, ast_root->nodes_count);
+}
+
+const char *llvm_opt_level_suffix(LLVMCodeGenOptLevel opt_level) {
+    switch(opt_level) { DEFAULT_INVALID;
+        case LLVMCodeGenLevelNone:       return "<O0>";
+        case LLVMCodeGenLevelLess:       return "<O1>";
+        case LLVMCodeGenLevelDefault:    return "<O2>";
+        case LLVMCodeGenLevelAggressive: return "<O3>";
+    }
+    return NULL;
+}
+
+bool llvm_run_passes(LLVM_Context *ctx, const char *passes) {
+    Timing_Section timing;
+    timing_begin(&timing, TIMING_OPTIMIZE);
+
+    LLVMPassBuilderOptionsRef options = LLVMCreatePassBuilderOptions();
+    LLVMErrorRef error = LLVMRunPasses(ctx->module, passes, ctx->target_machine, options);
+    LLVMDisposePassBuilderOptions(options);
+
+    timing_end(&timing);
+
+    if(error != NULL) {
+        char *error_message = LLVMGetErrorMessage(error);
+        report_error(L"LLVM OPTIMIZE ERROR: %hs", error_message);
+        LLVMDisposeErrorMessage(error_message);
         return false;
     }
     return true;
 }
+
+bool llvm_optimize(LLVM_Context *ctx) {
+    if(ctx->opt_level == LLVMCodeGenLevelNone) {
+        return true;
+    }
+
+    char passes[64];
+    snprintf(passes, sizeof(passes), "default%s", llvm_opt_level_suffix(ctx->opt_level));
+    return llvm_run_passes(ctx, passes);
+}
+
+// Weight of a procedure when splitting into partitions, roughly how much IR it will produce
+static size_t get_node_codegen_weight(AST_Node *node) {
+    if(node->kind != ast_kind(AST_Procedure)) {
+        return 0;
+    }
+    AST_Procedure *ast_proc = (AST_Procedure *)node;
+    return 1 + ast_proc->block->nodes_count;
+}
+
+bool llvm_partitions_init(LLVM_Partitions *parts, Parser *parser, size_t partition_count, LLVMCodeGenOptLevel opt_level) {
+    ZERO_STRUCT(*parts);
+
+    // Partition workers only read bodies, the skipped ones get parsed while still on one thread
+    parser_parse_all_bodies(parser);
+
+    AST_Root *ast_root = parser->ast_root;
+
+    // No point in having partitions without any procedures in them
+    partition_count = MAX(MIN(partition_count, ast_root->nodes_count), 1);
+
+    parts->partitions = (LLVM_Partition *)calloc(partition_count, sizeof(LLVM_Partition));
+    if(parts->partitions == NULL) {
+        report_error(L"Failed to allocate memory in llvm_partitions_init.");
+        return false;
+    }
+
+    parts->parser = parser;
+    parts->partition_count = partition_count;
+
+    size_t total_weight = 0;
+    for(size_t index = 0; index < ast_root->nodes_count; ++index) {
+        total_weight += get_node_codegen_weight(ast_root->nodes[index]);
+    }
+
+    // Split into contiguous ranges of about equal weight, so linking them back in order keeps the serial procedure order
+    size_t node_index = 0;
+    size_t weight_done = 0;
+    for(size_t part_index = 0; part_index < partition_count; ++part_index) {
+        LLVM_Partition *part = &parts->partitions[part_index];
+        part->node_first = node_index;
+
+        const size_t weight_target = (total_weight * (part_index + 1)) / partition_count;
+        const size_t nodes_left_for_rest = partition_count - part_index - 1;
+
+        while(node_index < ast_root->nodes_count - nodes_left_for_rest) {
+            if(weight_done >= weight_target && node_index > part->node_first) {
+                break;
+            }
+            weight_done += get_node_codegen_weight(ast_root->nodes[node_index]);
+            node_index += 1;
+        }
+
+        if(part_index + 1 == partition_count) {
+            node_index = ast_root->nodes_count;
+        }
+
+        part->node_count = node_index - part->node_first;
+
+        char module_name[64];
+        snprintf(module_name, sizeof(module_name), "module.%llu", (unsigned long long)part_index);
+
+        if(!llvm_init_module(&part->ctx, parser, opt_level, module_name)) {
+            llvm_partitions_free(parts);
+            return false;
+        }
+
+        part->ctx.is_partition = true;
+    }
+
+    return true;
+}
+
+void llvm_partitions_free(LLVM_Partitions *parts) {
+    for(size_t index = 0; index < parts->partition_count; ++index) {
+        LLVM_Partition *part = &parts->partitions[index];
+        if(part->bitcode != NULL) {
+            LLVMDisposeMemoryBuffer(part->bitcode);
+        }
+        if(part->ctx.context != NULL) {
+            llvm_shutdown(&part->ctx);
+        }
+    }
+
+    free(parts->partitions);
+
+    ZERO_STRUCT(*parts);
+}
+
+static void convert_partition_job(void *user_data, size_t job_index, size_t worker_index) {
+    LLVM_Partitions *parts = (LLVM_Partitions *)user_data;
+    LLVM_Partition *part = &parts->partitions[job_index];
+
+    // Errors must not take down the other workers
+    jmp_buf recovery;
+    jmp_buf *previous_recovery = error_recovery_set(&recovery);
+
+    if(setjmp(recovery) == 0) {
+        convert_nodes(&part->ctx, &parts->parser->ast_root->nodes[part->node_first], part->node_count);
+        if(!llvm_optimize(&part->ctx)) {
+            ATOMIC_ADD(&parts->failed_count, 1);
+        }
+    } else {
+        ATOMIC_ADD(&parts->failed_count, 1);
+    }
+
+    error_recovery_set(previous_recovery);
+}
+
+bool llvm_convert_partitions(LLVM_Partitions *parts, Thread_Pool *pool) {
+    parts->failed_count = 0;
+    return thread_pool_run(pool, parts->partition_count, convert_partition_job, parts) && parts->failed_count == 0;
+}
+
+typedef struct {
+    LLVM_Partitions *parts;
+    Emit_Kind kind;
+    const char *filepath_base;
+    size_t failed_count; // Atomic
+} Emit_Partitions_Job;
+
+static void emit_partition_job(void *user_data, size_t job_index, size_t worker_index) {
+    Emit_Partitions_Job *job = (Emit_Partitions_Job *)user_data;
+    LLVM_Partition *part = &job->parts->partitions[job_index];
+
+    char filepath[512];
+    snprintf(filepath, sizeof(filepath), "%s.%llu.%s", job->filepath_base, (unsigned long long)job_index, emit_kind_extensions[job->kind]);
+
+    if(!llvm_emit(&part->ctx, job->kind, filepath)) {
+        ATOMIC_ADD(&job->failed_count, 1);
+    }
+}
+
+bool llvm_emit_partitions(LLVM_Partitions *parts, Thread_Pool *pool, Emit_Kind kind, const char *filepath_base) {
+    Emit_Partitions_Job job = { .parts = parts, .kind = kind, .filepath_base = filepath_base };
+    return thread_pool_run(pool, parts->partition_count, emit_partition_job, &job) && job.failed_count == 0;
+}
+
+static void write_partition_bitcode_job(void *user_data, size_t job_index, size_t worker_index) {
+    LLVM_Partitions *parts = (LLVM_Partitions *)user_data;
+    LLVM_Partition *part = &parts->partitions[job_index];
+    part->bitcode = LLVMWriteBitcodeToMemoryBuffer(part->ctx.module);
+}
+
+bool llvm_link_partitions(LLVM_Context *ctx, LLVM_Partitions *parts, Thread_Pool *pool) {
+    Timing_Section timing;
+    timing_begin(&timing, TIMING_LINK);
+
+    // Modules from different contexts can't be linked directly, go through bitcode; Serializing runs on the pool
+    bool success = thread_pool_run(pool, parts->partition_count, write_partition_bitcode_job, parts);
+
+    // Bitcode left over after a failure is freed with the partitions
+    for(size_t index = 0; index < parts->partition_count && success; ++index) {
+        LLVM_Partition *part = &parts->partitions[index];
+
+        LLVMModuleRef module = NULL;
+        const bool parsed = LLVMParseBitcodeInContext2(ctx->context, part->bitcode, &module) == 0;
+
+        LLVMDisposeMemoryBuffer(part->bitcode);
+        part->bitcode = NULL;
+
+        if(!parsed) {
+            report_error(L"LLVM LINK ERROR: Failed to load bitcode of partition %llu", (unsigned long long)index);
+            success = false;
+        } else if(LLVMLinkModules2(ctx->module, module) != 0) { // Source module gets destroyed by the linker
+            report_error(L"LLVM LINK ERROR: Failed to link partition %llu", (unsigned long long)index);
+            success = false;
+        }
+    }
+
+    if(success) {
+        llvm_internalize_procedures(ctx);
+    }
+
+    timing_end(&timing);
+
+    if(success) {
+        llvm_verify(ctx);
+    }
+    return success;
+}
+
+void llvm_internalize_procedures(LLVM_Context *ctx) {
+    AST_Root *ast_root = ctx->parser->ast_root;
+    for(size_t index = 0; index < ast_root->nodes_count; ++index) {
+        AST_Node *node = ast_root->nodes[index];
+        if(node->kind != ast_kind(AST_Procedure) || (node->flags & AST_FLAG_EXPORTED)) {
+            continue;
+        }
+
+        AST_Procedure *ast_proc = (AST_Procedure *)node;
+        char *proc_signature = convert_to_mbs_alloc(ast_proc->signature.data, ast_proc->signature.length, NULL);
+        LLVMValueRef proc = LLVMGetNamedFunction(ctx->module, proc_signature);
+        free(proc_signature);
+
+        if(proc != NULL && !LLVMIsDeclaration(proc)) {
+            LLVMSetVisibility(proc, LLVMDefaultVisibility);
+            LLVMSetLinkage(proc, LLVMInternalLinkage);
+        }
+    }
+}
+
+LLVMMemoryBufferRef llvm_emit_to_memory_buffer(LLVM_Context *ctx, Emit_Kind kind) {
+    switch(kind) { DEFAULT_INVALID;
+        case EMIT_OBJECT:
+        case EMIT_ASSEMBLY: {
+            char *error_message = NULL;
+            LLVMMemoryBufferRef buffer = NULL;
+            LLVMCodeGenFileType file_type = kind == EMIT_OBJECT ? LLVMObjectFile : LLVMAssemblyFile;
+            if(LLVMTargetMachineEmitToMemoryBuffer(ctx->target_machine, ctx->module, file_type, &error_message, &buffer) != 0) {
+                report_error(L"LLVM EMIT ERROR: %hs", error_message);
+                LLVMDisposeMessage(error_message);
+                return NULL;
+            }
+            return buffer;
+        };
+
+        case EMIT_BITCODE: {
+            return LLVMWriteBitcodeToMemoryBuffer(ctx->module);
+        };
+
+        case EMIT_IR: {
+            // Printed IR is a plain string, wrap it so every kind gets written the same way
+            char *ir_string = LLVMPrintModuleToString(ctx->module);
+            LLVMMemoryBufferRef buffer = LLVMCreateMemoryBufferWithMemoryRangeCopy(ir_string, strlen(ir_string), "ir");
+            LLVMDisposeMessage(ir_string);
+            return buffer;
+        };
+    }
+    return NULL;
+}
+
+bool llvm_emit(LLVM_Context *ctx, Emit_Kind kind, const char *filepath) {
+    Timing_Section timing;
+    timing_begin(&timing, TIMING_EMIT);
+
+    LLVMMemoryBufferRef buffer = llvm_emit_to_memory_buffer(ctx, kind);
+    if(buffer == NULL) {
+        timing_end(&timing);
+        return false;
+    }
+
+    const char *data  = LLVMGetBufferStart(buffer);
+    const size_t size = LLVMGetBufferSize(buffer);
+
+    bool success = false;
+    if(strcmp(filepath, "-") == 0) {
+        success = stdout_write(data, size);
+    } else {
+        wchar_t *wide_filepath = convert_to_wcs_alloc(filepath, strlen(filepath), NULL);
+        if(wide_filepath != NULL) {
+            success = file_write(wide_filepath, data, size);
+            free(wide_filepath);
+        }
+    }
+
+    if(!success) {
+        report_error(L"Failed to write output to \"%hs\"", filepath);
+    }
+
+    LLVMDisposeMemoryBuffer(buffer);
+
+    timing_end(&timing);
+    return success;
+}
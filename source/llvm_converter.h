@@ -3,12 +3,32 @@
 
 #include "common.h"
 #include "parser.h"
+#include "thread_pool.h"
+#include "procedure_table.h"
+#include "specialization.h"
+#include "generics.h"
 
 #include <llvm-c/Core.h>
 #include <llvm-c/Analysis.h>
 #include <llvm-c/Target.h>
 #include <llvm-c/TargetMachine.h>
 
+typedef enum : uint8_t {
+    EMIT_OBJECT = 0,
+    EMIT_ASSEMBLY,
+    EMIT_BITCODE,
+    EMIT_IR,
+    EMIT__COUNT
+} Emit_Kind;
+
+// File extension for each Emit_Kind, without the dot
+static const char *emit_kind_extensions[EMIT__COUNT] = {
+    "o",
+    "s",
+    "bc",
+    "ll",
+};
+
 typedef struct {
     Parser *parser;
 
@@ -18,14 +38,90 @@ typedef struct {
     LLVMTargetRef target;
     LLVMTargetMachineRef target_machine;
     char *target_triple;
+    LLVMCodeGenOptLevel opt_level;
+
+    // Module holds only part of the procedures; Non-exported ones are kept hidden instead of internal so other partitions can call them
+    bool is_partition;
+
+    // Exported procedures of other files, declared in the module when called; Can be NULL
+    Procedure_Table *external_procs;
+
+    // Every procedure declared in the module, calls take their parameter and return types from here
+    Procedure_Table *declared;
+
+    // Clone budget for calls with literal arguments, 0 disables; The cache only exists during llvm_convert and partition conversion
+    size_t specialize_budget;
+    Specialization_Cache *specializations;
+
+    // Instances of generic procedures, created on the first call to one and freed with the specializations
+    Generic_Instances *generics;
+    const Type_Kind *type_args; // Of the instance being emitted, NULL outside of one
 } LLVM_Context;
 
-bool llvm_init(LLVM_Context *ctx, Parser *parser);
+bool llvm_init(LLVM_Context *ctx, Parser *parser, LLVMCodeGenOptLevel opt_level);
+bool llvm_init_module(LLVM_Context *ctx, Parser *parser, LLVMCodeGenOptLevel opt_level, const char *module_name);
+
+// New module on the context, builder and target machine of base, so a worker can reuse them between files; Free with llvm_shutdown_module
+void llvm_init_module_shared(LLVM_Context *ctx, LLVM_Context *base, Parser *parser, const char *module_name);
+void llvm_shutdown_module(LLVM_Context *ctx);
 void llvm_shutdown(LLVM_Context *ctx);
 void llvm_convert(LLVM_Context *ctx);
 
+// Building blocks of llvm_convert, for converting procedures one at a time as they get parsed
+// A procedure has to be declared before its body is emitted, and so do the procedures it calls
+void declare_procedure(LLVM_Context *ctx, AST_Procedure *ast_proc);
+void emit_procedure(LLVM_Context *ctx, AST_Procedure *ast_proc);
+bool llvm_procedure_calls_declared(LLVM_Context *ctx, AST_Procedure *ast_proc);
+
+// Runs the default<On> pipeline matching ctx->opt_level, nothing at LLVMCodeGenLevelNone
+bool llvm_optimize(LLVM_Context *ctx);
+
+// Verification failures abort, they are converter bugs rather than user errors
+void llvm_verify(LLVM_Context *ctx);
+
+// Runs a textual new pass manager pipeline, "<name><On>" pipelines should use llvm_opt_level_suffix
+bool llvm_run_passes(LLVM_Context *ctx, const char *passes);
+const char *llvm_opt_level_suffix(LLVMCodeGenOptLevel opt_level);
+
+/*
+ * Partitioned code generation
+ * Procedures are split into contiguous ranges, one per partition, each with its own LLVM context, module, builder and target machine.
+ * The split only depends on partition count so the output does not change with the thread count.
+ */
+typedef struct {
+    LLVM_Context ctx;
+    size_t node_first;
+    size_t node_count;
+    LLVMMemoryBufferRef bitcode; // Set while linking
+} LLVM_Partition;
+
+typedef struct {
+    Parser *parser;
+    LLVM_Partition *partitions;
+    size_t partition_count;
+    size_t failed_count; // Atomic
+} LLVM_Partitions;
+
+bool llvm_partitions_init(LLVM_Partitions *parts, Parser *parser, size_t partition_count, LLVMCodeGenOptLevel opt_level);
+void llvm_partitions_free(LLVM_Partitions *parts);
+
+// Converts, verifies and optimizes every partition on the pool; False if a partition hit a fatal error
+bool llvm_convert_partitions(LLVM_Partitions *parts, Thread_Pool *pool);
+
+// Emits every partition on the pool to "<filepath_base>.<index>.<extension>"
+bool llvm_emit_partitions(LLVM_Partitions *parts, Thread_Pool *pool, Emit_Kind kind, const char *filepath_base);
+
+// Links all partitions in order into ctx->module, through bitcode serialized on the pool
+bool llvm_link_partitions(LLVM_Context *ctx, LLVM_Partitions *parts, Thread_Pool *pool);
+
+// Once every piece is linked into one module, non-exported procedures defined in it go from hidden to internal
+void llvm_internalize_procedures(LLVM_Context *ctx);
+
 // Use after llvm_convert
-bool llvm_write_ir_file(LLVM_Context *ctx, const char *filepath);
-bool llvm_emit_object(LLVM_Context *ctx, const char *filepath);
+// Output is produced in memory and written with a single write; filepath "-" writes to stdout
+bool llvm_emit(LLVM_Context *ctx, Emit_Kind kind, const char *filepath);
+
+// Returns the module contents in a memory buffer, NULL on failure; Dispose with LLVMDisposeMemoryBuffer
+LLVMMemoryBufferRef llvm_emit_to_memory_buffer(LLVM_Context *ctx, Emit_Kind kind);
 
 #endif /* _LLVM_CONVERTER_H */
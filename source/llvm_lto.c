@@ -0,0 +1,320 @@
+#include "llvm_lto.h"
+#include "timing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <llvm-c/BitReader.h>
+#include <llvm-c/BitWriter.h>
+#include <llvm-c/Linker.h>
+
+LLVMMemoryBufferRef llvm_lto_prepare_module(LLVM_Context *ctx) {
+    if(ctx->opt_level != LLVMCodeGenLevelNone) {
+        char passes[64];
+        snprintf(passes, sizeof(passes), "thinlto-pre-link%s", llvm_opt_level_suffix(ctx->opt_level));
+        if(!llvm_run_passes(ctx, passes)) {
+            return NULL;
+        }
+    }
+    return LLVMWriteBitcodeToMemoryBuffer(ctx->module);
+}
+
+static bool is_local_linkage(LLVMValueRef value) {
+    LLVMLinkage linkage = LLVMGetLinkage(value);
+    return linkage == LLVMInternalLinkage || linkage == LLVMPrivateLinkage;
+}
+
+static size_t count_instructions(LLVMValueRef proc) {
+    size_t count = 0;
+    for(LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(proc); block != NULL; block = LLVMGetNextBasicBlock(block)) {
+        for(LLVMValueRef inst = LLVMGetFirstInstruction(block); inst != NULL; inst = LLVMGetNextInstruction(inst)) {
+            count += 1;
+        }
+    }
+    return count;
+}
+
+// Turns a definition into a declaration; The C API has no deleteBody so go instruction by instruction
+static void strip_procedure_body(LLVMValueRef proc) {
+    // Drop every use between instructions first, then nothing keeps the instructions or blocks alive
+    for(LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(proc); block != NULL; block = LLVMGetNextBasicBlock(block)) {
+        for(LLVMValueRef inst = LLVMGetFirstInstruction(block); inst != NULL; inst = LLVMGetNextInstruction(inst)) {
+            if(LLVMGetTypeKind(LLVMTypeOf(inst)) != LLVMVoidTypeKind) {
+                LLVMReplaceAllUsesWith(inst, LLVMGetUndef(LLVMTypeOf(inst)));
+            }
+        }
+    }
+
+    // Branches and phis of later blocks use earlier ones, e.g. loop back-edges, so no block goes before every instruction is gone
+    for(LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(proc); block != NULL; block = LLVMGetNextBasicBlock(block)) {
+        LLVMValueRef inst = LLVMGetFirstInstruction(block);
+        while(inst != NULL) {
+            LLVMValueRef next_inst = LLVMGetNextInstruction(inst);
+            LLVMInstructionEraseFromParent(inst);
+            inst = next_inst;
+        }
+    }
+
+    LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(proc);
+    while(block != NULL) {
+        LLVMBasicBlockRef next_block = LLVMGetNextBasicBlock(block);
+        LLVMDeleteBasicBlock(block);
+        block = next_block;
+    }
+}
+
+#define IMPORT_SET_MAX 64
+
+typedef struct {
+    LLVMValueRef procs[IMPORT_SET_MAX];
+    size_t count;
+    size_t instructions;
+} Import_Set;
+
+static bool import_set_contains(Import_Set *set, LLVMValueRef proc) {
+    for(size_t index = 0; index < set->count; ++index) {
+        if(set->procs[index] == proc) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Adds proc and every internal procedure it calls; Returns false if they don't fit the budget
+static bool import_set_add_closure(Import_Set *set, LLVMValueRef proc) {
+    if(import_set_contains(set, proc)) {
+        return true;
+    }
+
+    if(set->count >= IMPORT_SET_MAX) {
+        return false;
+    }
+
+    set->instructions += count_instructions(proc);
+    if(set->instructions > LTO_IMPORT_INSTRUCTIONS_MAX) {
+        return false;
+    }
+
+    set->procs[set->count++] = proc;
+
+    // Internal procedures can't be referenced from another module, a copy has to come along
+    for(LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(proc); block != NULL; block = LLVMGetNextBasicBlock(block)) {
+        for(LLVMValueRef inst = LLVMGetFirstInstruction(block); inst != NULL; inst = LLVMGetNextInstruction(inst)) {
+            if(LLVMGetInstructionOpcode(inst) != LLVMCall) {
+                continue;
+            }
+
+            LLVMValueRef callee = LLVMGetCalledValue(inst);
+            if(LLVMIsAFunction(callee) && !LLVMIsDeclaration(callee) && is_local_linkage(callee)) {
+                if(!import_set_add_closure(set, callee)) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+// Reduces source module to what dest wants from it, so it can be linked into dest
+static void reduce_to_imports(LLVMModuleRef dest, LLVMModuleRef source) {
+    Import_Set imports = { };
+
+    for(LLVMValueRef proc = LLVMGetFirstFunction(source); proc != NULL; proc = LLVMGetNextFunction(proc)) {
+        if(LLVMIsDeclaration(proc) || is_local_linkage(proc)) {
+            continue;
+        }
+
+        size_t name_length = 0;
+        const char *name = LLVMGetValueName2(proc, &name_length);
+
+        LLVMValueRef dest_proc = LLVMGetNamedFunction(dest, name);
+        if(dest_proc == NULL || !LLVMIsDeclaration(dest_proc)) {
+            continue;
+        }
+
+        // All or nothing for each procedure, roll back what a failed closure added
+        Import_Set attempt = imports;
+        if(import_set_add_closure(&attempt, proc)) {
+            imports = attempt;
+        }
+    }
+
+    LLVMValueRef proc = LLVMGetFirstFunction(source);
+    while(proc != NULL) {
+        LLVMValueRef next_proc = LLVMGetNextFunction(proc);
+
+        if(import_set_contains(&imports, proc)) {
+            // Only there to be inlined, the real definition stays in its own object
+            if(!is_local_linkage(proc)) {
+                LLVMSetLinkage(proc, LLVMAvailableExternallyLinkage);
+            }
+        } else if(!LLVMIsDeclaration(proc)) {
+            strip_procedure_body(proc);
+        }
+
+        proc = next_proc;
+    }
+
+    // Internal procedures that were not imported are declarations without users now
+    proc = LLVMGetFirstFunction(source);
+    while(proc != NULL) {
+        LLVMValueRef next_proc = LLVMGetNextFunction(proc);
+
+        if(LLVMIsDeclaration(proc) && is_local_linkage(proc)) {
+            assert(LLVMGetFirstUse(proc) == NULL && "Internal procedure still used after reducing module to imports");
+            LLVMDeleteFunction(proc);
+        }
+
+        proc = next_proc;
+    }
+}
+
+typedef struct {
+    LTO_Module *modules;
+    size_t module_count;
+    Procedure_Table *exported;
+    LLVM_Context *worker_contexts;
+    Emit_Kind emit_kind;
+    size_t failed_count; // Atomic
+} LTO_Backends;
+
+// Finds which modules define procedures that module_index only declares
+static void find_import_sources(LTO_Backends *backends, LLVMModuleRef module, size_t module_index, bool *out_is_source) {
+    for(LLVMValueRef proc = LLVMGetFirstFunction(module); proc != NULL; proc = LLVMGetNextFunction(proc)) {
+        if(!LLVMIsDeclaration(proc) || LLVMGetIntrinsicID(proc) != 0) {
+            continue;
+        }
+
+        size_t name_length = 0;
+        const char *name = LLVMGetValueName2(proc, &name_length);
+
+        wchar_t *wide_name = convert_to_wcs_alloc(name, name_length, NULL);
+        if(wide_name == NULL) {
+            continue;
+        }
+
+        // Owners past the modules are interface files, there is no bitcode to import from
+        Procedure_Table_Entry *entry = procedure_table_find(backends->exported, str_view_wcstr(wide_name));
+        if(entry != NULL && entry->owner != module_index && entry->owner < backends->module_count) {
+            out_is_source[entry->owner] = true;
+        }
+
+        free(wide_name);
+    }
+}
+
+static bool import_procedures(LTO_Backends *backends, LLVM_Context *ctx, size_t module_index) {
+    bool *is_source = (bool *)calloc(backends->module_count, sizeof(bool));
+    if(is_source == NULL) {
+        fprintf(stderr, "Failed to allocate memory in import_procedures.\n");
+        return false;
+    }
+
+    find_import_sources(backends, ctx->module, module_index, is_source);
+
+    // Sources go in module order so the result doesn't depend on scheduling
+    bool success = true;
+    for(size_t source_index = 0; source_index < backends->module_count && success; ++source_index) {
+        if(!is_source[source_index]) {
+            continue;
+        }
+
+        LLVMModuleRef source = NULL;
+        if(LLVMParseBitcodeInContext2(ctx->context, backends->modules[source_index].bitcode, &source) != 0) {
+            fprintf(stderr, "LLVM LTO ERROR: Failed to load bitcode of %s\n", backends->modules[source_index].module_name);
+            success = false;
+            break;
+        }
+
+        reduce_to_imports(ctx->module, source);
+
+        // Source module gets destroyed by the linker
+        if(LLVMLinkModules2(ctx->module, source) != 0) {
+            fprintf(stderr, "LLVM LTO ERROR: Failed to import from %s\n", backends->modules[source_index].module_name);
+            success = false;
+        }
+    }
+
+    free(is_source);
+    return success;
+}
+
+static void run_backend_job(void *user_data, size_t job_index, size_t worker_index) {
+    LTO_Backends *backends = (LTO_Backends *)user_data;
+    LTO_Module *module = &backends->modules[job_index];
+
+    Trace_Span trace_span;
+    trace_begin(&trace_span);
+
+    LLVM_Context ctx;
+    llvm_init_module_shared(&ctx, &backends->worker_contexts[worker_index], NULL, module->module_name);
+
+    // Start from the pre-link module instead of the empty one
+    LLVMDisposeModule(ctx.module);
+    ctx.module = NULL;
+
+    bool success = LLVMParseBitcodeInContext2(ctx.context, module->bitcode, &ctx.module) == 0;
+    if(!success) {
+        fprintf(stderr, "LLVM LTO ERROR: Failed to load bitcode of %s\n", module->module_name);
+    }
+
+    // Importing only pays off when something is going to inline it
+    if(success && ctx.opt_level != LLVMCodeGenLevelNone) {
+        Timing_Section timing;
+        timing_begin(&timing, TIMING_LTO_IMPORT);
+        success = import_procedures(backends, &ctx, job_index);
+        timing_end(&timing);
+
+        if(success) {
+            char passes[64];
+            snprintf(passes, sizeof(passes), "thinlto%s", llvm_opt_level_suffix(ctx.opt_level));
+            success = llvm_run_passes(&ctx, passes);
+        }
+    }
+
+    if(success) {
+        llvm_verify(&ctx);
+        success = llvm_emit(&ctx, backends->emit_kind, module->output_path);
+    }
+
+    if(!success) {
+        ATOMIC_ADD(&backends->failed_count, 1);
+    }
+
+    llvm_shutdown_module(&ctx);
+
+    trace_end(&trace_span, "lto_backend", module->module_name);
+}
+
+bool llvm_lto_run_backends(LTO_Module *modules, size_t module_count, Procedure_Table *exported, Thread_Pool *pool, LLVM_Context *worker_contexts, Emit_Kind emit_kind) {
+    LTO_Backends backends = {
+        .modules = modules,
+        .module_count = module_count,
+        .exported = exported,
+        .worker_contexts = worker_contexts,
+        .emit_kind = emit_kind
+    };
+
+    // Bitcode size stands in for backend time
+    size_t *weights = (size_t *)malloc(sizeof(size_t) * module_count);
+    if(weights == NULL) {
+        fprintf(stderr, "Failed to allocate memory in llvm_lto_run_backends.\n");
+        return false;
+    }
+
+    for(size_t index = 0; index < module_count; ++index) {
+        weights[index] = LLVMGetBufferSize(modules[index].bitcode);
+    }
+
+    size_t *job_order = thread_pool_order_largest_first(weights, module_count);
+    free(weights);
+    if(job_order == NULL) {
+        return false;
+    }
+
+    const bool ran = thread_pool_run_ordered(pool, job_order, module_count, run_backend_job, &backends);
+    free(job_order);
+
+    return ran && backends.failed_count == 0;
+}
@@ -0,0 +1,35 @@
+#ifndef _LLVM_LTO_H
+#define _LLVM_LTO_H
+
+#include "common.h"
+#include "llvm_converter.h"
+#include "procedure_table.h"
+#include "thread_pool.h"
+
+/*
+ * In-process ThinLTO style whole program compilation
+ *
+ * Every file is compiled on its own into a pre-link optimized bitcode module.
+ * The table of procedures exported from all files serves as the combined summary.
+ * Backends then run in parallel, one per module: small exported procedures the module calls are imported
+ * from their owner's bitcode as available_externally definitions, together with the internal procedures they use,
+ * then the module goes through the post-link pipeline and gets emitted.
+ */
+
+// Largest procedure, with the internal procedures it needs, that gets imported into other modules
+#define LTO_IMPORT_INSTRUCTIONS_MAX 100
+
+typedef struct {
+    LLVMMemoryBufferRef bitcode; // Pre-link module
+    const char *output_path;
+    const char *module_name;
+} LTO_Module;
+
+// Runs the pre-link pipeline over ctx->module and serializes it; NULL on failure
+LLVMMemoryBufferRef llvm_lto_prepare_module(LLVM_Context *ctx);
+
+// Imports, optimizes and emits every module on the pool, largest first; exported maps procedures to module indices, larger ones are skipped
+// worker_contexts holds one initialized context per pool worker, backends build their modules in them
+bool llvm_lto_run_backends(LTO_Module *modules, size_t module_count, Procedure_Table *exported, Thread_Pool *pool, LLVM_Context *worker_contexts, Emit_Kind emit_kind);
+
+#endif /* _LLVM_LTO_H */
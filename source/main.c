@@ -3,245 +3,1116 @@
 #include "lexer.h"
 #include "parser.h"
 #include "llvm_converter.h"
+#include "thread_pool.h"
+#include "driver.h"
+#include "daemon.h"
+#include "bench.h"
+#include "polang.h"
+#include "pipeline.h"
+#include "output.h"
+#include "reachability.h"
+#include "procedure_cache.h"
+#include "interface_file.h"
+#include "specialization.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <locale.h>
 
 #ifdef _WIN32
 #include <windows.h>
 #endif
 
-#define PRINT_AST_TREE_DEPTH_MAX 128
+typedef struct {
+    AST_Node *node;
+    size_t depth; // Root is 0 and has no branch in front
+    bool is_last;
+} AST_Dump_Frame;
 
-void print_ast(AST_Node *node, int32_t depth, bool is_last, bool depth_continues[PRINT_AST_TREE_DEPTH_MAX]) {
-    if(depth > -1) {
-        for(int32_t index = 0; index < depth; ++index) {
-            if(depth_continues[index]) {
-                wprintf(L"│   ");
-            } else {
-                wprintf(L"    ");
-            }
-        }
+// Explicit stack instead of recursion, so arbitrarily deep expressions can't overflow the call stack
+typedef struct {
+    AST_Dump_Frame *frames;
+    size_t frames_count;
+    size_t frames_capacity;
 
-        if(is_last) {
-            wprintf(L"└── ");
-        } else {
-            wprintf(L"├── ");
-        }
+    bool *depth_continues; // Whether the ancestor at that depth has siblings left, drawn as │
+    size_t depth_capacity;
+} AST_Dump;
 
-        depth_continues[depth] = !is_last;
+static bool ast_dump_push(AST_Dump *dump, AST_Node *node, size_t depth, bool is_last) {
+    if(dump->frames_count == dump->frames_capacity) {
+        dump->frames_capacity = MAX(dump->frames_capacity * 2, 256);
+        AST_Dump_Frame *new_frames = (AST_Dump_Frame *)realloc(dump->frames, sizeof(AST_Dump_Frame) * dump->frames_capacity);
+        if(new_frames == NULL) {
+            fwprintf(stderr, L"Failed to allocate memory in ast_dump_push.\n");
+            return false;
+        }
+        dump->frames = new_frames;
     }
 
+    dump->frames[dump->frames_count++] = (AST_Dump_Frame) { .node = node, .depth = depth, .is_last = is_last };
+    return true;
+}
+
+// Pushed last to first, so they pop in order
+static bool ast_dump_push_children(AST_Dump *dump, AST_Node *node, size_t depth) {
+    const size_t child_depth = depth + 1;
+    bool success = true;
+
     switch(node->kind) {
         default: {
-            assert(0 && "Unhandled AST_Kind in print_ast!");
+            assert(0 && "Unhandled AST_Kind in ast_dump_push_children!");
         } break;
 
-        case ast_kind(AST_Root): {
-            AST_Root *ast_root = (AST_Root *)node;
-            wprintf(L"Root\n");
+        case ast_kind(AST_Literal):
+        case ast_kind(AST_Variable_Ref): break;
 
-            for(size_t index = 0; index < ast_root->nodes_count; ++index) {
-                AST_Node *sub_node = ast_root->nodes[index];
-                print_ast(sub_node, depth + 1, (index + 1) == ast_root->nodes_count, depth_continues);
+        case ast_kind(AST_Type_Def): {
+            AST_Type_Def *ast_type_def = (AST_Type_Def *)node;
+            if(ast_type_def->kind == TYPE_ARRAY) {
+                success = ast_dump_push(dump, (AST_Node *)ast_type_def->element_type, child_depth, true);
             }
         } break;
 
-        case ast_kind(AST_Type_Def): {
-            AST_Type_Def *ast_type_def = (AST_Type_Def *)node;
-            wprintf(L"Type Def : %.*ls, size : %lluB\n", ast_type_def->signature.length, ast_type_def->signature.data, get_size_of_type(ast_type_def->kind));
+        case ast_kind(AST_Root): {
+            AST_Root *ast_root = (AST_Root *)node;
+            for(size_t index = ast_root->nodes_count; success && index > 0; --index) {
+                success = ast_dump_push(dump, ast_root->nodes[index - 1], child_depth, index == ast_root->nodes_count);
+            }
         } break;
 
         case ast_kind(AST_Parameter): {
             AST_Parameter *ast_param = (AST_Parameter *)node;
-            wprintf(L"Parameter : %.*ls\n", ast_param->identifier.length, ast_param->identifier.data);
-            print_ast((AST_Node *)ast_param->data_type, depth + 1, true, depth_continues);
+            success = ast_dump_push(dump, (AST_Node *)ast_param->data_type, child_depth, true);
         } break;
 
         case ast_kind(AST_Declaration): {
             AST_Declaration *ast_decl = (AST_Declaration *)node;
-            wprintf(L"Declaration : %.*ls\n", ast_decl->identifier.length, ast_decl->identifier.data);
-            print_ast((AST_Node *)ast_decl->data_type, depth + 1, ast_decl->expression == NULL, depth_continues);
             if(ast_decl->expression != NULL) {
-                print_ast(ast_decl->expression, depth + 1, true, depth_continues);
+                success = ast_dump_push(dump, ast_decl->expression, child_depth, true);
             }
+            success = success && ast_dump_push(dump, (AST_Node *)ast_decl->data_type, child_depth, ast_decl->expression == NULL);
         } break;
 
         case ast_kind(AST_Block): {
             AST_Block *ast_block = (AST_Block *)node;
-            wprintf(L"Block\n");
-
-            for(size_t index = 0; index < ast_block->nodes_count; ++index) {
-                AST_Node *sub_node = ast_block->nodes[index];
-                print_ast(sub_node, depth + 1, (index + 1) == ast_block->nodes_count, depth_continues);
+            for(size_t index = ast_block->nodes_count; success && index > 0; --index) {
+                success = ast_dump_push(dump, ast_block->nodes[index - 1], child_depth, index == ast_block->nodes_count);
             }
         } break;
 
         case ast_kind(AST_Procedure): {
             AST_Procedure *ast_proc = (AST_Procedure *)node;
-            wprintf(L"Procedure : %.*ls\n", ast_proc->signature.length, ast_proc->signature.data);
-
-            print_ast((AST_Node *)ast_proc->return_type, depth + 1, ast_proc->params_count == 0 && ast_proc->block == NULL, depth_continues);
-
-            for(size_t index = 0; index < ast_proc->params_count; ++index) {
-                AST_Parameter *ast_param = ast_proc->params[index];
-                print_ast((AST_Node *)ast_param, depth + 1, ast_proc->block == NULL && (index + 1) == ast_proc->params_count, depth_continues);
+            if(ast_proc->block != NULL) {
+                success = ast_dump_push(dump, (AST_Node *)ast_proc->block, child_depth, true);
             }
 
-            if(ast_proc->block != NULL) {
-                print_ast((AST_Node *)ast_proc->block, depth + 1, true, depth_continues);
+            for(size_t index = ast_proc->params_count; success && index > 0; --index) {
+                success = ast_dump_push(dump, (AST_Node *)ast_proc->params[index - 1], child_depth, ast_proc->block == NULL && index == ast_proc->params_count);
             }
+
+            success = success && ast_dump_push(dump, (AST_Node *)ast_proc->return_type, child_depth, ast_proc->params_count == 0 && ast_proc->block == NULL);
         } break;
 
         case ast_kind(AST_Return): {
             AST_Return *ast_return = (AST_Return *)node;
-            wprintf(L"Return\n");
-
             if(ast_return->expression != NULL) {
-                print_ast(ast_return->expression, depth + 1, true, depth_continues);
+                success = ast_dump_push(dump, ast_return->expression, child_depth, true);
+            }
+        } break;
+
+        case ast_kind(AST_Binary): {
+            AST_Binary *ast_binary = (AST_Binary *)node;
+            success = ast_dump_push(dump, ast_binary->expr_r, child_depth, true) &&
+                      ast_dump_push(dump, ast_binary->expr_l, child_depth, false);
+        } break;
+
+        case ast_kind(AST_Procedure_Call): {
+            AST_Procedure_Call *ast_proc_call = (AST_Procedure_Call *)node;
+            for(size_t index = ast_proc_call->params_count; success && index > 0; --index) {
+                AST_Node *expression = ast_proc_call->params[index - 1];
+                assert(is_expression(expression) && "Procedure call's param is not an expression !!!");
+                success = ast_dump_push(dump, expression, child_depth, index == ast_proc_call->params_count);
             }
         } break;
 
+        case ast_kind(AST_Conversion): {
+            AST_Conversion *ast_conversion = (AST_Conversion *)node;
+            success = ast_dump_push(dump, ast_conversion->expression, child_depth, true);
+        } break;
+
+        case ast_kind(AST_Index): {
+            AST_Index *ast_index = (AST_Index *)node;
+            success = ast_dump_push(dump, ast_index->index, child_depth, true) &&
+                      ast_dump_push(dump, ast_index->expression, child_depth, false);
+        } break;
+
+        case ast_kind(AST_Reduction): {
+            AST_Reduction *ast_reduction = (AST_Reduction *)node;
+            success = ast_dump_push(dump, ast_reduction->expression, child_depth, true);
+        } break;
+
+        case ast_kind(AST_Assignment): {
+            AST_Assignment *ast_assignment = (AST_Assignment *)node;
+            success = ast_dump_push(dump, ast_assignment->expression, child_depth, true) &&
+                      ast_dump_push(dump, ast_assignment->target, child_depth, false);
+        } break;
+
+        case ast_kind(AST_Comparison): {
+            AST_Comparison *ast_comparison = (AST_Comparison *)node;
+            success = ast_dump_push(dump, ast_comparison->expr_r, child_depth, true) &&
+                      ast_dump_push(dump, ast_comparison->expr_l, child_depth, false);
+        } break;
+
+        case ast_kind(AST_While): {
+            AST_While *ast_while = (AST_While *)node;
+            success = ast_dump_push(dump, (AST_Node *)ast_while->block, child_depth, true) &&
+                      ast_dump_push(dump, (AST_Node *)ast_while->condition, child_depth, false);
+        } break;
+
+        case ast_kind(AST_Struct): {
+            AST_Struct *ast_struct = (AST_Struct *)node;
+            for(size_t index = ast_struct->fields_count; success && index > 0; --index) {
+                success = ast_dump_push(dump, (AST_Node *)ast_struct->fields[index - 1], child_depth, index == ast_struct->fields_count);
+            }
+        } break;
+
+        case ast_kind(AST_Field): {
+            AST_Field *ast_field = (AST_Field *)node;
+            success = ast_dump_push(dump, ast_field->expression, child_depth, true);
+        } break;
+
+        case ast_kind(AST_For): {
+            AST_For *ast_for = (AST_For *)node;
+            success = ast_dump_push(dump, (AST_Node *)ast_for->block, child_depth, true) &&
+                      ast_dump_push(dump, ast_for->end, child_depth, false) &&
+                      ast_dump_push(dump, ast_for->start, child_depth, false);
+        } break;
+    }
+
+    return success;
+}
+
+static void print_ast_node(Output_Sink *out, AST_Node *node) {
+    switch(node->kind) {
+        default: {
+            assert(0 && "Unhandled AST_Kind in print_ast_node!");
+        } break;
+
+        case ast_kind(AST_Root): {
+            output_cstr(out, "Root\n");
+        } break;
+
+        case ast_kind(AST_Type_Def): {
+            AST_Type_Def *ast_type_def = (AST_Type_Def *)node;
+            output_cstr(out, "Type Def : ");
+            output_wide(out, ast_type_def->signature.data, ast_type_def->signature.length);
+            if(ast_type_def->kind == TYPE_ARRAY) {
+                output_format(out, ", array of %u\n", ast_type_def->array_length);
+                break;
+            }
+            if(is_vector_type(ast_type_def->kind)) {
+                output_format(out, ", vector of %u", get_vector_lanes(ast_type_def->kind));
+            }
+            if(get_element_type(ast_type_def->kind) == TYPE_PARAMETER) {
+                output_cstr(out, ", type parameter\n");
+            } else if(ast_type_def->kind == TYPE_CUSTOM) {
+                output_cstr(out, ", struct\n");
+            } else {
+                output_format(out, ", size : %dB\n", get_size_of_type(ast_type_def->kind));
+            }
+        } break;
+
+        case ast_kind(AST_Parameter): {
+            AST_Parameter *ast_param = (AST_Parameter *)node;
+            output_cstr(out, "Parameter : ");
+            output_wide(out, ast_param->identifier.data, ast_param->identifier.length);
+            output_cstr(out, "\n");
+        } break;
+
+        case ast_kind(AST_Declaration): {
+            AST_Declaration *ast_decl = (AST_Declaration *)node;
+            output_cstr(out, "Declaration : ");
+            output_wide(out, ast_decl->identifier.data, ast_decl->identifier.length);
+            output_cstr(out, "\n");
+        } break;
+
+        case ast_kind(AST_Block): {
+            output_cstr(out, "Block\n");
+        } break;
+
+        case ast_kind(AST_Procedure): {
+            AST_Procedure *ast_proc = (AST_Procedure *)node;
+            output_cstr(out, "Procedure : ");
+            output_wide(out, ast_proc->signature.data, ast_proc->signature.length);
+            output_cstr(out, (ast_proc->node.flags & AST_FLAG_EXPORTED) ? " [exported]" : "");
+            output_cstr(out, ast_proc->type_params_count > 0 ? " [generic]" : "");
+            output_cstr(out, (ast_proc->node.flags & AST_FLAG_BODY_PENDING) ? " [body not parsed]\n" : "\n");
+        } break;
+
+        case ast_kind(AST_Return): {
+            output_cstr(out, "Return\n");
+        } break;
+
         case ast_kind(AST_Literal): {
             AST_Literal *ast_literal = (AST_Literal *)node;
-            wprintf(L"Literal : ");
-            
             switch(ast_literal->kind) {
-                default: assert(0 && "Unhandled literal type in print_ast"); break;
-                case LITERAL_INT64:   { wprintf(L"%lld [int64]\n", ast_literal->value_int64); } break;
-                case LITERAL_UINT64:  { wprintf(L"%llu [uint64]\n", ast_literal->value_uint64); } break;
-                case LITERAL_FLOAT64: { wprintf(L"%f [float64]\n", ast_literal->value_float64); } break;
+                default: assert(0 && "Unhandled literal type in print_ast_node"); break;
+                case LITERAL_INT64:   { output_format(out, "Literal : %lld [int64]\n", (long long)ast_literal->value_int64); } break;
+                case LITERAL_UINT64:  { output_format(out, "Literal : %llu [uint64]\n", (unsigned long long)ast_literal->value_uint64); } break;
+                case LITERAL_FLOAT64: { output_format(out, "Literal : %f [float64]\n", ast_literal->value_float64); } break;
             }
         } break;
 
         case ast_kind(AST_Binary): {
             AST_Binary *ast_binary = (AST_Binary *)node;
-            wprintf(L"Binary : %ls\n", binary_operation_string(ast_binary->operation));
-            print_ast(ast_binary->expr_l, depth + 1, false, depth_continues);
-            print_ast(ast_binary->expr_r, depth + 1, true, depth_continues);
+            const wchar_t *operation = binary_operation_string(ast_binary->operation);
+            output_cstr(out, "Binary : ");
+            output_wide(out, operation, wcslen(operation));
+            output_cstr(out, "\n");
         } break;
 
         case ast_kind(AST_Variable_Ref): {
             AST_Variable_Ref *ast_var_ref = (AST_Variable_Ref *)node;
-            wprintf(L"Variable reference : %.*ls\n", ast_var_ref->var_ident.length, ast_var_ref->var_ident.data);
+            output_cstr(out, "Variable reference : ");
+            output_wide(out, ast_var_ref->var_ident.data, ast_var_ref->var_ident.length);
+            output_cstr(out, "\n");
         } break;
 
         case ast_kind(AST_Procedure_Call): {
             AST_Procedure_Call *ast_proc_call = (AST_Procedure_Call *)node;
-            wprintf(L"Procedure call : %.*ls\n", ast_proc_call->procedure_signature.length, ast_proc_call->procedure_signature.data);
+            output_cstr(out, "Procedure call : ");
+            output_wide(out, ast_proc_call->procedure_signature.data, ast_proc_call->procedure_signature.length);
+            output_cstr(out, "\n");
+        } break;
 
-            for(size_t index = 0; index < ast_proc_call->params_count; ++index) {
-                AST_Node *expression = ast_proc_call->params[index];
-                assert(is_expression(expression) && "Procedure call's param is not an expression !!!");
-                print_ast(expression, depth + 1, (index + 1) == ast_proc_call->params_count, depth_continues);
+        case ast_kind(AST_Conversion): {
+            AST_Conversion *ast_conversion = (AST_Conversion *)node;
+            output_cstr(out, "Conversion : ");
+            output_wide(out, ast_conversion->data_type->signature.data, ast_conversion->data_type->signature.length);
+            if(is_vector_type(ast_conversion->data_type->kind)) {
+                output_format(out, ", vector of %u", get_vector_lanes(ast_conversion->data_type->kind));
             }
+            output_cstr(out, "\n");
+        } break;
+
+        case ast_kind(AST_Index): {
+            output_cstr(out, "Index\n");
+        } break;
+
+        case ast_kind(AST_Reduction): {
+            AST_Reduction *ast_reduction = (AST_Reduction *)node;
+            const wchar_t *operation = reduction_operation_string(ast_reduction->operation);
+            output_cstr(out, "Reduction : ");
+            output_wide(out, operation, wcslen(operation));
+            output_cstr(out, "\n");
+        } break;
+
+        case ast_kind(AST_Assignment): {
+            output_cstr(out, "Assignment\n");
+        } break;
+
+        case ast_kind(AST_Comparison): {
+            AST_Comparison *ast_comparison = (AST_Comparison *)node;
+            const wchar_t *operation = comparison_operation_string(ast_comparison->operation);
+            output_cstr(out, "Comparison : ");
+            output_wide(out, operation, wcslen(operation));
+            output_cstr(out, "\n");
+        } break;
+
+        case ast_kind(AST_While): {
+            output_cstr(out, "While\n");
+        } break;
+
+        case ast_kind(AST_Struct): {
+            AST_Struct *ast_struct = (AST_Struct *)node;
+            output_cstr(out, "Struct : ");
+            output_wide(out, ast_struct->identifier.data, ast_struct->identifier.length);
+            output_cstr(out, (ast_struct->node.flags & AST_FLAG_LAYOUT_C) ? " [c]" : "");
+            output_cstr(out, (ast_struct->node.flags & AST_FLAG_SOA) ? " [soa]\n" : "\n");
+        } break;
+
+        case ast_kind(AST_Field): {
+            AST_Field *ast_field = (AST_Field *)node;
+            output_cstr(out, "Field : ");
+            output_wide(out, ast_field->identifier.data, ast_field->identifier.length);
+            output_cstr(out, "\n");
+        } break;
+
+        case ast_kind(AST_For): {
+            AST_For *ast_for = (AST_For *)node;
+            output_cstr(out, "For : ");
+            output_wide(out, ast_for->identifier.data, ast_for->identifier.length);
+            output_cstr(out, "\n");
         } break;
     }
 }
 
-static void print_ast_tree(Parser *parser) {
-    wprintf(L"\nGenerated AST Tree\n");
-    wprintf(L"-----------------\n");
-    bool depth_continues[PRINT_AST_TREE_DEPTH_MAX] = { };
-    print_ast((AST_Node *)parser->ast_root, -1, true, depth_continues);
-    wprintf(L"-----------------\n\n");
+static void print_ast_tree(Output_Sink *out, Parser *parser) {
+    output_cstr(out, "\nGenerated AST Tree\n");
+    output_cstr(out, "-----------------\n");
+
+    AST_Dump dump = { };
+    bool success = ast_dump_push(&dump, (AST_Node *)parser->ast_root, 0, true);
+
+    while(success && dump.frames_count > 0) {
+        const AST_Dump_Frame frame = dump.frames[--dump.frames_count];
+
+        if(frame.depth >= dump.depth_capacity) {
+            const size_t new_capacity = MAX(dump.depth_capacity * 2, frame.depth + 64);
+            bool *new_continues = (bool *)realloc(dump.depth_continues, sizeof(bool) * new_capacity);
+            if(new_continues == NULL) {
+                fwprintf(stderr, L"Failed to allocate memory in print_ast_tree.\n");
+                break;
+            }
+            dump.depth_continues = new_continues;
+            dump.depth_capacity = new_capacity;
+        }
+
+        if(frame.depth > 0) {
+            for(size_t depth = 1; depth < frame.depth; ++depth) {
+                output_cstr(out, dump.depth_continues[depth] ? "│   " : "    ");
+            }
+            output_cstr(out, frame.is_last ? "└── " : "├── ");
+        }
+        dump.depth_continues[frame.depth] = !frame.is_last;
+
+        print_ast_node(out, frame.node);
+        success = ast_dump_push_children(&dump, frame.node, frame.depth);
+    }
+
+    free(dump.frames);
+    free(dump.depth_continues);
+
+    output_cstr(out, "-----------------\n\n");
 }
 
-static void print_lexer_tokens(Lexer *lexer) {
+static void print_lexer_tokens(Output_Sink *out, Lexer *lexer) {
+    output_cstr(out, "\nLexed Tokens\n");
+    output_cstr(out, "-----------------\n");
+
     while(true) {
         Token token = lexer_next_token(lexer);
 
-        wprintf(L"%s", token_kind_strings[token.kind]);
+        output_wide(out, token_kind_strings[token.kind], wcslen(token_kind_strings[token.kind]));
 
         switch(token.kind) {
             default: break;
 
             case TOKEN_IDENTIFIER: {
-                wprintf(L" : %.*ls", token.value_string.length, token.value_string.data);
+                output_cstr(out, " : ");
+                output_wide(out, token.value_string.data, token.value_string.length);
             } break;
 
             case TOKEN_NUMBER: {
                 if(token.flags & TOKEN_FLAG_NUMBER_INT64) {
-                    wprintf(L" : %lld", token.value_int64);
+                    output_format(out, " : %lld", (long long)token.value_int64);
                 } else if(token.flags & TOKEN_FLAG_NUMBER_UINT64) {
-                    wprintf(L" : %lld", token.value_uint64);
+                    output_format(out, " : %llu", (unsigned long long)token.value_uint64);
                 } else if(token.flags & TOKEN_FLAG_NUMBER_FLOAT64) {
-                    wprintf(L" : %f", token.value_float64);
+                    output_format(out, " : %f", token.value_float64);
                 } else {
-                    wprintf(L" : Unknown number value!!!");
+                    output_cstr(out, " : Unknown number value!!!");
                 }
             } break;
         }
-            
-        wprintf(L"\n");
+
+        output_cstr(out, "\n");
 
         if(token.kind == TOKEN_EOF) {
             break;
         }
     }
+
+    output_cstr(out, "-----------------\n\n");
 }
 
-int main(int argc, char **argv) {
-    setlocale(LC_ALL, "en_US.utf-8");
+static const char *get_default_output_path(Emit_Kind kind) {
+    switch(kind) {
+        default:            INVALID_CODE_PATH; return NULL;
+        case EMIT_OBJECT:   return "program.o";
+        case EMIT_ASSEMBLY: return "program.s";
+        case EMIT_BITCODE:  return "program.bc";
+        case EMIT_IR:       return "program_IR.txt";
+    }
+}
 
-#ifdef _WIN32
-    SetConsoleOutputCP(CP_UTF8);
-#endif
+static void print_usage(void) {
+    fwprintf(stderr, L"Usage: PoLang [options] <source files...>\n");
+    fwprintf(stderr, L"       PoLang --daemon[=<socket>]      Keep a compiler resident, serving --use-daemon compiles\n");
+    fwprintf(stderr, L"       PoLang --use-daemon[=<socket>] [options] <source files...>\n");
+    fwprintf(stderr, L"       PoLang --stop-daemon[=<socket>]\n");
+    fwprintf(stderr, L"  <file>.polangi              Interface of a file compiled earlier, its exported procedures can be called\n");
+    fwprintf(stderr, L"  -O0, -O1, -O2, -O3          Optimization level (default -O0)\n");
+    fwprintf(stderr, L"  --codegen-partitions=<N>    Split code generation into N modules (default 1)\n");
+    fwprintf(stderr, L"  -j <N>, -j<N>               Threads used for partitions and files (default: processor count)\n");
+    fwprintf(stderr, L"  --split-objects             Emit <output>.<index>.<ext> per partition instead of linking\n");
+    fwprintf(stderr, L"  --emit=obj|asm|bc|ll        Output format (default ll)\n");
+    fwprintf(stderr, L"  -o <path>                   Output path, - for stdout (default program.<ext>, program_IR.txt for ll)\n");
+    fwprintf(stderr, L"                              Output directory when compiling many files (default .)\n");
+    fwprintf(stderr, L"  --thin-lto                  Import procedures across files before optimizing\n");
+    fwprintf(stderr, L"  --emit-interface            Also write <output>.polangi with the exported procedures of every file\n");
+    fwprintf(stderr, L"  --cache-dir=<path>          Reuse outputs of unchanged sources from this directory\n");
+    fwprintf(stderr, L"  --cache-size=<MiB>          Object cache size limit (default %d)\n", OBJECT_CACHE_DEFAULT_SIZE_MB);
+    fwprintf(stderr, L"  --procedure-cache           Also reuse optimized procedures that didn't change, needs --cache-dir\n");
+    fwprintf(stderr, L"  --time-report[=table|json]  Time spent in each phase and LLVM pass (default table)\n");
+    fwprintf(stderr, L"  --time-report-file=<path>   Write the time report there instead of stderr\n");
+    fwprintf(stderr, L"  --trace=<file.json>         Record phases and procedures as Chrome trace events\n");
+    fwprintf(stderr, L"  --pipeline                  Lex, parse and generate code of a single file on three threads at once\n");
+    fwprintf(stderr, L"  --lazy-bodies               Skip procedure bodies until code generation needs them\n");
+    fwprintf(stderr, L"  --keep-unreachable          Convert procedures no exported procedure calls, dropped by default\n");
+    fwprintf(stderr, L"  --specialize[=<budget>]     Clone procedures for calls with literal arguments, up to budget statements (default %d)\n", SPECIALIZATION_DEFAULT_BUDGET);
+    fwprintf(stderr, L"  --bench <procedure>         JIT the module and time calls to the procedure instead of writing output\n");
+    fwprintf(stderr, L"  --bench-args=<a,b,...>      Arguments for the benchmarked procedure, parsed by parameter type\n");
+    fwprintf(stderr, L"  --bench-samples=<N>         Timed samples after warm-up (default %d)\n", BENCH_DEFAULT_SAMPLES);
+    fwprintf(stderr, L"  -q                          No progress messages, only errors and results\n");
+    fwprintf(stderr, L"  --dump-tokens               Print the lexed tokens\n");
+    fwprintf(stderr, L"  --dump-ast                  Print the parsed AST\n");
+}
 
-    fwprintf(stdout, L"\nStart...\n");
+static void write_time_report(Compile_Options *options) {
+    if(options->time_report_path == NULL) {
+        timing_report(stderr, options->time_report_format);
+        return;
+    }
+
+    FILE *file = NULL;
+    wchar_t *wide_path = convert_to_wcs_alloc(options->time_report_path, strlen(options->time_report_path), NULL);
+    if(wide_path == NULL || _wfopen_s(&file, wide_path, L"w") != 0) {
+        fwprintf(stderr, L"Failed to open time report file: %hs\n", options->time_report_path);
+        timing_report(stderr, options->time_report_format);
+    } else {
+        timing_report(file, options->time_report_format);
+        fclose(file);
+    }
 
-    wchar_t source_file_path[64] = { };
+    free(wide_path);
+}
 
-    if(argc >= 2) { // Source file specified as command line argument
-        size_t converted = convert_to_wcs(argv[1], strlen(argv[1]), source_file_path, ARRAY_SIZE(source_file_path));
-    } else { // Use test source file path
-        wcscpy_s(source_file_path, ARRAY_SIZE(source_file_path), L"../source/główny.polang");
+static void finish_object_cache(Object_Cache *cache) {
+    if(cache == NULL) {
+        return;
     }
 
-    assert(wcslen(source_file_path) > 0 && "Length of source file path is 0");
-    fwprintf(stdout, L"Source file: \"%ls\"\n", source_file_path);
+    object_cache_evict(cache);
+    object_cache_report(cache);
+    object_cache_free(cache);
+}
 
-    Lexer lexer;
-    if(!lexer_init_from_file(&lexer, source_file_path)) {
-        return -1;
+static bool parse_size_option(const char *arg, const char *prefix, size_t *out_value) {
+    const size_t prefix_length = strlen(prefix);
+    if(strncmp(arg, prefix, prefix_length) != 0) {
+        return false;
     }
 
-    fwprintf(stdout, L"Lexed tokens: %llu\n", lexer.token_count);
+    char *end = NULL;
+    *out_value = (size_t)strtoull(arg + prefix_length, &end, 10);
+    return end != arg + prefix_length && *end == '\0';
+}
 
-    Parser parser;
-    if(!parser_init(&parser, &lexer)) {
-        lexer_free(&lexer);
+static bool parse_options(int argc, char **argv, Compile_Options *options) {
+    ZERO_STRUCT(*options);
+
+    options->source_paths = (const char **)malloc(sizeof(const char *) * argc);
+    options->interface_paths = (const char **)malloc(sizeof(const char *) * argc);
+    if(options->source_paths == NULL || options->interface_paths == NULL) {
+        fwprintf(stderr, L"Failed to allocate memory in parse_options.\n");
+        return false;
+    }
+
+    options->opt_level = LLVMCodeGenLevelNone;
+    options->codegen_partitions = 1;
+    options->emit_kind = EMIT_IR;
+    options->cache_size_mb = OBJECT_CACHE_DEFAULT_SIZE_MB;
+    options->bench_samples = BENCH_DEFAULT_SAMPLES;
+    options->verbosity = OUTPUT_DEFAULT;
+
+    for(int32_t index = 1; index < argc; ++index) {
+        const char *arg = argv[index];
+
+        if(strcmp(arg, "-O0") == 0) {
+            options->opt_level = LLVMCodeGenLevelNone;
+        } else if(strcmp(arg, "-O1") == 0) {
+            options->opt_level = LLVMCodeGenLevelLess;
+        } else if(strcmp(arg, "-O2") == 0) {
+            options->opt_level = LLVMCodeGenLevelDefault;
+        } else if(strcmp(arg, "-O3") == 0) {
+            options->opt_level = LLVMCodeGenLevelAggressive;
+        } else if(strncmp(arg, "--codegen-partitions=", 21) == 0) {
+            if(!parse_size_option(arg, "--codegen-partitions=", &options->codegen_partitions) || options->codegen_partitions == 0) {
+                fwprintf(stderr, L"Invalid partition count: %hs\n", arg);
+                return false;
+            }
+        } else if(strcmp(arg, "-j") == 0) {
+            if(index + 1 >= argc || !parse_size_option(argv[index + 1], "", &options->thread_count)) {
+                fwprintf(stderr, L"Missing thread count after -j\n");
+                return false;
+            }
+            index += 1;
+        } else if(strncmp(arg, "-j", 2) == 0 || strncmp(arg, "--codegen-threads=", 18) == 0) {
+            // --codegen-threads= is the older spelling
+            const char *prefix = arg[1] == 'j' ? "-j" : "--codegen-threads=";
+            if(!parse_size_option(arg, prefix, &options->thread_count)) {
+                fwprintf(stderr, L"Invalid thread count: %hs\n", arg);
+                return false;
+            }
+        } else if(strcmp(arg, "--split-objects") == 0) {
+            options->split_objects = true;
+        } else if(strncmp(arg, "--emit=", 7) == 0) {
+            const char *kind = arg + 7;
+            if(strcmp(kind, "obj") == 0) {
+                options->emit_kind = EMIT_OBJECT;
+            } else if(strcmp(kind, "asm") == 0) {
+                options->emit_kind = EMIT_ASSEMBLY;
+            } else if(strcmp(kind, "bc") == 0) {
+                options->emit_kind = EMIT_BITCODE;
+            } else if(strcmp(kind, "ll") == 0) {
+                options->emit_kind = EMIT_IR;
+            } else {
+                fwprintf(stderr, L"Unknown output format: %hs\n", kind);
+                return false;
+            }
+        } else if(strcmp(arg, "-o") == 0) {
+            if(index + 1 >= argc) {
+                fwprintf(stderr, L"Missing path after -o\n");
+                return false;
+            }
+            options->output_path = argv[++index];
+        } else if(strcmp(arg, "--thin-lto") == 0) {
+            options->thin_lto = true;
+        } else if(strncmp(arg, "--cache-dir=", 12) == 0) {
+            options->cache_directory = arg + 12;
+            if(*options->cache_directory == '\0') {
+                fwprintf(stderr, L"Missing object cache directory: %hs\n", arg);
+                return false;
+            }
+        } else if(strcmp(arg, "--time-report") == 0 || strcmp(arg, "--time-report=table") == 0) {
+            options->time_report = true;
+            options->time_report_format = TIMING_REPORT_TABLE;
+        } else if(strcmp(arg, "--time-report=json") == 0) {
+            options->time_report = true;
+            options->time_report_format = TIMING_REPORT_JSON;
+        } else if(strncmp(arg, "--trace=", 8) == 0) {
+            options->trace_path = arg + 8;
+        } else if(strncmp(arg, "--time-report-file=", 19) == 0) {
+            options->time_report_path = arg + 19;
+        } else if(strncmp(arg, "--cache-size=", 13) == 0) {
+            if(!parse_size_option(arg, "--cache-size=", &options->cache_size_mb)) {
+                fwprintf(stderr, L"Invalid object cache size: %hs\n", arg);
+                return false;
+            }
+        } else if(strcmp(arg, "-q") == 0) {
+            options->verbosity = OUTPUT_QUIET;
+        } else if(strcmp(arg, "--dump-tokens") == 0) {
+            options->dump_tokens = true;
+        } else if(strcmp(arg, "--dump-ast") == 0) {
+            options->dump_ast = true;
+        } else if(strcmp(arg, "--procedure-cache") == 0) {
+            options->procedure_cache = true;
+        } else if(strcmp(arg, "--keep-unreachable") == 0) {
+            options->keep_unreachable = true;
+        } else if(strcmp(arg, "--lazy-bodies") == 0) {
+            options->lazy_bodies = true;
+        } else if(strcmp(arg, "--pipeline") == 0) {
+            options->pipeline = true;
+        } else if(strcmp(arg, "--bench") == 0) {
+            if(index + 1 >= argc) {
+                fwprintf(stderr, L"Missing procedure after --bench\n");
+                return false;
+            }
+            options->bench_procedure = argv[++index];
+        } else if(strncmp(arg, "--bench-args=", 13) == 0) {
+            options->bench_args = arg + 13;
+        } else if(strncmp(arg, "--bench-samples=", 16) == 0) {
+            if(!parse_size_option(arg, "--bench-samples=", &options->bench_samples) || options->bench_samples == 0) {
+                fwprintf(stderr, L"Invalid benchmark sample count: %hs\n", arg);
+                return false;
+            }
+        } else if(strcmp(arg, "--specialize") == 0) {
+            options->specialize_budget = SPECIALIZATION_DEFAULT_BUDGET;
+        } else if(strncmp(arg, "--specialize=", 13) == 0) {
+            if(!parse_size_option(arg, "--specialize=", &options->specialize_budget) || options->specialize_budget == 0) {
+                fwprintf(stderr, L"Invalid specialization budget: %hs\n", arg);
+                return false;
+            }
+        } else if(strcmp(arg, "--emit-interface") == 0) {
+            options->emit_interface = true;
+        } else if(arg[0] == '-') {
+            fwprintf(stderr, L"Unknown option: %hs\n", arg);
+            return false;
+        } else if(is_interface_path(arg)) {
+            options->interface_paths[options->interface_count++] = arg;
+        } else {
+            options->source_paths[options->source_count++] = arg;
+        }
+    }
+
+    // Procedures from interface files only exist in objects the JIT doesn't see
+    if(options->bench_procedure != NULL && (options->source_count > 1 || options->thin_lto || options->codegen_partitions > 1 || options->interface_count > 0)) {
+        fwprintf(stderr, L"--bench takes a single file without --thin-lto, partitions or interface files\n");
+        return false;
+    }
+
+    if(options->pipeline && (options->source_count > 1 || options->thin_lto || options->codegen_partitions > 1 || options->bench_procedure != NULL || options->lazy_bodies)) {
+        fwprintf(stderr, L"--pipeline takes a single file without --thin-lto, partitions, --bench or --lazy-bodies\n");
+        return false;
+    }
+
+    if(options->procedure_cache && (options->cache_directory == NULL || options->source_count > 1 || options->thin_lto || options->codegen_partitions > 1 || options->bench_procedure != NULL || options->pipeline)) {
+        fwprintf(stderr, L"--procedure-cache takes a single file and --cache-dir without --thin-lto, partitions, --bench or --pipeline\n");
+        return false;
+    }
+
+    // Clones need the callee bodies, pipelined they may not be parsed yet; Cached procedures are keyed without their callees' bodies
+    if(options->specialize_budget > 0 && (options->pipeline || options->procedure_cache)) {
+        fwprintf(stderr, L"--specialize doesn't work with --pipeline or --procedure-cache\n");
+        return false;
+    }
+
+    // Tokens only exist chunk by chunk while pipelined
+    if(options->dump_tokens && options->pipeline) {
+        fwprintf(stderr, L"--dump-tokens doesn't work with --pipeline\n");
+        return false;
+    }
+
+    // Many files go through the driver, which names outputs after the sources
+    if(options->source_count > 1 || options->thin_lto) {
+        if(options->dump_tokens || options->dump_ast || options->lazy_bodies) {
+            fwprintf(stderr, L"--dump-tokens, --dump-ast and --lazy-bodies take a single file without --thin-lto\n");
+            return false;
+        }
+        return true;
+    }
+
+    if(options->output_path == NULL) {
+        options->output_path = get_default_output_path(options->emit_kind);
+    }
+
+    if(options->split_objects && strcmp(options->output_path, "-") == 0) {
+        fwprintf(stderr, L"Can't write split outputs to stdout\n");
+        return false;
+    }
+
+    if(options->emit_interface) {
+        if(strcmp(options->output_path, "-") == 0) {
+            fwprintf(stderr, L"Can't name the interface file after stdout\n");
+            return false;
+        }
+
+        options->interface_output_path = interface_path_for_output(options->output_path);
+        if(options->interface_output_path == NULL) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void free_options(Compile_Options *options) {
+    free(options->source_paths);
+    free(options->interface_paths);
+    free(options->interface_output_path);
+}
+
+// Takes procedures nothing exported calls out of the AST and lists them; A benchmarked procedure counts as exported
+static bool drop_unreachable_procedures(Parser *parser, Compile_Options *options, Output_Sink *out) {
+    wchar_t *bench_signature = NULL;
+    if(options->bench_procedure != NULL) {
+        bench_signature = convert_to_wcs_alloc(options->bench_procedure, strlen(options->bench_procedure), NULL);
+        if(bench_signature == NULL) {
+            fwprintf(stderr, L"Invalid procedure name: %hs\n", options->bench_procedure);
+            return false;
+        }
+    }
+
+    const Str_View bench_root = bench_signature != NULL ? str_view_wcstr(bench_signature) : (Str_View) { };
+    Removed_Procedures removed;
+    const bool success = remove_unreachable_procedures(parser, bench_signature != NULL ? &bench_root : NULL, &removed);
+    free(bench_signature);
+
+    if(!success) {
+        return false;
+    }
+
+    if(removed.count > 0) {
+        output_progress(out, "Removed %llu unreachable procedures:\n", (unsigned long long)removed.count);
+        for(size_t index = 0; index < removed.count && out->verbosity >= OUTPUT_DEFAULT; ++index) {
+            output_cstr(out, "  ");
+            output_wide(out, removed.procedures[index]->signature.data, removed.procedures[index]->signature.length);
+            output_cstr(out, "\n");
+        }
+    }
+
+    removed_procedures_free(&removed);
+    return true;
+}
+
+// New module in session->module_ctx on the session's context for the optimization level
+static bool init_module(Polang_Session *session, LLVMCodeGenOptLevel opt_level, Parser *parser) {
+    LLVM_Context *llvm_base = polang_session_llvm(session, opt_level);
+    if(llvm_base == NULL) {
+        return false;
+    }
+
+    llvm_init_module_shared(&session->module_ctx, llvm_base, parser, "module");
+    return true;
+}
+
+// Output and interface are cached apart, a hit needs both
+static bool fetch_cached_outputs(Object_Cache *cache, const Cache_Key *cache_key, Compile_Options *options) {
+    if(!object_cache_fetch(cache, cache_key, options->output_path)) {
+        return false;
+    }
+
+    if(options->interface_output_path == NULL) {
+        return true;
+    }
+
+    Cache_Key interface_key;
+    driver_interface_cache_key(&interface_key, cache_key);
+    return object_cache_fetch(cache, &interface_key, options->interface_output_path);
+}
+
+static void store_cached_outputs(Object_Cache *cache, const Cache_Key *cache_key, Compile_Options *options) {
+    object_cache_store(cache, cache_key, options->output_path);
+
+    if(options->interface_output_path != NULL) {
+        Cache_Key interface_key;
+        driver_interface_cache_key(&interface_key, cache_key);
+        object_cache_store(cache, &interface_key, options->interface_output_path);
+    }
+}
+
+static int32_t compile_single_file(Polang_Session *session, Compile_Options *options, Object_Cache *cache, Interface_Set *interfaces, Output_Sink *out) {
+    output_progress(out, "\nStart...\n");
+
+    // Source file specified as command line argument, or the test source file
+    const char *source_path = options->source_count == 1 ? options->source_paths[0] : "../source/główny.polang";
+    wchar_t *source_file_path = convert_to_wcs_alloc(source_path, strlen(source_path), NULL);
+
+    if(source_file_path == NULL || wcslen(source_file_path) == 0) {
+        fwprintf(stderr, L"Invalid source file path\n");
+        free(source_file_path);
         return -1;
     }
+    output_progress(out, "Source file: \"%s\"\n", source_path);
+
+    // Split outputs and stdout don't go through the cache, benchmarks have no output
+    Cache_Key cache_key;
+    const bool cache_usable = cache != NULL && !options->split_objects && options->bench_procedure == NULL && strcmp(options->output_path, "-") != 0 &&
+                              driver_init_cache_key(&cache_key, options, &source_file_path, 1);
+
+    if(cache_usable && fetch_cached_outputs(cache, &cache_key, options)) {
+        output_progress(out, "Output taken from object cache: \"%s\"\n", options->output_path);
+        free(source_file_path);
+        return 0;
+    }
+
+    Lexer *lexer = &session->lexer;
+    Parser *parser = &session->parser;
+    LLVM_Context *llvm_ctx = &session->module_ctx;
+    const LLVMCodeGenOptLevel opt_level = options->opt_level;
 
-    lexer_rewind(&lexer);
-    parser_parse(&parser);
+    if(options->pipeline) {
+        output_progress(out, "Lexing, parsing and code generation pipelined\n");
+
+        if(!init_module(session, opt_level, parser)) {
+            free(source_file_path);
+            return -1;
+        }
+        llvm_ctx->external_procs = &interfaces->procedures;
+
+        if(!pipeline_convert_file(llvm_ctx, lexer, parser, source_file_path)) {
+            llvm_shutdown_module(llvm_ctx);
+            free(source_file_path);
+            return -1;
+        }
+
+        output_progress(out, "Parsed and converted without error\n");
+
+        if(options->dump_ast) {
+            print_ast_tree(out, parser);
+        }
+    } else {
+        if(!lexer_load_file(lexer, source_file_path)) {
+            fwprintf(stderr, L"Failed to read source file: %ls\n", source_file_path);
+            free(source_file_path);
+            return -1;
+        }
+
+        output_progress(out, "Lexed tokens: %llu\n", (unsigned long long)lexer->token_count);
+
+        if(options->dump_tokens) {
+            lexer_rewind(lexer);
+            print_lexer_tokens(out, lexer);
+        }
+
+        if(!parser_reinit(parser, lexer)) {
+            free(source_file_path);
+            return -1;
+        }
+        parser->lazy_bodies = options->lazy_bodies;
+
+        lexer_rewind(lexer);
+        parser_parse(parser);
  
-    wprintf(L"Parsed without error\n");
-    wprintf(L"AST memory usage: %llub of %llub (%f%%)\n", parser.ast_mem_arena.cursor, parser.ast_mem_arena.bytes, (double)parser.ast_mem_arena.cursor / (double)parser.ast_mem_arena.bytes);
+        output_progress(out, "Parsed without error\n");
+        output_progress(out, "AST memory usage: %llub of %llub (%f%%)\n", (unsigned long long)parser->ast_mem_arena.cursor, (unsigned long long)parser->ast_mem_arena.bytes, (double)parser->ast_mem_arena.cursor / (double)parser->ast_mem_arena.bytes);
 
-    print_ast_tree(&parser);
+        if(options->dump_ast) {
+            print_ast_tree(out, parser);
+        }
 
-    wprintf(L"LLVM converter init\n");
+        if(!options->keep_unreachable && !drop_unreachable_procedures(parser, options, out)) {
+            free(source_file_path);
+            return -1;
+        }
 
-    LLVM_Context llvm_ctx;
-    llvm_init(&llvm_ctx, &parser);
+        output_progress(out, "LLVM converter init\n");
 
-    llvm_convert(&llvm_ctx);
+        if(!init_module(session, opt_level, parser)) {
+            free(source_file_path);
+            return -1;
+        }
+        llvm_ctx->external_procs = &interfaces->procedures;
+        llvm_ctx->specialize_budget = options->specialize_budget;
+    }
 
-    const char *ir_file_path = "program_IR.txt";
-    if(llvm_write_ir_file(&llvm_ctx, ir_file_path)) {
-        fprintf(stdout, "IR file written to \"%s\"\n", ir_file_path);
+    // Written before code generation like the driver does, exports are known once parsed
+    if(options->interface_output_path != NULL) {
+        if(!interface_file_write(options->interface_output_path, parser->ast_root)) {
+            llvm_shutdown_module(llvm_ctx);
+            free(source_file_path);
+            return -1;
+        }
+        output_progress(out, "Interface written to \"%s\"\n", options->interface_output_path);
+    }
+
+    bool output_written = false;
+    bool success = true;
+
+    if(options->codegen_partitions > 1) {
+        Thread_Pool pool;
+        LLVM_Partitions partitions;
+
+        if(!thread_pool_init(&pool, options->thread_count)) {
+            llvm_shutdown_module(llvm_ctx);
+            free(source_file_path);
+            return -1;
+        }
+
+        if(!llvm_partitions_init(&partitions, parser, options->codegen_partitions, opt_level)) {
+            thread_pool_free(&pool);
+            llvm_shutdown_module(llvm_ctx);
+            free(source_file_path);
+            return -1;
+        }
+
+        for(size_t index = 0; index < partitions.partition_count; ++index) {
+            partitions.partitions[index].ctx.external_procs = &interfaces->procedures;
+            partitions.partitions[index].ctx.specialize_budget = options->specialize_budget;
+        }
+
+        output_progress(out, "Code generation: %llu partitions on %llu threads\n", (unsigned long long)partitions.partition_count, (unsigned long long)pool.worker_count);
+
+        success = llvm_convert_partitions(&partitions, &pool);
+
+        if(!success) {
+            output_written = true;
+        } else if(options->split_objects) {
+            if(llvm_emit_partitions(&partitions, &pool, options->emit_kind, options->output_path)) {
+                output_progress(out, "Output written to \"%s.<0..%llu>.%s\"\n", options->output_path, (unsigned long long)partitions.partition_count - 1, emit_kind_extensions[options->emit_kind]);
+            } else {
+                fwprintf(stderr, L"Failed to emit partition outputs.\n");
+                success = false;
+            }
+            output_written = true;
+        } else {
+            success = llvm_link_partitions(llvm_ctx, &partitions, &pool);
+            output_written = !success;
+        }
+
+        llvm_partitions_free(&partitions);
+        thread_pool_free(&pool);
+    } else if(options->bench_procedure != NULL) {
+        llvm_convert(llvm_ctx);
+        success = bench_run(llvm_ctx, options->bench_procedure, options->bench_args, options->bench_samples, out);
+        output_written = true;
+    } else if(options->pipeline) {
+        success = llvm_optimize(llvm_ctx);
+        output_written = !success;
+    } else if(options->procedure_cache) {
+        Procedure_Cache_Stats stats;
+        success = procedure_cache_convert(llvm_ctx, cache, &stats);
+        output_written = !success;
+        output_progress(out, "Procedure cache: %llu reused, %llu compiled\n", (unsigned long long)stats.reused, (unsigned long long)stats.compiled);
     } else {
-        fprintf(stderr, "Failed to write IR file.\n");
+        llvm_convert(llvm_ctx);
+        success = llvm_optimize(llvm_ctx);
+        output_written = !success;
+    }
+
+    if(!output_written) {
+        if(llvm_emit(llvm_ctx, options->emit_kind, options->output_path)) {
+            output_progress(out, "Output written to \"%s\"\n", options->output_path);
+
+            if(cache_usable) {
+                store_cached_outputs(cache, &cache_key, options);
+            }
+        } else {
+            fwprintf(stderr, L"Failed to write output.\n");
+            success = false;
+        }
+    }
+
+    output_progress(out, "Freeing resources\n");
+
+    llvm_shutdown_module(llvm_ctx);
+    free(source_file_path);
+
+    return success ? 0 : -1;
+}
+
+// Daemon_Compile_Proc, also used directly when running without a daemon; A daemon keeps the session between compiles
+static int32_t compile(void *user_data, int32_t argc, char **argv) {
+    Polang_Session *session = (Polang_Session *)user_data;
+
+    Compile_Options options;
+    if(!parse_options(argc, argv, &options)) {
+        print_usage();
+        free_options(&options);
+        return -1;
+    }
+
+    Object_Cache object_cache;
+    Object_Cache *cache = NULL;
+    if(options.cache_directory != NULL) {
+        if(!object_cache_init(&object_cache, options.cache_directory, (uint64_t)options.cache_size_mb * MB(1))) {
+            free_options(&options);
+            return -1;
+        }
+        cache = &object_cache;
+    }
+
+    // Progress and dumps share stdout with nothing but an output written there, then they go to stderr without progress
+    const bool output_to_stdout = options.output_path != NULL && strcmp(options.output_path, "-") == 0;
+    Output_Sink out;
+    output_init(&out, output_to_stdout ? stderr : stdout, output_to_stdout ? OUTPUT_QUIET : options.verbosity);
+
+    Output_Sink errors;
+    output_init(&errors, stderr, options.verbosity);
+    errors.flush_first = &out;
+    const Diagnostic_Handler previous_diagnostics = diagnostic_handler_set((Diagnostic_Handler) { .proc = output_diagnostic, .user_data = &errors });
+
+    if(options.time_report) {
+        timing_start(true);
+    }
+
+    if(options.trace_path != NULL && !trace_start(options.trace_path)) {
+        diagnostic_handler_set(previous_diagnostics);
+        output_free(&errors);
+        output_free(&out);
+        finish_object_cache(cache);
+        free_options(&options);
+        return -1;
+    }
+
+    int32_t exit_code = -1;
+    Interface_Set interfaces; // Single file only, the driver loads its own
+
+    if(options.source_count > 1 || options.thin_lto) {
+        exit_code = driver_compile_files(&options, cache) ? 0 : -1;
+    } else if(interface_set_load(&interfaces, options.interface_paths, options.interface_count)) {
+        // Lexer, parser and converter errors end up here instead of exiting
+        jmp_buf recovery;
+        jmp_buf *previous_recovery = error_recovery_set(&recovery);
+
+        if(setjmp(recovery) == 0) {
+            exit_code = compile_single_file(session, &options, cache, &interfaces, &out);
+        } else if(session->module_ctx.module != NULL) {
+            llvm_shutdown_module(&session->module_ctx);
+        }
+
+        error_recovery_set(previous_recovery);
+        interface_set_free(&interfaces);
+
+        if(exit_code == 0) {
+            output_progress(&out, "\nExited successfully.\n");
+        }
+    }
+
+    // Before the time report and cache statistics on stderr
+    diagnostic_handler_set(previous_diagnostics);
+    output_free(&errors);
+    output_free(&out);
+
+    if(options.time_report) {
+        write_time_report(&options);
+    }
+
+    if(options.trace_path != NULL && !trace_stop() && exit_code == 0) {
+        exit_code = -1;
+    }
+
+    finish_object_cache(cache);
+    free_options(&options);
+    return exit_code;
+}
+
+// "--name" or "--name=value"; out_value gets the default path without a value
+static bool parse_socket_option(const char *arg, const char *name, char *out_value, size_t value_size) {
+    const size_t name_length = strlen(name);
+    if(strncmp(arg, name, name_length) != 0) {
+        return false;
     }
 
-    fwprintf(stdout, L"Freeing resources\n");
+    // Left empty if the default directory isn't safe to use, the daemon calls then fail
+    if(arg[name_length] == '\0') {
+        daemon_default_socket_path(out_value, value_size);
+        return true;
+    }
 
-    lexer_free(&lexer);
-    parser_free(&parser);
-    llvm_shutdown(&llvm_ctx);
+    if(arg[name_length] == '=' && arg[name_length + 1] != '\0') {
+        snprintf(out_value, value_size, "%s", arg + name_length + 1);
+        return true;
+    }
+
+    return false;
+}
+
+int main(int argc, char **argv) {
+    setlocale(LC_ALL, "en_US.utf-8");
+
+#ifdef _WIN32
+    SetConsoleOutputCP(CP_UTF8);
+#endif
+
+    // Daemon options take over the whole invocation
+    char socket_path[512];
+    for(int32_t index = 1; index < argc; ++index) {
+        if(parse_socket_option(argv[index], "--stop-daemon", socket_path, sizeof(socket_path))) {
+            return daemon_stop(socket_path) ? 0 : -1;
+        }
+
+        if(parse_socket_option(argv[index], "--use-daemon", socket_path, sizeof(socket_path))) {
+            // Forward everything else
+            for(int32_t move_index = index; move_index + 1 < argc; ++move_index) {
+                argv[move_index] = argv[move_index + 1];
+            }
+            return daemon_forward_compile(socket_path, argc - 1, argv);
+        }
+    }
+
+    Polang_Session session;
+    polang_session_init(&session, NULL, NULL);
+
+    int32_t exit_code = 0;
+    if(argc == 2 && parse_socket_option(argv[1], "--daemon", socket_path, sizeof(socket_path))) {
+        exit_code = daemon_serve(socket_path, compile, &session) ? 0 : -1;
+    } else {
+        exit_code = compile(&session, argc, argv);
+    }
 
-    fwprintf(stdout, L"\nExited successfully.\n");
-    return 0;
+    polang_session_free(&session);
+    return exit_code;
 }
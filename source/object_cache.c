@@ -0,0 +1,379 @@
+#include "object_cache.h"
+#include "file_io.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <llvm-c/Core.h>
+#include <llvm-c/TargetMachine.h>
+#include <llvm/Config/llvm-config.h>
+
+// SHA-256, a hit gets linked into the output unchecked so the key has to be collision resistant
+static const uint32_t sha256_round_constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_compress(uint32_t state[8], const uint8_t block[64]) {
+    uint32_t w[64];
+    for(size_t index = 0; index < 16; ++index) {
+        w[index] = ((uint32_t)block[index * 4] << 24) | ((uint32_t)block[index * 4 + 1] << 16) |
+                   ((uint32_t)block[index * 4 + 2] << 8) | (uint32_t)block[index * 4 + 3];
+    }
+    for(size_t index = 16; index < 64; ++index) {
+        const uint32_t s0 = ROTR32(w[index - 15], 7) ^ ROTR32(w[index - 15], 18) ^ (w[index - 15] >> 3);
+        const uint32_t s1 = ROTR32(w[index - 2], 17) ^ ROTR32(w[index - 2], 19) ^ (w[index - 2] >> 10);
+        w[index] = w[index - 16] + s0 + w[index - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for(size_t index = 0; index < 64; ++index) {
+        const uint32_t t1 = h + (ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25)) + ((e & f) ^ (~e & g)) + sha256_round_constants[index] + w[index];
+        const uint32_t t2 = (ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void cache_key_add(Cache_Key *key, const void *data, size_t bytes) {
+    const uint8_t *at = (const uint8_t *)data;
+    size_t used = key->bytes % 64;
+    key->bytes += bytes;
+
+    while(bytes > 0) {
+        const size_t taken = MIN(bytes, 64 - used);
+        memcpy(&key->block[used], at, taken);
+        at += taken;
+        bytes -= taken;
+        used += taken;
+
+        if(used == 64) {
+            sha256_compress(key->state, key->block);
+            used = 0;
+        }
+    }
+}
+
+// Pads a copy, the key itself can still be extended
+static void cache_key_digest(const Cache_Key *key, uint8_t out_digest[32]) {
+    Cache_Key final = *key;
+    const uint64_t bit_count = key->bytes * 8;
+
+    const uint8_t padding_start = 0x80;
+    cache_key_add(&final, &padding_start, 1);
+
+    const uint8_t zero = 0;
+    while(final.bytes % 64 != 56) {
+        cache_key_add(&final, &zero, 1);
+    }
+
+    uint8_t length[8];
+    for(size_t index = 0; index < 8; ++index) {
+        length[index] = (uint8_t)(bit_count >> (56 - index * 8));
+    }
+    cache_key_add(&final, length, sizeof(length));
+
+    for(size_t index = 0; index < 8; ++index) {
+        out_digest[index * 4] = (uint8_t)(final.state[index] >> 24);
+        out_digest[index * 4 + 1] = (uint8_t)(final.state[index] >> 16);
+        out_digest[index * 4 + 2] = (uint8_t)(final.state[index] >> 8);
+        out_digest[index * 4 + 3] = (uint8_t)final.state[index];
+    }
+}
+
+void cache_key_add_u64(Cache_Key *key, uint64_t value) {
+    cache_key_add(key, &value, sizeof(value));
+}
+
+// Length goes first so consecutive strings can't run into each other
+void cache_key_add_string(Cache_Key *key, const char *string) {
+    const size_t length = strlen(string);
+    cache_key_add_u64(key, length);
+    cache_key_add(key, string, length);
+}
+
+bool cache_key_add_file(Cache_Key *key, const wchar_t *filepath) {
+    void *data = NULL;
+    size_t bytes = 0;
+    if(!file_read_bytes(filepath, &data, &bytes)) {
+        return false;
+    }
+
+    cache_key_add_u64(key, bytes);
+    cache_key_add(key, data, bytes);
+    free(data);
+    return true;
+}
+
+void cache_key_init(Cache_Key *key) {
+    static const uint32_t initial_state[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(key->state, initial_state, sizeof(initial_state));
+    key->bytes = 0;
+
+    // Build time too, so development builds that didn't bump the version don't share entries
+    cache_key_add_string(key, POLANG_VERSION " " __DATE__ " " __TIME__);
+    cache_key_add_string(key, LLVM_VERSION_STRING);
+
+    char *target_triple = LLVMGetDefaultTargetTriple();
+    char *cpu_name = LLVMGetHostCPUName();
+    char *cpu_features = LLVMGetHostCPUFeatures();
+
+    cache_key_add_string(key, target_triple);
+    cache_key_add_string(key, cpu_name);
+    cache_key_add_string(key, cpu_features);
+
+    LLVMDisposeMessage(target_triple);
+    LLVMDisposeMessage(cpu_name);
+    LLVMDisposeMessage(cpu_features);
+}
+
+// "<directory>/<key><suffix>"
+static wchar_t *make_entry_path(Object_Cache *cache, const Cache_Key *key, const wchar_t *suffix) {
+    const size_t length = wcslen(cache->directory) + 1 + 32 + wcslen(suffix) + 1;
+    wchar_t *path = (wchar_t *)malloc(length * sizeof(wchar_t));
+    if(path == NULL) {
+        fprintf(stderr, "Failed to allocate memory in make_entry_path.\n");
+        return NULL;
+    }
+
+    uint8_t digest[32];
+    cache_key_digest(key, digest);
+
+    wchar_t name[33];
+    for(size_t index = 0; index < 16; ++index) {
+        swprintf(&name[index * 2], 3, L"%02x", digest[index]);
+    }
+
+    swprintf(path, length, L"%ls/%ls%ls", cache->directory, name, suffix);
+    return path;
+}
+
+bool object_cache_init(Object_Cache *cache, const char *directory, uint64_t size_limit) {
+    ZERO_STRUCT(*cache);
+
+    cache->directory = convert_to_wcs_alloc(directory, strlen(directory), NULL);
+    if(cache->directory == NULL) {
+        fprintf(stderr, "Invalid object cache directory: %s\n", directory);
+        return false;
+    }
+
+    if(!directory_create(cache->directory)) {
+        fprintf(stderr, "Failed to create object cache directory: %s\n", directory);
+        free(cache->directory);
+        return false;
+    }
+
+    cache->size_limit = size_limit;
+    return true;
+}
+
+bool object_cache_fetch(Object_Cache *cache, const Cache_Key *key, const char *output_path) {
+    wchar_t *entry_path = make_entry_path(cache, key, L".cached");
+    wchar_t *wide_output_path = convert_to_wcs_alloc(output_path, strlen(output_path), NULL);
+
+    // Check first, a miss must not touch the previous output
+    size_t bytes = 0;
+    bool hit = entry_path != NULL && wide_output_path != NULL && file_get_size(entry_path, &bytes);
+
+    // Entry can still get evicted by another build in between, then it is a miss after all
+    hit = hit && file_link_or_copy(entry_path, wide_output_path);
+
+    if(hit) {
+        file_touch(entry_path);
+        cache->hits += 1;
+    } else {
+        cache->misses += 1;
+    }
+
+    free(entry_path);
+    free(wide_output_path);
+    return hit;
+}
+
+bool object_cache_store(Object_Cache *cache, const Cache_Key *key, const char *output_path) {
+    wchar_t suffix[64];
+    swprintf(suffix, ARRAY_SIZE(suffix), L".%u.%u.tmp", get_process_id(), cache->temp_counter++);
+
+    wchar_t *entry_path = make_entry_path(cache, key, L".cached");
+    wchar_t *temp_path = make_entry_path(cache, key, suffix);
+    wchar_t *wide_output_path = convert_to_wcs_alloc(output_path, strlen(output_path), NULL);
+
+    bool success = entry_path != NULL && temp_path != NULL && wide_output_path != NULL;
+
+    // Whoever renames last wins, the contents are the same anyway
+    if(success && file_link_or_copy(wide_output_path, temp_path)) {
+        success = file_rename(temp_path, entry_path);
+        if(!success) {
+            file_delete(temp_path);
+        }
+    } else {
+        success = false;
+    }
+
+    if(success) {
+        cache->stores += 1;
+    }
+
+    free(entry_path);
+    free(temp_path);
+    free(wide_output_path);
+    return success;
+}
+
+bool object_cache_fetch_data(Object_Cache *cache, const Cache_Key *key, void **out_data, size_t *out_bytes) {
+    wchar_t *entry_path = make_entry_path(cache, key, L".cached");
+
+    const bool hit = entry_path != NULL && file_read_bytes(entry_path, out_data, out_bytes);
+
+    if(hit) {
+        file_touch(entry_path);
+        cache->hits += 1;
+    } else {
+        cache->misses += 1;
+    }
+
+    free(entry_path);
+    return hit;
+}
+
+bool object_cache_store_data(Object_Cache *cache, const Cache_Key *key, const void *data, size_t bytes) {
+    wchar_t suffix[64];
+    swprintf(suffix, ARRAY_SIZE(suffix), L".%u.%u.tmp", get_process_id(), cache->temp_counter++);
+
+    wchar_t *entry_path = make_entry_path(cache, key, L".cached");
+    wchar_t *temp_path = make_entry_path(cache, key, suffix);
+
+    bool success = entry_path != NULL && temp_path != NULL && file_write(temp_path, data, bytes);
+    if(success) {
+        success = file_rename(temp_path, entry_path);
+        if(!success) {
+            file_delete(temp_path);
+        }
+    }
+
+    if(success) {
+        cache->stores += 1;
+    }
+
+    free(entry_path);
+    free(temp_path);
+    return success;
+}
+
+typedef struct {
+    wchar_t *name;
+    uint64_t bytes;
+    uint64_t modified_time;
+} Cache_Entry;
+
+typedef struct {
+    Cache_Entry *entries;
+    size_t entry_count;
+    size_t entry_capacity;
+    uint64_t total_bytes;
+} Cache_Listing;
+
+static void collect_cache_entry(void *user_data, const Directory_Entry *entry) {
+    Cache_Listing *listing = (Cache_Listing *)user_data;
+
+    if(listing->entry_count == listing->entry_capacity) {
+        const size_t new_capacity = MAX(listing->entry_capacity * 2, 64);
+        Cache_Entry *new_entries = (Cache_Entry *)realloc(listing->entries, new_capacity * sizeof(Cache_Entry));
+        if(new_entries == NULL) {
+            return;
+        }
+        listing->entries = new_entries;
+        listing->entry_capacity = new_capacity;
+    }
+
+    wchar_t *name = wcsdup(entry->name);
+    if(name == NULL) {
+        return;
+    }
+
+    listing->entries[listing->entry_count++] = (Cache_Entry) {
+        .name = name,
+        .bytes = entry->bytes,
+        .modified_time = entry->modified_time
+    };
+    listing->total_bytes += entry->bytes;
+}
+
+static int compare_cache_entries(const void *a, const void *b) {
+    const Cache_Entry *entry_a = (const Cache_Entry *)a;
+    const Cache_Entry *entry_b = (const Cache_Entry *)b;
+
+    if(entry_a->modified_time != entry_b->modified_time) {
+        return entry_a->modified_time < entry_b->modified_time ? -1 : 1;
+    }
+    return wcscmp(entry_a->name, entry_b->name);
+}
+
+// Leftover temporary files count as entries too
+void object_cache_evict(Object_Cache *cache) {
+    if(cache->stores == 0) {
+        return;
+    }
+
+    Cache_Listing listing = { };
+    if(!directory_list(cache->directory, collect_cache_entry, &listing)) {
+        return;
+    }
+
+    if(listing.total_bytes > cache->size_limit) {
+        qsort(listing.entries, listing.entry_count, sizeof(Cache_Entry), compare_cache_entries);
+
+        for(size_t index = 0; index < listing.entry_count && listing.total_bytes > cache->size_limit; ++index) {
+            const size_t length = wcslen(cache->directory) + wcslen(listing.entries[index].name) + 2;
+            wchar_t *path = (wchar_t *)malloc(length * sizeof(wchar_t));
+            if(path == NULL) {
+                break;
+            }
+            swprintf(path, length, L"%ls/%ls", cache->directory, listing.entries[index].name);
+
+            // Another build may have evicted it already
+            if(file_delete(path)) {
+                cache->evictions += 1;
+            }
+            listing.total_bytes -= listing.entries[index].bytes;
+            free(path);
+        }
+    }
+
+    for(size_t index = 0; index < listing.entry_count; ++index) {
+        free(listing.entries[index].name);
+    }
+    free(listing.entries);
+}
+
+void object_cache_free(Object_Cache *cache) {
+    free(cache->directory);
+    ZERO_STRUCT(*cache);
+}
+
+void object_cache_report(Object_Cache *cache) {
+    fwprintf(stderr, L"Object cache: %llu hits, %llu misses, %llu stored, %llu evicted\n",
+             (unsigned long long)cache->hits, (unsigned long long)cache->misses,
+             (unsigned long long)cache->stores, (unsigned long long)cache->evictions);
+}
@@ -0,0 +1,65 @@
+#ifndef _OBJECT_CACHE_H
+#define _OBJECT_CACHE_H
+
+#include "common.h"
+
+/*
+ * Content-addressed on-disk cache of compiler outputs
+ *
+ * Entries are named after a SHA-256 of everything that decides the output: compiler version, host target
+ * and CPU features, options and source bytes. A hit hardlinks (or copies) the stored file to the output path,
+ * so nothing gets lexed, parsed or generated.
+ * Entries are written under a unique temporary name and renamed into place, concurrent builds sharing
+ * a cache directory never see partial files. Hits refresh the modification time, which eviction uses as LRU order.
+ */
+
+#define OBJECT_CACHE_DEFAULT_SIZE_MB 1024
+
+// Running SHA-256, copies can be extended separately; Entry names use the first 128 bits of the digest
+typedef struct {
+    uint32_t state[8];
+    uint8_t  block[64];
+    uint64_t bytes;
+} Cache_Key;
+
+typedef struct {
+    wchar_t *directory;
+    uint64_t size_limit;
+
+    // Statistics of this process
+    size_t hits;
+    size_t misses;
+    size_t stores;
+    size_t evictions;
+
+    uint32_t temp_counter;
+} Object_Cache;
+
+/* Creates the directory if needed */
+bool object_cache_init(Object_Cache *cache, const char *directory, uint64_t size_limit);
+
+void object_cache_free(Object_Cache *cache);
+
+/* Deletes least recently used entries until the cache fits its size limit; Does nothing if this process stored nothing */
+void object_cache_evict(Object_Cache *cache);
+
+/* Key starts with the compiler version and host target */
+void cache_key_init(Cache_Key *key);
+void cache_key_add(Cache_Key *key, const void *data, size_t bytes);
+void cache_key_add_u64(Cache_Key *key, uint64_t value);
+void cache_key_add_string(Cache_Key *key, const char *string);
+bool cache_key_add_file(Cache_Key *key, const wchar_t *filepath);
+
+/* On a hit places the stored output at output_path and returns true */
+bool object_cache_fetch(Object_Cache *cache, const Cache_Key *key, const char *output_path);
+
+/* Stores the file at output_path under key */
+bool object_cache_store(Object_Cache *cache, const Cache_Key *key, const char *output_path);
+
+/* Same for outputs kept in memory; out_data -> @allocated */
+bool object_cache_fetch_data(Object_Cache *cache, const Cache_Key *key, void **out_data, size_t *out_bytes);
+bool object_cache_store_data(Object_Cache *cache, const Cache_Key *key, const void *data, size_t bytes);
+
+void object_cache_report(Object_Cache *cache);
+
+#endif /* _OBJECT_CACHE_H */
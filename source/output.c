@@ -0,0 +1,180 @@
+#include "output.h"
+#include "file_io.h"
+
+#include <stdlib.h>
+#include <stdarg.h>
+
+void output_init(Output_Sink *sink, FILE *stream, Output_Verbosity verbosity) {
+    ZERO_STRUCT(*sink);
+    sink->stream = stream;
+    sink->verbosity = verbosity;
+
+    // Unbuffered output still works, only slower
+    sink->buffer = (char *)malloc(OUTPUT_BUFFER_BYTES);
+}
+
+void output_free(Output_Sink *sink) {
+    output_flush(sink);
+    free(sink->buffer);
+    ZERO_STRUCT(*sink);
+}
+
+bool output_flush(Output_Sink *sink) {
+    if(sink->used == 0) {
+        return true;
+    }
+
+    const bool success = stream_write(sink->stream, sink->buffer, sink->used);
+    sink->used = 0;
+    return success;
+}
+
+void output_bytes(Output_Sink *sink, const char *data, size_t bytes) {
+    if(sink->buffer == NULL) {
+        stream_write(sink->stream, data, bytes);
+        return;
+    }
+
+    if(sink->used + bytes > OUTPUT_BUFFER_BYTES) {
+        output_flush(sink);
+
+        if(bytes > OUTPUT_BUFFER_BYTES) {
+            stream_write(sink->stream, data, bytes);
+            return;
+        }
+    }
+
+    memcpy(sink->buffer + sink->used, data, bytes);
+    sink->used += bytes;
+}
+
+void output_cstr(Output_Sink *sink, const char *string) {
+    output_bytes(sink, string, strlen(string));
+}
+
+void output_repeat(Output_Sink *sink, const char *string, size_t count) {
+    const size_t bytes = strlen(string);
+    for(size_t index = 0; index < count; ++index) {
+        output_bytes(sink, string, bytes);
+    }
+}
+
+// Bytes written to out, at most 4; Unpaired surrogates become U+FFFD
+static size_t encode_utf8(uint32_t code_point, char *out) {
+    if(code_point < 0x80) {
+        out[0] = (char)code_point;
+        return 1;
+    }
+
+    if(code_point < 0x800) {
+        out[0] = (char)(0xC0 | (code_point >> 6));
+        out[1] = (char)(0x80 | (code_point & 0x3F));
+        return 2;
+    }
+
+    if(code_point > 0x10FFFF || (code_point >= 0xD800 && code_point <= 0xDFFF)) {
+        code_point = 0xFFFD;
+    }
+
+    if(code_point < 0x10000) {
+        out[0] = (char)(0xE0 | (code_point >> 12));
+        out[1] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (code_point & 0x3F));
+        return 3;
+    }
+
+    out[0] = (char)(0xF0 | (code_point >> 18));
+    out[1] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (code_point & 0x3F));
+    return 4;
+}
+
+void output_wide(Output_Sink *sink, const wchar_t *data, size_t length) {
+    char encoded[64];
+    size_t encoded_bytes = 0;
+
+    for(size_t index = 0; index < length; ++index) {
+        uint32_t code_point = (uint32_t)data[index];
+
+        // UTF-16 on Windows, pairs of surrogates make one code point
+        if(code_point >= 0xD800 && code_point <= 0xDBFF && index + 1 < length) {
+            const uint32_t low = (uint32_t)data[index + 1];
+            if(low >= 0xDC00 && low <= 0xDFFF) {
+                code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                index += 1;
+            }
+        }
+
+        if(encoded_bytes + 4 > sizeof(encoded)) {
+            output_bytes(sink, encoded, encoded_bytes);
+            encoded_bytes = 0;
+        }
+        encoded_bytes += encode_utf8(code_point, encoded + encoded_bytes);
+    }
+
+    output_bytes(sink, encoded, encoded_bytes);
+}
+
+static void output_format_args(Output_Sink *sink, const char *format, va_list args) {
+    va_list args_copy;
+    va_copy(args_copy, args);
+    const size_t available = sink->buffer != NULL ? OUTPUT_BUFFER_BYTES - sink->used : 0;
+    const int32_t length = vsnprintf(available > 0 ? sink->buffer + sink->used : NULL, available, format, args_copy);
+    va_end(args_copy);
+
+    if(length < 0) {
+        return;
+    }
+
+    // Formatted straight into the buffer when it fits
+    if((size_t)length < available) {
+        sink->used += length;
+        return;
+    }
+
+    if(sink->buffer != NULL && (size_t)length < OUTPUT_BUFFER_BYTES) {
+        output_flush(sink);
+        sink->used = vsnprintf(sink->buffer, OUTPUT_BUFFER_BYTES, format, args);
+        return;
+    }
+
+    char *formatted = (char *)malloc(length + 1);
+    if(formatted == NULL) {
+        fprintf(stderr, "Failed to allocate memory in output_format.\n");
+        return;
+    }
+
+    vsnprintf(formatted, length + 1, format, args);
+    output_bytes(sink, formatted, length);
+    free(formatted);
+}
+
+void output_format(Output_Sink *sink, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    output_format_args(sink, format, args);
+    va_end(args);
+}
+
+void output_progress(Output_Sink *sink, const char *format, ...) {
+    if(sink->verbosity < OUTPUT_DEFAULT) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    output_format_args(sink, format, args);
+    va_end(args);
+}
+
+void output_diagnostic(void *user_data, const wchar_t *message) {
+    Output_Sink *sink = (Output_Sink *)user_data;
+    if(sink->flush_first != NULL) {
+        output_flush(sink->flush_first);
+    }
+
+    output_wide(sink, message, wcslen(message));
+    output_bytes(sink, "\n", 1);
+    output_flush(sink);
+}
@@ -0,0 +1,50 @@
+#ifndef _OUTPUT_H
+#define _OUTPUT_H
+
+#include "common.h"
+
+#include <stdio.h>
+
+/*
+ * Buffered console output of the compiler: progress messages, token and AST dumps, diagnostics and benchmark results
+ * Text is encoded to UTF-8 here and written to the stream's file descriptor in large blocks, so printing a big dump
+ * costs a few write calls instead of one wide CRT call per piece. Wide strings are encoded by hand, without the locale.
+ * A sink belongs to one thread; Flush it before anything else writes to the same stream.
+ */
+
+#define OUTPUT_BUFFER_BYTES KB(256)
+
+typedef enum {
+    OUTPUT_QUIET,   // -q, errors and requested dumps only
+    OUTPUT_DEFAULT, // Progress messages
+} Output_Verbosity;
+
+typedef struct Output_Sink {
+    FILE *stream;
+    char *buffer; // OUTPUT_BUFFER_BYTES, NULL writes straight through
+    size_t used;
+    Output_Verbosity verbosity;
+
+    // Flushed before every diagnostic, so errors on stderr come after the progress leading up to them on a console
+    struct Output_Sink *flush_first;
+} Output_Sink;
+
+void output_init(Output_Sink *sink, FILE *stream, Output_Verbosity verbosity);
+void output_free(Output_Sink *sink); // Flushes
+bool output_flush(Output_Sink *sink);
+
+void output_bytes(Output_Sink *sink, const char *data, size_t bytes);
+void output_cstr(Output_Sink *sink, const char *string);
+void output_wide(Output_Sink *sink, const wchar_t *data, size_t length);
+void output_repeat(Output_Sink *sink, const char *string, size_t count);
+
+// printf formatting of UTF-8 text; Wide strings go through output_wide
+void output_format(Output_Sink *sink, const char *format, ...);
+
+// Same as output_format, dropped below OUTPUT_DEFAULT
+void output_progress(Output_Sink *sink, const char *format, ...);
+
+// Diagnostic_Proc writing each message as a line to the Output_Sink in user_data, flushed right away
+void output_diagnostic(void *user_data, const wchar_t *message);
+
+#endif /* _OUTPUT_H */
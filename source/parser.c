@@ -1,4 +1,6 @@
 #include "parser.h"
+#include "timing.h"
+#include "trace.h"
 
 #include <stdlib.h>
 
@@ -6,8 +8,8 @@
 
 AST_Node *parse_expression(Parser *parser);
 
-// @TODO:
-void todo___print_the_line(Parser *parser, size_t line) {
+// Line of the source with leading whitespace skipped, for error messages
+static Str_View get_source_line(Parser *parser, size_t line) {
     Str_View view = str_view(parser->lexer->file_data, parser->lexer->file_length);
  
     size_t lines_skipped = 1;
@@ -26,38 +28,40 @@ void todo___print_the_line(Parser *parser, size_t line) {
         view.length = index - 1;
     }
     
-    wprintf(L"%.*ls", view.length, view.data);
+    return view;
 }
 
-void report_unexpected_token(Parser *parser, Token token, wchar_t *string) {
-    wprintf(L"On line: %llu\nGot unexpected token %ls\n", token.line, token_kind_strings[token.kind]);
+// "Identifier = <name>\n" for identifier tokens, empty otherwise
+static void format_token_identifier(Token token, wchar_t *buffer, size_t buffer_size) {
+    buffer[0] = L'\0';
     if(token.kind == TOKEN_IDENTIFIER) {
-        wprintf(L"Identifier = %.*ls\n", token.value_string.length, token.value_string.data);
-    }
-    todo___print_the_line(parser, token.line);
-    wprintf(L"\n");
-    if(string != NULL) {
-        wprintf(string);
+        swprintf(buffer, buffer_size, L"Identifier = %.*ls\n", token.value_string.length, token.value_string.data);
     }
-    wprintf(L"\n");
-    exit(-1);
+}
+
+void report_unexpected_token(Parser *parser, Token token, wchar_t *string) {
+    wchar_t identifier[256];
+    format_token_identifier(token, identifier, ARRAY_SIZE(identifier));
+    Str_View line = get_source_line(parser, token.line);
+
+    report_error(L"On line: %llu\nGot unexpected token %ls\n%ls%.*ls%ls%ls", token.line, token_kind_strings[token.kind], identifier, line.length, line.data, string != NULL ? L"\n" : L"", string != NULL ? string : L"");
+    fatal_error();
 }
 
 void report_syntax_error(Parser *parser, Token token, Token_Kind token_expected) {
-    wprintf(L"On line: %llu\nGot unexpected token %ls, expected %ls\n", token.line, token_kind_strings[token.kind], token_kind_strings[token_expected]);
-    if(token.kind == TOKEN_IDENTIFIER) {
-        wprintf(L"Identifier = %.*ls\n", token.value_string.length, token.value_string.data);
-    }
-    todo___print_the_line(parser, token.line);
-    wprintf(L"\n");
-    wprintf(L"\n");
-    exit(-1);
+    wchar_t identifier[256];
+    format_token_identifier(token, identifier, ARRAY_SIZE(identifier));
+    Str_View line = get_source_line(parser, token.line);
+
+    report_error(L"On line: %llu\nGot unexpected token %ls, expected %ls\n%ls%.*ls", token.line, token_kind_strings[token.kind], token_kind_strings[token_expected], identifier, line.length, line.data);
+    fatal_error();
 }
 
 static AST_Node *_parser_new_ast(Parser *parser, AST_Kind kind, size_t size_of_ast_struct) {
     AST_Node *new_ast = mem_arena_push(&parser->ast_mem_arena, size_of_ast_struct);
     if(new_ast == NULL) {
-        assert(0 && "Failed to allocate memory for ast");
+        report_error(L"Source too large, out of AST memory.");
+        fatal_error();
     }
     memset(new_ast, 0, size_of_ast_struct);
     new_ast->kind = kind;
@@ -70,7 +74,7 @@ bool parser_init(Parser *parser, Lexer *lexer) {
     parser->ast_mem_arena = mem_arena_alloc(PARSER_AST_MEMORY_BYTES);
 
     if(parser->ast_mem_arena.pointer == NULL) {
-        fwprintf(stderr, L"Failed to allocate memory for parser.\n");
+        report_error(L"Failed to allocate memory for parser.");
         return false;
     }
 
@@ -78,6 +82,20 @@ bool parser_init(Parser *parser, Lexer *lexer) {
     return true;
 }
 
+bool parser_reinit(Parser *parser, Lexer *lexer) {
+    if(parser->ast_mem_arena.pointer == NULL) {
+        return parser_init(parser, lexer);
+    }
+
+    Memory_Arena ast_mem_arena = parser->ast_mem_arena;
+    mem_arena_reset(&ast_mem_arena);
+
+    ZERO_STRUCT(*parser);
+    parser->ast_mem_arena = ast_mem_arena;
+    parser->lexer = lexer;
+    return true;
+}
+
 void parser_free(Parser *parser) {
     mem_arena_free(&parser->ast_mem_arena);
 
@@ -98,40 +116,157 @@ AST_Type_Def *get_simple_data_type(Parser *parser, Token_Kind token_kind) {
         case TOKEN_KEYWORD_INT64:   return parser->ast_type_def_int64; 
         case TOKEN_KEYWORD_UINT64:  return parser->ast_type_def_uint64;
         case TOKEN_KEYWORD_FLOAT64: return parser->ast_type_def_float64;
+        case TOKEN_KEYWORD_INT32:   return parser->ast_type_def_int32;
+        case TOKEN_KEYWORD_UINT32:  return parser->ast_type_def_uint32;
+        case TOKEN_KEYWORD_INT16:   return parser->ast_type_def_int16;
+        case TOKEN_KEYWORD_INT8:    return parser->ast_type_def_int8;
+        case TOKEN_KEYWORD_FLOAT32: return parser->ast_type_def_float32;
     }
 }
 
-void root_add_node(AST_Root *ast_root, AST_Node *node) {
-    assert(ast_root->nodes_count < AST_ROOT_NODES_MAX && "Exceeded root nodes limit @TODO");
-    ast_root->nodes[ast_root->nodes_count++] = node;
+// Simple type keyword, a type parameter of the procedure being parsed or a struct declared before; NULL if the token is none of them
+static AST_Type_Def *get_data_type(Parser *parser, Token token) {
+    AST_Type_Def *ast_type = get_simple_data_type(parser, token.kind);
+    if(ast_type != NULL || token.kind != TOKEN_IDENTIFIER) {
+        return ast_type;
+    }
+
+    // Type parameters shadow structs
+    for(size_t index = 0; parser->procedure != NULL && index < parser->procedure->type_params_count; ++index) {
+        AST_Type_Def *type_param = parser->procedure->type_params[index];
+        if(str_view_compare(type_param->signature, token.value_string)) {
+            return type_param;
+        }
+    }
+
+    for(size_t index = 0; index < parser->structs_count; ++index) {
+        if(str_view_compare(parser->structs[index]->identifier, token.value_string)) {
+            return parser->structs[index]->data_type;
+        }
+    }
+
+    return NULL;
 }
 
-void block_add_node(AST_Block *ast_block, AST_Node *node) {
-    assert(ast_block->nodes_count < AST_BLOCK_NODES_MAX && "Exceeded block nodes limit @TODO");
-    ast_block->nodes[ast_block->nodes_count++] = node;
+// Lane count of a vector type keyword, 0 for other tokens
+static uint32_t get_vector_keyword_lanes(Token_Kind token_kind) {
+    switch(token_kind) {
+        default: return 0;
+        case TOKEN_KEYWORD_VECTOR2:  return 2;
+        case TOKEN_KEYWORD_VECTOR4:  return 4;
+        case TOKEN_KEYWORD_VECTOR8:  return 8;
+        case TOKEN_KEYWORD_VECTOR16: return 16;
+    }
 }
 
-AST_Parameter *parse_procedure_param(Parser *parser) {
-    Token token_ident = lexer_peek_token(parser->lexer, 0);
-    Token token_colon = lexer_peek_token(parser->lexer, 1);
-    Token token_type  = lexer_peek_token(parser->lexer, 2);
+static bool starts_data_type(Parser *parser, Token token) {
+    return get_vector_keyword_lanes(token.kind) != 0 || get_data_type(parser, token) != NULL;
+}
 
-    if(token_ident.kind != TOKEN_IDENTIFIER) {
-        report_syntax_error(parser, token_ident, TOKEN_IDENTIFIER);
-    }
+// Type at the next token, "wektor4<typ>" for vectors and "[length]typ" for arrays; NULL without consuming anything if none starts there
+static AST_Type_Def *parse_data_type(Parser *parser) {
+    Token token = lexer_peek_token(parser->lexer, 0);
+
+    if(token.kind == TOKEN_BRACKET_OPEN) {
+        lexer_next_token(parser->lexer);
+
+        Token token_length = expect_token(parser, TOKEN_NUMBER);
+        if(!(token_length.flags & TOKEN_FLAG_NUMBER_INT64) || token_length.value_int64 <= 0 || token_length.value_int64 > UINT32_MAX) {
+            report_unexpected_token(parser, token_length, L"Array length has to be a positive integer!");
+        }
 
-    if(token_colon.kind != TOKEN_COLON) {
-        report_syntax_error(parser, token_colon, TOKEN_COLON);
+        expect_token(parser, TOKEN_BRACKET_CLOSE);
+
+        Token token_element = lexer_peek_token(parser->lexer, 0);
+        AST_Type_Def *element = parse_data_type(parser);
+        if(element == NULL || element->kind == TYPE_ARRAY || element->kind == TYPE_VOID) {
+            report_unexpected_token(parser, token_element, L"Expected element type of the array!");
+        }
+
+        AST_Type_Def *ast_type = AST_NEW(parser, AST_Type_Def);
+        ast_type->kind = TYPE_ARRAY;
+        ast_type->signature = element->signature;
+        ast_type->element_type = element;
+        ast_type->array_length = (uint32_t)token_length.value_int64;
+        return ast_type;
     }
 
-    AST_Type_Def *ast_type = get_simple_data_type(parser, token_type.kind);
-    if(ast_type == NULL) {
-        report_unexpected_token(parser, token_type, L"Expected data type!");
+    const uint32_t lanes = get_vector_keyword_lanes(token.kind);
+    if(lanes == 0) {
+        AST_Type_Def *ast_type = get_data_type(parser, token);
+        if(ast_type != NULL) {
+            lexer_next_token(parser->lexer);
+        }
+        return ast_type;
     }
 
     lexer_next_token(parser->lexer);
-    lexer_next_token(parser->lexer);
-    lexer_next_token(parser->lexer);
+    expect_token(parser, TOKEN_LESS);
+
+    Token token_element = lexer_next_token(parser->lexer);
+    AST_Type_Def *element = get_data_type(parser, token_element);
+    if(element == NULL || element->kind == TYPE_CUSTOM) {
+        report_unexpected_token(parser, token_element, L"Expected element type of the vector!");
+    }
+
+    expect_token(parser, TOKEN_GREATER);
+
+    AST_Type_Def *ast_type = AST_NEW(parser, AST_Type_Def);
+    ast_type->kind = make_vector_type(element->kind, lanes);
+    ast_type->signature = element->signature;
+    ast_type->type_param_index = element->type_param_index;
+    return ast_type;
+}
+
+static void scope_add_node(Parser *parser, AST_Node *node) {
+    if(parser->scope_nodes_count == PARSER_SCOPE_NODES_MAX) {
+        report_unexpected_token(parser, lexer_peek_token(parser->lexer, 0), L"Too many variables in scope!");
+    }
+    parser->scope_nodes[parser->scope_nodes_count++] = node;
+}
+
+// Declaration, loop or parameter the name refers to, innermost first; NULL if there is none
+static AST_Node *find_variable(Parser *parser, Str_View identifier) {
+    for(size_t index = parser->scope_nodes_count; index > 0; --index) {
+        AST_Node *node = parser->scope_nodes[index - 1];
+        const Str_View node_identifier = node->kind == ast_kind(AST_Declaration) ? ((AST_Declaration *)node)->identifier : ((AST_For *)node)->identifier;
+        if(str_view_compare(node_identifier, identifier)) {
+            return node;
+        }
+    }
+
+    for(size_t index = 0; index < parser->procedure->params_count; ++index) {
+        if(str_view_compare(parser->procedure->params[index]->identifier, identifier)) {
+            return (AST_Node *)parser->procedure->params[index];
+        }
+    }
+
+    return NULL;
+}
+
+void root_add_node(Parser *parser, AST_Node *node) {
+    AST_Root *ast_root = parser->ast_root;
+    if(ast_root->nodes_count == AST_ROOT_NODES_MAX) {
+        report_unexpected_token(parser, lexer_peek_token(parser->lexer, 0), L"Too many procedures and structs in the file!");
+    }
+    ast_root->nodes[ast_root->nodes_count++] = node;
+}
+
+void block_add_node(Parser *parser, AST_Block *ast_block, AST_Node *node) {
+    if(ast_block->nodes_count == AST_BLOCK_NODES_MAX) {
+        report_unexpected_token(parser, lexer_peek_token(parser->lexer, 0), L"Too many statements in a block!");
+    }
+    ast_block->nodes[ast_block->nodes_count++] = node;
+}
+
+AST_Parameter *parse_procedure_param(Parser *parser) {
+    Token token_ident = expect_token(parser, TOKEN_IDENTIFIER);
+    expect_token(parser, TOKEN_COLON);
+
+    AST_Type_Def *ast_type = parse_data_type(parser);
+    if(ast_type == NULL) {
+        report_unexpected_token(parser, lexer_peek_token(parser->lexer, 0), L"Expected data type!");
+    }
 
     AST_Parameter *ast_param = AST_NEW(parser, AST_Parameter);
     ast_param->identifier = token_ident.value_string;
@@ -139,8 +274,10 @@ AST_Parameter *parse_procedure_param(Parser *parser) {
     return ast_param;
 }
 
-static void procedure_add_param(AST_Procedure *ast_proc, AST_Parameter *ast_param) {
-    assert(ast_proc->params_count < AST_PROCEDURE_PARAMS_MAX && "Exceeded procedure parameter limit! @TODO");
+static void procedure_add_param(Parser *parser, AST_Procedure *ast_proc, AST_Parameter *ast_param) {
+    if(ast_proc->params_count == AST_PROCEDURE_PARAMS_MAX) {
+        report_unexpected_token(parser, lexer_peek_token(parser->lexer, 0), L"Too many parameters!");
+    }
     ast_proc->params[ast_proc->params_count++] = ast_param;
 }
 
@@ -167,17 +304,53 @@ AST_Literal *make_ast_literal(Parser *parser, Token *token) {
     return ast_literal;
 }
 
-void procedure_call_add_param(AST_Procedure_Call *ast_proc_call, AST_Node *expression) {
-    assert(ast_proc_call->params_count < AST_PROCEDURE_PARAMS_MAX && "Exceeded procedure call params limit @TODO");
+void procedure_call_add_param(Parser *parser, AST_Procedure_Call *ast_proc_call, AST_Node *expression) {
+    if(ast_proc_call->params_count == AST_PROCEDURE_PARAMS_MAX) {
+        report_unexpected_token(parser, lexer_peek_token(parser->lexer, 0), L"Too many arguments!");
+    }
     ast_proc_call->params[ast_proc_call->params_count++] = expression;
 }
 
+// "[type, ...]" after the name of a generic procedure
+static void parse_type_args(Parser *parser, AST_Procedure_Call *ast_proc_call) {
+    expect_token(parser, TOKEN_BRACKET_OPEN);
+
+    while(true) {
+        Token token_type = lexer_peek_token(parser->lexer, 0);
+        AST_Type_Def *ast_type = parse_data_type(parser);
+        if(ast_type == NULL) {
+            report_unexpected_token(parser, token_type, L"Expected data type in type arguments!");
+        }
+        if(ast_type->kind == TYPE_CUSTOM) {
+            report_unexpected_token(parser, token_type, L"Structs can't be type arguments!");
+        }
+
+        if(ast_proc_call->type_args_count == AST_PROCEDURE_TYPE_PARAMS_MAX) {
+            report_unexpected_token(parser, token_type, L"Too many type arguments!");
+        }
+        ast_proc_call->type_args[ast_proc_call->type_args_count++] = ast_type;
+
+        Token token = lexer_next_token(parser->lexer);
+        if(token.kind == TOKEN_BRACKET_CLOSE) {
+            break;
+        }
+        if(token.kind != TOKEN_COMMA) {
+            report_syntax_error(parser, token, TOKEN_BRACKET_CLOSE);
+        }
+    }
+}
+
 AST_Procedure_Call *parse_procedure_call(Parser *parser) {
     Token token_signature = expect_token(parser, TOKEN_IDENTIFIER);
-    expect_token(parser, TOKEN_PAREN_OPEN);
 
     AST_Procedure_Call *ast_proc_call = AST_NEW(parser, AST_Procedure_Call);
     ast_proc_call->procedure_signature = token_signature.value_string;
+
+    if(lexer_peek_token(parser->lexer, 0).kind == TOKEN_BRACKET_OPEN) {
+        parse_type_args(parser, ast_proc_call);
+    }
+
+    expect_token(parser, TOKEN_PAREN_OPEN);
  
     // If next token is close paren, immediatelly fall off from following loop, could just wrap it in an if...
     bool expect_expression = lexer_peek_token(parser->lexer, 0).kind != TOKEN_PAREN_CLOSE;
@@ -203,7 +376,7 @@ AST_Procedure_Call *parse_procedure_call(Parser *parser) {
             }
         } else {
             AST_Node *expression = parse_expression(parser);
-            procedure_call_add_param(ast_proc_call, expression);
+            procedure_call_add_param(parser, ast_proc_call, expression);
             expect_expression = false;
         }
     }
@@ -211,12 +384,56 @@ AST_Procedure_Call *parse_procedure_call(Parser *parser) {
     return ast_proc_call;
 }
 
+// "typ(expression)", the next token starts the type
+static AST_Conversion *parse_conversion(Parser *parser) {
+    Token token_type = lexer_peek_token(parser->lexer, 0);
+    AST_Type_Def *data_type = parse_data_type(parser);
+    assert(data_type != NULL);
+    if(data_type->kind == TYPE_CUSTOM) {
+        report_unexpected_token(parser, token_type, L"Values can't be converted to a struct, assign its fields instead!");
+    }
+    expect_token(parser, TOKEN_PAREN_OPEN);
+
+    AST_Conversion *ast_conversion = AST_NEW(parser, AST_Conversion);
+    ast_conversion->data_type = data_type;
+    ast_conversion->expression = parse_expression(parser);
+
+    expect_token(parser, TOKEN_PAREN_CLOSE);
+    return ast_conversion;
+}
+
 AST_Node *parse_expression(Parser *parser) {
     AST_Node *expression = NULL;
  
     Token token = lexer_peek_token(parser->lexer, 0);
     switch(token.kind) {
-        default: { report_unexpected_token(parser, token, L"Unexpected token in parse_expression"); } break;
+        default: {
+            if(!starts_data_type(parser, token)) {
+                report_unexpected_token(parser, token, L"Unexpected token in parse_expression");
+            }
+            expression = (AST_Node *)parse_conversion(parser);
+        } break;
+
+        case TOKEN_KEYWORD_SUM:
+        case TOKEN_KEYWORD_PRODUCT:
+        case TOKEN_KEYWORD_MIN:
+        case TOKEN_KEYWORD_MAX: {
+            lexer_next_token(parser->lexer);
+
+            AST_Reduction *ast_reduction = AST_NEW(parser, AST_Reduction);
+            switch(token.kind) {
+                default: assert(0);
+                case TOKEN_KEYWORD_SUM:     ast_reduction->operation = REDUCTION_SUM;     break;
+                case TOKEN_KEYWORD_PRODUCT: ast_reduction->operation = REDUCTION_PRODUCT; break;
+                case TOKEN_KEYWORD_MIN:     ast_reduction->operation = REDUCTION_MIN;     break;
+                case TOKEN_KEYWORD_MAX:     ast_reduction->operation = REDUCTION_MAX;     break;
+            }
+
+            expect_token(parser, TOKEN_PAREN_OPEN);
+            ast_reduction->expression = parse_expression(parser);
+            expect_token(parser, TOKEN_PAREN_CLOSE);
+            expression = (AST_Node *)ast_reduction;
+        } break;
         
         case TOKEN_NUMBER: {
             lexer_next_token(parser->lexer);
@@ -227,7 +444,14 @@ AST_Node *parse_expression(Parser *parser) {
 
         case TOKEN_IDENTIFIER: {
             Token token_past_ident = lexer_peek_token(parser->lexer, 1);
-            if(token_past_ident.kind == TOKEN_PAREN_OPEN) {
+
+            // Brackets hold type arguments of a call or index what comes before them
+            const bool type_args = token_past_ident.kind == TOKEN_BRACKET_OPEN && starts_data_type(parser, lexer_peek_token(parser->lexer, 2));
+
+            if(get_data_type(parser, token) != NULL && token_past_ident.kind == TOKEN_PAREN_OPEN) {
+                // Type parameter of the generic procedure
+                expression = (AST_Node *)parse_conversion(parser);
+            } else if(token_past_ident.kind == TOKEN_PAREN_OPEN || type_args) {
                 AST_Procedure_Call *ast_proc_call = parse_procedure_call(parser);
                 expression = (AST_Node *)ast_proc_call;
             } else {
@@ -239,6 +463,32 @@ AST_Node *parse_expression(Parser *parser) {
         } break;
     }
 
+    // Brackets index what comes before them, a dot takes one of its fields
+    while(true) {
+        Token token_postfix = lexer_peek_token(parser->lexer, 0);
+
+        if(token_postfix.kind == TOKEN_BRACKET_OPEN) {
+            lexer_next_token(parser->lexer);
+
+            AST_Index *ast_index = AST_NEW(parser, AST_Index);
+            ast_index->expression = expression;
+            ast_index->index = parse_expression(parser);
+            expression = (AST_Node *)ast_index;
+
+            expect_token(parser, TOKEN_BRACKET_CLOSE);
+        } else if(token_postfix.kind == TOKEN_DOT) {
+            lexer_next_token(parser->lexer);
+            Token token_field = expect_token(parser, TOKEN_IDENTIFIER);
+
+            AST_Field *ast_field = AST_NEW(parser, AST_Field);
+            ast_field->expression = expression;
+            ast_field->identifier = token_field.value_string;
+            expression = (AST_Node *)ast_field;
+        } else {
+            break;
+        }
+    }
+
     Token token_next = lexer_peek_token(parser->lexer, 0);
     switch(token_next.kind) {
         default: {
@@ -271,11 +521,88 @@ AST_Node *parse_expression(Parser *parser) {
     return expression;
 }
 
+// "name = expression;" or "name[index] = expression;", either can be followed by ".field"
+static AST_Assignment *parse_assignment(Parser *parser) {
+    Token token_ident = expect_token(parser, TOKEN_IDENTIFIER);
+
+    AST_Node *variable = find_variable(parser, token_ident.value_string);
+    if(variable == NULL) {
+        report_unexpected_token(parser, token_ident, L"Assignment to a variable that isn't declared!");
+    }
+    if(variable->kind == ast_kind(AST_For)) {
+        report_unexpected_token(parser, token_ident, L"Loop variables can't be assigned to!");
+    }
+
+    AST_Variable_Ref *ast_var_ref = AST_NEW(parser, AST_Variable_Ref);
+    ast_var_ref->var_ident = token_ident.value_string;
+
+    AST_Assignment *ast_assignment = AST_NEW(parser, AST_Assignment);
+    ast_assignment->target = (AST_Node *)ast_var_ref;
+
+    if(lexer_peek_token(parser->lexer, 0).kind == TOKEN_BRACKET_OPEN) {
+        lexer_next_token(parser->lexer);
+
+        AST_Index *ast_index = AST_NEW(parser, AST_Index);
+        ast_index->expression = (AST_Node *)ast_var_ref;
+        ast_index->index = parse_expression(parser);
+        ast_assignment->target = (AST_Node *)ast_index;
+
+        expect_token(parser, TOKEN_BRACKET_CLOSE);
+    }
+
+    if(lexer_peek_token(parser->lexer, 0).kind == TOKEN_DOT) {
+        lexer_next_token(parser->lexer);
+        Token token_field = expect_token(parser, TOKEN_IDENTIFIER);
+
+        AST_Field *ast_field = AST_NEW(parser, AST_Field);
+        ast_field->expression = ast_assignment->target;
+        ast_field->identifier = token_field.value_string;
+        ast_assignment->target = (AST_Node *)ast_field;
+    }
+
+    // Array elements and struct fields are stored in place, anything else assigned to needs a stack slot
+    AST_Type_Def *data_type = variable->kind == ast_kind(AST_Declaration) ? ((AST_Declaration *)variable)->data_type : ((AST_Parameter *)variable)->data_type;
+    if(!is_memory_type(data_type->kind)) {
+        variable->flags |= AST_FLAG_ASSIGNED;
+    }
+
+    expect_token(parser, TOKEN_EQUAL);
+    ast_assignment->expression = parse_expression(parser);
+    expect_token(parser, TOKEN_SEMICOLON);
+
+    return ast_assignment;
+}
+
+// "expression < expression" or another comparison, the condition of a loop
+static AST_Comparison *parse_comparison(Parser *parser) {
+    AST_Comparison *ast_comparison = AST_NEW(parser, AST_Comparison);
+    ast_comparison->expr_l = parse_expression(parser);
+
+    Token token = lexer_next_token(parser->lexer);
+    switch(token.kind) {
+        default: {
+            report_unexpected_token(parser, token, L"Expected comparison in the condition!");
+        } break;
+        case TOKEN_LESS:          ast_comparison->operation = COMPARISON_LESS;          break;
+        case TOKEN_LESS_EQUAL:    ast_comparison->operation = COMPARISON_LESS_EQUAL;    break;
+        case TOKEN_GREATER:       ast_comparison->operation = COMPARISON_GREATER;       break;
+        case TOKEN_GREATER_EQUAL: ast_comparison->operation = COMPARISON_GREATER_EQUAL; break;
+        case TOKEN_EQUAL_DOUBLE:  ast_comparison->operation = COMPARISON_EQUAL;         break;
+        case TOKEN_NOT_EQUAL:     ast_comparison->operation = COMPARISON_NOT_EQUAL;     break;
+    }
+
+    ast_comparison->expr_r = parse_expression(parser);
+    return ast_comparison;
+}
+
 AST_Block *parse_block(Parser *parser) {
     expect_token(parser, TOKEN_BRACE_OPEN);
 
     AST_Block *ast_block = AST_NEW(parser, AST_Block);
 
+    // Declarations go out of scope with the block
+    const size_t scope_nodes_count = parser->scope_nodes_count;
+
     while(true) {
         Token token = lexer_peek_token(parser->lexer, 0);
  
@@ -304,26 +631,74 @@ AST_Block *parse_block(Parser *parser) {
 
                 expect_token(parser, TOKEN_SEMICOLON);
 
-                block_add_node(ast_block, (AST_Node *)ast_return);
+                block_add_node(parser, ast_block, (AST_Node *)ast_return);
+            } break;
+
+            case TOKEN_KEYWORD_WHILE: {
+                lexer_next_token(parser->lexer);
+
+                AST_While *ast_while = AST_NEW(parser, AST_While);
+                ast_while->condition = parse_comparison(parser);
+                ast_while->block = parse_block(parser);
+
+                block_add_node(parser, ast_block, (AST_Node *)ast_while);
+            } break;
+
+            case TOKEN_KEYWORD_FOR: {
+                lexer_next_token(parser->lexer);
+                Token token_ident = expect_token(parser, TOKEN_IDENTIFIER);
+                expect_token(parser, TOKEN_EQUAL);
+
+                AST_For *ast_for = AST_NEW(parser, AST_For);
+                ast_for->identifier = token_ident.value_string;
+                ast_for->start = parse_expression(parser);
+                expect_token(parser, TOKEN_KEYWORD_TO);
+                ast_for->end = parse_expression(parser);
+
+                // The loop variable is only visible in the body
+                const size_t scope_nodes_count_for = parser->scope_nodes_count;
+                scope_add_node(parser, (AST_Node *)ast_for);
+                ast_for->block = parse_block(parser);
+                parser->scope_nodes_count = scope_nodes_count_for;
+
+                block_add_node(parser, ast_block, (AST_Node *)ast_for);
             } break;
 
             case TOKEN_IDENTIFIER: {
+                Token token_past_ident = lexer_peek_token(parser->lexer, 1);
+                if(token_past_ident.kind == TOKEN_PAREN_OPEN || (token_past_ident.kind == TOKEN_BRACKET_OPEN && starts_data_type(parser, lexer_peek_token(parser->lexer, 2)))) {
+                    // Called for what it does, a result is dropped
+                    block_add_node(parser, ast_block, (AST_Node *)parse_procedure_call(parser));
+                    expect_token(parser, TOKEN_SEMICOLON);
+                    break;
+                }
+
+                if(token_past_ident.kind != TOKEN_COLON) {
+                    block_add_node(parser, ast_block, (AST_Node *)parse_assignment(parser));
+                    break;
+                }
+
                 lexer_next_token(parser->lexer);
                 expect_token(parser, TOKEN_COLON);
 
                 Token token_past_colon = lexer_peek_token(parser->lexer, 0);
-                AST_Type_Def *ast_type_def = get_simple_data_type(parser, token_past_colon.kind);
+                AST_Type_Def *ast_type_def = parse_data_type(parser);
                 if(ast_type_def == NULL) {
                     report_unexpected_token(parser, token_past_colon, L"Expected data type for the identifier :");
                 }
 
-                lexer_next_token(parser->lexer);
-
                 AST_Declaration *ast_decl = AST_NEW(parser, AST_Declaration);
                 ast_decl->identifier = token.value_string;
                 ast_decl->data_type = ast_type_def;
 
                 if(lexer_peek_token(parser->lexer, 0).kind == TOKEN_EQUAL) {
+                    if(ast_type_def->kind == TYPE_ARRAY) {
+                        report_unexpected_token(parser, lexer_peek_token(parser->lexer, 0), L"Arrays can't be initialized, assign their elements instead!");
+                    }
+                    if(ast_type_def->kind == TYPE_CUSTOM) {
+                        report_unexpected_token(parser, lexer_peek_token(parser->lexer, 0), L"Structs can't be initialized, assign their fields instead!");
+                    }
+
                     lexer_next_token(parser->lexer);
                     ast_decl->expression = parse_expression(parser);
                     // if(ast_decl->expression == NULL) @TODO EXPECTED EXPRESSION
@@ -333,21 +708,90 @@ AST_Block *parse_block(Parser *parser) {
 
                 expect_token(parser, TOKEN_SEMICOLON);
 
-                block_add_node(ast_block, (AST_Node *)ast_decl);
+                block_add_node(parser, ast_block, (AST_Node *)ast_decl);
+                scope_add_node(parser, (AST_Node *)ast_decl);
             } break;
         }
     }
 
+    parser->scope_nodes_count = scope_nodes_count;
     return ast_block;
 }
 
-void parse_procedure(Parser *parser) {
+// Moves past a block by matching braces only, nothing gets allocated
+static void skip_block(Parser *parser) {
+    expect_token(parser, TOKEN_BRACE_OPEN);
+
+    size_t depth = 1;
+    while(depth > 0) {
+        // Peeked first, only the EOF token in the array knows its line
+        Token token = lexer_peek_token(parser->lexer, 0);
+
+        if(token.kind == TOKEN_BRACE_OPEN) {
+            depth += 1;
+        } else if(token.kind == TOKEN_BRACE_CLOSE) {
+            depth -= 1;
+        } else if(token.kind == TOKEN_EOF) {
+            report_unexpected_token(parser, token, L"Procedure body is missing its closing }");
+        }
+
+        lexer_next_token(parser->lexer);
+    }
+}
+
+// "[T, U]" between :: and the parameters of a generic procedure
+static void parse_type_params(Parser *parser, AST_Procedure *ast_proc) {
+    expect_token(parser, TOKEN_BRACKET_OPEN);
+
+    while(true) {
+        Token token_name = expect_token(parser, TOKEN_IDENTIFIER);
+        AST_Type_Def *named = get_data_type(parser, token_name);
+        if(named != NULL && named->kind == TYPE_PARAMETER) {
+            report_unexpected_token(parser, token_name, L"Type parameter named twice!");
+        }
+
+        if(ast_proc->type_params_count == AST_PROCEDURE_TYPE_PARAMS_MAX) {
+            report_unexpected_token(parser, token_name, L"Too many type parameters!");
+        }
+
+        AST_Type_Def *type_param = AST_NEW(parser, AST_Type_Def);
+        type_param->kind = TYPE_PARAMETER;
+        type_param->signature = token_name.value_string;
+        type_param->type_param_index = (uint32_t)ast_proc->type_params_count;
+        ast_proc->type_params[ast_proc->type_params_count++] = type_param;
+
+        Token token = lexer_next_token(parser->lexer);
+        if(token.kind == TOKEN_BRACKET_CLOSE) {
+            break;
+        }
+        if(token.kind != TOKEN_COMMA) {
+            report_syntax_error(parser, token, TOKEN_BRACKET_CLOSE);
+        }
+    }
+}
+
+void parse_procedure(Parser *parser, AST_Flags flags) {
+    Trace_Span trace_span;
+    trace_begin(&trace_span);
+
     Token token_signature = expect_token(parser, TOKEN_IDENTIFIER);
     expect_token(parser, TOKEN_COLON_DOUBLE);
-    expect_token(parser, TOKEN_PAREN_OPEN);
 
     AST_Procedure *ast_proc = AST_NEW(parser, AST_Procedure);
+    ast_proc->node.flags = flags;
     ast_proc->signature = token_signature.value_string;
+    parser->procedure = ast_proc;
+
+    if(lexer_peek_token(parser->lexer, 0).kind == TOKEN_BRACKET_OPEN) {
+        parse_type_params(parser, ast_proc);
+    }
+
+    expect_token(parser, TOKEN_PAREN_OPEN);
+
+    // Entry point has to be visible to the linker
+    if(str_view_compare_to_string(ast_proc->signature, L"start")) {
+        ast_proc->node.flags |= AST_FLAG_EXPORTED;
+    }
 
     // If immediatelly after there is ), do not expect a param, and fall out of the while loop
     bool expect_param = lexer_peek_token(parser->lexer, 0).kind != TOKEN_PAREN_CLOSE;
@@ -373,7 +817,7 @@ void parse_procedure(Parser *parser) {
         } else {
             AST_Parameter *ast_param = parse_procedure_param(parser);
             assert(ast_param != NULL && "Failed to parse procedure param");
-            procedure_add_param(ast_proc, ast_param);
+            procedure_add_param(parser, ast_proc, ast_param);
             expect_param = false;
         }
     }
@@ -384,30 +828,190 @@ void parse_procedure(Parser *parser) {
     // Return type
     if(lexer_peek_token(parser->lexer, 0).kind == TOKEN_ARROW) {
         lexer_next_token(parser->lexer);
-        Token token_type = lexer_next_token(parser->lexer);
+        Token token_type = lexer_peek_token(parser->lexer, 0);
 
-        AST_Type_Def *ast_type = get_simple_data_type(parser, token_type.kind);
+        AST_Type_Def *ast_type = parse_data_type(parser);
 
         if(ast_type == NULL) {
             if(token_type.kind == TOKEN_KEYWORD_VOID) {
+                lexer_next_token(parser->lexer);
                 ast_type = parser->ast_type_def_void;
             } else {
                 report_unexpected_token(parser, token_type, L"Expected data type!");
             }
         }
 
+        if(ast_type->kind == TYPE_ARRAY) {
+            report_unexpected_token(parser, token_type, L"Arrays can't be returned, take one as a parameter to fill instead!");
+        }
+        if(ast_type->kind == TYPE_CUSTOM) {
+            report_unexpected_token(parser, token_type, L"Structs can't be returned, take one as a parameter to fill instead!");
+        }
+
         ast_proc->return_type = ast_type;
     } else {
         ast_proc->return_type = parser->ast_type_def_void;
     }
 
+    if(parser->lazy_bodies) {
+        ast_proc->body_token = lexer_tell(parser->lexer);
+        ast_proc->node.flags |= AST_FLAG_BODY_PENDING;
+        skip_block(parser);
+    } else {
+        ast_proc->block = parse_block(parser);
+    }
+
+    parser->procedure = NULL;
+    root_add_node(parser, (AST_Node *)ast_proc);
+
+    if(parser->procedure_queue != NULL) {
+        spsc_queue_push(parser->procedure_queue, ast_proc);
+    }
+
+    trace_end_wide(&trace_span, "parse", ast_proc->signature);
+}
+
+// Largest fields first, equal sizes keep their declared order; Sizes are powers of two, so no field needs padding in front of it
+static void set_struct_layout(AST_Struct *ast_struct) {
+    for(size_t index = 0; index < ast_struct->fields_count; ++index) {
+        if(ast_struct->node.flags & AST_FLAG_LAYOUT_C) {
+            ast_struct->field_slots[index] = (uint8_t)index;
+            continue;
+        }
+
+        const int32_t size = get_size_of_type(ast_struct->fields[index]->data_type->kind);
+        size_t slot = 0;
+        for(size_t other = 0; other < ast_struct->fields_count; ++other) {
+            const int32_t other_size = get_size_of_type(ast_struct->fields[other]->data_type->kind);
+            slot += other_size > size || (other_size == size && other < index);
+        }
+        ast_struct->field_slots[index] = (uint8_t)slot;
+    }
+}
+
+// "Name :: struktura(attribute, ...) { field : typ; ... }", the attributes are optional
+static void parse_struct(Parser *parser) {
+    Token token_ident = expect_token(parser, TOKEN_IDENTIFIER);
+    expect_token(parser, TOKEN_COLON_DOUBLE);
+    expect_token(parser, TOKEN_KEYWORD_STRUCT);
+
+    if(get_data_type(parser, token_ident) != NULL) {
+        report_unexpected_token(parser, token_ident, L"Struct named like one declared before!");
+    }
+    if(parser->structs_count == PARSER_STRUCTS_MAX) {
+        report_unexpected_token(parser, token_ident, L"Too many structs!");
+    }
+
+    AST_Struct *ast_struct = AST_NEW(parser, AST_Struct);
+    ast_struct->identifier = token_ident.value_string;
+
+    if(lexer_peek_token(parser->lexer, 0).kind == TOKEN_PAREN_OPEN) {
+        lexer_next_token(parser->lexer);
+
+        while(true) {
+            Token token_attribute = expect_token(parser, TOKEN_IDENTIFIER);
+            if(str_view_compare_to_string(token_attribute.value_string, L"c")) {
+                ast_struct->node.flags |= AST_FLAG_LAYOUT_C;
+            } else if(str_view_compare_to_string(token_attribute.value_string, L"soa")) {
+                ast_struct->node.flags |= AST_FLAG_SOA;
+            } else {
+                report_unexpected_token(parser, token_attribute, L"Unknown struct attribute, expected c or soa!");
+            }
+
+            Token token = lexer_next_token(parser->lexer);
+            if(token.kind == TOKEN_PAREN_CLOSE) {
+                break;
+            }
+            if(token.kind != TOKEN_COMMA) {
+                report_syntax_error(parser, token, TOKEN_PAREN_CLOSE);
+            }
+        }
+    }
+
+    expect_token(parser, TOKEN_BRACE_OPEN);
+
+    while(lexer_peek_token(parser->lexer, 0).kind != TOKEN_BRACE_CLOSE) {
+        Token token_field = expect_token(parser, TOKEN_IDENTIFIER);
+        expect_token(parser, TOKEN_COLON);
+
+        Token token_type = lexer_peek_token(parser->lexer, 0);
+        AST_Type_Def *field_type = parse_data_type(parser);
+        if(field_type == NULL || is_memory_type(field_type->kind)) {
+            report_unexpected_token(parser, token_type, L"Expected a simple or vector type for the field!");
+        }
+
+        expect_token(parser, TOKEN_SEMICOLON);
+
+        for(size_t index = 0; index < ast_struct->fields_count; ++index) {
+            if(str_view_compare(ast_struct->fields[index]->identifier, token_field.value_string)) {
+                report_unexpected_token(parser, token_field, L"Field named twice!");
+            }
+        }
+        if(ast_struct->fields_count == AST_STRUCT_FIELDS_MAX) {
+            report_unexpected_token(parser, token_field, L"Too many fields!");
+        }
+
+        AST_Declaration *ast_field = AST_NEW(parser, AST_Declaration);
+        ast_field->identifier = token_field.value_string;
+        ast_field->data_type = field_type;
+        ast_struct->fields[ast_struct->fields_count++] = ast_field;
+    }
+
+    Token token_close = expect_token(parser, TOKEN_BRACE_CLOSE);
+    if(ast_struct->fields_count == 0) {
+        report_unexpected_token(parser, token_close, L"Struct without fields!");
+    }
+
+    set_struct_layout(ast_struct);
+
+    AST_Type_Def *ast_type = AST_NEW(parser, AST_Type_Def);
+    ast_type->kind = TYPE_CUSTOM;
+    ast_type->signature = ast_struct->identifier;
+    ast_type->struct_def = ast_struct;
+    ast_struct->data_type = ast_type;
+
+    parser->structs[parser->structs_count++] = ast_struct;
+    root_add_node(parser, (AST_Node *)ast_struct);
+}
+
+AST_Block *parser_parse_body(Parser *parser, AST_Procedure *ast_proc) {
+    if(!(ast_proc->node.flags & AST_FLAG_BODY_PENDING)) {
+        return ast_proc->block;
+    }
+
+    Trace_Span trace_span;
+    trace_begin(&trace_span);
+
+    const size_t cursor = lexer_tell(parser->lexer);
+    lexer_seek(parser->lexer, ast_proc->body_token);
+
+    parser->procedure = ast_proc;
     ast_proc->block = parse_block(parser);
+    ast_proc->node.flags &= ~AST_FLAG_BODY_PENDING;
+    parser->procedure = NULL;
+
+    lexer_seek(parser->lexer, cursor);
+
+    trace_end_wide(&trace_span, "parse body", ast_proc->signature);
+    return ast_proc->block;
+}
 
-    root_add_node(parser->ast_root, (AST_Node *)ast_proc);
+void parser_parse_all_bodies(Parser *parser) {
+    AST_Root *ast_root = parser->ast_root;
+    for(size_t index = 0; index < ast_root->nodes_count; ++index) {
+        AST_Node *node = ast_root->nodes[index];
+        if(node->kind == ast_kind(AST_Procedure)) {
+            parser_parse_body(parser, (AST_Procedure *)node);
+        }
+    }
 }
 
 void parser_parse(Parser *parser) {
+    Timing_Section timing;
+    timing_begin(&timing, TIMING_PARSE);
+
     mem_arena_reset(&parser->ast_mem_arena);
+    parser->structs_count = 0;
 
     parser->ast_type_def_void = AST_NEW(parser, AST_Type_Def);
     parser->ast_type_def_void->kind = TYPE_VOID;
@@ -425,6 +1029,26 @@ void parser_parse(Parser *parser) {
     parser->ast_type_def_float64->kind = TYPE_FLOAT64;
     parser->ast_type_def_float64->signature = str_view_wcstr(L"float64");
 
+    parser->ast_type_def_int32 = AST_NEW(parser, AST_Type_Def);
+    parser->ast_type_def_int32->kind = TYPE_INT32;
+    parser->ast_type_def_int32->signature = str_view_wcstr(L"int32");
+
+    parser->ast_type_def_uint32 = AST_NEW(parser, AST_Type_Def);
+    parser->ast_type_def_uint32->kind = TYPE_UINT32;
+    parser->ast_type_def_uint32->signature = str_view_wcstr(L"uint32");
+
+    parser->ast_type_def_int16 = AST_NEW(parser, AST_Type_Def);
+    parser->ast_type_def_int16->kind = TYPE_INT16;
+    parser->ast_type_def_int16->signature = str_view_wcstr(L"int16");
+
+    parser->ast_type_def_int8 = AST_NEW(parser, AST_Type_Def);
+    parser->ast_type_def_int8->kind = TYPE_INT8;
+    parser->ast_type_def_int8->signature = str_view_wcstr(L"int8");
+
+    parser->ast_type_def_float32 = AST_NEW(parser, AST_Type_Def);
+    parser->ast_type_def_float32->kind = TYPE_FLOAT32;
+    parser->ast_type_def_float32->signature = str_view_wcstr(L"float32");
+
     parser->ast_root = AST_NEW(parser, AST_Root);
 
     while(true) {
@@ -435,15 +1059,31 @@ void parser_parse(Parser *parser) {
             break;
         }
 
-        if(token.kind == TOKEN_IDENTIFIER) {
+        if(token.kind == TOKEN_KEYWORD_EXPORT) {
+            lexer_next_token(parser->lexer);
+
+            Token token_past_export = lexer_peek_token(parser->lexer, 0);
+            if(token_past_export.kind != TOKEN_IDENTIFIER || lexer_peek_token(parser->lexer, 1).kind != TOKEN_COLON_DOUBLE) {
+                report_unexpected_token(parser, token_past_export, L"Expected procedure after export keyword");
+            }
+            if(lexer_peek_token(parser->lexer, 2).kind == TOKEN_KEYWORD_STRUCT) {
+                report_unexpected_token(parser, token_past_export, L"Only procedures are exported, structs are declared in every file using them");
+            }
+
+            parse_procedure(parser, AST_FLAG_EXPORTED);
+        } else if(token.kind == TOKEN_IDENTIFIER) {
             Token token_past_ident = lexer_peek_token(parser->lexer, 1);
 
             if(token_past_ident.kind == TOKEN_COLON_DOUBLE) {
                 Token token_past_colons = lexer_peek_token(parser->lexer, 2);
 
-                if(token_past_colons.kind == TOKEN_PAREN_OPEN) {
-                    parse_procedure(parser);
-                } 
+                if(token_past_colons.kind == TOKEN_PAREN_OPEN || token_past_colons.kind == TOKEN_BRACKET_OPEN) {
+                    parse_procedure(parser, AST_FLAG_NONE);
+                } else if(token_past_colons.kind == TOKEN_KEYWORD_STRUCT) {
+                    parse_struct(parser);
+                } else {
+                    report_unexpected_token(parser, token_past_colons, L"Expected procedure parameters or struktura after ::");
+                }
             } else {
                 lexer_next_token(parser->lexer);
             }
@@ -452,4 +1092,6 @@ void parser_parse(Parser *parser) {
             lexer_next_token(parser->lexer);
         }
     }
+
+    timing_end(&timing);
 }
@@ -5,8 +5,11 @@
 #include "lexer.h"
 #include "memory_arena.h"
 #include "ast_defs.h"
+#include "spsc_queue.h"
 
 #define PARSER_AST_MEMORY_BYTES MB(16)
+#define PARSER_SCOPE_NODES_MAX  1024
+#define PARSER_STRUCTS_MAX      256
 
 inline bool is_expression(AST_Node *node) {
     switch(node->kind) {
@@ -17,12 +20,62 @@ inline bool is_expression(AST_Node *node) {
         case ast_kind(AST_Literal):
         case ast_kind(AST_Binary):
         case ast_kind(AST_Variable_Ref):
+        case ast_kind(AST_Conversion):
+        case ast_kind(AST_Index):
+        case ast_kind(AST_Reduction):
+        case ast_kind(AST_Field):
         case ast_kind(AST_Procedure_Call): {
             return true;
         }
     }
 }
 
+// Expressions a statement holds directly and the block nested in it, for passes going over every expression of a body
+inline size_t get_statement_expressions(AST_Node *node, AST_Node *out_expressions[2], AST_Block **out_block) {
+    *out_block = NULL;
+
+    switch(node->kind) {
+        default: {
+            assert(0 && "Unhandled statement in get_statement_expressions");
+            return 0;
+        }
+
+        case ast_kind(AST_Return): {
+            out_expressions[0] = ((AST_Return *)node)->expression;
+            return out_expressions[0] != NULL ? 1 : 0;
+        }
+
+        case ast_kind(AST_Declaration): {
+            out_expressions[0] = ((AST_Declaration *)node)->expression;
+            return out_expressions[0] != NULL ? 1 : 0;
+        }
+
+        case ast_kind(AST_Assignment): {
+            out_expressions[0] = ((AST_Assignment *)node)->target;
+            out_expressions[1] = ((AST_Assignment *)node)->expression;
+            return 2;
+        }
+
+        case ast_kind(AST_Procedure_Call): {
+            out_expressions[0] = node;
+            return 1;
+        }
+
+        case ast_kind(AST_While): {
+            out_expressions[0] = (AST_Node *)((AST_While *)node)->condition;
+            *out_block = ((AST_While *)node)->block;
+            return 1;
+        }
+
+        case ast_kind(AST_For): {
+            out_expressions[0] = ((AST_For *)node)->start;
+            out_expressions[1] = ((AST_For *)node)->end;
+            *out_block = ((AST_For *)node)->block;
+            return 2;
+        }
+    }
+}
+
 typedef struct {
     // Memory for creating AST nodes
     Memory_Arena ast_mem_arena;
@@ -38,10 +91,46 @@ typedef struct {
     AST_Type_Def *ast_type_def_int64;
     AST_Type_Def *ast_type_def_uint64;
     AST_Type_Def *ast_type_def_float64;
+    AST_Type_Def *ast_type_def_int32;
+    AST_Type_Def *ast_type_def_uint32;
+    AST_Type_Def *ast_type_def_int16;
+    AST_Type_Def *ast_type_def_int8;
+    AST_Type_Def *ast_type_def_float32;
+
+    // Procedure whose parameters or body are being parsed, its type parameters can be used as types
+    AST_Procedure *procedure;
+
+    // Declared so far, types can name a struct after its declaration
+    AST_Struct *structs[PARSER_STRUCTS_MAX];
+    size_t structs_count;
+
+    // Declarations and loops of the blocks being parsed, innermost last; Assignments find their variable here
+    AST_Node *scope_nodes[PARSER_SCOPE_NODES_MAX];
+    size_t scope_nodes_count;
+
+    // Pipelined mode, every procedure also gets pushed here once parsed; NULL otherwise
+    SPSC_Queue *procedure_queue;
+
+    // Procedure bodies are only brace-matched by parser_parse and get parsed when something needs them, see parser_parse_body
+    // The lexer has to keep its tokens until then; Doesn't work with streaming lexers
+    bool lazy_bodies;
 } Parser;
 
 bool parser_init(Parser *parser, Lexer *lexer);
 void parser_free(Parser *parser);
+
+/* Like parser_init, but keeps the AST arena of a previous parse if there is one */
+bool parser_reinit(Parser *parser, Lexer *lexer);
 void parser_parse(Parser *parser);
 
+/*
+ * Block of a procedure, parsed first if it was skipped; Syntax errors in it are reported then
+ * Parsing allocates from the AST arena and moves the lexer, so it has to happen on the parser's thread.
+ * Once every body that's needed is parsed, reading them from other threads is fine.
+ */
+AST_Block *parser_parse_body(Parser *parser, AST_Procedure *ast_proc);
+
+/* Parses every skipped body, for passes that go over all procedures at once or on many threads */
+void parser_parse_all_bodies(Parser *parser);
+
 #endif /* _PARSER_H */
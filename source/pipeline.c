@@ -0,0 +1,208 @@
+#include "pipeline.h"
+#include "spsc_queue.h"
+#include "threads.h"
+#include "timing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+    LLVM_Context *ctx;
+    Lexer *lexer; // Producer
+
+    SPSC_Queue token_queue;     // Token_Chunk, lexer thread to parser
+    SPSC_Queue procedure_queue; // AST_Procedure, parser to codegen thread; NULL ends it
+
+    // Messages of all three threads in the order reported, the caller's handler gets them once the workers are done;
+    // Its sink belongs to the calling thread
+    Mutex diagnostics_mutex;
+    wchar_t **diagnostics;
+    size_t diagnostics_count;
+    size_t diagnostics_capacity;
+
+    bool lexer_failed;
+    bool codegen_failed;
+
+    // Codegen thread only, kept out of its locals since they have to survive fatal_error
+    AST_Procedure **deferred; // Waiting for a callee to be declared
+    size_t deferred_count;
+    size_t deferred_capacity;
+    bool procedures_ended;
+} Pipeline;
+
+// Diagnostic_Proc of every pipeline thread
+static void queue_diagnostic(void *user_data, const wchar_t *message) {
+    Pipeline *pipeline = (Pipeline *)user_data;
+    mutex_lock(&pipeline->diagnostics_mutex);
+
+    if(pipeline->diagnostics_count == pipeline->diagnostics_capacity) {
+        const size_t new_capacity = MAX(pipeline->diagnostics_capacity * 2, 16);
+        wchar_t **new_diagnostics = (wchar_t **)realloc(pipeline->diagnostics, sizeof(wchar_t *) * new_capacity);
+        if(new_diagnostics != NULL) {
+            pipeline->diagnostics = new_diagnostics;
+            pipeline->diagnostics_capacity = new_capacity;
+        }
+    }
+
+    wchar_t *copy = pipeline->diagnostics_count < pipeline->diagnostics_capacity ? wcsdup(message) : NULL;
+    if(copy != NULL) {
+        pipeline->diagnostics[pipeline->diagnostics_count++] = copy;
+    } else {
+        fwprintf(stderr, L"%ls\n", message);
+    }
+
+    mutex_unlock(&pipeline->diagnostics_mutex);
+}
+
+static Diagnostic_Handler get_queue_handler(Pipeline *pipeline) {
+    return (Diagnostic_Handler) { .proc = queue_diagnostic, .user_data = pipeline };
+}
+
+static void lexer_thread(void *user_data) {
+    Pipeline *pipeline = (Pipeline *)user_data;
+    diagnostic_handler_set(get_queue_handler(pipeline));
+
+    jmp_buf recovery;
+    error_recovery_set(&recovery);
+
+    if(setjmp(recovery) == 0) {
+        lexer_tokenize_to_queue(pipeline->lexer, &pipeline->token_queue);
+    } else {
+        pipeline->lexer_failed = true;
+        lexer_abort_stream(pipeline->lexer);
+    }
+
+    error_recovery_set(NULL);
+}
+
+static void codegen_thread(void *user_data) {
+    Pipeline *pipeline = (Pipeline *)user_data;
+    LLVM_Context *ctx = pipeline->ctx;
+    diagnostic_handler_set(get_queue_handler(pipeline));
+
+    Timing_Section timing;
+    timing_begin(&timing, TIMING_IR_BUILD);
+
+    jmp_buf recovery;
+    error_recovery_set(&recovery);
+
+    if(setjmp(recovery) == 0) {
+        AST_Procedure *ast_proc = NULL;
+        while((ast_proc = (AST_Procedure *)spsc_queue_pop(&pipeline->procedure_queue)) != NULL) {
+            declare_procedure(ctx, ast_proc);
+
+            // Function order in the module follows the declarations, so emitting bodies out of order changes nothing
+            if(llvm_procedure_calls_declared(ctx, ast_proc)) {
+                emit_procedure(ctx, ast_proc);
+                continue;
+            }
+
+            if(pipeline->deferred_count == pipeline->deferred_capacity) {
+                pipeline->deferred_capacity = MAX(pipeline->deferred_capacity * 2, 64);
+                AST_Procedure **new_deferred = (AST_Procedure **)realloc(pipeline->deferred, sizeof(AST_Procedure *) * pipeline->deferred_capacity);
+                if(new_deferred == NULL) {
+                    report_error(L"Failed to allocate memory in codegen_thread.");
+                    fatal_error();
+                }
+                pipeline->deferred = new_deferred;
+            }
+            pipeline->deferred[pipeline->deferred_count++] = ast_proc;
+        }
+        pipeline->procedures_ended = true;
+
+        for(size_t index = 0; index < pipeline->deferred_count; ++index) {
+            emit_procedure(ctx, pipeline->deferred[index]);
+        }
+    } else {
+        pipeline->codegen_failed = true;
+    }
+
+    error_recovery_set(NULL);
+    timing_end(&timing);
+
+    // The parser blocks on a full queue until everything is popped
+    while(!pipeline->procedures_ended) {
+        pipeline->procedures_ended = spsc_queue_pop(&pipeline->procedure_queue) == NULL;
+    }
+
+    free(pipeline->deferred);
+}
+
+bool pipeline_convert_file(LLVM_Context *ctx, Lexer *lexer, Parser *parser, wchar_t *filepath) {
+    if(!lexer_read_file(lexer, filepath)) {
+        return false;
+    }
+
+    Pipeline pipeline = {
+        .ctx = ctx,
+        .lexer = lexer,
+    };
+
+    if(!spsc_queue_init(&pipeline.token_queue, PIPELINE_TOKEN_CHUNKS_MAX)) {
+        return false;
+    }
+
+    if(!spsc_queue_init(&pipeline.procedure_queue, PIPELINE_PROCEDURES_MAX)) {
+        spsc_queue_free(&pipeline.token_queue);
+        return false;
+    }
+
+    mutex_init(&pipeline.diagnostics_mutex);
+    const Diagnostic_Handler previous_diagnostics = diagnostic_handler_set(get_queue_handler(&pipeline));
+
+    Lexer token_stream;
+    lexer_init_from_queue(&token_stream, lexer, &pipeline.token_queue);
+
+    Thread lexer_handle;
+    Thread codegen_handle;
+    const bool lexer_started = thread_create(&lexer_handle, lexer_thread, &pipeline);
+    const bool codegen_started = lexer_started && thread_create(&codegen_handle, codegen_thread, &pipeline);
+
+    bool parsed = false;
+    if(codegen_started) {
+        if(parser_reinit(parser, &token_stream)) {
+            parser->procedure_queue = &pipeline.procedure_queue;
+
+            jmp_buf recovery;
+            jmp_buf *previous_recovery = error_recovery_set(&recovery);
+
+            if(setjmp(recovery) == 0) {
+                parser_parse(parser);
+                parsed = true;
+            }
+
+            error_recovery_set(previous_recovery);
+            parser->procedure_queue = NULL;
+        }
+
+        spsc_queue_push(&pipeline.procedure_queue, NULL);
+        thread_join(&codegen_handle);
+    } else {
+        fwprintf(stderr, L"Failed to start pipeline threads.\n");
+    }
+
+    if(lexer_started) {
+        lexer_drain_stream(&token_stream);
+        thread_join(&lexer_handle);
+    }
+
+    // Tokens are gone with the chunks, the AST only points into the file data
+    parser->lexer = lexer;
+
+    spsc_queue_free(&pipeline.token_queue);
+    spsc_queue_free(&pipeline.procedure_queue);
+
+    diagnostic_handler_set(previous_diagnostics);
+    for(size_t index = 0; index < pipeline.diagnostics_count; ++index) {
+        report_error(L"%ls", pipeline.diagnostics[index]);
+        free(pipeline.diagnostics[index]);
+    }
+    free(pipeline.diagnostics);
+    mutex_free(&pipeline.diagnostics_mutex);
+
+    const bool success = parsed && !pipeline.lexer_failed && !pipeline.codegen_failed;
+    if(success) {
+        llvm_verify(ctx);
+    }
+    return success;
+}
@@ -0,0 +1,24 @@
+#ifndef _PIPELINE_H
+#define _PIPELINE_H
+
+#include "common.h"
+#include "lexer.h"
+#include "parser.h"
+#include "llvm_converter.h"
+
+/*
+ * Pipelined front end for large single files, --pipeline
+ * Lexing, parsing and IR building overlap on three threads: a lexer thread pushes token chunks through an SPSC queue
+ * to the parser on the calling thread, which pushes every finished procedure through a second one to a codegen thread.
+ * Procedures calling ones that haven't been parsed yet are emitted at the end of the file.
+ * The module comes out the same as from llvm_convert. Phase times overlap and include waiting on the previous stage.
+ * Diagnostics of all three threads are collected and passed to the caller's handler on the calling thread at the end.
+ */
+
+#define PIPELINE_TOKEN_CHUNKS_MAX 64
+#define PIPELINE_PROCEDURES_MAX   1024
+
+// Reads the file into lexer, parses it with parser and converts it into ctx->module; False after an error, already reported
+bool pipeline_convert_file(LLVM_Context *ctx, Lexer *lexer, Parser *parser, wchar_t *filepath);
+
+#endif /* _PIPELINE_H */
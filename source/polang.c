@@ -0,0 +1,112 @@
+#include "polang.h"
+
+#include <stdlib.h>
+
+void polang_session_init(Polang_Session *session, Polang_Diagnostic_Proc *diagnostic_proc, void *user_data) {
+    ZERO_STRUCT(*session);
+
+    session->diagnostics.proc = diagnostic_proc;
+    session->diagnostics.user_data = user_data;
+}
+
+void polang_session_free(Polang_Session *session) {
+    lexer_free(&session->lexer);
+    if(session->parser.ast_mem_arena.pointer != NULL) {
+        parser_free(&session->parser);
+    }
+
+    for(size_t index = 0; index < ARRAY_SIZE(session->llvm); ++index) {
+        if(session->llvm_ready[index]) {
+            llvm_shutdown(&session->llvm[index]);
+        }
+    }
+
+    ZERO_STRUCT(*session);
+}
+
+LLVM_Context *polang_session_llvm(Polang_Session *session, LLVMCodeGenOptLevel opt_level) {
+    // Nothing gets freed from a context until it's disposed, start over before it grows without bound
+    if(session->llvm_ready[opt_level] && session->llvm_compiles[opt_level] >= POLANG_SESSION_CONTEXT_COMPILES_MAX) {
+        llvm_shutdown(&session->llvm[opt_level]);
+        session->llvm_ready[opt_level] = false;
+    }
+
+    if(!session->llvm_ready[opt_level]) {
+        if(!llvm_init(&session->llvm[opt_level], NULL, opt_level)) {
+            return NULL;
+        }
+        session->llvm_ready[opt_level] = true;
+        session->llvm_compiles[opt_level] = 0;
+    }
+
+    session->llvm_compiles[opt_level] += 1;
+    return &session->llvm[opt_level];
+}
+
+// Everything up to the output, jumps out through fatal_error on compile errors
+static bool compile_to_output(Polang_Session *session, const char *source, size_t bytes, const char *name, const Polang_Compile_Options *options, Polang_Output *out_output) {
+    Lexer *lexer = &session->lexer;
+    if(!lexer_load_buffer(lexer, source, bytes)) {
+        return false;
+    }
+
+    Parser *parser = &session->parser;
+    if(!parser_reinit(parser, lexer)) {
+        return false;
+    }
+
+    lexer_rewind(lexer);
+    parser_parse(parser);
+
+    LLVM_Context *base = polang_session_llvm(session, options->opt_level);
+    if(base == NULL) {
+        return false;
+    }
+
+    LLVM_Context *llvm_ctx = &session->module_ctx;
+    llvm_init_module_shared(llvm_ctx, base, parser, name);
+
+    llvm_convert(llvm_ctx);
+    const bool optimized = llvm_optimize(llvm_ctx);
+    LLVMMemoryBufferRef buffer = optimized ? llvm_emit_to_memory_buffer(llvm_ctx, options->emit_kind) : NULL;
+
+    llvm_shutdown_module(llvm_ctx);
+
+    if(buffer == NULL) {
+        return false;
+    }
+
+    out_output->buffer = buffer;
+    out_output->data = LLVMGetBufferStart(buffer);
+    out_output->bytes = LLVMGetBufferSize(buffer);
+    return true;
+}
+
+bool polang_compile_buffer(Polang_Session *session, const char *source, size_t bytes, const char *name, const Polang_Compile_Options *options, Polang_Output *out_output) {
+    ZERO_STRUCT(*out_output);
+
+    Diagnostic_Handler previous_diagnostics = diagnostic_handler_set(session->diagnostics);
+
+    jmp_buf recovery;
+    jmp_buf *previous_recovery = error_recovery_set(&recovery);
+
+    bool success = false;
+    if(setjmp(recovery) == 0) {
+        success = compile_to_output(session, source, bytes, name, options, out_output);
+    } else if(session->module_ctx.module != NULL) {
+        llvm_shutdown_module(&session->module_ctx);
+    }
+
+    error_recovery_set(previous_recovery);
+    diagnostic_handler_set(previous_diagnostics);
+
+    return success;
+}
+
+void polang_output_free(Polang_Output *output) {
+    if(output->buffer != NULL) {
+        LLVMDisposeMemoryBuffer(output->buffer);
+    }
+
+    ZERO_STRUCT(*output);
+}
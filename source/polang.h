@@ -0,0 +1,60 @@
+#ifndef _POLANG_H
+#define _POLANG_H
+
+#include "common.h"
+#include "lexer.h"
+#include "parser.h"
+#include "llvm_converter.h"
+
+/*
+ * libpolang, the compiler as a library
+ * A session keeps the lexer token storage, the AST arena and an LLVM context per optimization level between compiles;
+ * They get reset, not freed, so compiling many small sources in one process pays for setting them up only once.
+ * Types and constants of every module stay in an LLVM context, so it's recreated every POLANG_SESSION_CONTEXT_COMPILES_MAX compiles.
+ * Errors never exit the process: each one goes to the session's diagnostic callback and the compile returns false.
+ * A session is used by one thread at a time, separate sessions can compile in parallel.
+ */
+
+#define POLANG_SESSION_CONTEXT_COMPILES_MAX 64
+
+typedef Diagnostic_Proc Polang_Diagnostic_Proc;
+
+typedef struct {
+    LLVMCodeGenOptLevel opt_level;
+    Emit_Kind emit_kind;
+} Polang_Compile_Options;
+
+typedef struct {
+    const char *data;
+    size_t bytes;
+    LLVMMemoryBufferRef buffer; // Owns data
+} Polang_Output;
+
+typedef struct {
+    Lexer  lexer;  // Token storage
+    Parser parser; // AST arena
+
+    // Context, builder and target machine per optimization level, created on first use
+    LLVM_Context llvm[LLVMCodeGenLevelAggressive + 1];
+    bool llvm_ready[LLVMCodeGenLevelAggressive + 1];
+    uint32_t llvm_compiles[LLVMCodeGenLevelAggressive + 1]; // Modules created on the context since it was created
+
+    // Module of the current compile, disposed after a fatal error
+    LLVM_Context module_ctx;
+
+    Diagnostic_Handler diagnostics;
+} Polang_Session;
+
+// diagnostic_proc can be NULL, diagnostics then go to stderr
+void polang_session_init(Polang_Session *session, Polang_Diagnostic_Proc *diagnostic_proc, void *user_data);
+void polang_session_free(Polang_Session *session);
+
+// Compiles UTF-8 source from memory, name becomes the module name; Free the output with polang_output_free
+bool polang_compile_buffer(Polang_Session *session, const char *source, size_t bytes, const char *name, const Polang_Compile_Options *options, Polang_Output *out_output);
+void polang_output_free(Polang_Output *output);
+
+// Shared LLVM context of the optimization level for one llvm_init_module_shared, NULL if the target couldn't be set up
+// No module of an earlier compile may be alive, the context can get recreated
+LLVM_Context *polang_session_llvm(Polang_Session *session, LLVMCodeGenOptLevel opt_level);
+
+#endif /* _POLANG_H */
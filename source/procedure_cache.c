@@ -0,0 +1,382 @@
+#include "procedure_cache.h"
+#include "procedure_table.h"
+#include "timing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <llvm-c/BitReader.h>
+#include <llvm-c/BitWriter.h>
+#include <llvm-c/Linker.h>
+
+static void key_add_view(Cache_Key *key, Str_View view) {
+    cache_key_add_u64(key, view.length);
+    cache_key_add(key, view.data, view.length * sizeof(wchar_t));
+}
+
+// Code using a struct depends on its whole layout
+static void key_add_struct(Cache_Key *key, AST_Struct *ast_struct) {
+    key_add_view(key, ast_struct->identifier);
+    cache_key_add_u64(key, ast_struct->node.flags & (AST_FLAG_LAYOUT_C | AST_FLAG_SOA));
+    cache_key_add_u64(key, ast_struct->fields_count);
+    for(size_t index = 0; index < ast_struct->fields_count; ++index) {
+        key_add_view(key, ast_struct->fields[index]->identifier);
+        cache_key_add_u64(key, ast_struct->fields[index]->data_type->kind);
+    }
+}
+
+static void key_add_type(Cache_Key *key, AST_Type_Def *ast_type) {
+    cache_key_add_u64(key, ast_type->kind);
+    if(ast_type->kind == TYPE_ARRAY) {
+        cache_key_add_u64(key, ast_type->element_type->kind);
+        cache_key_add_u64(key, ast_type->array_length);
+        ast_type = ast_type->element_type;
+    }
+    if(ast_type->kind == TYPE_CUSTOM) {
+        key_add_struct(key, ast_type->struct_def);
+    }
+}
+
+// What callers see of a procedure: name, linkage and types
+static void key_add_signature(Cache_Key *key, AST_Procedure *ast_proc) {
+    key_add_view(key, ast_proc->signature);
+    cache_key_add_u64(key, ast_proc->node.flags & AST_FLAG_EXPORTED);
+    cache_key_add_u64(key, ast_proc->return_type->kind);
+    cache_key_add_u64(key, ast_proc->params_count);
+    for(size_t index = 0; index < ast_proc->params_count; ++index) {
+        key_add_type(key, ast_proc->params[index]->data_type);
+    }
+}
+
+// Procedures of the module first, like calls resolve
+static Procedure_Table_Entry *find_callee(LLVM_Context *ctx, Procedure_Table *procedures, Str_View signature) {
+    Procedure_Table_Entry *entry = procedure_table_find(procedures, signature);
+    if(entry == NULL && ctx->external_procs != NULL) {
+        entry = procedure_table_find(ctx->external_procs, signature);
+    }
+    return entry;
+}
+
+static void key_add_expression(Cache_Key *key, LLVM_Context *ctx, Procedure_Table *procedures, AST_Node *expr) {
+    cache_key_add_u64(key, expr->kind);
+
+    switch(expr->kind) {
+        default: {
+            assert(0 && "Unhandled AST_Kind in key_add_expression!");
+        } break;
+
+        case ast_kind(AST_Literal): {
+            AST_Literal *ast_literal = (AST_Literal *)expr;
+            cache_key_add_u64(key, ast_literal->kind);
+            cache_key_add_u64(key, ast_literal->value_uint64);
+        } break;
+
+        case ast_kind(AST_Variable_Ref): {
+            key_add_view(key, ((AST_Variable_Ref *)expr)->var_ident);
+        } break;
+
+        case ast_kind(AST_Binary): {
+            AST_Binary *ast_binary = (AST_Binary *)expr;
+            cache_key_add_u64(key, ast_binary->operation);
+            key_add_expression(key, ctx, procedures, ast_binary->expr_l);
+            key_add_expression(key, ctx, procedures, ast_binary->expr_r);
+        } break;
+
+        case ast_kind(AST_Comparison): {
+            AST_Comparison *ast_comparison = (AST_Comparison *)expr;
+            cache_key_add_u64(key, ast_comparison->operation);
+            key_add_expression(key, ctx, procedures, ast_comparison->expr_l);
+            key_add_expression(key, ctx, procedures, ast_comparison->expr_r);
+        } break;
+
+        case ast_kind(AST_Conversion): {
+            AST_Conversion *ast_conversion = (AST_Conversion *)expr;
+            cache_key_add_u64(key, ast_conversion->data_type->kind);
+            key_add_expression(key, ctx, procedures, ast_conversion->expression);
+        } break;
+
+        case ast_kind(AST_Index): {
+            AST_Index *ast_index = (AST_Index *)expr;
+            key_add_expression(key, ctx, procedures, ast_index->expression);
+            key_add_expression(key, ctx, procedures, ast_index->index);
+        } break;
+
+        case ast_kind(AST_Reduction): {
+            AST_Reduction *ast_reduction = (AST_Reduction *)expr;
+            cache_key_add_u64(key, ast_reduction->operation);
+            key_add_expression(key, ctx, procedures, ast_reduction->expression);
+        } break;
+
+        case ast_kind(AST_Field): {
+            AST_Field *ast_field = (AST_Field *)expr;
+            key_add_view(key, ast_field->identifier);
+            key_add_expression(key, ctx, procedures, ast_field->expression);
+        } break;
+
+        case ast_kind(AST_Procedure_Call): {
+            AST_Procedure_Call *ast_proc_call = (AST_Procedure_Call *)expr;
+            cache_key_add_u64(key, ast_proc_call->params_count);
+            for(size_t index = 0; index < ast_proc_call->params_count; ++index) {
+                key_add_expression(key, ctx, procedures, ast_proc_call->params[index]);
+            }
+
+            // A changed callee signature changes the call, its body doesn't
+            Procedure_Table_Entry *entry = find_callee(ctx, procedures, ast_proc_call->procedure_signature);
+            if(entry != NULL) {
+                key_add_signature(key, entry->procedure);
+            } else {
+                key_add_view(key, ast_proc_call->procedure_signature);
+            }
+        } break;
+    }
+}
+
+// Statements with what they hold: declared names and types, the loop variables and nested blocks
+static void key_add_block(Cache_Key *key, LLVM_Context *ctx, Procedure_Table *procedures, AST_Block *ast_block) {
+    cache_key_add_u64(key, ast_block->nodes_count);
+
+    for(size_t index = 0; index < ast_block->nodes_count; ++index) {
+        AST_Node *node = ast_block->nodes[index];
+        cache_key_add_u64(key, node->kind);
+
+        if(node->kind == ast_kind(AST_Declaration)) {
+            AST_Declaration *ast_decl = (AST_Declaration *)node;
+            key_add_view(key, ast_decl->identifier);
+            key_add_type(key, ast_decl->data_type);
+            cache_key_add_u64(key, ast_decl->node.flags & AST_FLAG_ASSIGNED);
+        } else if(node->kind == ast_kind(AST_For)) {
+            key_add_view(key, ((AST_For *)node)->identifier);
+        }
+
+        AST_Node *expressions[2];
+        AST_Block *nested_block;
+        const size_t expressions_count = get_statement_expressions(node, expressions, &nested_block);
+
+        cache_key_add_u64(key, expressions_count);
+        for(size_t expr_index = 0; expr_index < expressions_count; ++expr_index) {
+            key_add_expression(key, ctx, procedures, expressions[expr_index]);
+        }
+
+        if(nested_block != NULL) {
+            key_add_block(key, ctx, procedures, nested_block);
+        }
+    }
+}
+
+static void make_procedure_key(Cache_Key *key, LLVM_Context *ctx, Procedure_Table *procedures, AST_Procedure *ast_proc) {
+    cache_key_init(key);
+    cache_key_add_string(key, "procedure");
+    cache_key_add_u64(key, ctx->opt_level);
+
+    key_add_signature(key, ast_proc);
+    for(size_t index = 0; index < ast_proc->params_count; ++index) {
+        key_add_view(key, ast_proc->params[index]->identifier);
+    }
+
+    for(size_t index = 0; index < ast_proc->params_count; ++index) {
+        cache_key_add_u64(key, ast_proc->params[index]->node.flags & AST_FLAG_ASSIGNED);
+    }
+
+    key_add_block(key, ctx, procedures, parser_parse_body(ctx->parser, ast_proc));
+}
+
+static void declare_callees(LLVM_Context *ctx, Procedure_Table *procedures, AST_Node *expr) {
+    if(expr->kind == ast_kind(AST_Binary)) {
+        AST_Binary *ast_binary = (AST_Binary *)expr;
+        declare_callees(ctx, procedures, ast_binary->expr_l);
+        declare_callees(ctx, procedures, ast_binary->expr_r);
+    } else if(expr->kind == ast_kind(AST_Comparison)) {
+        AST_Comparison *ast_comparison = (AST_Comparison *)expr;
+        declare_callees(ctx, procedures, ast_comparison->expr_l);
+        declare_callees(ctx, procedures, ast_comparison->expr_r);
+    } else if(expr->kind == ast_kind(AST_Conversion)) {
+        declare_callees(ctx, procedures, ((AST_Conversion *)expr)->expression);
+    } else if(expr->kind == ast_kind(AST_Index)) {
+        declare_callees(ctx, procedures, ((AST_Index *)expr)->expression);
+        declare_callees(ctx, procedures, ((AST_Index *)expr)->index);
+    } else if(expr->kind == ast_kind(AST_Reduction)) {
+        declare_callees(ctx, procedures, ((AST_Reduction *)expr)->expression);
+    } else if(expr->kind == ast_kind(AST_Field)) {
+        declare_callees(ctx, procedures, ((AST_Field *)expr)->expression);
+    } else if(expr->kind == ast_kind(AST_Procedure_Call)) {
+        AST_Procedure_Call *ast_proc_call = (AST_Procedure_Call *)expr;
+        for(size_t index = 0; index < ast_proc_call->params_count; ++index) {
+            declare_callees(ctx, procedures, ast_proc_call->params[index]);
+        }
+
+        // Unknown callees are left for emit_procedure to report
+        Procedure_Table_Entry *entry = procedure_table_find(procedures, ast_proc_call->procedure_signature);
+        if(entry == NULL) {
+            return;
+        }
+
+        char *proc_signature = convert_to_mbs_alloc(ast_proc_call->procedure_signature.data, ast_proc_call->procedure_signature.length, NULL);
+        const bool declared = LLVMGetNamedFunction(ctx->module, proc_signature) != NULL;
+        free(proc_signature);
+
+        if(!declared) {
+            declare_procedure(ctx, entry->procedure);
+        }
+    }
+}
+
+static void declare_block_callees(LLVM_Context *ctx, Procedure_Table *procedures, AST_Block *ast_block) {
+    for(size_t index = 0; index < ast_block->nodes_count; ++index) {
+        AST_Node *expressions[2];
+        AST_Block *nested_block;
+        const size_t expressions_count = get_statement_expressions(ast_block->nodes[index], expressions, &nested_block);
+
+        for(size_t expr_index = 0; expr_index < expressions_count; ++expr_index) {
+            declare_callees(ctx, procedures, expressions[expr_index]);
+        }
+
+        if(nested_block != NULL) {
+            declare_block_callees(ctx, procedures, nested_block);
+        }
+    }
+}
+
+// Converts and optimizes the procedure alone, returns its bitcode
+static LLVMMemoryBufferRef compile_procedure(LLVM_Context *base, Procedure_Table *procedures, AST_Procedure *ast_proc) {
+    LLVM_Context proc_ctx;
+    llvm_init_module_shared(&proc_ctx, base, base->parser, "procedure");
+
+    // Kept external until everything is linked, the optimizer would drop an internal procedure nobody calls here
+    proc_ctx.is_partition = true;
+    proc_ctx.external_procs = base->external_procs;
+
+    Timing_Section timing;
+    timing_begin(&timing, TIMING_IR_BUILD);
+
+    declare_procedure(&proc_ctx, ast_proc);
+
+    declare_block_callees(&proc_ctx, procedures, ast_proc->block);
+
+    emit_procedure(&proc_ctx, ast_proc);
+
+    timing_end(&timing);
+
+    llvm_verify(&proc_ctx);
+
+    LLVMMemoryBufferRef bitcode = NULL;
+    if(llvm_optimize(&proc_ctx)) {
+        bitcode = LLVMWriteBitcodeToMemoryBuffer(proc_ctx.module);
+    }
+
+    llvm_shutdown_module(&proc_ctx);
+    return bitcode;
+}
+
+static bool link_bitcode(LLVM_Context *ctx, const char *data, size_t bytes, AST_Procedure *ast_proc) {
+    Timing_Section timing;
+    timing_begin(&timing, TIMING_LINK);
+
+    LLVMMemoryBufferRef buffer = LLVMCreateMemoryBufferWithMemoryRange(data, bytes, "procedure", 0);
+
+    LLVMModuleRef module = NULL;
+    bool success = LLVMParseBitcodeInContext2(ctx->context, buffer, &module) == 0;
+    LLVMDisposeMemoryBuffer(buffer);
+
+    if(!success) {
+        report_error(L"LLVM LINK ERROR: Failed to load bitcode of procedure %.*ls", ast_proc->signature.length, ast_proc->signature.data);
+    } else if(LLVMLinkModules2(ctx->module, module) != 0) {
+        // Source module gets destroyed by the linker either way
+        report_error(L"LLVM LINK ERROR: Failed to link procedure %.*ls", ast_proc->signature.length, ast_proc->signature.data);
+        success = false;
+    }
+
+    timing_end(&timing);
+    return success;
+}
+
+static bool convert_procedure(LLVM_Context *ctx, Object_Cache *cache, Procedure_Table *procedures, AST_Procedure *ast_proc, Procedure_Cache_Stats *stats) {
+    Cache_Key key;
+    make_procedure_key(&key, ctx, procedures, ast_proc);
+
+    void *cached = NULL;
+    size_t cached_bytes = 0;
+    if(object_cache_fetch_data(cache, &key, &cached, &cached_bytes)) {
+        const bool linked = link_bitcode(ctx, (const char *)cached, cached_bytes, ast_proc);
+        free(cached);
+
+        // A damaged entry gets compiled again and replaced
+        if(linked) {
+            stats->reused += 1;
+            return true;
+        }
+    }
+
+    LLVMMemoryBufferRef bitcode = compile_procedure(ctx, procedures, ast_proc);
+    if(bitcode == NULL) {
+        return false;
+    }
+
+    const char *data = LLVMGetBufferStart(bitcode);
+    const size_t bytes = LLVMGetBufferSize(bitcode);
+
+    object_cache_store_data(cache, &key, data, bytes);
+    const bool linked = link_bitcode(ctx, data, bytes, ast_proc);
+    LLVMDisposeMemoryBuffer(bitcode);
+
+    stats->compiled += 1;
+    return linked;
+}
+
+bool procedure_cache_convert(LLVM_Context *ctx, Object_Cache *cache, Procedure_Cache_Stats *out_stats) {
+    ZERO_STRUCT(*out_stats);
+
+    AST_Root *ast_root = ctx->parser->ast_root;
+
+    Procedure_Table procedures;
+    if(!procedure_table_init(&procedures, ast_root->nodes_count)) {
+        return false;
+    }
+
+    // Pieces get compiled apart, so defined twice has to be caught before the linker sees it
+    for(size_t index = 0; index < ast_root->nodes_count; ++index) {
+        AST_Node *node = ast_root->nodes[index];
+        if(node->kind != ast_kind(AST_Procedure)) {
+            continue;
+        }
+
+        AST_Procedure *ast_proc = (AST_Procedure *)node;
+        if(ast_proc->type_params_count > 0) {
+            report_error(L"Generic procedures can't be compiled with --procedure-cache: %.*ls", ast_proc->signature.length, ast_proc->signature.data);
+            procedure_table_free(&procedures);
+            return false;
+        }
+
+        if(!procedure_table_add(&procedures, ast_proc, 0, NULL)) {
+            report_error(L"Procedure defined more than once: %.*ls", ast_proc->signature.length, ast_proc->signature.data);
+            procedure_table_free(&procedures);
+            return false;
+        }
+    }
+
+    // Compile errors jump past the table, free it on the way
+    jmp_buf recovery;
+    jmp_buf *previous_recovery = error_recovery_set(&recovery);
+
+    if(setjmp(recovery) != 0) {
+        error_recovery_set(previous_recovery);
+        procedure_table_free(&procedures);
+        fatal_error();
+    }
+
+    bool success = true;
+    for(size_t index = 0; success && index < ast_root->nodes_count; ++index) {
+        AST_Node *node = ast_root->nodes[index];
+        if(node->kind == ast_kind(AST_Procedure)) {
+            success = convert_procedure(ctx, cache, &procedures, (AST_Procedure *)node, out_stats);
+        }
+    }
+
+    error_recovery_set(previous_recovery);
+    procedure_table_free(&procedures);
+
+    if(success) {
+        llvm_internalize_procedures(ctx);
+        llvm_verify(ctx);
+    }
+    return success;
+}
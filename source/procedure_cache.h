@@ -0,0 +1,24 @@
+#ifndef _PROCEDURE_CACHE_H
+#define _PROCEDURE_CACHE_H
+
+#include "common.h"
+#include "llvm_converter.h"
+#include "object_cache.h"
+
+/*
+ * Per-procedure cache of optimized bitcode, --procedure-cache
+ * Every procedure is keyed by its AST with source positions left out, the signatures of the procedures it calls
+ * and the optimization level. Changed procedures get converted and optimized alone in a module of their own,
+ * then stored; Unchanged ones are loaded back from the cache. All the pieces get linked into ctx->module.
+ * Optimizing procedure by procedure means nothing gets inlined across procedures.
+ */
+
+typedef struct {
+    size_t reused;
+    size_t compiled;
+} Procedure_Cache_Stats;
+
+// Use instead of llvm_convert and llvm_optimize; Jumps out through fatal_error on compile errors like they do
+bool procedure_cache_convert(LLVM_Context *ctx, Object_Cache *cache, Procedure_Cache_Stats *out_stats);
+
+#endif /* _PROCEDURE_CACHE_H */
@@ -0,0 +1,87 @@
+#include "procedure_table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+bool procedure_table_init(Procedure_Table *table, size_t capacity_hint) {
+    ZERO_STRUCT(*table);
+
+    // Keep the load factor under a half
+    size_t capacity = 16;
+    while(capacity < capacity_hint * 2) {
+        capacity *= 2;
+    }
+
+    table->entries = (Procedure_Table_Entry *)calloc(capacity, sizeof(Procedure_Table_Entry));
+    if(table->entries == NULL) {
+        fprintf(stderr, "Failed to allocate memory in procedure_table_init.\n");
+        return false;
+    }
+
+    table->capacity = capacity;
+    return true;
+}
+
+void procedure_table_free(Procedure_Table *table) {
+    free(table->entries);
+
+    ZERO_STRUCT(*table);
+}
+
+static Procedure_Table_Entry *find_slot(Procedure_Table_Entry *entries, size_t capacity, Str_View signature) {
+    size_t index = (size_t)str_view_hash(signature) & (capacity - 1);
+    while(true) {
+        Procedure_Table_Entry *entry = &entries[index];
+        if(entry->procedure == NULL || str_view_compare(entry->procedure->signature, signature)) {
+            return entry;
+        }
+        index = (index + 1) & (capacity - 1);
+    }
+}
+
+static bool grow(Procedure_Table *table) {
+    const size_t new_capacity = table->capacity * 2;
+    Procedure_Table_Entry *new_entries = (Procedure_Table_Entry *)calloc(new_capacity, sizeof(Procedure_Table_Entry));
+    if(new_entries == NULL) {
+        fprintf(stderr, "Failed to allocate memory in procedure_table_add.\n");
+        return false;
+    }
+
+    for(size_t index = 0; index < table->capacity; ++index) {
+        Procedure_Table_Entry *entry = &table->entries[index];
+        if(entry->procedure != NULL) {
+            *find_slot(new_entries, new_capacity, entry->procedure->signature) = *entry;
+        }
+    }
+
+    free(table->entries);
+    table->entries = new_entries;
+    table->capacity = new_capacity;
+    return true;
+}
+
+bool procedure_table_add(Procedure_Table *table, AST_Procedure *procedure, uint32_t owner, Procedure_Table_Entry *out_existing) {
+    if((table->count + 1) * 2 > table->capacity) {
+        if(!grow(table)) {
+            return false;
+        }
+    }
+
+    Procedure_Table_Entry *entry = find_slot(table->entries, table->capacity, procedure->signature);
+    if(entry->procedure != NULL) {
+        if(out_existing != NULL) {
+            *out_existing = *entry;
+        }
+        return false;
+    }
+
+    entry->procedure = procedure;
+    entry->owner = owner;
+    table->count += 1;
+    return true;
+}
+
+Procedure_Table_Entry *procedure_table_find(Procedure_Table *table, Str_View signature) {
+    Procedure_Table_Entry *entry = find_slot(table->entries, table->capacity, signature);
+    return entry->procedure != NULL ? entry : NULL;
+}
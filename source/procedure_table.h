@@ -0,0 +1,30 @@
+#ifndef _PROCEDURE_TABLE_H
+#define _PROCEDURE_TABLE_H
+
+#include "common.h"
+#include "string_view.h"
+#include "ast_defs.h"
+
+/* Maps procedure signatures to their AST, across all compiled files */
+
+typedef struct {
+    AST_Procedure *procedure; // NULL if the slot is empty
+    uint32_t owner;           // Index of the file the procedure is defined in
+} Procedure_Table_Entry;
+
+typedef struct {
+    Procedure_Table_Entry *entries;
+    size_t capacity; // Power of two
+    size_t count;
+} Procedure_Table;
+
+bool procedure_table_init(Procedure_Table *table, size_t capacity_hint);
+void procedure_table_free(Procedure_Table *table);
+
+/* Returns false if a procedure with the same signature is already in the table, out_existing is set to it then */
+bool procedure_table_add(Procedure_Table *table, AST_Procedure *procedure, uint32_t owner, Procedure_Table_Entry *out_existing);
+
+/* Returns NULL if not found; Safe to call from many threads while nothing is added */
+Procedure_Table_Entry *procedure_table_find(Procedure_Table *table, Str_View signature);
+
+#endif /* _PROCEDURE_TABLE_H */
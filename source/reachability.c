@@ -0,0 +1,209 @@
+#include "reachability.h"
+#include "procedure_table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+    Parser *parser;
+    Procedure_Table procedures;
+
+    AST_Procedure **pending; // Reached, body not walked yet
+    size_t pending_count;
+    size_t pending_capacity;
+} Reachability;
+
+static bool mark_reached(Reachability *reach, AST_Procedure *ast_proc) {
+    if(ast_proc->node.flags & AST_FLAG_REACHED) {
+        return true;
+    }
+    ast_proc->node.flags |= AST_FLAG_REACHED;
+
+    if(reach->pending_count == reach->pending_capacity) {
+        reach->pending_capacity = MAX(reach->pending_capacity * 2, 256);
+        AST_Procedure **new_pending = (AST_Procedure **)realloc(reach->pending, sizeof(AST_Procedure *) * reach->pending_capacity);
+        if(new_pending == NULL) {
+            report_error(L"Failed to allocate memory in mark_reached.");
+            return false;
+        }
+        reach->pending = new_pending;
+    }
+
+    reach->pending[reach->pending_count++] = ast_proc;
+    return true;
+}
+
+static bool mark_signature_reached(Reachability *reach, Str_View signature) {
+    Procedure_Table_Entry *entry = procedure_table_find(&reach->procedures, signature);
+    return entry == NULL || mark_reached(reach, entry->procedure);
+}
+
+static bool walk_expression(Reachability *reach, AST_Node *expr) {
+    switch(expr->kind) {
+        default: {
+            return true;
+        };
+
+        case ast_kind(AST_Binary): {
+            AST_Binary *ast_binary = (AST_Binary *)expr;
+            return walk_expression(reach, ast_binary->expr_l) && walk_expression(reach, ast_binary->expr_r);
+        };
+
+        case ast_kind(AST_Comparison): {
+            AST_Comparison *ast_comparison = (AST_Comparison *)expr;
+            return walk_expression(reach, ast_comparison->expr_l) && walk_expression(reach, ast_comparison->expr_r);
+        };
+
+        case ast_kind(AST_Conversion): {
+            return walk_expression(reach, ((AST_Conversion *)expr)->expression);
+        };
+
+        case ast_kind(AST_Index): {
+            AST_Index *ast_index = (AST_Index *)expr;
+            return walk_expression(reach, ast_index->expression) && walk_expression(reach, ast_index->index);
+        };
+
+        case ast_kind(AST_Reduction): {
+            return walk_expression(reach, ((AST_Reduction *)expr)->expression);
+        };
+
+        case ast_kind(AST_Field): {
+            return walk_expression(reach, ((AST_Field *)expr)->expression);
+        };
+
+        case ast_kind(AST_Procedure_Call): {
+            AST_Procedure_Call *ast_proc_call = (AST_Procedure_Call *)expr;
+            for(size_t index = 0; index < ast_proc_call->params_count; ++index) {
+                if(!walk_expression(reach, ast_proc_call->params[index])) {
+                    return false;
+                }
+            }
+            return mark_signature_reached(reach, ast_proc_call->procedure_signature);
+        };
+    }
+}
+
+static bool walk_block(Reachability *reach, AST_Block *ast_block) {
+    for(size_t index = 0; index < ast_block->nodes_count; ++index) {
+        AST_Node *expressions[2];
+        AST_Block *nested_block;
+        const size_t expressions_count = get_statement_expressions(ast_block->nodes[index], expressions, &nested_block);
+
+        for(size_t expr_index = 0; expr_index < expressions_count; ++expr_index) {
+            if(!walk_expression(reach, expressions[expr_index])) {
+                return false;
+            }
+        }
+
+        if(nested_block != NULL && !walk_block(reach, nested_block)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool walk_procedure(Reachability *reach, AST_Procedure *ast_proc) {
+    return walk_block(reach, parser_parse_body(reach->parser, ast_proc));
+}
+
+static bool find_reachable(Reachability *reach, const Str_View *extra_root) {
+    AST_Root *ast_root = reach->parser->ast_root;
+
+    for(size_t index = 0; index < ast_root->nodes_count; ++index) {
+        AST_Node *node = ast_root->nodes[index];
+        if(node->kind != ast_kind(AST_Procedure)) {
+            continue;
+        }
+
+        AST_Procedure *ast_proc = (AST_Procedure *)node;
+
+        // Duplicates stay in for the converter to report
+        if(!procedure_table_add(&reach->procedures, ast_proc, 0, NULL) && !mark_reached(reach, ast_proc)) {
+            return false;
+        }
+    }
+
+    for(size_t index = 0; index < ast_root->nodes_count; ++index) {
+        AST_Node *node = ast_root->nodes[index];
+        if(node->kind == ast_kind(AST_Procedure) && (node->flags & AST_FLAG_EXPORTED) && !mark_reached(reach, (AST_Procedure *)node)) {
+            return false;
+        }
+    }
+
+    if(extra_root != NULL && !mark_signature_reached(reach, *extra_root)) {
+        return false;
+    }
+
+    while(reach->pending_count > 0) {
+        if(!walk_procedure(reach, reach->pending[--reach->pending_count])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool remove_unreachable_procedures(Parser *parser, const Str_View *extra_root, Removed_Procedures *out_removed) {
+    ZERO_STRUCT(*out_removed);
+
+    AST_Root *ast_root = parser->ast_root;
+
+    Reachability reach = { .parser = parser };
+    if(!procedure_table_init(&reach.procedures, ast_root->nodes_count)) {
+        return false;
+    }
+
+    // Parsing a skipped body can fail, clean up before passing the error on
+    jmp_buf recovery;
+    jmp_buf *previous_recovery = error_recovery_set(&recovery);
+
+    if(setjmp(recovery) != 0) {
+        error_recovery_set(previous_recovery);
+        procedure_table_free(&reach.procedures);
+        free(reach.pending);
+        fatal_error();
+    }
+
+    bool success = find_reachable(&reach, extra_root);
+    error_recovery_set(previous_recovery);
+
+    size_t unreached_count = 0;
+    for(size_t index = 0; index < ast_root->nodes_count; ++index) {
+        AST_Node *node = ast_root->nodes[index];
+        unreached_count += node->kind == ast_kind(AST_Procedure) && !(node->flags & AST_FLAG_REACHED);
+    }
+
+    if(success && unreached_count > 0) {
+        out_removed->procedures = (AST_Procedure **)malloc(sizeof(AST_Procedure *) * unreached_count);
+        if(out_removed->procedures == NULL) {
+            report_error(L"Failed to allocate memory in remove_unreachable_procedures.");
+            success = false;
+        }
+    }
+
+    // Compacted in place, the kept nodes stay in source order
+    size_t kept_count = 0;
+    for(size_t index = 0; index < ast_root->nodes_count; ++index) {
+        AST_Node *node = ast_root->nodes[index];
+        const bool reached = node->kind != ast_kind(AST_Procedure) || (node->flags & AST_FLAG_REACHED);
+        node->flags &= ~AST_FLAG_REACHED;
+
+        if(!success || reached) {
+            ast_root->nodes[kept_count++] = node;
+        } else {
+            out_removed->procedures[out_removed->count++] = (AST_Procedure *)node;
+        }
+    }
+    ast_root->nodes_count = kept_count;
+
+    procedure_table_free(&reach.procedures);
+    free(reach.pending);
+    return success;
+}
+
+void removed_procedures_free(Removed_Procedures *removed) {
+    free(removed->procedures);
+
+    ZERO_STRUCT(*removed);
+}
@@ -0,0 +1,24 @@
+#ifndef _REACHABILITY_H
+#define _REACHABILITY_H
+
+#include "common.h"
+#include "parser.h"
+
+/*
+ * Dead procedure elimination on the AST, before any IR gets built
+ * Starts from the exported procedures, start among them, and follows procedure calls through the bodies;
+ * Procedures never reached are taken out of the root, so conversion, optimization and output only pay for what's used.
+ * Only reached bodies get parsed when the parser skipped them, see Parser.lazy_bodies.
+ * Calls to procedures that aren't defined in the file are left for the converter to report.
+ */
+
+typedef struct {
+    AST_Procedure **procedures; // In source order
+    size_t count;
+} Removed_Procedures;
+
+// extra_root keeps one more procedure alive by signature, NULL for none; False if out of memory, the AST is left as it was then
+bool remove_unreachable_procedures(Parser *parser, const Str_View *extra_root, Removed_Procedures *out_removed);
+void removed_procedures_free(Removed_Procedures *removed);
+
+#endif /* _REACHABILITY_H */
@@ -0,0 +1,165 @@
+#include "specialization.h"
+#include "parser.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+bool specialization_cache_init(Specialization_Cache *cache, AST_Root *ast_root, size_t budget) {
+    ZERO_STRUCT(*cache);
+    cache->budget = budget;
+
+    if(!procedure_table_init(&cache->procedures, ast_root->nodes_count)) {
+        return false;
+    }
+
+    // Redefinitions get reported by declare_procedure, the first one is as good as any here; Generic ones have instances instead
+    for(size_t index = 0; index < ast_root->nodes_count; ++index) {
+        AST_Node *node = ast_root->nodes[index];
+        if(node->kind == ast_kind(AST_Procedure) && ((AST_Procedure *)node)->type_params_count == 0) {
+            procedure_table_add(&cache->procedures, (AST_Procedure *)node, 0, NULL);
+        }
+    }
+
+    cache->capacity = 64;
+    cache->entries = (Specialization *)calloc(cache->capacity, sizeof(Specialization));
+    if(cache->entries == NULL) {
+        report_error(L"Failed to allocate memory in specialization_cache_init.");
+        procedure_table_free(&cache->procedures);
+        return false;
+    }
+
+    return true;
+}
+
+void specialization_cache_free(Specialization_Cache *cache) {
+    procedure_table_free(&cache->procedures);
+    free(cache->entries);
+
+    ZERO_STRUCT(*cache);
+}
+
+bool specialization_has_constants(AST_Node **args, size_t args_count) {
+    for(size_t index = 0; index < args_count; ++index) {
+        if(args[index]->kind == ast_kind(AST_Literal)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint64_t hash_mix(uint64_t hash, uint64_t value) {
+    hash ^= value;
+    hash *= 0x100000001b3ull;
+    return hash;
+}
+
+// Only which arguments are literals and their values matter, the rest vary between call sites
+static uint64_t hash_key(AST_Procedure *procedure, AST_Node **args) {
+    uint64_t hash = hash_mix(0xcbf29ce484222325ull, (uint64_t)(uintptr_t)procedure);
+
+    for(size_t index = 0; index < procedure->params_count; ++index) {
+        if(args[index]->kind != ast_kind(AST_Literal)) {
+            hash = hash_mix(hash, LITERAL__INVALID);
+            continue;
+        }
+
+        AST_Literal *ast_literal = (AST_Literal *)args[index];
+        hash = hash_mix(hash, ast_literal->kind);
+        hash = hash_mix(hash, ast_literal->value_uint64);
+    }
+
+    return hash;
+}
+
+static bool keys_equal(Specialization *entry, AST_Procedure *procedure, AST_Node **args) {
+    if(entry->procedure != procedure) {
+        return false;
+    }
+
+    for(size_t index = 0; index < procedure->params_count; ++index) {
+        const bool is_literal = args[index]->kind == ast_kind(AST_Literal);
+        if(is_literal != (entry->args[index]->kind == ast_kind(AST_Literal))) {
+            return false;
+        }
+
+        if(is_literal) {
+            AST_Literal *literal_a = (AST_Literal *)args[index];
+            AST_Literal *literal_b = (AST_Literal *)entry->args[index];
+            if(literal_a->kind != literal_b->kind || literal_a->value_uint64 != literal_b->value_uint64) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static Specialization *find_slot(Specialization *entries, size_t capacity, AST_Procedure *procedure, AST_Node **args) {
+    size_t index = (size_t)hash_key(procedure, args) & (capacity - 1);
+    while(true) {
+        Specialization *entry = &entries[index];
+        if(entry->procedure == NULL || keys_equal(entry, procedure, args)) {
+            return entry;
+        }
+        index = (index + 1) & (capacity - 1);
+    }
+}
+
+static bool grow(Specialization_Cache *cache) {
+    const size_t new_capacity = cache->capacity * 2;
+    Specialization *new_entries = (Specialization *)calloc(new_capacity, sizeof(Specialization));
+    if(new_entries == NULL) {
+        report_error(L"Failed to allocate memory in specialization_add.");
+        return false;
+    }
+
+    for(size_t index = 0; index < cache->capacity; ++index) {
+        Specialization *entry = &cache->entries[index];
+        if(entry->procedure != NULL) {
+            *find_slot(new_entries, new_capacity, entry->procedure, entry->args) = *entry;
+        }
+    }
+
+    free(cache->entries);
+    cache->entries = new_entries;
+    cache->capacity = new_capacity;
+    return true;
+}
+
+LLVMValueRef specialization_find(Specialization_Cache *cache, AST_Procedure *procedure, AST_Node **args) {
+    return find_slot(cache->entries, cache->capacity, procedure, args)->clone;
+}
+
+// Statements of loop bodies count too, each one gets cloned
+static size_t count_statements(AST_Block *ast_block) {
+    size_t count = ast_block->nodes_count;
+    for(size_t index = 0; index < ast_block->nodes_count; ++index) {
+        AST_Node *expressions[2];
+        AST_Block *nested_block;
+        get_statement_expressions(ast_block->nodes[index], expressions, &nested_block);
+
+        if(nested_block != NULL) {
+            count += count_statements(nested_block);
+        }
+    }
+    return count;
+}
+
+Specialization *specialization_add(Specialization_Cache *cache, AST_Procedure *procedure, AST_Node **args) {
+    const size_t cost = 1 + count_statements(procedure->block);
+    if(cache->spent + cost > cache->budget) {
+        return NULL;
+    }
+
+    if((cache->count + 1) * 2 > cache->capacity && !grow(cache)) {
+        return NULL;
+    }
+
+    Specialization *entry = find_slot(cache->entries, cache->capacity, procedure, args);
+    assert(entry->procedure == NULL && "Procedure already specialized for these arguments");
+
+    *entry = (Specialization) { .procedure = procedure, .args = args };
+    cache->count += 1;
+    cache->spent += cost;
+    return entry;
+}
@@ -0,0 +1,50 @@
+#ifndef _SPECIALIZATION_H
+#define _SPECIALIZATION_H
+
+#include "common.h"
+#include "ast_defs.h"
+#include "procedure_table.h"
+
+#include <llvm-c/Core.h>
+
+/*
+ * Constant argument specialization, --specialize
+ * A call passing literals to a procedure defined in the module calls a clone of it instead, with those parameters
+ * bound to the literal values, so the IR builder folds whatever they feed into while emitting the clone.
+ * Clones are kept per (procedure, literal arguments) and every call site passing the same literals shares one.
+ * Each clone spends the statement count of its procedure, loop bodies included, from the budget; Calls past it use the
+ * generic procedure.
+ */
+
+#define SPECIALIZATION_DEFAULT_BUDGET 4096
+
+typedef struct {
+    AST_Procedure *procedure; // NULL if the slot is empty
+    AST_Node **args;          // Arguments of the first call, only the literals among them count
+    LLVMValueRef clone;
+} Specialization;
+
+typedef struct {
+    Procedure_Table procedures; // Defined in the module, the ones that can be cloned
+
+    Specialization *entries;
+    size_t capacity; // Power of two
+    size_t count;
+
+    size_t budget;
+    size_t spent;
+} Specialization_Cache;
+
+bool specialization_cache_init(Specialization_Cache *cache, AST_Root *ast_root, size_t budget);
+void specialization_cache_free(Specialization_Cache *cache);
+
+/* True if any argument is a literal */
+bool specialization_has_constants(AST_Node **args, size_t args_count);
+
+/* Clone of the procedure for these literal arguments, NULL if there is none yet */
+LLVMValueRef specialization_find(Specialization_Cache *cache, AST_Procedure *procedure, AST_Node **args);
+
+/* Spends the procedure's cost from the budget, its body has to be parsed; NULL if it doesn't fit, set clone of the entry otherwise */
+Specialization *specialization_add(Specialization_Cache *cache, AST_Procedure *procedure, AST_Node **args);
+
+#endif /* _SPECIALIZATION_H */
@@ -0,0 +1,72 @@
+#include "spsc_queue.h"
+#include "threads.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Busy polls before falling back to yielding, a stage that is just behind catches up within these
+#define SPSC_QUEUE_SPIN_COUNT 256
+
+bool spsc_queue_init(SPSC_Queue *queue, size_t capacity) {
+    ZERO_STRUCT(*queue);
+
+    queue->capacity = 1;
+    while(queue->capacity < capacity) {
+        queue->capacity *= 2;
+    }
+
+    queue->slots = (void **)malloc(sizeof(void *) * queue->capacity);
+    if(queue->slots == NULL) {
+        fprintf(stderr, "Failed to allocate memory in spsc_queue_init.\n");
+        return false;
+    }
+
+    return true;
+}
+
+void spsc_queue_free(SPSC_Queue *queue) {
+    free(queue->slots);
+
+    ZERO_STRUCT(*queue);
+}
+
+bool spsc_queue_try_push(SPSC_Queue *queue, void *item) {
+    // Own index is only written by this side, the other side's needs the acquire
+    const size_t tail = queue->tail;
+    if(tail - ATOMIC_LOAD_ACQUIRE(&queue->head) == queue->capacity) {
+        return false;
+    }
+
+    queue->slots[tail & (queue->capacity - 1)] = item;
+    ATOMIC_STORE_RELEASE(&queue->tail, tail + 1);
+    return true;
+}
+
+bool spsc_queue_try_pop(SPSC_Queue *queue, void **out_item) {
+    const size_t head = queue->head;
+    if(head == ATOMIC_LOAD_ACQUIRE(&queue->tail)) {
+        return false;
+    }
+
+    *out_item = queue->slots[head & (queue->capacity - 1)];
+    ATOMIC_STORE_RELEASE(&queue->head, head + 1);
+    return true;
+}
+
+void spsc_queue_push(SPSC_Queue *queue, void *item) {
+    for(size_t attempt = 0; !spsc_queue_try_push(queue, item); ++attempt) {
+        if(attempt >= SPSC_QUEUE_SPIN_COUNT) {
+            thread_yield();
+        }
+    }
+}
+
+void *spsc_queue_pop(SPSC_Queue *queue) {
+    void *item = NULL;
+    for(size_t attempt = 0; !spsc_queue_try_pop(queue, &item); ++attempt) {
+        if(attempt >= SPSC_QUEUE_SPIN_COUNT) {
+            thread_yield();
+        }
+    }
+    return item;
+}
@@ -0,0 +1,36 @@
+#ifndef _SPSC_QUEUE_H
+#define _SPSC_QUEUE_H
+
+#include "common.h"
+
+/*
+ * Lock-free single-producer single-consumer ring of pointers
+ * Only one thread may push and only one other thread may pop. Items are published with release/acquire ordering,
+ * so whatever the producer wrote before pushing an item is visible to the consumer after popping it.
+ * The blocking calls spin for a while, then yield until the ring has room or an item.
+ */
+
+#define SPSC_QUEUE_CACHE_LINE 64
+
+typedef struct {
+    void **slots;
+    size_t capacity; // Power of two
+
+    // Each written by one side only, on separate cache lines so the sides don't invalidate each other
+    size_t head; // Next slot to pop, consumer
+    uint8_t head_padding[SPSC_QUEUE_CACHE_LINE - sizeof(size_t)];
+    size_t tail; // Next slot to push, producer
+    uint8_t tail_padding[SPSC_QUEUE_CACHE_LINE - sizeof(size_t)];
+} SPSC_Queue;
+
+// Capacity gets rounded up to a power of two
+bool spsc_queue_init(SPSC_Queue *queue, size_t capacity);
+void spsc_queue_free(SPSC_Queue *queue);
+
+bool spsc_queue_try_push(SPSC_Queue *queue, void *item);
+bool spsc_queue_try_pop(SPSC_Queue *queue, void **out_item);
+
+void  spsc_queue_push(SPSC_Queue *queue, void *item);
+void *spsc_queue_pop(SPSC_Queue *queue);
+
+#endif /* _SPSC_QUEUE_H */
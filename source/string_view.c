@@ -55,6 +55,15 @@ wchar_t str_view_peek_next(Str_View *view, size_t offset) {
     return view->data[offset];
 }
 
+uint64_t str_view_hash(Str_View view) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for(size_t index = 0; index < view.length; ++index) {
+        hash ^= (uint64_t)view.data[index];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
 static inline bool is_char_any_of(wchar_t _char, wchar_t const *chars, size_t count) {
     for(size_t index = 0; index < count; ++index) {
         if(chars[index] == _char) {
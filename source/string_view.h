@@ -31,6 +31,9 @@ void    str_view_consume_whitespaces(Str_View *view);
 wchar_t str_view_peek(Str_View *view);
 wchar_t str_view_peek_next(Str_View *view, size_t offset);
 
+/* FNV-1a over the characters, for hash tables keyed by Str_View */
+uint64_t str_view_hash(Str_View view);
+
 size_t str_view_find_first(Str_View view, wchar_t _char);
 size_t str_view_find_first_of(Str_View view, wchar_t const *chars, size_t count);
 size_t str_view_find_first_not(Str_View view, wchar_t _char);
@@ -0,0 +1,259 @@
+#include "thread_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+    Thread_Pool *pool;
+    size_t worker_index;
+} Worker_Start;
+
+static bool deque_pop_front(Job_Deque *deque, size_t *out_job) {
+    mutex_lock(&deque->mutex);
+    const bool has_job = deque->head < deque->tail;
+    if(has_job) {
+        *out_job = deque->jobs[deque->head++];
+    }
+    mutex_unlock(&deque->mutex);
+    return has_job;
+}
+
+static bool deque_steal_back(Job_Deque *deque, size_t *out_job) {
+    mutex_lock(&deque->mutex);
+    const bool has_job = deque->head < deque->tail;
+    if(has_job) {
+        *out_job = deque->jobs[--deque->tail];
+    }
+    mutex_unlock(&deque->mutex);
+    return has_job;
+}
+
+static void run_batch_jobs(Thread_Pool *pool, size_t worker_index) {
+    size_t job_index = 0;
+    while(true) {
+        if(deque_pop_front(&pool->deques[worker_index], &job_index)) {
+            pool->job_proc(pool->user_data, job_index, worker_index);
+            continue;
+        }
+
+        // Own deque is empty, look for work starting at the next worker so thieves spread out
+        bool stolen = false;
+        for(size_t offset = 1; offset < pool->worker_count && !stolen; ++offset) {
+            stolen = deque_steal_back(&pool->deques[(worker_index + offset) % pool->worker_count], &job_index);
+        }
+
+        if(!stolen) {
+            // Jobs never get added during a batch, so every deque is empty for good
+            break;
+        }
+
+        pool->job_proc(pool->user_data, job_index, worker_index);
+    }
+}
+
+static void worker_proc(void *user_data) {
+    Worker_Start start = *(Worker_Start *)user_data;
+    free(user_data);
+
+    Thread_Pool *pool = start.pool;
+    size_t seen_batch = 0;
+
+    mutex_lock(&pool->mutex);
+    while(true) {
+        while(!pool->shutting_down && pool->batch_index == seen_batch) {
+            cond_var_wait(&pool->batch_started, &pool->mutex);
+        }
+
+        if(pool->shutting_down) {
+            break;
+        }
+
+        seen_batch = pool->batch_index;
+        mutex_unlock(&pool->mutex);
+
+        run_batch_jobs(pool, start.worker_index);
+
+        mutex_lock(&pool->mutex);
+        pool->workers_finished += 1;
+        cond_var_signal(&pool->batch_finished);
+    }
+    mutex_unlock(&pool->mutex);
+}
+
+bool thread_pool_init(Thread_Pool *pool, size_t worker_count) {
+    ZERO_STRUCT(*pool);
+
+    if(worker_count == 0) {
+        worker_count = get_processor_count();
+    }
+
+    mutex_init(&pool->mutex);
+    cond_var_init(&pool->batch_started);
+    cond_var_init(&pool->batch_finished);
+
+    pool->deques = (Job_Deque *)calloc(worker_count, sizeof(Job_Deque));
+    pool->threads = (Thread *)malloc(sizeof(Thread) * worker_count);
+    if(pool->deques == NULL || pool->threads == NULL) {
+        fprintf(stderr, "Failed to allocate memory in thread_pool_init.\n");
+        free(pool->deques);
+        free(pool->threads);
+        pool->deques = NULL;
+        pool->threads = NULL;
+        thread_pool_free(pool);
+        return false;
+    }
+
+    for(size_t index = 0; index < worker_count; ++index) {
+        mutex_init(&pool->deques[index].mutex);
+    }
+    pool->deque_count = worker_count;
+
+    pool->worker_count = 1;
+
+    for(size_t index = 1; index < worker_count; ++index) {
+        Worker_Start *start = (Worker_Start *)malloc(sizeof(Worker_Start));
+        if(start == NULL) {
+            fprintf(stderr, "Failed to allocate memory in thread_pool_init.\n");
+            break;
+        }
+
+        start->pool = pool;
+        start->worker_index = index;
+
+        // Jobs only get dealt to workers that started, a failure just leaves the pool smaller
+        if(!thread_create(&pool->threads[index - 1], worker_proc, start)) {
+            free(start);
+            fprintf(stderr, "Failed to create worker thread, continuing with %llu.\n", (unsigned long long)pool->worker_count);
+            break;
+        }
+
+        pool->worker_count += 1;
+    }
+
+    return true;
+}
+
+void thread_pool_free(Thread_Pool *pool) {
+    mutex_lock(&pool->mutex);
+    pool->shutting_down = true;
+    cond_var_broadcast(&pool->batch_started);
+    mutex_unlock(&pool->mutex);
+
+    for(size_t index = 1; index < pool->worker_count; ++index) {
+        thread_join(&pool->threads[index - 1]);
+    }
+
+    for(size_t index = 0; index < pool->deque_count; ++index) {
+        mutex_free(&pool->deques[index].mutex);
+    }
+
+    free(pool->job_storage);
+    free(pool->deques);
+    free(pool->threads);
+
+    cond_var_free(&pool->batch_finished);
+    cond_var_free(&pool->batch_started);
+    mutex_free(&pool->mutex);
+
+    ZERO_STRUCT(*pool);
+}
+
+bool thread_pool_run_ordered(Thread_Pool *pool, const size_t *job_order, size_t job_count, Thread_Pool_Job_Proc *job_proc, void *user_data) {
+    if(pool->worker_count == 1 || job_count == 1) {
+        for(size_t index = 0; index < job_count; ++index) {
+            job_proc(user_data, job_order != NULL ? job_order[index] : index, 0);
+        }
+        return true;
+    }
+
+    mutex_lock(&pool->mutex);
+
+    if(pool->job_storage == NULL || pool->job_storage_capacity < job_count) {
+        free(pool->job_storage);
+        pool->job_storage = (size_t *)malloc(sizeof(size_t) * job_count);
+        pool->job_storage_capacity = job_count;
+        if(pool->job_storage == NULL) {
+            pool->job_storage_capacity = 0;
+            mutex_unlock(&pool->mutex);
+            fprintf(stderr, "Failed to allocate memory in thread_pool_run_ordered.\n");
+            return false;
+        }
+    }
+
+    // Deal jobs round-robin, each worker's deque is a contiguous slice of job_storage
+    const size_t worker_count = pool->worker_count;
+    size_t slice_start = 0;
+    for(size_t worker_index = 0; worker_index < worker_count; ++worker_index) {
+        Job_Deque *deque = &pool->deques[worker_index];
+        deque->jobs = &pool->job_storage[slice_start];
+        deque->head = 0;
+        deque->tail = 0;
+
+        for(size_t order_index = worker_index; order_index < job_count; order_index += worker_count) {
+            deque->jobs[deque->tail++] = job_order != NULL ? job_order[order_index] : order_index;
+        }
+
+        slice_start += deque->tail;
+    }
+
+    pool->job_proc = job_proc;
+    pool->user_data = user_data;
+    pool->workers_finished = 0;
+    pool->batch_index += 1;
+    cond_var_broadcast(&pool->batch_started);
+    mutex_unlock(&pool->mutex);
+
+    run_batch_jobs(pool, 0);
+
+    // Every worker has to leave the batch before its state can be reused
+    mutex_lock(&pool->mutex);
+    while(pool->workers_finished < pool->worker_count - 1) {
+        cond_var_wait(&pool->batch_finished, &pool->mutex);
+    }
+    mutex_unlock(&pool->mutex);
+    return true;
+}
+
+bool thread_pool_run(Thread_Pool *pool, size_t job_count, Thread_Pool_Job_Proc *job_proc, void *user_data) {
+    return thread_pool_run_ordered(pool, NULL, job_count, job_proc, user_data);
+}
+
+typedef struct {
+    size_t weight;
+    size_t index;
+} Weighted_Job;
+
+static int compare_weighted_jobs(const void *a, const void *b) {
+    const Weighted_Job *job_a = (const Weighted_Job *)a;
+    const Weighted_Job *job_b = (const Weighted_Job *)b;
+
+    if(job_a->weight != job_b->weight) {
+        return job_a->weight > job_b->weight ? -1 : 1;
+    }
+    return job_a->index < job_b->index ? -1 : (job_a->index > job_b->index);
+}
+
+size_t *thread_pool_order_largest_first(const size_t *weights, size_t job_count) {
+    size_t *job_order = (size_t *)malloc(sizeof(size_t) * job_count);
+    Weighted_Job *jobs = (Weighted_Job *)malloc(sizeof(Weighted_Job) * job_count);
+    if(job_order == NULL || jobs == NULL) {
+        fprintf(stderr, "Failed to allocate memory in thread_pool_order_largest_first.\n");
+        free(job_order);
+        free(jobs);
+        return NULL;
+    }
+
+    for(size_t index = 0; index < job_count; ++index) {
+        jobs[index].weight = weights[index];
+        jobs[index].index = index;
+    }
+
+    qsort(jobs, job_count, sizeof(Weighted_Job), compare_weighted_jobs);
+
+    for(size_t index = 0; index < job_count; ++index) {
+        job_order[index] = jobs[index].index;
+    }
+
+    free(jobs);
+    return job_order;
+}
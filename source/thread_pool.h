@@ -0,0 +1,56 @@
+#ifndef _THREAD_POOL_H
+#define _THREAD_POOL_H
+
+#include "common.h"
+#include "threads.h"
+
+/* job_index in [0, job_count); worker_index in [0, worker_count), 0 is the thread that called thread_pool_run */
+typedef void Thread_Pool_Job_Proc(void *user_data, size_t job_index, size_t worker_index);
+
+/*
+ * Work-stealing pool
+ * Jobs of a batch are dealt round-robin into per-worker deques, in the order given.
+ * A worker takes jobs from the front of its own deque and, once empty, steals from the back of the others.
+ */
+
+typedef struct {
+    Mutex   mutex;
+    size_t *jobs;
+    size_t  head;
+    size_t  tail;
+} Job_Deque;
+
+typedef struct {
+    Thread    *threads;
+    Job_Deque *deques;
+    size_t     deque_count;
+    size_t     worker_count; // Includes the calling thread
+
+    Mutex    mutex;
+    Cond_Var batch_started;
+    Cond_Var batch_finished;
+
+    // Current batch, written under mutex
+    Thread_Pool_Job_Proc *job_proc;
+    void   *user_data;
+    size_t *job_storage;
+    size_t  job_storage_capacity;
+    size_t  batch_index;
+    size_t  workers_finished;
+    bool    shutting_down;
+} Thread_Pool;
+
+/* worker_count of 0 uses the processor count; worker_count of 1 runs everything on the calling thread */
+bool thread_pool_init(Thread_Pool *pool, size_t worker_count);
+void thread_pool_free(Thread_Pool *pool);
+
+/* Runs job_proc for every job index and blocks until all of them are done; False if the batch couldn't be started */
+bool thread_pool_run(Thread_Pool *pool, size_t job_count, Thread_Pool_Job_Proc *job_proc, void *user_data);
+
+/* Same, job_order lists job indices in the order they should be started, e.g. the longest first */
+bool thread_pool_run_ordered(Thread_Pool *pool, const size_t *job_order, size_t job_count, Thread_Pool_Job_Proc *job_proc, void *user_data);
+
+/* Job order by descending weight, ties keep index order; Caller frees the returned array */
+size_t *thread_pool_order_largest_first(const size_t *weights, size_t job_count);
+
+#endif /* _THREAD_POOL_H */
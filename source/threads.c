@@ -0,0 +1,151 @@
+#include "threads.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sched.h>
+#endif
+
+typedef struct {
+    Thread_Proc *proc;
+    void *user_data;
+} Thread_Start;
+
+#ifdef _WIN32
+static DWORD WINAPI thread_entry(LPVOID param) {
+#else
+static void *thread_entry(void *param) {
+#endif
+    Thread_Start start = *(Thread_Start *)param;
+    free(param);
+
+    start.proc(start.user_data);
+    return 0;
+}
+
+bool thread_create(Thread *thread, Thread_Proc *proc, void *user_data) {
+    Thread_Start *start = (Thread_Start *)malloc(sizeof(Thread_Start));
+    if(start == NULL) {
+        fprintf(stderr, "Failed to allocate memory in thread_create.\n");
+        return false;
+    }
+
+    start->proc = proc;
+    start->user_data = user_data;
+
+#ifdef _WIN32
+    *thread = CreateThread(NULL, 0, thread_entry, start, 0, NULL);
+    if(*thread == NULL) {
+        free(start);
+        return false;
+    }
+#else
+    if(pthread_create(thread, NULL, thread_entry, start) != 0) {
+        free(start);
+        return false;
+    }
+#endif
+    return true;
+}
+
+void thread_join(Thread *thread) {
+#ifdef _WIN32
+    WaitForSingleObject(*thread, INFINITE);
+    CloseHandle(*thread);
+#else
+    pthread_join(*thread, NULL);
+#endif
+}
+
+void thread_yield(void) {
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+void mutex_init(Mutex *mutex) {
+#ifdef _WIN32
+    InitializeCriticalSection(mutex);
+#else
+    pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+void mutex_free(Mutex *mutex) {
+#ifdef _WIN32
+    DeleteCriticalSection(mutex);
+#else
+    pthread_mutex_destroy(mutex);
+#endif
+}
+
+void mutex_lock(Mutex *mutex) {
+#ifdef _WIN32
+    EnterCriticalSection(mutex);
+#else
+    pthread_mutex_lock(mutex);
+#endif
+}
+
+void mutex_unlock(Mutex *mutex) {
+#ifdef _WIN32
+    LeaveCriticalSection(mutex);
+#else
+    pthread_mutex_unlock(mutex);
+#endif
+}
+
+void cond_var_init(Cond_Var *cond) {
+#ifdef _WIN32
+    InitializeConditionVariable(cond);
+#else
+    pthread_cond_init(cond, NULL);
+#endif
+}
+
+void cond_var_free(Cond_Var *cond) {
+#ifdef _WIN32
+    // Nothing to free on Windows
+#else
+    pthread_cond_destroy(cond);
+#endif
+}
+
+void cond_var_wait(Cond_Var *cond, Mutex *mutex) {
+#ifdef _WIN32
+    SleepConditionVariableCS(cond, mutex, INFINITE);
+#else
+    pthread_cond_wait(cond, mutex);
+#endif
+}
+
+void cond_var_signal(Cond_Var *cond) {
+#ifdef _WIN32
+    WakeConditionVariable(cond);
+#else
+    pthread_cond_signal(cond);
+#endif
+}
+
+void cond_var_broadcast(Cond_Var *cond) {
+#ifdef _WIN32
+    WakeAllConditionVariable(cond);
+#else
+    pthread_cond_broadcast(cond);
+#endif
+}
+
+size_t get_processor_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return MAX((size_t)info.dwNumberOfProcessors, 1);
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (size_t)count : 1;
+#endif
+}
@@ -0,0 +1,56 @@
+#ifndef _THREADS_H
+#define _THREADS_H
+
+#include "common.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+/* Thin wrappers over the platform threading primitives */
+
+#ifdef _WIN32
+typedef HANDLE             Thread;
+typedef CRITICAL_SECTION   Mutex;
+typedef CONDITION_VARIABLE Cond_Var;
+#else
+typedef pthread_t       Thread;
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t  Cond_Var;
+#endif
+
+typedef void Thread_Proc(void *user_data);
+
+bool thread_create(Thread *thread, Thread_Proc *proc, void *user_data);
+void thread_join(Thread *thread);
+
+/* Gives the rest of the time slice to another ready thread */
+void thread_yield(void);
+
+void mutex_init(Mutex *mutex);
+void mutex_free(Mutex *mutex);
+void mutex_lock(Mutex *mutex);
+void mutex_unlock(Mutex *mutex);
+
+void cond_var_init(Cond_Var *cond);
+void cond_var_free(Cond_Var *cond);
+void cond_var_wait(Cond_Var *cond, Mutex *mutex);
+void cond_var_signal(Cond_Var *cond);
+void cond_var_broadcast(Cond_Var *cond);
+
+/* Number of logical processors, at least 1 */
+size_t get_processor_count(void);
+
+/* Atomics, sequentially consistent; Returns the new value */
+#define ATOMIC_ADD(pointer, value) __atomic_add_fetch((pointer), (value), __ATOMIC_SEQ_CST)
+#define ATOMIC_LOAD(pointer)       __atomic_load_n((pointer), __ATOMIC_SEQ_CST)
+#define ATOMIC_STORE(pointer, value) __atomic_store_n((pointer), (value), __ATOMIC_SEQ_CST)
+
+/* Publishing data: writes before the release store are visible to whoever sees the stored value with an acquire load */
+#define ATOMIC_LOAD_ACQUIRE(pointer)         __atomic_load_n((pointer), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE_RELEASE(pointer, value) __atomic_store_n((pointer), (value), __ATOMIC_RELEASE)
+
+#endif /* _THREADS_H */
@@ -0,0 +1,252 @@
+#include "timing.h"
+#include "threads.h"
+#include "file_io.h"
+
+#include <stdlib.h>
+
+#include <llvm-c/Support.h>
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+static const char *timing_phase_names[TIMING__COUNT] = {
+    [TIMING_FILE_READ]      = "File read",
+    [TIMING_UTF_CONVERSION] = "UTF conversion",
+    [TIMING_TOKENIZE]       = "Tokenization",
+    [TIMING_PARSE]          = "Parsing",
+    [TIMING_IR_BUILD]       = "IR construction",
+    [TIMING_VERIFY]         = "Module verification",
+    [TIMING_OPTIMIZE]       = "Optimization",
+    [TIMING_LINK]           = "Partition linking",
+    [TIMING_LTO_IMPORT]     = "LTO importing",
+    [TIMING_EMIT]           = "Emission",
+};
+
+static const char *timing_phase_keys[TIMING__COUNT] = {
+    [TIMING_FILE_READ]      = "file_read",
+    [TIMING_UTF_CONVERSION] = "utf_conversion",
+    [TIMING_TOKENIZE]       = "tokenize",
+    [TIMING_PARSE]          = "parse",
+    [TIMING_IR_BUILD]       = "ir_build",
+    [TIMING_VERIFY]         = "verify",
+    [TIMING_OPTIMIZE]       = "optimize",
+    [TIMING_LINK]           = "link",
+    [TIMING_LTO_IMPORT]     = "lto_import",
+    [TIMING_EMIT]           = "emit",
+};
+
+typedef struct {
+    size_t wall_ns; // Atomic
+    size_t cpu_ns;  // Atomic
+    size_t count;   // Atomic
+} Timing_Totals;
+
+static bool timing_enabled = false;
+static Timing_Totals timing_totals[TIMING__COUNT];
+static uint64_t timing_start_wall_ns;
+static uint64_t timing_start_cpu_ns;
+
+// Where LLVM writes its -time-passes tables, empty if not collected
+static char llvm_pass_timing_path[512];
+
+uint64_t timing_wall_ns(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+#endif
+}
+
+#ifdef _WIN32
+static uint64_t filetime_to_ns(FILETIME time) {
+    return ((((uint64_t)time.dwHighDateTime) << 32) | time.dwLowDateTime) * 100;
+}
+#endif
+
+uint64_t timing_thread_cpu_ns(void) {
+#ifdef _WIN32
+    FILETIME creation_time, exit_time, kernel_time, user_time;
+    GetThreadTimes(GetCurrentThread(), &creation_time, &exit_time, &kernel_time, &user_time);
+    return filetime_to_ns(kernel_time) + filetime_to_ns(user_time);
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+#endif
+}
+
+uint64_t timing_process_cpu_ns(void) {
+#ifdef _WIN32
+    FILETIME creation_time, exit_time, kernel_time, user_time;
+    GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time);
+    return filetime_to_ns(kernel_time) + filetime_to_ns(user_time);
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+#endif
+}
+
+// LLVM options can be parsed only once per process, a daemon keeps collecting after its first timed compile
+static void enable_llvm_pass_timing(void) {
+    static bool llvm_options_parsed = false;
+    if(llvm_options_parsed) {
+        return;
+    }
+    llvm_options_parsed = true;
+
+    char file_name[64];
+    snprintf(file_name, sizeof(file_name), "polang_time_passes.%u.txt", get_process_id());
+    get_temp_file_path(llvm_pass_timing_path, sizeof(llvm_pass_timing_path), file_name);
+
+    char output_option[600];
+    snprintf(output_option, sizeof(output_option), "-info-output-file=%s", llvm_pass_timing_path);
+
+    const char *args[] = { "PoLang", "-time-passes", output_option };
+    LLVMParseCommandLineOptions(ARRAY_SIZE(args), args, NULL);
+}
+
+void timing_start(bool llvm_passes) {
+    for(size_t index = 0; index < TIMING__COUNT; ++index) {
+        ZERO_STRUCT(timing_totals[index]);
+    }
+
+    if(llvm_passes) {
+        enable_llvm_pass_timing();
+    }
+
+    // Leftovers of an earlier compile in the same process
+    if(llvm_pass_timing_path[0] != '\0') {
+        remove(llvm_pass_timing_path);
+    }
+
+    timing_start_wall_ns = timing_wall_ns();
+    timing_start_cpu_ns = timing_process_cpu_ns();
+    timing_enabled = true;
+}
+
+bool timing_is_enabled(void) {
+    return timing_enabled;
+}
+
+void timing_begin(Timing_Section *section, Timing_Phase phase) {
+    trace_begin(&section->trace_span);
+
+    section->phase = phase;
+    section->active = timing_enabled;
+    if(!section->active) {
+        return;
+    }
+
+    section->wall_start_ns = timing_wall_ns();
+    section->cpu_start_ns = timing_thread_cpu_ns();
+}
+
+void timing_end(Timing_Section *section) {
+    trace_end(&section->trace_span, "phase", timing_phase_names[section->phase]);
+
+    if(!section->active) {
+        return;
+    }
+
+    Timing_Totals *totals = &timing_totals[section->phase];
+    ATOMIC_ADD(&totals->wall_ns, timing_wall_ns() - section->wall_start_ns);
+    ATOMIC_ADD(&totals->cpu_ns, timing_thread_cpu_ns() - section->cpu_start_ns);
+    ATOMIC_ADD(&totals->count, 1);
+    section->active = false;
+}
+
+// @allocated; NULL if LLVM wrote nothing
+static char *read_llvm_pass_timing(void) {
+    if(llvm_pass_timing_path[0] == '\0') {
+        return NULL;
+    }
+
+    wchar_t *wide_path = convert_to_wcs_alloc(llvm_pass_timing_path, strlen(llvm_pass_timing_path), NULL);
+    if(wide_path == NULL) {
+        return NULL;
+    }
+
+    char *text = NULL;
+    size_t bytes = 0;
+    if(file_read_bytes(wide_path, (void **)&text, &bytes)) {
+        text[bytes] = '\0';
+        file_delete(wide_path);
+    }
+
+    free(wide_path);
+    return text;
+}
+
+static void write_json_string(FILE *file, const char *string) {
+    fputc('"', file);
+    for(const char *at = string; *at; ++at) {
+        switch(*at) {
+            case '"':  fputs("\\\"", file); break;
+            case '\\': fputs("\\\\", file); break;
+            case '\n': fputs("\\n", file); break;
+            case '\r': fputs("\\r", file); break;
+            case '\t': fputs("\\t", file); break;
+            default: {
+                if((unsigned char)*at < 0x20) {
+                    fprintf(file, "\\u%04x", (unsigned char)*at);
+                } else {
+                    fputc(*at, file);
+                }
+            } break;
+        }
+    }
+    fputc('"', file);
+}
+
+void timing_report(FILE *file, Timing_Report_Format format) {
+    const double total_wall_ms = (double)(timing_wall_ns() - timing_start_wall_ns) / 1e6;
+    const double total_cpu_ms = (double)(timing_process_cpu_ns() - timing_start_cpu_ns) / 1e6;
+    timing_enabled = false;
+
+    char *llvm_pass_timing = read_llvm_pass_timing();
+
+    if(format == TIMING_REPORT_JSON) {
+        fprintf(file, "{\n  \"total\": { \"wall_ms\": %.3f, \"cpu_ms\": %.3f },\n  \"phases\": {\n", total_wall_ms, total_cpu_ms);
+        for(size_t index = 0; index < TIMING__COUNT; ++index) {
+            Timing_Totals *totals = &timing_totals[index];
+            fprintf(file, "    \"%s\": { \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"count\": %llu }%s\n",
+                    timing_phase_keys[index], (double)totals->wall_ns / 1e6, (double)totals->cpu_ns / 1e6,
+                    (unsigned long long)totals->count, index + 1 < TIMING__COUNT ? "," : "");
+        }
+        fprintf(file, "  },\n  \"llvm_passes\": ");
+        if(llvm_pass_timing != NULL) {
+            write_json_string(file, llvm_pass_timing);
+        } else {
+            fprintf(file, "null");
+        }
+        fprintf(file, "\n}\n");
+    } else {
+        fprintf(file, "\n===-------------------------------------------------------------------------===\n");
+        fprintf(file, "                              PoLang time report\n");
+        fprintf(file, "===-------------------------------------------------------------------------===\n");
+        fprintf(file, "  %-24s %12s %12s %8s\n", "Phase", "Wall ms", "CPU ms", "Count");
+        for(size_t index = 0; index < TIMING__COUNT; ++index) {
+            Timing_Totals *totals = &timing_totals[index];
+            if(totals->count == 0) {
+                continue;
+            }
+            fprintf(file, "  %-24s %12.3f %12.3f %8llu\n", timing_phase_names[index], (double)totals->wall_ns / 1e6, (double)totals->cpu_ns / 1e6, (unsigned long long)totals->count);
+        }
+        fprintf(file, "  %-24s %12.3f %12.3f\n", "Total", total_wall_ms, total_cpu_ms);
+
+        if(llvm_pass_timing != NULL) {
+            fputs(llvm_pass_timing, file);
+        }
+    }
+
+    fflush(file);
+    free(llvm_pass_timing);
+}
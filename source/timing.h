@@ -0,0 +1,58 @@
+#ifndef _TIMING_H
+#define _TIMING_H
+
+#include "common.h"
+#include "trace.h"
+
+#include <stdio.h>
+
+/*
+ * Per-phase compile time, for --time-report
+ * Every timed section adds its wall and thread CPU time to the totals of its phase.
+ * Sections run in parallel on the thread pool, so per-phase wall time is the sum over threads and can exceed the total.
+ * With tracing on, every section also becomes a trace event, see trace.h.
+ */
+
+typedef enum {
+    TIMING_FILE_READ,
+    TIMING_UTF_CONVERSION,
+    TIMING_TOKENIZE,
+    TIMING_PARSE,
+    TIMING_IR_BUILD,
+    TIMING_VERIFY,
+    TIMING_OPTIMIZE,
+    TIMING_LINK,
+    TIMING_LTO_IMPORT,
+    TIMING_EMIT,
+    TIMING__COUNT
+} Timing_Phase;
+
+typedef enum {
+    TIMING_REPORT_TABLE,
+    TIMING_REPORT_JSON,
+} Timing_Report_Format;
+
+typedef struct {
+    Timing_Phase phase;
+    uint64_t wall_start_ns;
+    uint64_t cpu_start_ns;
+    bool     active;
+    Trace_Span trace_span;
+} Timing_Section;
+
+uint64_t timing_wall_ns(void);
+uint64_t timing_thread_cpu_ns(void);
+uint64_t timing_process_cpu_ns(void);
+
+/* Resets the totals; llvm_passes also collects LLVM's own -time-passes tables */
+void timing_start(bool llvm_passes);
+bool timing_is_enabled(void);
+
+/* Both do nothing unless timing or tracing was started */
+void timing_begin(Timing_Section *section, Timing_Phase phase);
+void timing_end(Timing_Section *section);
+
+/* Stops timing and writes the report */
+void timing_report(FILE *file, Timing_Report_Format format);
+
+#endif /* _TIMING_H */
@@ -0,0 +1,177 @@
+#include "trace.h"
+#include "timing.h"
+#include "threads.h"
+#include "file_io.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+    char    *name;
+    const char *category;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    uint32_t thread_id;
+} Trace_Event;
+
+static bool trace_enabled = false;
+
+static Mutex trace_mutex;
+static Trace_Event *trace_events;
+static size_t trace_event_count;
+static size_t trace_event_capacity;
+static char *trace_path;
+static uint64_t trace_start_ns;
+
+// Small sequential ids read better in a viewer than OS thread ids; 1 is the first thread that records
+static size_t trace_thread_count; // Atomic
+static THREAD_LOCAL uint32_t trace_thread_id;
+
+bool trace_start(const char *filepath) {
+    static bool mutex_ready = false;
+    if(!mutex_ready) {
+        mutex_init(&trace_mutex);
+        mutex_ready = true;
+    }
+
+    trace_path = strdup(filepath);
+    if(trace_path == NULL) {
+        fprintf(stderr, "Failed to allocate memory in trace_start.\n");
+        return false;
+    }
+
+    trace_event_count = 0;
+    trace_start_ns = timing_wall_ns();
+    trace_enabled = true;
+    return true;
+}
+
+bool trace_is_enabled(void) {
+    return trace_enabled;
+}
+
+void trace_begin(Trace_Span *span) {
+    span->active = trace_enabled;
+    if(span->active) {
+        span->start_ns = timing_wall_ns();
+    }
+}
+
+static void record_event(Trace_Span *span, const char *category, char *name) {
+    const uint64_t end_ns = timing_wall_ns();
+
+    if(trace_thread_id == 0) {
+        trace_thread_id = (uint32_t)ATOMIC_ADD(&trace_thread_count, 1);
+    }
+
+    mutex_lock(&trace_mutex);
+
+    if(trace_event_count == trace_event_capacity) {
+        const size_t new_capacity = MAX(trace_event_capacity * 2, 1024);
+        Trace_Event *new_events = (Trace_Event *)realloc(trace_events, new_capacity * sizeof(Trace_Event));
+        if(new_events == NULL) {
+            mutex_unlock(&trace_mutex);
+            free(name);
+            return;
+        }
+        trace_events = new_events;
+        trace_event_capacity = new_capacity;
+    }
+
+    trace_events[trace_event_count++] = (Trace_Event) {
+        .name = name,
+        .category = category,
+        .start_ns = span->start_ns,
+        .duration_ns = end_ns - span->start_ns,
+        .thread_id = trace_thread_id
+    };
+
+    mutex_unlock(&trace_mutex);
+}
+
+void trace_end(Trace_Span *span, const char *category, const char *name) {
+    if(!span->active) {
+        return;
+    }
+    span->active = false;
+
+    char *name_copy = strdup(name);
+    if(name_copy != NULL) {
+        record_event(span, category, name_copy);
+    }
+}
+
+void trace_end_wide(Trace_Span *span, const char *category, Str_View name) {
+    if(!span->active) {
+        return;
+    }
+    span->active = false;
+
+    char *name_copy = convert_to_mbs_alloc(name.data, name.length, NULL);
+    if(name_copy != NULL) {
+        record_event(span, category, name_copy);
+    }
+}
+
+// Names come from identifiers, anything can be in them
+static void write_json_name(FILE *file, const char *name) {
+    fputc('"', file);
+    for(const char *at = name; *at; ++at) {
+        if(*at == '"' || *at == '\\') {
+            fputc('\\', file);
+            fputc(*at, file);
+        } else if((unsigned char)*at < 0x20) {
+            fprintf(file, "\\u%04x", (unsigned char)*at);
+        } else {
+            fputc(*at, file);
+        }
+    }
+    fputc('"', file);
+}
+
+bool trace_stop(void) {
+    if(!trace_enabled) {
+        return true;
+    }
+    trace_enabled = false;
+
+    FILE *file = NULL;
+    wchar_t *wide_path = convert_to_wcs_alloc(trace_path, strlen(trace_path), NULL);
+    const bool opened = wide_path != NULL && _wfopen_s(&file, wide_path, L"wb") == 0;
+    free(wide_path);
+
+    if(!opened) {
+        fprintf(stderr, "Failed to open trace file: %s\n", trace_path);
+    } else {
+        const uint32_t process_id = get_process_id();
+
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+        const size_t thread_count = ATOMIC_LOAD(&trace_thread_count);
+        for(size_t index = 0; index < thread_count; ++index) {
+            fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%llu,\"args\":{\"name\":\"Thread %llu\"}},\n",
+                    process_id, (unsigned long long)index + 1, (unsigned long long)index + 1);
+        }
+
+        for(size_t index = 0; index < trace_event_count; ++index) {
+            Trace_Event *event = &trace_events[index];
+            fprintf(file, "{\"name\":");
+            write_json_name(file, event->name);
+            fprintf(file, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%u,\"tid\":%u}%s\n",
+                    event->category, (double)(event->start_ns - trace_start_ns) / 1e3, (double)event->duration_ns / 1e3,
+                    process_id, event->thread_id, index + 1 < trace_event_count ? "," : "");
+        }
+
+        fprintf(file, "]}\n");
+        fclose(file);
+    }
+
+    for(size_t index = 0; index < trace_event_count; ++index) {
+        free(trace_events[index].name);
+    }
+    trace_event_count = 0;
+
+    free(trace_path);
+    trace_path = NULL;
+    return opened;
+}
@@ -0,0 +1,31 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include "common.h"
+#include "string_view.h"
+
+/*
+ * Chrome trace-event recording, for --trace=<file.json>
+ * Spans become complete ("X") events with the recording thread's id; The file opens in chrome://tracing or Perfetto.
+ * Phases get recorded through timing sections, procedures are recorded by the parser and the converter.
+ * Nothing is recorded, or allocated, unless tracing was started.
+ */
+
+typedef struct {
+    uint64_t start_ns;
+    bool     active;
+} Trace_Span;
+
+bool trace_start(const char *filepath);
+bool trace_is_enabled(void);
+
+/* Writes the file and drops the recorded events; False if the file couldn't be written */
+bool trace_stop(void);
+
+void trace_begin(Trace_Span *span);
+
+/* Name gets copied */
+void trace_end(Trace_Span *span, const char *category, const char *name);
+void trace_end_wide(Trace_Span *span, const char *category, Str_View name);
+
+#endif /* _TRACE_H */